@@ -1,8 +1,17 @@
 #pragma once
 #include "node.h"
+#include "node_arena.h"
+#include "node_view.h"
+#include "distance.h"
 #include "page_manager.h"
 #include "bptree_config.h"
 #include "DataObject.h"
+#include "buffer_pool.h"
+#include "thread_pool.h"
+#include "quantized_store.h"
+#include "leaf_summary.h"
+#include "segment_graph.h"
+#include "leaf_prefetcher.h"
 #include <iostream>
 #include <utility>
 #include <vector>
@@ -16,6 +25,32 @@
 #include <memory>
 #include <unordered_map>
 
+// One KNN hit without its vector data (see search_knn_into)
+// distance is the squared L2 distance; vector_id addresses the VectorStore record
+struct KNNResult {
+    double distance;
+    uint64_t vector_id;
+    int key;
+    int32_t original_id;
+    
+    bool operator<(const KNNResult& other) const { return distance < other.distance; }
+};
+
+// Per-query hooks for DiskBPlusTree::search_knn_batch
+// Each query runs lookup -> search -> on_result on one pool thread, so the stages of different
+// queries overlap. Hooks may be called concurrently from several threads.
+struct KNNBatchHooks {
+    // Return true to answer query i without a tree search (e.g. from a cache)
+    std::function<bool(size_t query)> lookup;
+    // Optional, after a lookup miss: return true with the key intervals to search instead of the
+    // query's range (e.g. what a cache does not cover); hits are the top K over those intervals.
+    // search_knn_shared_scan does not call it.
+    std::function<bool(size_t query, std::vector<std::pair<int, int>>& intervals)> narrow;
+    // Called once per query as soon as it finishes (completion order, not query order)
+    // searched is false when lookup answered the query (hits is then empty)
+    std::function<void(size_t query, const std::vector<KNNResult>& hits, bool searched, long long search_us)> on_result;
+};
+
 class DiskBPlusTree {
 public:
     // Constructor for opening existing index
@@ -23,13 +58,75 @@ public:
     
     // Constructor for creating new index with specified config
     DiskBPlusTree(const std::string& filename, const BPTreeConfig& config);
+    ~DiskBPlusTree();
     
     void insert_data_object(const DataObject& obj);
+    // insert_data_object for each object, in order, with writes batched: node pages dirtied by
+    // the batch are written once at the end (PageManager::beginBatchWrite) and vector records
+    // are appended through the bulk buffer. Not durable until sync().
+    void insert_batch(const std::vector<DataObject>& objects);
+    // Write out pending pages, vectors and metadata and fsync the index files
+    // (in snapshot mode after waiting for current readers and folding every shadow page home)
+    bool sync();
+    
+    // Copy-on-write snapshots (see PageManager::enableSnapshots): from here on every search runs
+    // against the tree as of the last completed insert, delete or bulk load, without locks,
+    // while one writer at a time modifies it. Each outermost write publishes a new snapshot.
+    // Call before searches start; setup calls (loadIntoMemory, mapIndex, enableBufferPool, ...)
+    // must not run concurrently with searches. Leaf summaries and segment graphs are dropped
+    // and cannot be built or loaded while snapshots are on.
+    bool enableSnapshots();
+    bool snapshotsEnabled() const { return pm->snapshotsEnabled(); }
     
     // Bulk load: efficiently build tree from sorted data (for initial index creation)
     // Data is sorted by key, leaves are filled to fill_factor capacity, tree is built bottom-up
     // fill_factor: 0.5 to 1.0, default 0.7 (70% full leaves)
     void bulk_load(std::vector<DataObject>& objects, float fill_factor = 0.7f);
+    
+    // Streaming bottom-up build (what bulk_load runs on): add() vectors in nondecreasing key
+    // order, then finish(). Each key's vectors become one sequential list, each leaf one aligned
+    // block, and leaves are written as they fill, so memory stays at one leaf plus one key's
+    // vectors (and a few bytes per leaf for the internal levels). Vector records and node pages
+    // go through the bulk write buffers of VectorStore and PageManager.
+    class BulkLoader {
+    public:
+        explicit BulkLoader(DiskBPlusTree& tree, float fill_factor = 0.7f);
+        ~BulkLoader();  // ends the bulk write modes; without finish() the tree is left unchanged
+        
+        BulkLoader(const BulkLoader&) = delete;
+        BulkLoader& operator=(const BulkLoader&) = delete;
+        
+        void reserve(size_t vectors);  // pre-size the vector metadata table
+        // Throws std::runtime_error if key is smaller than the previous one
+        void add(int key, const float* vector, uint32_t size, int32_t original_id);
+        // Write the last leaf and the internal levels, then set the root and save the header
+        void finish();
+        
+        uint64_t vectorCount() const { return vectors_; }
+        size_t keyCount() const { return keys_; }
+        
+    private:
+        DiskBPlusTree& tree_;
+        int keys_per_node_;
+        BPlusNode leaf_;
+        BPlusNode prev_leaf_;
+        uint32_t prev_leaf_pid_ = INVALID_PAGE;
+        std::vector<uint32_t> leaf_pids_;
+        std::vector<int> leaf_first_keys_;
+        std::vector<uint64_t> leaf_counts_;
+        // vectors of the current key, back to back, stored as one list when the key changes
+        bool has_group_ = false;
+        int group_key_ = 0;
+        std::vector<float> group_data_;
+        std::vector<uint32_t> group_sizes_;
+        std::vector<int32_t> group_ids_;
+        uint64_t vectors_ = 0;
+        size_t keys_ = 0;
+        bool finished_ = false;
+        
+        void flushGroup();
+        void flushLeaf();
+    };
     bool delete_data_object(const DataObject& obj);  // Delete specific DataObject (matches key + vector)
     bool delete_data_object(int key);                 // Delete first entry with this key
     bool delete_data_object(float key);               // Delete first entry with this key
@@ -40,6 +137,48 @@ public:
     std::vector<DataObject*> search_range(float min_key, float max_key, bool use_memory_index = false);
     std::vector<DataObject*> search_knn_optimized(const std::vector<float>& query_vector, int min_key, int max_key, int k, bool use_memory_index = false);
     std::vector<DataObject*> search_knn_parallel(const std::vector<float>& query_vector, int min_key, int max_key, int k, int num_threads = 0, bool use_memory_index = false);
+    
+    // Vectors stored under keys in [min_key, max_key]
+    // O(log N) from the per-child counts of internal nodes; indexes created before those were
+    // kept (see PageManager::hasSubtreeCounts) fall back to visiting the overlapping leaves
+    uint64_t count_range(int min_key, int max_key, bool use_memory_index = false);
+    
+    // Size of a key range for query planning: leaves overlapping it and vectors under its keys
+    // exact is true when the counts come from count_range; otherwise (older indexes read from
+    // disk) vectors is the leaf count times the average leaf fill
+    struct RangeEstimate {
+        size_t leaves = 0;
+        uint64_t vectors = 0;
+        bool exact = false;
+    };
+    RangeEstimate estimate_range(int min_key, int max_key, bool use_memory_index = false);
+    
+    // Allocation-free KNN variants: hits are written to out (cleared first, ascending by distance)
+    // out keeps its capacity, so reusing it across queries avoids per-query mallocs
+    void search_knn_into(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                         std::vector<KNNResult>& out, bool use_memory_index = false);
+    void search_knn_parallel_into(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                                  std::vector<KNNResult>& out, int num_threads = 0, bool use_memory_index = false);
+    // search_knn_into over disjoint key intervals, merged into one top K
+    void search_knn_ranges_into(const std::vector<float>& query_vector, const std::vector<std::pair<int, int>>& intervals,
+                                int k, std::vector<KNNResult>& out, bool use_memory_index = false);
+    // Run many queries on the persistent search pool, one query per task (no batch barrier)
+    // Query i searches queries[i] in ranges[i]; results are delivered through hooks.on_result.
+    // num_threads: concurrent queries (0 = hardware_concurrency), works with or without the memory index
+    void search_knn_batch(const std::vector<std::vector<float>>& queries,
+                          const std::vector<std::pair<int, int>>& ranges, int k,
+                          const KNNBatchHooks& hooks, int num_threads = 0, bool use_memory_index = false);
+    // Single-pass batch for overlapping ranges: queries are sorted by range and the leaf chain is
+    // walked once, scoring every vector against all queries whose range covers its key.
+    // Runs on the calling thread; on_result fires as soon as the sweep passes a query's max key.
+    void search_knn_shared_scan(const std::vector<std::vector<float>>& queries,
+                                const std::vector<std::pair<int, int>>& ranges, int k,
+                                const KNNBatchHooks& hooks, bool use_memory_index = false);
+    // Fetch the vector of a hit (reuses the capacity of vector)
+    // Safe to call concurrently while concurrent reads are prepared (e.g. from batch hooks)
+    void get_result_vector(const KNNResult& hit, std::vector<float>& vector);
+    // Build caller-owned DataObjects for hits (what search_knn_optimized/parallel return)
+    std::vector<DataObject*> materialize_knn_results(const std::vector<KNNResult>& hits);
     bool search(const DataObject& obj, bool use_memory_index = false);
     void print_tree();
     std::pair<int, int> get_key_range();
@@ -51,6 +190,56 @@ public:
     bool isMemoryIndexLoaded() const { return memory_index_loaded_; }
     size_t estimateTotalMemoryMB() const;
     
+    // Bounded node cache under read() for indexes that do not fit in memory
+    // budget_mb: byte budget for cached nodes, shards: 0 = auto
+    void enableBufferPool(size_t budget_mb, size_t shards = 0);
+    void disableBufferPool();
+    bool hasBufferPool() const { return buffer_pool_ != nullptr; }
+    BufferPool::Stats getBufferPoolStats() const;
+    
+    // 8-bit quantized companion store (<index>.vectors.sq8, see QuantizedStore)
+    bool buildQuantizedStore();   // encode every stored vector, write the file and open it
+    bool loadQuantizedStore();    // open an existing file (false if missing or invalid)
+    bool hasQuantizedStore() const { return quantized_ && quantized_->is_open(); }
+    // With rerank_factor > 0, search_knn_into / search_knn_optimized rank candidates by
+    // quantized distance and re-rank the best k * rerank_factor exactly (0 = exact scan).
+    // loadIntoMemory then keeps full vectors on disk.
+    void setQuantizedRerank(int rerank_factor);
+    int getQuantizedRerank() const { return quantized_rerank_; }
+    
+    // Per-leaf centroid/radius summaries (<index>.vectors.leafsum, see LeafSummaries)
+    // While loaded, the single-threaded, batch and parallel KNN scans skip leaves whose
+    // triangle-inequality bound cannot beat the current K-th distance (results stay exact).
+    // Any insert or delete drops them until they are rebuilt.
+    bool buildLeafSummaries();   // summarize every leaf, write the file and keep it loaded
+    bool loadLeafSummaries();    // false if missing, invalid or built before the last modification
+    bool hasLeafSummaries() const { return !leaf_summaries_.empty(); }
+    
+    // Per-segment proximity graphs (<index>.vectors.graph, see SegmentGraphs)
+    // segment_vectors: target vectors per segment (whole leaves), degree: neighbors per node
+    bool buildSegmentGraphs(size_t segment_vectors = 8192, uint32_t degree = 32);
+    bool loadSegmentGraphs();    // false if missing, invalid or built before the last modification
+    bool hasSegmentGraphs() const { return segment_graphs_.is_open(); }
+    // With ef > 0, search_knn_into / search_knn_parallel_into search segments fully inside the
+    // query range through their graphs (approximate, beam width ef) and scan only the partially
+    // covered edges of the range. 0 = exact scan.
+    void setGraphSearch(int ef) { graph_ef_ = std::max(0, ef); }
+    
+    // Asynchronous read-ahead for the disk path of search_knn_into (see LeafPrefetcher):
+    // a worker keeps `leaves` leaves and their vector blocks in flight while the current leaf
+    // is scored. 0 (default) = synchronous read-ahead on the search thread. Pays off when reads
+    // actually wait on the device and a spare core runs the worker.
+    void setPrefetchWindow(size_t leaves) { prefetch_window_ = leaves; }
+    size_t getPrefetchWindow() const { return prefetch_window_; }
+    
+    // Memory-mapped vector reads (read-only; any insert/delete unmaps again)
+    bool mapVectors();
+    bool isVectorStoreMapped() const;
+    // Memory-mapped node reads: searches view index pages in place instead of reading and
+    // deserializing them, and processes share the page cache (read-only; any write unmaps again)
+    bool mapIndex() { return pm->mapPages(); }
+    bool isIndexMapped() const { return pm->isMapped(); }
+    
     // Access configuration
     const BPTreeConfig& getConfig() const { return pm->getConfig(); }
     uint32_t getOrder() const { return pm->getOrder(); }
@@ -59,18 +248,104 @@ public:
 
 private:
     std::unique_ptr<PageManager> pm;
+    // Distance kernel for the header's max_vector_size, picked at open (fixed-dimension when compiled in)
+    L2SqrKernel l2_sqr_kernel_;
     
-    // In-memory index cache
-    std::unordered_map<uint32_t, BPlusNode> memory_index_;
+    // In-memory index: flat snapshot of the nodes (see NodeArena)
+    NodeArena memory_index_;
     bool memory_index_loaded_ = false;
     
+    // Optional bounded node cache (see enableBufferPool)
+    std::unique_ptr<BufferPool> buffer_pool_;
+    
+    // Disk-path read-ahead worker (created on first use, see setPrefetchWindow)
+    std::unique_ptr<LeafPrefetcher> prefetcher_;
+    size_t prefetch_window_ = 0;
+    LeafPrefetcher& getLeafPrefetcher();
+    
+    // Leaf count of the whole tree for estimate_range (0 = not computed yet)
+    std::atomic<size_t> total_leaves_{0};
+    
+    // Optional leaf pruning summaries (see buildLeafSummaries)
+    LeafSummaries leaf_summaries_;
+    
+    // Optional per-segment graphs (see buildSegmentGraphs)
+    SegmentGraphs segment_graphs_;
+    int graph_ef_ = 0;
+    
+    // Optional quantized companion store (see buildQuantizedStore)
+    std::unique_ptr<QuantizedStore> quantized_;
+    int quantized_rerank_ = 0;
+    
+    // Persistent workers for search_knn_parallel (created on first use, resized on demand)
+    std::shared_ptr<ThreadPool> search_pool_;
+    std::mutex search_pool_mutex_;
+    std::shared_ptr<ThreadPool> getSearchPool(size_t workers);
+    
+    // Writers are serialized; the outermost scope folds shadow pages home and publishes a snapshot
+    std::recursive_mutex write_mutex_;
+    int write_depth_ = 0;
+    void beginWrite();
+    void endWrite();
+    class WriteScope {
+    public:
+        explicit WriteScope(DiskBPlusTree& tree) : tree_(tree) { tree_.beginWrite(); }
+        ~WriteScope() { tree_.endWrite(); }
+        WriteScope(const WriteScope&) = delete;
+        WriteScope& operator=(const WriteScope&) = delete;
+    private:
+        DiskBPlusTree& tree_;
+    };
+    // Copy the shadows whose home no reader sees any more back home (all = wait for readers first)
+    void foldSnapshotPages(bool all);
+    // Snapshot the prefetch worker reads under (the scan's, pinned while it runs)
+    const PageManager::Snapshot* prefetch_snapshot_ = nullptr;
+    
+    // read/write take page ids as nodes link them; readPage/writePage the page holding one
+    // (see PageManager::resolve and pageForWrite)
     void read(uint32_t pid, BPlusNode& node);
-    void readFromMemory(uint32_t pid, BPlusNode& node) const;
-    const BPlusNode* getNodeFromMemory(uint32_t pid) const;
+    void readPage(uint32_t page, BPlusNode& node);
+    // Memory index node (empty view if the page was not loaded)
+    NodeView getNodeFromMemory(uint32_t pid) const { return memory_index_.view(pid); }
+    // Memory index node if loaded, else the mapped page (see mapIndex), otherwise read() into
+    // scratch (the view points into it)
+    NodeView fetchNode(uint32_t pid, BPlusNode& scratch, bool use_memory_index);
+    // Thread-safe variant for use after pm->prepareConcurrentReads(): memory index, mapped page,
+    // buffer pool (pinned) or positional read into scratch, with caller-owned buffers
+    NodeView fetchNodeConcurrent(uint32_t pid, BPlusNode& scratch, std::vector<char>& page_buffer,
+                                 BufferPool::PinnedNode& pinned, bool use_memory_index);
+    // Sidecars describe the tree as it was built: drop them and bump the header counter
+    void onTreeModified();
+    
+    // Graph search over the covered segments plus scans of the range edges (see setGraphSearch)
+    // Returns false without touching out if the range covers no segment
+    bool search_knn_graph_into(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                               std::vector<KNNResult>& out, bool use_memory_index);
+    // search_knn_into over SQ8 codes with exact re-ranking (see setQuantizedRerank)
+    void search_knn_quantized_into(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                                   std::vector<KNNResult>& out, bool use_memory_index);
+    // Single-threaded KNN over the leaf chain that only uses fetchNodeConcurrent (batch workers)
+    void search_knn_concurrent(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                               std::vector<KNNResult>& out, std::vector<char>& page_buffer, bool use_memory_index);
     void write(uint32_t pid, const BPlusNode& node);
+    void writePage(uint32_t page, const BPlusNode& node);
     void splitLeaf(uint32_t leafPid, BPlusNode& leaf, int& promotedKey, uint32_t& newLeafPid);
     void print_tree_recursive(uint32_t pid, int level);
     void collect_range_data(uint32_t leafPid, int min_key, int max_key, std::vector<DataObject*>& results);
+    // Page ids of every leaf that may hold keys in [min_key, max_key], in key order,
+    // found from the internal levels without reading the leaves
+    // leaf_counts (optional): vectors of each whole leaf, left empty when the tree keeps no counts
+    void collect_leaf_pids(int min_key, int max_key, std::vector<uint32_t>& leaves, bool use_memory_index,
+                           std::vector<uint64_t>* leaf_counts = nullptr);
+    void collect_leaf_pids_recursive(uint32_t pid, int depth, int leaf_depth, int min_key, int max_key,
+                                     std::vector<uint32_t>& leaves, std::vector<uint64_t>* leaf_counts,
+                                     bool use_memory_index);
+    // count_range below pid, whose keys lie in [lower, upper]
+    uint64_t count_range_recursive(uint32_t pid, int64_t lower, int64_t upper, int min_key, int max_key,
+                                   bool use_memory_index);
+    // Add delta to the child_counts entries along path[0 .. levels) (no-op without subtree counts)
+    void adjustPathCounts(const std::vector<uint32_t>& path, const std::vector<int>& pathIndex,
+                          size_t levels, int64_t delta);
     int get_min_keys();
     
     // Helper to create initialized node
@@ -32,6 +32,7 @@ struct BPTreeConfig {
         // - next: 4 bytes
         // - vector_list_ids[order]: order * 8 bytes (first vector ID for each key)
         // - vector_counts[order]: order * 4 bytes (count of vectors per key)
+        // - child_counts[order+1]: (order+1) * 8 bytes (vectors under each child)
         
         size_t fixed_overhead = 4 + 4;  // isLeaf + keyCount (with padding)
         size_t keys_size = order * sizeof(int);
@@ -39,8 +40,10 @@ struct BPTreeConfig {
         size_t next_size = sizeof(uint32_t);
         size_t vector_list_ids_size = order * sizeof(uint64_t);
         size_t vector_counts_size = order * sizeof(uint32_t);
+        size_t child_counts_size = (order + 1) * sizeof(uint64_t);
         
-        return fixed_overhead + keys_size + children_size + next_size + vector_list_ids_size + vector_counts_size;
+        return fixed_overhead + keys_size + children_size + next_size + vector_list_ids_size + vector_counts_size +
+               child_counts_size;
     }
     
     uint32_t calculate_min_page_size() const {
@@ -79,9 +82,14 @@ struct IndexFileHeader {
     uint32_t root_page;
     uint32_t next_free_page;
     uint32_t total_entries;
-    uint32_t reserved[4];  // Reserved for future use
+    uint32_t modification_count;  // Bumped by every insert/delete (0 in older files)
+    uint32_t flags;        // HEADER_FLAG_* (0 in older files)
+    uint32_t reserved[2];  // Reserved for future use
     
-    IndexFileHeader() : root_page(0xFFFFFFFF), next_free_page(1), total_entries(0) {
-        for (int i = 0; i < 4; i++) reserved[i] = 0;
+    // Internal nodes keep BPlusNode::child_counts up to date (set for files created since)
+    static constexpr uint32_t HEADER_FLAG_SUBTREE_COUNTS = 1;
+    
+    IndexFileHeader() : root_page(0xFFFFFFFF), next_free_page(1), total_entries(0), modification_count(0), flags(0) {
+        for (int i = 0; i < 2; i++) reserved[i] = 0;
     }
 };
@@ -0,0 +1,119 @@
+#pragma once
+#include "node.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Bounded cache of deserialized B+ tree nodes that sits under DiskBPlusTree::read
+// - sharded by page id: each shard has its own mutex, hash index and CLOCK hand
+// - frames are preallocated from a byte budget, so resident memory never grows past it
+// - readers pin frames (PinnedNode); pinned frames are never evicted
+// Writes go through put() (write-through, updates a resident copy); page writes must not
+// race with readers of the same page, same as the rest of the tree.
+class BufferPool {
+private:
+    struct Shard;
+
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t bypasses = 0;   // misses that could not be cached (every frame pinned)
+        size_t resident = 0;     // frames currently holding a page
+        size_t capacity = 0;     // total frames
+
+        double hit_rate() const {
+            uint64_t total = hits + misses;
+            return total > 0 ? static_cast<double>(hits) / total : 0.0;
+        }
+    };
+
+    // Pin on one node. The node stays valid and resident until the handle is destroyed.
+    class PinnedNode {
+    public:
+        PinnedNode() = default;
+        ~PinnedNode() { release(); }
+
+        PinnedNode(PinnedNode&& other) noexcept { *this = std::move(other); }
+        PinnedNode& operator=(PinnedNode&& other) noexcept;
+        PinnedNode(const PinnedNode&) = delete;
+        PinnedNode& operator=(const PinnedNode&) = delete;
+
+        const BPlusNode& operator*() const { return *node_; }
+        const BPlusNode* operator->() const { return node_; }
+        const BPlusNode* get() const { return node_; }
+        explicit operator bool() const { return node_ != nullptr; }
+
+    private:
+        friend class BufferPool;
+        void release();
+
+        BufferPool* pool_ = nullptr;
+        Shard* shard_ = nullptr;
+        uint32_t frame_ = 0;
+        const BPlusNode* node_ = nullptr;
+        std::unique_ptr<BPlusNode> owned_;  // set when the node bypassed the pool
+    };
+
+    // budget_bytes / node_bytes frames, split over num_shards (0 = pick from capacity)
+    BufferPool(size_t budget_bytes, size_t node_bytes, size_t num_shards = 0);
+
+    // Return the node for pid, calling load(BPlusNode&) on a miss
+    // Thread-safe as long as load is; the loader runs without holding the shard lock
+    template <typename Loader>
+    PinnedNode fetch(uint32_t pid, Loader&& load) {
+        PinnedNode handle;
+        if (tryPin(pid, handle)) {
+            return handle;
+        }
+        BPlusNode node;
+        load(node);
+        return insertAndPin(pid, std::move(node));
+    }
+
+    // Update the resident copy of pid after a page write (no-op if not resident)
+    void put(uint32_t pid, const BPlusNode& node);
+    void invalidate(uint32_t pid);
+    void clear();
+
+    Stats getStats() const;
+    void resetStats();
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct Frame {
+        uint32_t pid = INVALID_PAGE;
+        uint32_t pin_count = 0;
+        bool referenced = false;  // CLOCK reference bit
+        BPlusNode node;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::vector<Frame> frames;
+        std::unordered_map<uint32_t, uint32_t> index;  // pid -> frame
+        size_t hand = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t bypasses = 0;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    size_t shard_mask_ = 0;
+    size_t capacity_ = 0;
+
+    Shard& shardFor(uint32_t pid) const {
+        // Fibonacci hash so sequential page ids spread over shards
+        return *shards_[(static_cast<uint64_t>(pid) * 0x9E3779B97F4A7C15ull >> 32) & shard_mask_];
+    }
+
+    bool tryPin(uint32_t pid, PinnedNode& out);
+    PinnedNode insertAndPin(uint32_t pid, BPlusNode&& node);
+    bool findVictim(Shard& shard, uint32_t& frame);
+    void unpin(Shard& shard, uint32_t frame);
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "bplustree_disk.h"
+#include "thread_pool.h"
+
+struct BulkBuildOptions {
+    size_t memory_mb = 1024;    // budget for run buffers (input chunks and sort keys)
+    int threads = 0;            // parse/sort threads including the caller (0 = hardware_concurrency)
+    float fill_factor = 0.7f;
+    std::string temp_dir = "."; // where sorted runs are spilled when the input exceeds the budget
+};
+
+// Streaming bulk build of an index from an .fvecs file (build_index_fvecs --bulk-load)
+// The input is read in runs that fit the memory budget, the next run being read while the
+// current one is processed. Records of a run are validated and keyed in parallel, then sorted
+// by (key, position) with a parallel merge sort. An input that fits in one run goes straight
+// into DiskBPlusTree::BulkLoader; otherwise every sorted run is spilled to a temporary file and
+// the runs are k-way merged into the loader, so memory stays bounded whatever the input size.
+class BulkBuilder {
+public:
+    BulkBuilder(DiskBPlusTree& tree, const BulkBuildOptions& options);
+
+    // labels: key of every vector (RFANN mode; only the first labels->size() vectors are used),
+    // nullptr = the key is the vector's position in the file.
+    // Returns false (after printing why) on malformed input or I/O errors.
+    bool build(const std::string& fvecs_path, const std::vector<int>* labels);
+
+    uint64_t vectorCount() const { return vector_count_; }
+    size_t runCount() const { return run_count_; }
+
+private:
+    // One run in memory: raw .fvecs records and their sort entries (key, index in the run)
+    struct Run {
+        std::vector<char> records;
+        std::vector<uint64_t> order;
+        uint64_t first = 0;     // position of the run's first vector in the file
+        size_t count = 0;
+    };
+
+    DiskBPlusTree& tree_;
+    BulkBuildOptions options_;
+    std::unique_ptr<ThreadPool> pool_;  // nullptr = single-threaded
+    uint32_t dimension_ = 0;
+    uint64_t vector_count_ = 0;
+    size_t run_count_ = 0;
+    std::vector<std::string> spilled_;
+
+    size_t fvecsRecordBytes() const { return sizeof(int32_t) + dimension_ * sizeof(float); }
+    size_t runRecordBytes() const { return 2 * sizeof(int32_t) + dimension_ * sizeof(float); }
+
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+    bool keyRun(Run& run, const std::vector<int>* labels);
+    void sortRun(Run& run);
+    void loadRun(const Run& run, DiskBPlusTree::BulkLoader& loader) const;
+    bool spillRun(const Run& run);
+    bool mergeRuns(DiskBPlusTree::BulkLoader& loader);
+    void removeSpilled();
+};
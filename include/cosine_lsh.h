@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Random-hyperplane LSH over the input vectors of cached queries (QueryCache similar lookups)
+// Each of TABLES tables hashes a vector to the signs of its dot products with BITS random
+// hyperplanes; two vectors at angle theta agree on a bit with probability 1 - theta / pi.
+// candidates() probes the query's bucket and every bucket one bit away in each table, so the
+// work depends on the bucket sizes, not on how many queries are cached.
+class CosineLSH {
+public:
+    static constexpr uint32_t TABLES = 16;
+    static constexpr uint32_t BITS = 12;
+
+    CosineLSH() = default;
+
+    void clear();
+    size_t size() const { return slot_of_.size(); }
+    uint32_t dimension() const { return dim_; }
+
+    // The first vector fixes the dimension; vectors of another dimension are not indexed
+    void insert(const std::string& id, const std::vector<float>& vector);
+    void remove(const std::string& id);
+
+    // Ids of indexed vectors within one bit of vector's signature in some table (each id once)
+    void candidates(const std::vector<float>& vector, std::vector<const std::string*>& out) const;
+
+    // Probability that a vector at normalized cosine similarity (cos + 1) / 2 with the query is
+    // among candidates() (at least that for anything more similar)
+    static double recall(double similarity);
+
+private:
+    uint32_t dim_ = 0;
+    std::vector<float> planes_;  // TABLES * BITS hyperplanes of dim_ floats
+    std::vector<std::unordered_map<uint32_t, std::vector<uint32_t>>> tables_;  // signature -> slots
+    std::vector<std::string> ids_;                  // by slot
+    std::vector<uint32_t> signatures_;              // TABLES per slot
+    std::vector<uint32_t> free_slots_;
+    std::unordered_map<std::string, uint32_t> slot_of_;
+
+    void signature(const std::vector<float>& vector, uint32_t* out) const;
+};
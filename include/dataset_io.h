@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Benchmark dataset files shared by search_index_test and bench
+// Loaders print to std::cerr and return an empty result when the file cannot be opened.
+
+// .fvecs: per vector an int32 dimension followed by that many floats
+std::vector<std::vector<float>> load_fvecs_queries(const std::string& path);
+
+// .ivecs: per query an int32 count followed by that many neighbor ids
+std::vector<std::vector<int32_t>> load_ivecs_groundtruth(const std::string& path);
+
+// Query range JSON: [left0, right0, left1, right1, ...], at most num_queries pairs
+std::vector<std::pair<int, int>> read_qrange_json(const std::string& path, int num_queries);
+
+// Fraction of the first min(k, |groundtruth|) ground-truth ids among the first k retrieved
+double calculate_recall(const std::vector<int>& retrieved, const std::vector<int32_t>& groundtruth, int k);
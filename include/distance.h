@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Squared Euclidean (L2) distance kernels for KNN scans
+// Ranking only needs the squared distance, so no sqrt is taken here.
+// The kernel (AVX-512F, AVX2+FMA, NEON or scalar) is picked once from the CPU features at runtime.
+
+using L2SqrKernel = float (*)(const float* a, const float* b, size_t n);
+
+// Best kernel for this CPU (resolved on first call)
+L2SqrKernel get_l2_sqr_kernel();
+
+// Kernel for vectors of dim elements: compiled for that exact length when dim is one of the
+// fixed dimensions (96, 128, 256, 384, 768, 960), the generic kernel otherwise. Still correct
+// for other lengths, which take the generic path.
+L2SqrKernel get_l2_sqr_kernel(size_t dim);
+
+// True when get_l2_sqr_kernel(dim) is compiled for dim
+bool has_fixed_l2_sqr_kernel(size_t dim);
+
+// Name of the kernel returned by get_l2_sqr_kernel() ("avx512", "avx2", "neon", "scalar")
+const char* get_l2_sqr_kernel_name();
+
+// Convenience wrappers over the dispatched kernel (compare min(a.size(), b.size()) elements)
+inline float l2_sqr(const float* a, const float* b, size_t n) {
+    return get_l2_sqr_kernel()(a, b, n);
+}
+
+inline float l2_sqr(const std::vector<float>& a, const std::vector<float>& b) {
+    size_t n = a.size() < b.size() ? a.size() : b.size();
+    return get_l2_sqr_kernel()(a.data(), b.data(), n);
+}
+
+// Squared L2 distance from one vector to several queries: out[i] = kernel(queries[i], vec, n)
+// Used by shared scans, where each stored vector is read once and scored against every
+// query that covers its key while it is still hot in cache.
+inline void l2_sqr_one_to_many(L2SqrKernel kernel, const float* vec, const float* const* queries, size_t count,
+                               size_t n, float* out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = kernel(queries[i], vec, n);
+    }
+}
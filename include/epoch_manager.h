@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+
+// Epoch-based reclamation for one writer and many lock-free readers
+// Readers announce the epoch they start in (enter/exit or Guard); the writer unlinks an object,
+// retire()s it and advance()s the epoch. A retired object is freed by reclaim() once every
+// active reader announced a later epoch: those readers started after it was unlinked.
+// enter/exit are thread-safe; every other member belongs to the writer thread.
+class EpochManager {
+public:
+    static constexpr size_t MAX_READERS = 128;  // concurrent readers; more wait for a free slot
+
+    EpochManager() = default;
+    ~EpochManager();  // runs every callback still pending
+
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    // Announce a reader in the current epoch; returns the slot to pass to exit()
+    size_t enter();
+    void exit(size_t slot);
+
+    // enter() for the lifetime of the guard
+    class Guard {
+    public:
+        explicit Guard(EpochManager& epochs) : epochs_(epochs), slot_(epochs.enter()) {}
+        ~Guard() { epochs_.exit(slot_); }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    private:
+        EpochManager& epochs_;
+        size_t slot_;
+    };
+
+    uint64_t current() const { return epoch_.load(std::memory_order_acquire); }
+    // Call free() once no reader can hold what was unlinked before this call
+    void retire(std::function<void()> free);
+    void advance() { epoch_.fetch_add(1, std::memory_order_seq_cst); }
+    // True when every active reader entered after epoch
+    bool isSafe(uint64_t epoch) const;
+    // Run the callbacks whose epoch is safe (in retire order)
+    void reclaim();
+    // advance(), wait until every reader active before the call has left, then reclaim()
+    void synchronize();
+
+private:
+    static constexpr uint64_t IDLE = UINT64_MAX;
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> epoch{IDLE};
+    };
+
+    std::atomic<uint64_t> epoch_{1};
+    std::array<Slot, MAX_READERS> slots_;
+    std::deque<std::pair<uint64_t, std::function<void()>>> retired_;  // (epoch, free), epoch order
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "node.h"
+
+// Asynchronous read-ahead along the leaf chain for disk-path KNN scans
+// A persistent worker thread keeps up to `window` leaves read ahead of the scan and, for each
+// one, hints the vector blocks of its in-range keys to the kernel (see VectorStore::prefetchLists),
+// so page and vector I/O overlap with scoring the current leaf instead of running between leaves.
+class LeafPrefetcher {
+public:
+    // read: load one node (runs on the worker, must be thread-safe)
+    // hint: called on the worker for every leaf read, before the scan gets it
+    using ReadFn = std::function<void(uint32_t pid, BPlusNode& node, std::vector<char>& buffer)>;
+    using HintFn = std::function<void(const BPlusNode& leaf, int min_key, int max_key)>;
+
+    LeafPrefetcher(ReadFn read, HintFn hint);
+    ~LeafPrefetcher();
+
+    LeafPrefetcher(const LeafPrefetcher&) = delete;
+    LeafPrefetcher& operator=(const LeafPrefetcher&) = delete;
+
+    // Follow the chain from first_pid, ending after the first leaf whose last key exceeds max_key
+    void start(uint32_t first_pid, int min_key, int max_key, size_t window);
+    // Next leaf in chain order (blocks until it is read); false once the chain is exhausted
+    bool next(BPlusNode& leaf);
+    // Cancel the scan and wait until the worker no longer reads for it
+    void stop();
+
+    // Stops the scan of prefetcher (if any) when it goes out of scope, early exits included
+    class Scan {
+    public:
+        explicit Scan(LeafPrefetcher* prefetcher) : prefetcher_(prefetcher) {}
+        ~Scan() { if (prefetcher_) prefetcher_->stop(); }
+        Scan(const Scan&) = delete;
+        Scan& operator=(const Scan&) = delete;
+    private:
+        LeafPrefetcher* prefetcher_;
+    };
+
+private:
+    ReadFn read_;
+    HintFn hint_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<BPlusNode> ready_;   // read, not yet handed out
+    std::vector<BPlusNode> spare_;  // recycled nodes (keep their array capacity)
+    uint32_t next_pid_ = INVALID_PAGE;
+    int min_key_ = 0;
+    int max_key_ = 0;
+    size_t window_ = 0;
+    uint64_t generation_ = 0;       // bumped by stop(), so reads of a cancelled scan are dropped
+    bool active_ = false;
+    bool done_ = false;             // the chain has no more leaves for this scan
+    bool reading_ = false;          // the worker is inside read_/hint_
+    bool worker_waiting_ = false;   // waiters on cv_, so hand-offs only notify when needed
+    bool consumer_waiting_ = false;
+    bool shutdown_ = false;
+    std::thread worker_;
+
+    void worker_loop();
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "node_view.h"
+
+// Per-leaf pruning summaries, kept in <vectors file>.leafsum
+// Each leaf is summarized by the centroid of all its vectors and the radius of the ball around
+// it that holds them. By the triangle inequality no vector of the leaf is closer to a query q than
+// max(0, |q - centroid| - radius), so a KNN scan can skip the leaf once that bound cannot beat
+// the current K-th distance. Summaries are found by the leaf's first key and only used while the
+// leaf's fingerprint (its keys, list ids and counts) still matches.
+class LeafSummaries {
+public:
+    LeafSummaries() = default;
+
+    // Identity of a leaf's contents; any insert, delete or split changes it
+    static uint64_t fingerprint(const NodeView& leaf);
+
+    void clear();
+    bool empty() const { return entries_.empty(); }
+    size_t size() const { return entries_.size(); }
+    uint32_t dimension() const { return dim_; }
+
+    // Start a new set of summaries for vectors of dimension dim
+    void reset(uint32_t dim);
+    // Append the summary of leaf (leaves must be added in key order)
+    void add(const NodeView& leaf, const float* centroid, float radius);
+
+    // store_next_id identifies the vector store state the summaries were built from;
+    // load() rejects files built for a different state
+    bool save(const std::string& path, uint64_t store_next_id) const;
+    bool load(const std::string& path, uint64_t store_next_id);
+
+    // Centroid of leaf (radius in radius), nullptr if leaf has no valid summary
+    const float* find(const NodeView& leaf, float& radius) const;
+
+private:
+    struct Entry {
+        int32_t first_key;
+        float radius;
+        uint64_t fingerprint;
+    };
+    static_assert(sizeof(Entry) == 16, "Entry must match the on-disk layout");
+
+    uint32_t dim_ = 0;
+    std::vector<Entry> entries_;    // ascending by first_key
+    std::vector<float> centroids_;  // entries_.size() * dim_
+};
@@ -27,6 +27,9 @@ public:
     // Log with custom formatting
     static void log(LogLevel level, const std::string& message);
     
+    // True if a message of this level would be written; guard messages that are costly to build
+    static bool is_enabled(LogLevel level) { return initialized_ && level >= min_level_; }
+    
     // Log performance metrics
     static void log_performance(const std::string& operation, double duration_ms, const std::string& details = "");
     
@@ -0,0 +1,197 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifndef BPTREE_METRICS
+#define BPTREE_METRICS 1
+#endif
+
+// Hot-path search metrics: per-thread counters and log-linear latency histograms
+// Compiled in unless BPTREE_METRICS=0 and off until Metrics::set_enabled(true); while off each
+// instrumentation point costs one relaxed load and no clock reads. Every thread writes its own
+// slots with relaxed atomics (no locked read-modify-write, no shared cache lines); snapshot()
+// sums all threads, including ones that have exited.
+// Histograms bucket nanoseconds by power of two with 16 linear sub-buckets (<= 6.25% error).
+
+enum class MetricStage {
+    Search,       // one search_knn_into / search_knn_parallel_into call
+    Traversal,    // root to the first leaf of the range
+    LeafRead,     // one leaf read from disk (or waited for from the prefetcher)
+    LeafScan,     // all in-range vectors of one leaf: fetch, distance and heap
+    VectorFetch,  // sampled: from the previous vector's end to the next vector's data
+    Distance,     // sampled: one distance kernel call
+    Heap,         // sampled: one accepted heap offer
+    Count
+};
+
+enum class MetricCounter {
+    Searches,
+    NodesTraversed,
+    LeafReads,
+    LeavesScanned,
+    LeavesPruned,
+    VectorsScored,
+    HeapInserts,
+    Count
+};
+
+constexpr size_t METRIC_STAGE_COUNT = static_cast<size_t>(MetricStage::Count);
+constexpr size_t METRIC_COUNTER_COUNT = static_cast<size_t>(MetricCounter::Count);
+
+struct HistogramSnapshot {
+    static constexpr size_t SUB_BUCKETS = 16;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + (64 - 4) * SUB_BUCKETS;
+
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+    std::array<uint64_t, BUCKETS> buckets{};
+
+    static size_t bucket_of(uint64_t ns);
+    static uint64_t bucket_upper(size_t bucket);  // largest value in the bucket
+
+    // Upper bound of the bucket holding the p-th (0..1) fraction of values (0 when empty)
+    uint64_t percentile(double p) const;
+    double mean_ns() const { return count ? static_cast<double>(sum_ns) / count : 0.0; }
+};
+
+struct MetricsSnapshot {
+    std::array<uint64_t, METRIC_COUNTER_COUNT> counters{};
+    std::array<HistogramSnapshot, METRIC_STAGE_COUNT> stages;
+
+    uint64_t counter(MetricCounter c) const { return counters[static_cast<size_t>(c)]; }
+    const HistogramSnapshot& stage(MetricStage s) const { return stages[static_cast<size_t>(s)]; }
+};
+
+class Metrics {
+public:
+    // Distance and vector-fetch times are taken for one vector in SAMPLE_EVERY, heap times for
+    // one heap offer in HEAP_SAMPLE_EVERY
+    static constexpr uint32_t SAMPLE_EVERY = 64;
+    static constexpr uint32_t HEAP_SAMPLE_EVERY = 8;
+
+    static void set_enabled(bool enabled);
+#if BPTREE_METRICS
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+#else
+    static constexpr bool enabled() { return false; }
+#endif
+
+    static void add(MetricCounter counter, uint64_t n = 1);
+    static void record(MetricStage stage, uint64_t ns);
+
+    static MetricsSnapshot snapshot();
+    static void reset();
+
+    static const char* stage_name(MetricStage stage);
+    static const char* counter_name(MetricCounter counter);
+
+    // Prometheus text exposition (counters and cumulative _bucket/_sum/_count per stage)
+    static std::string to_prometheus(const MetricsSnapshot& snapshot);
+    // Human-readable table: counters, then count/mean/p50/p95/p99/max per stage
+    static std::string format_summary(const MetricsSnapshot& snapshot);
+
+private:
+#if BPTREE_METRICS
+    static std::atomic<bool> enabled_;
+#endif
+};
+
+// Times its scope into a stage when metrics are enabled at construction
+class MetricTimer {
+public:
+    explicit MetricTimer(MetricStage stage) : stage_(stage), active_(Metrics::enabled()) {
+        if (active_) start_ = std::chrono::steady_clock::now();
+    }
+    ~MetricTimer() { stop(); }
+
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+    void stop() {
+        if (!active_) return;
+        active_ = false;
+        Metrics::record(stage_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count()));
+    }
+
+private:
+    MetricStage stage_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Per-vector instrumentation of a scan loop, sampled so that unsampled vectors only bump a
+// counter: begin() before the distance, distance_done() after it, offer_begin()/offered() around
+// the heap offer (skipped when the candidate is rejected); flush() adds the counts. The vector-fetch
+// time of a sampled vector is the gap since the previous vector's end, which covers reading its
+// data. Heap offers are rare next to distances, so they are sampled by their own count.
+class MetricVectorSampler {
+public:
+    MetricVectorSampler() : active_(Metrics::enabled()) {}
+    ~MetricVectorSampler() { flush(); }
+
+    MetricVectorSampler(const MetricVectorSampler&) = delete;
+    MetricVectorSampler& operator=(const MetricVectorSampler&) = delete;
+
+    // A new leaf: the next gap would include leaf handling, so no fetch time is taken across it
+    void new_leaf() { have_end_ = false; }
+
+    void begin() {
+        if (!active_) return;
+        scored_++;
+        sampled_ = (scored_ % Metrics::SAMPLE_EVERY) == 0;
+        tail_ = (scored_ % Metrics::SAMPLE_EVERY) == Metrics::SAMPLE_EVERY - 1;
+        if (!sampled_) return;
+        t0_ = std::chrono::steady_clock::now();
+        if (have_end_) Metrics::record(MetricStage::VectorFetch, ns(last_end_, t0_));
+        have_end_ = false;
+    }
+
+    void distance_done() {
+        if (!active_) return;
+        if (sampled_) Metrics::record(MetricStage::Distance, ns(t0_, std::chrono::steady_clock::now()));
+        if (tail_) {
+            // the vector before a sampled one marks where the sampled fetch starts
+            last_end_ = std::chrono::steady_clock::now();
+            have_end_ = true;
+        }
+    }
+
+    void offer_begin() {
+        if (!active_) return;
+        heap_sampled_ = (inserts_++ % Metrics::HEAP_SAMPLE_EVERY) == 0;
+        if (heap_sampled_) t1_ = std::chrono::steady_clock::now();
+    }
+
+    void offered() {
+        if (!active_) return;
+        if (heap_sampled_) Metrics::record(MetricStage::Heap, ns(t1_, std::chrono::steady_clock::now()));
+        if (tail_) last_end_ = std::chrono::steady_clock::now();
+    }
+
+    void flush() {
+        if (!active_) return;
+        if (scored_) Metrics::add(MetricCounter::VectorsScored, scored_);
+        if (inserts_) Metrics::add(MetricCounter::HeapInserts, inserts_);
+        scored_ = inserts_ = 0;
+    }
+
+private:
+    static uint64_t ns(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count());
+    }
+
+    bool active_;
+    bool sampled_ = false;
+    bool tail_ = false;
+    bool heap_sampled_ = false;
+    bool have_end_ = false;
+    uint64_t scored_ = 0;
+    uint64_t inserts_ = 0;
+    std::chrono::steady_clock::time_point t0_, t1_, last_end_;
+};
@@ -41,6 +41,10 @@ struct BPlusNode {
     std::vector<uint64_t> vector_list_ids;   // id of first vector in the list for each key
     std::vector<uint32_t> vector_counts;     // number of vectors for each key
     
+    // vectors under each child (internal nodes only; maintained when the header says so,
+    // see PageManager::hasSubtreeCounts)
+    std::vector<uint64_t> child_counts;
+    
     // initialize with given order (max_vec_size no longer needed for node structure)
     void init(uint32_t order, uint32_t /*max_vec_size*/ = 0) {
         isLeaf = false;
@@ -50,6 +54,18 @@ struct BPlusNode {
         children.resize(order + 1, INVALID_PAGE);
         vector_list_ids.resize(order, 0);
         vector_counts.resize(order, 0);
+        child_counts.resize(order + 1, 0);
+    }
+    
+    // vectors stored under this node
+    uint64_t vectorCount() const {
+        uint64_t total = 0;
+        if (isLeaf) {
+            for (int i = 0; i < keyCount; i++) total += vector_counts[i];
+        } else {
+            for (int i = 0; i <= keyCount; i++) total += child_counts[i];
+        }
+        return total;
     }
     
     // serialize node to raw bytes for disk storage
@@ -97,6 +113,13 @@ struct BPlusNode {
             std::memcpy(ptr, &vc, sizeof(uint32_t));
             ptr += sizeof(uint32_t);
         }
+        
+        // child_counts[order+1] - vectors under each child
+        for (uint32_t i = 0; i < config.order + 1; i++) {
+            uint64_t cc = (i < child_counts.size()) ? child_counts[i] : 0;
+            std::memcpy(ptr, &cc, sizeof(uint64_t));
+            ptr += sizeof(uint64_t);
+        }
     }
     
     // deserialize node from raw bytes
@@ -145,5 +168,11 @@ struct BPlusNode {
             std::memcpy(&vector_counts[i], ptr, sizeof(uint32_t));
             ptr += sizeof(uint32_t);
         }
+        
+        // child_counts[order+1]
+        for (uint32_t i = 0; i < config.order + 1; i++) {
+            std::memcpy(&child_counts[i], ptr, sizeof(uint64_t));
+            ptr += sizeof(uint64_t);
+        }
     }
 };
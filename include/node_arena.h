@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "node.h"
+#include "node_view.h"
+
+// Read-optimized snapshot of the tree nodes for the memory index (see DiskBPlusTree::loadIntoMemory)
+// Nodes sit in one flat array of fixed-size, cache-line-aligned records indexed by page id, so a
+// lookup is one multiply instead of a hash probe. Each record starts with the header and the key
+// array (padded to groups of 4 for NodeView::lowerBound, counted by the kernel of this order),
+// followed by either the internal fields (child_counts, children) or the leaf fields
+// (vector_list_ids, vector_counts), which share space.
+class NodeArena {
+public:
+    // Bytes of one record for the given order
+    static size_t recordBytes(uint32_t order);
+
+    // Drop any nodes and size the arena for page ids [0, page_count)
+    void reset(uint32_t order, uint32_t page_count);
+    void clear();
+
+    // Copy node into the record of pid (pid < page_count)
+    void store(uint32_t pid, const BPlusNode& node);
+
+    // View of pid, or an empty view if pid was never stored
+    NodeView view(uint32_t pid) const {
+        if (pid >= page_count_) return NodeView();
+        const char* record = base() + static_cast<size_t>(pid) * stride_;
+        const RecordHeader* header = reinterpret_cast<const RecordHeader*>(record);
+        if (!header->present) return NodeView();
+        NodeView v;
+        v.isLeaf = header->is_leaf != 0;
+        v.keyCount = header->key_count;
+        v.next = header->next;
+        v.keys = reinterpret_cast<const int*>(record + KEYS_OFFSET);
+        v.lower_bound_kernel = lower_bound_;
+        const char* fields = record + fields_offset_;
+        if (v.isLeaf) {
+            v.vector_list_ids = reinterpret_cast<const uint64_t*>(fields);
+            v.vector_counts = reinterpret_cast<const uint32_t*>(fields + leaf_counts_offset_);
+        } else {
+            v.child_counts = reinterpret_cast<const uint64_t*>(fields);
+            v.children = reinterpret_cast<const uint32_t*>(fields + children_offset_);
+        }
+        return v;
+    }
+
+    size_t size() const { return stored_; }
+    size_t memoryBytes() const { return storage_.size() * sizeof(CacheLine); }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t KEYS_OFFSET = 16;
+
+    struct RecordHeader {
+        uint32_t next;
+        uint16_t key_count;
+        uint8_t is_leaf;
+        uint8_t present;
+    };
+    struct alignas(CACHE_LINE) CacheLine {
+        char bytes[CACHE_LINE];
+    };
+
+    std::vector<CacheLine> storage_;
+    size_t stride_ = 0;               // bytes per record, a multiple of CACHE_LINE
+    size_t fields_offset_ = 0;        // start of the internal/leaf fields
+    size_t children_offset_ = 0;      // children, relative to fields_offset_
+    size_t leaf_counts_offset_ = 0;   // vector_counts, relative to fields_offset_
+    uint32_t order_ = 0;
+    PaddedLowerBound lower_bound_ = nullptr;  // padded_lower_bound_for(key slots of order_)
+    uint32_t page_count_ = 0;
+    size_t stored_ = 0;
+
+    const char* base() const { return reinterpret_cast<const char*>(storage_.data()); }
+    char* base() { return reinterpret_cast<char*>(storage_.data()); }
+
+    struct Layout {
+        size_t stride, fields, children, leaf_counts;
+    };
+    static Layout layoutFor(uint32_t order);
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "node.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define BPTREE_NODE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BPTREE_NODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Number of keys smaller than key in a key array padded with INT32_MAX to a multiple of 4
+// (NodeArena layout). Slots = 0 loops over key_count; any other Slots is the padded array size of
+// one order, fixed at compile time: nodes of up to 16 slots count every slot without a branch,
+// larger ones unroll the block loop and stop at key_count.
+template <size_t Slots>
+inline int padded_lower_bound(const int* keys, int key_count, int key) {
+    int n = 0;
+#if defined(BPTREE_NODE_SSE2)
+    // each lane counts the keys it saw below the probe (compare yields -1 per hit)
+    const __m128i probe = _mm_set1_epi32(key);
+    __m128i counts = _mm_setzero_si128();
+    for (int i = 0; Slots != 0 ? i < static_cast<int>(Slots) : i < key_count; i += 4) {
+        if (Slots > 16 && i >= key_count) break;
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+        counts = _mm_sub_epi32(counts, _mm_cmpgt_epi32(probe, block));
+    }
+    counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(1, 0, 3, 2)));
+    counts = _mm_add_epi32(counts, _mm_shuffle_epi32(counts, _MM_SHUFFLE(2, 3, 0, 1)));
+    n = _mm_cvtsi128_si32(counts);
+#elif defined(BPTREE_NODE_NEON)
+    const int32x4_t probe = vdupq_n_s32(key);
+    for (int i = 0; Slots != 0 ? i < static_cast<int>(Slots) : i < key_count; i += 4) {
+        if (Slots > 16 && i >= key_count) break;
+        uint32x4_t less = vcltq_s32(vld1q_s32(keys + i), probe);
+        n += static_cast<int>(vaddvq_u32(vshrq_n_u32(less, 31)));
+    }
+#else
+    for (int i = 0; i < key_count; i++) n += (key > keys[i]);
+#endif
+    return n;
+}
+
+using PaddedLowerBound = int (*)(const int* keys, int key_count, int key);
+
+// padded_lower_bound for arrays of key_slots keys: fixed for 4, 8, 12, 16, 32 and 64 slots,
+// the key_count loop otherwise
+inline PaddedLowerBound padded_lower_bound_for(size_t key_slots) {
+    switch (key_slots) {
+        case 4: return padded_lower_bound<4>;
+        case 8: return padded_lower_bound<8>;
+        case 12: return padded_lower_bound<12>;
+        case 16: return padded_lower_bound<16>;
+        case 32: return padded_lower_bound<32>;
+        case 64: return padded_lower_bound<64>;
+        default: return padded_lower_bound<0>;
+    }
+}
+
+// Read-only view of one B+ tree node: the fields of BPlusNode as plain pointers, so search code
+// reads nodes the same way whether they live in a BPlusNode (disk reads, buffer pool) or in the
+// flat NodeArena of the memory index. Leaf views leave children/child_counts unset once they
+// come from the arena, internal views leave vector_list_ids/vector_counts unset.
+struct NodeView {
+    bool isLeaf = false;
+    uint16_t keyCount = 0;
+    uint32_t next = INVALID_PAGE;
+    const int* keys = nullptr;
+    const uint32_t* children = nullptr;
+    const uint64_t* vector_list_ids = nullptr;
+    const uint32_t* vector_counts = nullptr;
+    const uint64_t* child_counts = nullptr;
+    // Set when keys is readable in groups of 4 past keyCount, padded with INT32_MAX (NodeArena
+    // layout): the padded_lower_bound kernel for the arena's order
+    PaddedLowerBound lower_bound_kernel = nullptr;
+
+    NodeView() = default;
+    // Views the node in place: valid while node is alive and unmodified
+    NodeView(const BPlusNode& node)  // NOLINT: implicit, so BPlusNodes pass where views are taken
+        : isLeaf(node.isLeaf), keyCount(node.keyCount), next(node.next), keys(node.keys.data()),
+          children(node.children.data()), vector_list_ids(node.vector_list_ids.data()),
+          vector_counts(node.vector_counts.data()), child_counts(node.child_counts.data()) {}
+
+    explicit operator bool() const { return keys != nullptr; }
+
+    // Number of keys smaller than key: the child (internal) or first slot (leaf) to follow for it,
+    // same as `while (i < keyCount && key > keys[i]) i++`. Keys are sorted, so counting is
+    // enough and the padded layout counts four keys per compare (padded_lower_bound).
+    int lowerBound(int key) const {
+        if (lower_bound_kernel) return lower_bound_kernel(keys, keyCount, key);
+        int n = 0;
+        for (int i = 0; i < keyCount; i++) n += (key > keys[i]);
+        return n;
+    }
+
+    // vectors stored under this node
+    uint64_t vectorCount() const {
+        uint64_t total = 0;
+        if (isLeaf) {
+            for (int i = 0; i < keyCount; i++) total += vector_counts[i];
+        } else {
+            for (int i = 0; i <= keyCount; i++) total += child_counts[i];
+        }
+        return total;
+    }
+};
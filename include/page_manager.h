@@ -1,12 +1,23 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <fstream>
+#include <map>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 #include <memory>
+#include "epoch_manager.h"
 #include "node.h"
+#include "node_view.h"
 #include "bptree_config.h"
 #include "vector_store.h"
+#include "positional_file.h"
+#include "mapped_file.h"
+
+class NodeArena;
 
 class PageManager {
 public:
@@ -22,19 +33,113 @@ public:
     void readNode(uint32_t pid, BPlusNode& node);
     void writeNode(uint32_t pid, const BPlusNode& node);
     
+    // Thread-safe read path: call prepareConcurrentReads() once (flushes pending writes and
+    // opens positional read handles), then readNodeAt() may be called from many threads.
+    // buffer is caller-owned scratch (resized to page size). Any write closes the handles again
+    // (except in snapshot mode, where readers only ever see pages no write touches).
+    bool prepareConcurrentReads();
+    void readNodeAt(uint32_t pid, BPlusNode& node, std::vector<char>& buffer) const;
+    
+    // Read-only mapping of the index file: mappedNode() views a page in its on-disk layout,
+    // without a read or deserialize, and is safe from many threads. Fails when the layout
+    // cannot be viewed in place (unaligned child_counts for odd orders). Any write unmaps again
+    // (except in snapshot mode; pages allocated past the mapping then return empty views).
+    bool mapPages();
+    void unmapPages() { mapped_.close(); }
+    bool isMapped() const { return mapped_.is_open(); }
+    // Empty view if pid is not mapped
+    NodeView mappedNode(uint32_t pid) const;
+    
+    // Bulk write mode (bulk_load): runs of consecutive pages are staged in one large buffer and
+    // written with a single sequential write. Reads, header saves and endBulkWrite() write them out.
+    static constexpr size_t DEFAULT_BULK_WRITE_BYTES = 8 * 1024 * 1024;
+    void beginBulkWrite(size_t buffer_bytes = DEFAULT_BULK_WRITE_BYTES);
+    void endBulkWrite();
+    
+    // Batch write mode (insert_batch): written pages, the header included, stay in memory and
+    // reads see them there, so a page dirtied by many inserts is written once. endBatchWrite()
+    // writes them out in page order, consecutive pages with one write.
+    void beginBatchWrite();
+    void endBatchWrite();
+    
+    // Write everything out and fsync the index and vector files (see PositionalFile::sync)
+    bool sync();
+    
+    // Copy-on-write snapshots, so searches never wait for (or see half of) an insert or delete.
+    // After enableSnapshots(), the first write of a page since the last publish() goes to a
+    // shadow page and the page id that nodes link to is remapped to it; publish() then swaps in
+    // the root and the remap table as the snapshot new readers pin (ReadSnapshot) and resolve()
+    // page ids through. Old snapshots, superseded shadows and the vector store's retired metadata
+    // are reclaimed through epochs once no reader holds them, and a shadow is folded back into
+    // its home page once no snapshot refers to the home, so the remap table stays small.
+    // Enable before readers start; writes, publish and folds belong to one writer thread.
+    struct Snapshot {
+        uint32_t root = INVALID_PAGE;
+        uint32_t flags = 0;
+        std::unordered_map<uint32_t, uint32_t> remaps;  // page id -> page holding it
+    };
+    bool enableSnapshots();
+    bool snapshotsEnabled() const { return snapshots_; }
+    // Page holding page id pid for this thread: its pinned snapshot, else the writer's view
+    uint32_t resolve(uint32_t pid) const { return snapshots_ ? resolvePinned(pid) : pid; }
+    // Page a write of page id pid goes to (pid itself without snapshots)
+    uint32_t pageForWrite(uint32_t pid);
+    // Make everything written since the last call visible to new readers
+    void publish();
+    // Shadowed pages whose home no reader can see any more, as (home, shadow) pairs: the caller
+    // copies each shadow to its home page, then calls finishFold(home)
+    void foldablePages(std::vector<std::pair<uint32_t, uint32_t>>& pages) const;
+    void finishFold(uint32_t home);
+    // Wait until every reader that started before the call has finished
+    void waitForReaders() { epochs_.synchronize(); }
+    // This thread's pinned snapshot of this PageManager (nullptr if none)
+    const Snapshot* pinnedSnapshot() const;
+    
+    // Pins the current snapshot on this thread for its lifetime (no-op without snapshots or when
+    // the thread already holds one of this PageManager)
+    class ReadSnapshot {
+    public:
+        explicit ReadSnapshot(PageManager& pm);
+        ~ReadSnapshot();
+        ReadSnapshot(const ReadSnapshot&) = delete;
+        ReadSnapshot& operator=(const ReadSnapshot&) = delete;
+    private:
+        PageManager* pm_ = nullptr;
+        size_t slot_ = 0;
+        const PageManager* prev_owner_ = nullptr;
+        const Snapshot* prev_snapshot_ = nullptr;
+    };
+    // Reads under a snapshot another thread keeps pinned for the whole scope (pool workers,
+    // the prefetch worker); no-op for nullptr
+    class SnapshotScope {
+    public:
+        SnapshotScope(const PageManager& pm, const Snapshot* snapshot);
+        ~SnapshotScope();
+        SnapshotScope(const SnapshotScope&) = delete;
+        SnapshotScope& operator=(const SnapshotScope&) = delete;
+    private:
+        bool active_ = false;
+        const PageManager* prev_owner_ = nullptr;
+        const Snapshot* prev_snapshot_ = nullptr;
+    };
+    
     // Bulk load all pages sequentially (much faster than random reads)
     // max_memory_mb: 0 = load all, >0 = limit memory usage
-    void loadAllNodes(std::unordered_map<uint32_t, BPlusNode>& nodes, size_t max_memory_mb = 0);
-    size_t estimateNodeMemoryMB() const;
+    // Read pages 1.. sequentially into arena, up to max_memory_mb of records (0 = all)
+    void loadAllNodes(NodeArena& arena, size_t max_memory_mb = 0);
+    size_t estimateNodeMemoryMB() const;  // memory index (NodeArena) size of all nodes
+    size_t estimateNodeBytes() const;  // resident size of one deserialized node
     
     // Raw page read/write for header
     void readRawPage(uint32_t pid, char* buffer, size_t size);
     void writeRawPage(uint32_t pid, const char* buffer, size_t size);
     
+    // In snapshot mode pages come from the reclaimed shadows first
     uint32_t allocatePage();
     // Allocate a page without immediately saving the header to disk.
     // Caller must call saveHeader() or flushHeader() when done with batch allocations.
     uint32_t allocatePageDeferred();
+    // The pinned snapshot's root on reader threads; setRoot reaches readers with the next publish()
     uint32_t getRoot();
     void setRoot(uint32_t pid);
     void setRootDeferred(uint32_t pid);
@@ -45,6 +150,15 @@ public:
     uint32_t getOrder() const { return header_.config.order; }
     uint32_t getMaxVectorSize() const { return header_.config.max_vector_size; }
     
+    // Tree modification counter (saved with the header); sidecar files record it to detect staleness
+    uint32_t getModificationCount() const { return header_.modification_count; }
+    void noteModification() { header_.modification_count++; }
+    
+    // Whether internal nodes carry valid child_counts (older files do not)
+    // (snapshot readers get the flags their snapshot was published with)
+    bool hasSubtreeCounts() const { return (headerFlags() & IndexFileHeader::HEADER_FLAG_SUBTREE_COUNTS) != 0; }
+    void setSubtreeCounts() { header_.flags |= IndexFileHeader::HEADER_FLAG_SUBTREE_COUNTS; }
+    
     // Save header to disk
     void saveHeader();
     
@@ -58,6 +172,19 @@ private:
     IndexFileHeader header_;
     std::vector<char> page_buffer_;  // Reusable buffer for serialization
     std::unique_ptr<VectorStore> vector_store_;
+    PositionalFile concurrent_reader_;  // Open between prepareConcurrentReads() and the next write
+    MappedFile mapped_;                 // Open between mapPages() and the next write
+    
+    // Bulk write staging (see beginBulkWrite): pages staged_first_pid_.. in order
+    std::vector<char> staged_pages_;
+    uint32_t staged_first_pid_ = 0;
+    bool bulk_write_ = false;
+    void flushStagedPages();
+    
+    // Batch write pages (see beginBatchWrite), full page images by pid
+    std::map<uint32_t, std::vector<char>> dirty_pages_;
+    bool batch_write_ = false;
+    void flushDirtyPages();
     
     // Batched flush: flush to disk every N writes instead of every write
     uint32_t writes_since_flush_ = 0;
@@ -66,4 +193,18 @@ private:
     
     void initNewFile(const BPTreeConfig& config);
     void loadExistingFile();
+    
+    // Snapshot state (see enableSnapshots); everything but snapshot_ belongs to the writer
+    bool snapshots_ = false;
+    std::vector<uint32_t> free_pages_;           // reclaimed shadows, reused before growing the file
+    EpochManager epochs_;                        // destroyed first: pending callbacks fill free_pages_
+    std::atomic<const Snapshot*> snapshot_{nullptr};
+    std::unordered_map<uint32_t, uint32_t> remaps_;       // the writer's view of the next snapshot
+    static constexpr uint64_t HIDDEN_PENDING = UINT64_MAX;
+    std::unordered_map<uint32_t, uint64_t> hidden_homes_; // shadowed home -> epoch of its last reader
+    std::unordered_set<uint32_t> private_pages_;          // written since publish(), unseen by readers
+    std::vector<uint32_t> superseded_;                    // readers stop seeing these at publish()
+    uint32_t resolvePinned(uint32_t pid) const;
+    uint32_t headerFlags() const;
+    uint32_t takePage();
 };
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only file handle with positional reads (pread / ReadFile with an explicit offset)
+// There is no shared seek state, so read_at() can be called from many threads at once.
+// Used for the lock-free concurrent read paths of PageManager and VectorStore.
+class PositionalFile {
+public:
+    PositionalFile() = default;
+    ~PositionalFile();
+
+    PositionalFile(const PositionalFile&) = delete;
+    PositionalFile& operator=(const PositionalFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const;
+
+    // Read exactly size bytes at offset. Returns false on error or short read (EOF).
+    bool read_at(uint64_t offset, void* buffer, size_t size) const;
+
+    // Ask the OS to start reading [offset, offset + size) into the page cache without waiting
+    // for it (posix_fadvise WILLNEED; a no-op where that is unavailable)
+    void prefetch(uint64_t offset, size_t size) const;
+
+    // Flush the OS-cached data of path to the device (fsync / FlushFileBuffers). Stream writes
+    // only reach the OS, so this is what makes them survive a crash. False if it cannot be synced.
+    static bool sync(const std::string& path);
+
+private:
+#ifdef _WIN32
+    void* handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+class VectorStore;
+
+// 8-bit scalar-quantized (SQ8) companion of a VectorStore, kept in <vectors file>.sq8
+// Every dimension d is mapped linearly from [min_d, max_d] to 0..255, so a vector costs
+// 1 byte per dimension instead of 4. Codes are indexed by vector id like the metadata table
+// (records are immutable, so codes stay valid; ids stored after the build have no code).
+// KNN scans rank candidates by asymmetric distance (exact query vs. decoded codes, via a
+// per-query lookup table) and then re-rank the best ones against the full-precision vectors.
+class QuantizedStore {
+public:
+    QuantizedStore() = default;
+
+    // Encode every vector of store and write the companion file at path
+    static bool build(VectorStore& store, const std::string& path);
+
+    // Map an existing companion file (read-only)
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return file_.is_open(); }
+
+    uint32_t dimension() const { return dim_; }
+    uint64_t encodedCount() const { return encoded_count_; }
+    size_t codeBytes() const { return static_cast<size_t>(slot_count_) * dim_; }
+
+    // Code of vector_id, nullptr if that id was stored after the build
+    const uint8_t* code(uint64_t vector_id) const {
+        return vector_id < slot_count_ ? codes_ + vector_id * dim_ : nullptr;
+    }
+
+    // Asymmetric distance table for a query: table[d * 256 + c] = (query[d] - decode(d, c))^2
+    // Only the first min(n, dimension()) dimensions are used
+    void buildDistanceTable(const float* query, size_t n, std::vector<float>& table) const;
+
+    // Approximate squared L2 distance between the query of table and a code
+    float distance(const std::vector<float>& table, const uint8_t* code) const {
+        const size_t n = table.size() / 256;
+        const float* t = table.data();
+        float sum = 0.0f;
+        for (size_t d = 0; d < n; d++, t += 256) {
+            sum += t[code[d]];
+        }
+        return sum;
+    }
+
+private:
+    MappedFile file_;
+    uint32_t dim_ = 0;
+    uint64_t slot_count_ = 0;      // code slots (max encoded id + 1)
+    uint64_t encoded_count_ = 0;   // slots holding a stored vector
+    const float* min_ = nullptr;   // per-dimension lower bound
+    const float* scale_ = nullptr; // per-dimension step: (max - min) / 255
+    const uint8_t* codes_ = nullptr;
+};
@@ -7,8 +7,14 @@
 #include <fstream>
 #include <ctime>
 #include <functional>
+#include <list>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
 #include "DataObject.h"
+#include "cosine_lsh.h"
 
 // Cached neighbor with distance for sorted storage
 struct CachedNeighbor {
@@ -29,6 +35,15 @@ struct CachedQueryResult {
     std::vector<CachedNeighbor> neighbors;  // Sorted by distance (nearest first)
 };
 
+// Cached results covering part of a query range (see QueryCache::find_range_cover)
+struct RangeCoverMatch {
+    bool found = false;
+    std::vector<std::string> query_ids;              // cached queries whose ranges are used
+    std::vector<CachedNeighbor> neighbors;           // their k nearest combined, sorted by distance
+    std::vector<std::pair<int, int>> residual;       // key intervals left to search, ascending
+    long long covered_keys = 0;                      // width of the covered part of the range
+};
+
 struct CacheConfig {
     size_t max_cache_size_bytes = 100 * 1024 * 1024;
     bool cache_enabled = true;
@@ -54,6 +69,13 @@ struct SimilarCacheMatch {
     CachedQueryResult result;
 };
 
+// Cached KNN results of an index, keyed by compute_query_hash
+// Entries live in memory (exact lookups are one hash probe, similar lookups never touch disk)
+// and persist in an append-only log of segments under <index>/.cache/: every change appends a
+// record, the log is replayed on open, and it is compacted once superseded records outweigh
+// live ones. Eviction is LRU over the in-memory entries.
+// Thread-safe: lookups (including the touch of a hit) share a reader-writer lock, so serving
+// threads only serialize on stores, updates and evictions; see the members for what guards what.
 class QueryCache {
 public:
     explicit QueryCache(const std::string& index_dir, bool enabled = true);
@@ -80,12 +102,23 @@ public:
                       const std::string& used_similar_query_id = "");
     
     // Similarity-based cache lookup
-    // Returns the best matching cached query if both similarities exceed thresholds
+    // Returns the best matching cached query if both similarities exceed thresholds.
+    // Past LSH_MIN_ENTRIES entries, when the vector threshold is high enough for the LSH to find
+    // a qualifying vector with probability >= LSH_MIN_RECALL, only LSH candidates are scored
+    // (approximate: a rare qualifying match can be missed); otherwise every overlapping range is.
     SimilarCacheMatch find_similar_cached_result(
         const std::vector<float>& query_vector,
         int min_key, int max_key, int k,
         const SimilarityThresholds& thresholds) const;
     
+    // Partial reuse for a miss: disjoint cached sub-ranges of [min_key, max_key] with exactly this
+    // query vector and at least k neighbors, chosen to cover the most keys. The exact top K of the
+    // range is the top K of neighbors merged with a KNN search over residual (merge_neighbors).
+    RangeCoverMatch find_range_cover(const std::vector<float>& query_vector,
+                                     int min_key, int max_key, int k) const;
+    // Merge sorted more into sorted into, keeping the k nearest
+    static void merge_neighbors(std::vector<CachedNeighbor>& into, const std::vector<CachedNeighbor>& more, int k);
+    
     // Similarity metrics (public for testing/inspection)
     static double compute_vector_cosine_similarity(const std::vector<float>& v1, const std::vector<float>& v2);
     static double compute_range_iou(int min1, int max1, int min2, int max2);
@@ -100,10 +133,18 @@ public:
     // Returns number of caches updated
     int update_for_deleted_object(int key, const std::vector<float>& vector);
 
+    // Batched forms for many inserted / deleted objects (keys from get_int_value, else the
+    // truncated float value): distances are computed once per (object, affected query) with the
+    // L2 kernel, and each affected entry is rewritten at most once. Return entries rewritten.
+    int update_for_inserted_objects(const std::vector<DataObject>& objects);
+    int update_for_deleted_objects(const std::vector<DataObject>& objects);
+
     void invalidate_for_key(int key);
 
     // Public access for cache inspection utilities
     bool load_query_result(const std::string& query_id, CachedQueryResult& result) const;
+    std::vector<std::string> list_query_ids() const;  // most recently used first
+    size_t get_cache_size() const;  // bytes of live log records
 
     void load_config(const std::string& config_path);
     void enforce_cache_limit();
@@ -117,16 +158,35 @@ public:
 private:
     std::string index_dir_;
     std::string cache_dir_;
-    std::string interval_tree_path_;
-    bool enabled_;
+    std::atomic<bool> enabled_;
+    bool loaded_ = false;
     CacheConfig config_;
 
-    // Store range bounds instead of individual keys to avoid O(N) memory per query
-    struct QueryRange {
-        int min_key;
-        int max_key;
+    // Locking: mutex_ is held shared by lookups and exclusively by everything that changes
+    // entries_, the interval tree or the LSH. A lookup that touches an entry (LRU order, TOUCH
+    // record) also takes lru_mutex_, which guards lru_, the active segment and dead_bytes_
+    // whenever mutex_ is only shared. Exclusive holders need not take lru_mutex_.
+    mutable std::shared_mutex mutex_;
+    mutable std::mutex lru_mutex_;
+
+    // In-memory entries (see class comment)
+    struct Entry {
+        CachedQueryResult result;               // result.last_used_date is stale, see last_used
+        std::atomic<int64_t> last_used{0};      // set by touches under a shared lock
+        size_t bytes = 0;                       // size of its current log record
+        std::list<std::string>::iterator lru;   // position in lru_
     };
-    std::unordered_map<std::string, QueryRange> query_ranges_;  // query_id -> range
+    std::unordered_map<std::string, Entry> entries_;
+    std::list<std::string> lru_;                // front = most recently used
+    
+    // Log: segment_<n>.log files replayed in order; records are appended to the highest one
+    static constexpr size_t SEGMENT_BYTES = 16 * 1024 * 1024;   // roll over to a new segment
+    static constexpr size_t COMPACT_MIN_BYTES = 1024 * 1024;    // dead bytes before compacting
+    std::ofstream segment_;
+    uint32_t segment_id_ = 0;
+    size_t segment_bytes_ = 0;
+    size_t live_bytes_ = 0;   // records of current entries
+    size_t dead_bytes_ = 0;   // superseded records, tombstones and touches
     
     // Interval tree for efficient range lookups: O(log N) instead of O(N)
     struct IntervalNode {
@@ -141,13 +201,36 @@ private:
     
     std::unique_ptr<IntervalNode> interval_root_;  // Root of interval tree
 
-    void ensure_directories();
-    void load_interval_tree();
-    void save_interval_tree();
+    // Input vectors of all entries, for similar lookups (see find_similar_cached_result)
+    static constexpr size_t LSH_MIN_ENTRIES = 256;
+    static constexpr double LSH_MIN_RECALL = 0.9;
+    CosineLSH vector_index_;
 
-    std::string get_query_file_path(const std::string& query_id) const;
-    void save_query_result(const CachedQueryResult& result);
-    void delete_query_result(const std::string& query_id);
+    // Locked public entry points share these (caller holds mutex_ as noted)
+    void set_enabled_locked(bool enabled);                  // exclusive
+    void evict_to_limit();                                  // exclusive
+    CachedQueryResult copy_result(const Entry& entry) const;  // shared, with the current last used
+
+    void ensure_directories();
+    void load_log();
+    void import_legacy_files();
+    std::string segment_path(uint32_t id) const;
+    bool open_segment(uint32_t id);
+    size_t append_record(uint8_t type, const std::vector<char>& payload);  // returns the record size
+    void maybe_compact();
+    void compact();
+
+    // Store result (replacing an entry with the same id) and log it
+    void put_entry(const CachedQueryResult& result);
+    void erase_entry(const std::string& query_id);
+    void touch_entry(Entry& entry);  // last used now, front of the LRU list (shared lock suffices)
+    // In-memory side of the three record types (replay and the functions above); bytes = record size
+    void apply_put(CachedQueryResult&& result, size_t bytes);
+    void apply_erase(const std::string& query_id, size_t bytes);
+    void apply_touch(const std::string& query_id, std::time_t last_used, size_t bytes);
+
+    // Entries whose range holds each object's key -> indices of those objects (exclusive lock)
+    std::unordered_map<std::string, std::vector<size_t>> group_by_entry(const std::vector<DataObject>& objects) const;
 
     void add_to_interval_tree(const std::string& query_id, int min_key, int max_key);
     void remove_from_interval_tree(const std::string& query_id);
@@ -158,9 +241,4 @@ private:
     void find_overlapping_intervals(const IntervalNode* node, int key, std::vector<std::string>& result) const;
     void find_overlapping_range(const IntervalNode* node, int min_key, int max_key, std::vector<std::string>& result) const;
     void update_max_end(IntervalNode* node);
-    void save_interval_tree(std::ofstream& file, const IntervalNode* node) const;
-    void load_interval_tree(std::ifstream& file, std::unique_ptr<IntervalNode>& node);
-
-    size_t get_cache_size() const;
-    std::vector<std::pair<std::string, std::time_t>> get_queries_by_last_used() const;
 };
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bplustree_disk.h"
+
+// Execution strategy of one KNN query, chosen by QueryPlanner
+struct KNNPlan {
+    enum class Strategy { CacheReuse, Serial, Parallel };
+
+    Strategy strategy = Strategy::Serial;
+    int threads = 1;                  // threads for Parallel
+    DiskBPlusTree::RangeEstimate range;
+    bool memory_resident = false;     // leaves are served from the memory index
+
+    const char* strategyName() const;
+    std::string describe() const;     // one line for logs
+};
+
+// Cost-based choice between cache reuse, a single-threaded scan and a parallel scan
+// The cost is the number of vectors under the query range (see DiskBPlusTree::estimate_range),
+// not its key width: a parallel scan only pays off once every thread gets enough vectors to
+// hide the cost of waking the pool and merging heaps, and scans from memory need more of them
+// than scans that wait on disk reads.
+class QueryPlanner {
+public:
+    // Vectors each thread should scan before a parallel plan is worth it
+    static constexpr uint64_t MIN_VECTORS_PER_THREAD_DISK = 8192;
+    static constexpr uint64_t MIN_VECTORS_PER_THREAD_MEMORY = 32768;
+
+    // max_threads: upper bound for parallel plans (0 = hardware_concurrency)
+    explicit QueryPlanner(DiskBPlusTree& tree, int max_threads = 0);
+
+    int maxThreads() const { return max_threads_; }
+
+    // cache_candidate: the query cache can answer this query (exact or similar match)
+    KNNPlan plan(int min_key, int max_key, bool cache_candidate, bool use_memory_index);
+
+    // Run a Serial or Parallel plan (CacheReuse plans are answered by the caller's cache)
+    void execute(const KNNPlan& plan, const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                 std::vector<KNNResult>& out, bool use_memory_index);
+
+private:
+    DiskBPlusTree& tree_;
+    int max_threads_;
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "distance.h"
+#include "mapped_file.h"
+
+// Per-segment proximity graphs, kept in <vectors file>.graph
+// A segment is a run of consecutive leaves holding roughly a fixed number of vectors; its key
+// range [first_key, last_key] contains exactly the vectors of those leaves. Each segment keeps a
+// copy of its vectors and a navigable small-world graph over them (HNSW base layer: beam-search
+// insertion with the neighbor-diversity heuristic), so a query range that fully covers a segment
+// can search it approximately in sublinear time instead of scanning it.
+class SegmentGraphs {
+public:
+    // One graph node: the VectorStore record it stands for
+    struct Node {
+        uint64_t vector_id;
+        int32_t key;
+        int32_t original_id;
+    };
+
+    struct Segment {
+        int32_t first_key;
+        int32_t last_key;
+        uint32_t node_count;
+        uint32_t entry;     // search entry point (node nearest to the segment centroid)
+        uint64_t offset;    // file offset of the segment block
+    };
+
+    // Reusable per-thread search state (visited marks)
+    struct Scratch {
+        std::vector<uint32_t> visited;
+        uint32_t epoch = 0;
+    };
+
+    // Streaming writer: segments are built and written one at a time, in key order
+    class Builder {
+    public:
+        // degree: max neighbors per node, ef_construction: beam width while inserting
+        Builder(const std::string& path, uint32_t dim, uint32_t degree, uint32_t ef_construction);
+        bool ok() const { return static_cast<bool>(out_); }
+
+        // vectors: nodes.size() * dim floats, in node order
+        void addSegment(int32_t first_key, int32_t last_key,
+                        const std::vector<Node>& nodes, const std::vector<float>& vectors);
+
+        // Write the segment table and header; the stamp identifies the index state
+        bool finish(uint64_t store_next_id, uint32_t modification_count);
+
+    private:
+        std::ofstream out_;
+        uint32_t dim_;
+        uint32_t degree_;
+        uint32_t ef_construction_;
+        std::vector<Segment> segments_;
+    };
+
+    SegmentGraphs() = default;
+
+    // Map an existing file (read-only); fails if it was built for a different index state
+    bool open(const std::string& path, uint64_t store_next_id, uint32_t modification_count);
+    void close();
+    bool is_open() const { return file_.is_open(); }
+
+    uint32_t dimension() const { return dim_; }
+    size_t segmentCount() const { return segments_.size(); }
+    const Segment& segment(size_t s) const { return segments_[s]; }
+    const Node& node(size_t s, uint32_t i) const { return nodes(s)[i]; }
+
+    // Segments whose key range lies inside [min_key, max_key], as a half-open index range
+    std::pair<size_t, size_t> coveredSegments(int min_key, int max_key) const;
+
+    // Approximate k nearest nodes of segment s: (squared distance, node index), ascending
+    // ef (>= k) is the beam width; larger is slower and more accurate
+    void search(size_t s, const float* query, size_t k, size_t ef, L2SqrKernel l2_sqr_kernel,
+                Scratch& scratch, std::vector<std::pair<float, uint32_t>>& out) const;
+
+private:
+    MappedFile file_;
+    uint32_t dim_ = 0;
+    uint32_t degree_ = 0;
+    std::vector<Segment> segments_;
+
+    const Node* nodes(size_t s) const;
+    const float* vectors(size_t s) const;
+    const uint32_t* adjacency(size_t s) const;
+};
@@ -0,0 +1,59 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent work-stealing thread pool
+// Each worker owns a deque: it pops from the front of its own and steals from the back of others.
+// parallel_for() hands out morsels through a shared counter, so fast workers keep taking work
+// while slow ones finish theirs; the calling thread takes part as well.
+class ThreadPool {
+public:
+    // num_threads: worker threads (0 = hardware_concurrency)
+    explicit ThreadPool(size_t num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    // Number of distinct slot values passed to parallel_for callbacks (workers + calling thread)
+    size_t slot_count() const { return workers_.size() + 1; }
+
+    // Run fn(index, slot) for index in [0, count) and wait for all of them
+    // slot identifies the executing thread within this call (0..slot_count()-1), so callers can
+    // keep per-thread state without locking. Exceptions from fn are rethrown here.
+    // Safe to call from inside a pool task (the caller runs the morsels itself if needed).
+    void parallel_for(size_t count, const std::function<void(size_t index, size_t slot)>& fn);
+
+    // Queue a fire-and-forget task
+    void submit(std::function<void()> task);
+
+    // Index of the calling thread among this pool's workers, -1 for other threads
+    int current_worker() const;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::atomic<size_t> next_queue_{0};   // round-robin target for submit()
+    std::atomic<size_t> pending_{0};      // queued, not yet started tasks
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    bool stopping_ = false;
+
+    void worker_loop(size_t index);
+    bool try_pop(size_t index, std::function<void()>& task);
+    void push(size_t queue, std::function<void()> task);
+};
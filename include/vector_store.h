@@ -1,12 +1,29 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include "mapped_file.h"
+#include "positional_file.h"
+
+class EpochManager;
 
 class VectorStore {
 public:
+    // On-disk record header: size (4 bytes) + next_id (8 bytes) + original_id (4 bytes)
+    static constexpr size_t RECORD_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(int32_t);
+    
+    // Non-owning view of one stored vector (points into mapped memory, the in-memory cache,
+    // or a scratch buffer that is only valid for the duration of the visit callback)
+    struct VectorView {
+        uint64_t id;
+        const float* data;
+        uint32_t size;
+        int32_t original_id;
+    };
+    
     VectorStore(const std::string& filename, uint32_t max_vector_size);
     ~VectorStore();
     
@@ -17,6 +34,26 @@ public:
     // Returns the new first_vector_id for the list
     uint64_t appendVectorToList(uint64_t first_vector_id, const std::vector<float>& vector, uint32_t actual_size, int32_t original_id = -1);
     
+    // Bulk load: store vectors as one list of consecutive ids written back to back
+    // (head = first id, each record links to id + 1). Returns the head id.
+    uint64_t storeVectorSequence(const std::vector<const std::vector<float>*>& vectors,
+                                 const std::vector<int32_t>& original_ids);
+    
+    // Same for count vectors stored back to back in data (sizes[i] floats each)
+    uint64_t storeVectorSequence(const float* data, const uint32_t* sizes, const int32_t* original_ids, size_t count);
+    
+    // Bulk append mode (bulk_load): records are staged in one large buffer and written with a
+    // single sequential write whenever it fills, instead of a few small stream writes per record.
+    // Reads, flush() and endBulkAppend() write the staged records out first.
+    static constexpr size_t DEFAULT_APPEND_BUFFER_BYTES = 8 * 1024 * 1024;
+    void beginBulkAppend(size_t buffer_bytes = DEFAULT_APPEND_BUFFER_BYTES);
+    void endBulkAppend();
+    
+    // Start the next record on a BLOCK_ALIGNMENT boundary (bulk_load does this once per leaf,
+    // so every leaf's vectors form one aligned block)
+    static constexpr uint64_t BLOCK_ALIGNMENT = 64;
+    void alignNextRecord();
+    
     // Retrieve a single vector by ID
     void retrieveVector(uint64_t vector_id, std::vector<float>& vector, uint32_t& actual_size);
     // Retrieve a single vector by ID, also returning the original fvecs file index
@@ -32,6 +69,26 @@ public:
                            std::vector<uint32_t>& sizes,
                            std::vector<int32_t>& original_ids);
     
+    // Visit every vector in a list without copying it into a std::vector
+    // fn is called as fn(const VectorView&) in list order
+    template <typename Fn>
+    void forEachVectorInList(uint64_t first_vector_id, uint32_t count, Fn&& fn);
+    
+    // Visit the ids of a list from the metadata table only (no vector data is read)
+    // fn is called as fn(uint64_t vector_id, int32_t original_id) in list order
+    template <typename Fn>
+    void forEachIdInList(uint64_t first_vector_id, uint32_t count, Fn&& fn) const;
+    
+    // True if the list at first_id was written by storeVectorSequence
+    // (ids first_id .. first_id + count - 1, linked in id order and stored back to back)
+    bool isSequentialList(uint64_t first_id, uint32_t count) const;
+    
+    // Visit records first_id .. first_id + count - 1 in id order
+    // Records stored back to back are fetched with one sequential read per block
+    // (up to MAX_BLOCK_READ_BYTES) instead of one read per record
+    template <typename Fn>
+    void forEachVectorInIdRange(uint64_t first_id, uint64_t count, Fn&& fn);
+    
     // Delete a vector from a list, returns new first_vector_id (or 0 if list is empty)
     uint64_t removeVectorFromList(uint64_t first_vector_id, uint32_t count, 
                                   const std::vector<float>& vector_to_remove,
@@ -40,24 +97,49 @@ public:
     uint64_t getNextVectorId() const { return next_vector_id_; }
     void setNextVectorId(uint64_t id) { next_vector_id_ = id; }
     uint32_t getMaxVectorSize() const { return max_vector_size_; }
+    const std::string& getFilename() const { return filename_; }
     
     // Get the maximum original_id across all stored vectors (-1 if none)
-    int32_t getMaxOriginalId() const {
-        int32_t max_id = -1;
-        for (const auto& pair : metadata_) {
-            if (pair.second.original_id > max_id) {
-                max_id = pair.second.original_id;
-            }
-        }
-        return max_id;
-    }
+    int32_t getMaxOriginalId() const { return max_original_id_; }
+    
+    // Number of vector records in the store
+    uint64_t getStoredCount() const { return stored_count_.load(std::memory_order_relaxed); }
     
-    // Pre-reserve metadata hash map capacity to avoid rehashing during bulk load
-    void reserveMetadata(size_t count) { metadata_.reserve(count); }
+    // Pre-reserve metadata table capacity for count more vectors (bulk load)
+    void reserveMetadata(size_t count);
     
     void flush();
+    // flush(), then fsync the vector and metadata files (false if either cannot be synced)
+    bool sync();
     void close();
     
+    // Read-only memory-mapped mode: vector reads are served from the mapped file
+    // (no seek/read syscalls, safe for concurrent readers). Any write unmaps the file, unless
+    // concurrent appends are enabled; records past the mapping are then read from the file.
+    bool mapReadOnly();
+    void unmap();
+    bool isMapped() const { return mapped_.is_open(); }
+    
+    // True when vector reads go to the file (not mapped, no memory cache), i.e. when block reads pay off
+    bool readsFromDisk() const { return !mapped_.is_open() && !memory_cache_loaded_; }
+    
+    // Thread-safe disk reads: flush pending writes and open a positional read handle.
+    // Afterwards forEachVectorInList may run concurrently (until the next write closes it,
+    // see enableConcurrentAppends)
+    bool prepareConcurrentReads();
+    
+    // Appends next to readers (snapshot mode, see PageManager::enableSnapshots): the mapping and
+    // the positional read handle stay open across writes, and a metadata table that outgrows its
+    // buffer moves to a new one while the old one is retired through epochs. Readers only see
+    // records appended before the last publishAppends(), so they never touch the write stream.
+    bool enableConcurrentAppends(EpochManager* epochs);
+    // Write appended records through to the file, so readers of the next snapshot can read them
+    void publishAppends();
+    
+    // Hint the records of lists (first_ids[i], counts[i]) to the page cache ahead of reading them
+    // Only acts while reads go to disk through the concurrent read handle; thread-safe like them
+    void prefetchLists(const uint64_t* first_ids, const uint32_t* counts, size_t lists) const;
+    
     // In-memory vector cache
     bool loadAllVectorsIntoMemory(size_t max_memory_mb = 0);
     void clearMemoryCache();
@@ -66,12 +148,15 @@ public:
     size_t estimateMemoryUsageMB() const;
     
 private:
+    // One entry of the metadata table, indexed directly by vector id
+    // (ids are dense; offset == 0 marks an id with no record, e.g. id 0)
     struct VectorMetadata {
         uint64_t offset;      // File offset where vector data starts
-        uint32_t size;        // Actual vector dimension
         uint64_t next_id;     // Next vector in list (0 = end of list)
+        uint32_t size;        // Actual vector dimension
         int32_t original_id;  // Original index in fvecs file (-1 = unset)
     };
+    static_assert(sizeof(VectorMetadata) == 24, "VectorMetadata is stored as-is in the .meta table");
     
     struct CachedVector {
         std::vector<float> data;
@@ -85,7 +170,18 @@ private:
     uint32_t max_vector_size_;
     uint64_t next_vector_id_;
     uint64_t write_pos_;  // Tracks append position to avoid seekp(end) per write
-    std::unordered_map<uint64_t, VectorMetadata> metadata_;
+    
+    // Metadata table. Read-only opens serve it straight from the mapped .meta file;
+    // the first write copies it into metadata_ (see makeMetadataWritable)
+    // Readers load the size before the table and the writer stores the table first, so a
+    // reader never indexes past the buffer it loaded.
+    std::vector<VectorMetadata> metadata_;
+    MappedFile meta_mapped_;
+    std::atomic<const VectorMetadata*> meta_table_{nullptr};
+    std::atomic<uint64_t> meta_table_size_{0};
+    std::atomic<uint64_t> stored_count_{0};
+    int32_t max_original_id_ = -1;
+    bool metadata_dirty_ = false;
     
     // Batched flush: flush to disk every N writes instead of every write
     uint32_t writes_since_flush_ = 0;
@@ -95,12 +191,149 @@ private:
     std::unordered_map<uint64_t, CachedVector> memory_cache_;
     bool memory_cache_loaded_ = false;
     
+    // Read-only mapping of the vector file (see mapReadOnly)
+    MappedFile mapped_;
+    
+    // Positional read handle (see prepareConcurrentReads)
+    PositionalFile concurrent_reader_;
+    
+    // Concurrent append mode (see enableConcurrentAppends)
+    EpochManager* epochs_ = nullptr;
+    std::atomic<uint64_t> flushed_end_{0};  // file bytes readable through the positional handle
+    // Writer reads of records past flushed_end_ write the stream out first
+    void ensureReadable(uint64_t end);
+    
+    static constexpr size_t MAX_BLOCK_READ_BYTES = 4 * 1024 * 1024;
+    static constexpr uint64_t PREFETCH_GAP_BYTES = 4096;  // prefetchLists merges records this close
+    
+    // Read file bytes [offset, offset + size) (positional read when prepared, else the stream)
+    bool readBytes(uint64_t offset, char* buffer, size_t size);
+    
+    // Resolve one vector: mapped file first, then in-memory cache, then a disk read into scratch
+    bool viewVector(uint64_t vector_id, VectorView& view, uint64_t& next_id, std::vector<float>& scratch);
+    
+    const VectorMetadata* findMetadata(uint64_t vector_id) const {
+        if (vector_id >= meta_table_size_.load(std::memory_order_acquire)) return nullptr;
+        const VectorMetadata* meta = meta_table_.load(std::memory_order_acquire) + vector_id;
+        return meta->offset != 0 ? meta : nullptr;
+    }
+    void makeMetadataWritable();
+    // Grow metadata_ to at least capacity slots (retiring the old buffer in concurrent append mode)
+    void reserveMetadataSlots(size_t capacity);
+    void publishMetadataTable();
+    
     void initNewFile();
     void loadExistingFile();
     void writeMetadata();
     void readMetadata();
+    void readLegacyMetadata(std::ifstream& meta_file, uint32_t count);
     
     // Internal: store vector with explicit ID and next pointer
-    void storeVectorInternal(uint64_t vector_id, const std::vector<float>& vector, 
-                            uint32_t actual_size, uint64_t next_id, int32_t original_id);
+    // (available floats of data are written, zero-padded up to actual_size)
+    void storeVectorInternal(uint64_t vector_id, const float* data, size_t available,
+                             uint32_t actual_size, uint64_t next_id, int32_t original_id);
+    
+    // Bulk append staging (see beginBulkAppend): file bytes from append_start_ on
+    std::vector<char> append_buffer_;
+    uint64_t append_start_ = 0;
+    bool bulk_append_ = false;
+    void stageRecord(uint64_t offset, const float* data, size_t copied, uint32_t actual_size,
+                     uint64_t next_id, int32_t original_id);
+    void flushAppendBuffer();
 };
+
+template <typename Fn>
+void VectorStore::forEachVectorInList(uint64_t first_vector_id, uint32_t count, Fn&& fn) {
+    // Lists written by storeVectorSequence are read as one block
+    if (count > 1 && readsFromDisk() && isSequentialList(first_vector_id, count)) {
+        forEachVectorInIdRange(first_vector_id, count, fn);
+        return;
+    }
+    
+    std::vector<float> scratch;
+    uint64_t current_id = first_vector_id;
+    uint32_t visited = 0;
+    
+    while (current_id != 0 && visited < count) {
+        VectorView view;
+        uint64_t next_id;
+        if (!viewVector(current_id, view, next_id, scratch)) {
+            break;  // End of valid chain
+        }
+        fn(view);
+        current_id = next_id;
+        visited++;
+    }
+}
+
+template <typename Fn>
+void VectorStore::forEachVectorInIdRange(uint64_t first_id, uint64_t count, Fn&& fn) {
+    std::vector<float> scratch;
+    const uint64_t end_id = first_id + count;
+    
+    // Mapped or cached vectors are already in memory: visit them one by one
+    if (mapped_.is_open() || memory_cache_loaded_) {
+        for (uint64_t id = first_id; id < end_id; id++) {
+            VectorView view;
+            uint64_t next_id;
+            if (viewVector(id, view, next_id, scratch)) {
+                fn(view);
+            }
+        }
+        return;
+    }
+    
+    uint64_t id = first_id;
+    while (id < end_id) {
+        const VectorMetadata* first = findMetadata(id);
+        if (!first) {
+            id++;
+            continue;
+        }
+        
+        // Extend the block while records stay back to back
+        uint64_t block_end = id + 1;
+        uint64_t bytes = RECORD_HEADER_SIZE + first->size * sizeof(float);
+        while (block_end < end_id) {
+            const VectorMetadata* meta = findMetadata(block_end);
+            if (!meta || meta->offset != first->offset + bytes) break;
+            uint64_t record = RECORD_HEADER_SIZE + meta->size * sizeof(float);
+            if (bytes + record > MAX_BLOCK_READ_BYTES) break;
+            bytes += record;
+            block_end++;
+        }
+        
+        // Record sizes are multiples of 4 bytes, so float data stays aligned in a float buffer
+        scratch.resize((bytes + sizeof(float) - 1) / sizeof(float));
+        if (!readBytes(first->offset, reinterpret_cast<char*>(scratch.data()), static_cast<size_t>(bytes))) {
+            return;
+        }
+        const char* base = reinterpret_cast<const char*>(scratch.data());
+        const VectorMetadata* table = meta_table_.load(std::memory_order_acquire);
+        for (uint64_t b = id; b < block_end; b++) {
+            const VectorMetadata& meta = table[b];
+            VectorView view;
+            view.id = b;
+            view.data = reinterpret_cast<const float*>(base + (meta.offset - first->offset) + RECORD_HEADER_SIZE);
+            view.size = meta.size;
+            view.original_id = meta.original_id;
+            fn(view);
+        }
+        id = block_end;
+    }
+}
+
+template <typename Fn>
+void VectorStore::forEachIdInList(uint64_t first_vector_id, uint32_t count, Fn&& fn) const {
+    uint64_t current_id = first_vector_id;
+    uint32_t visited = 0;
+    while (current_id != 0 && visited < count) {
+        const VectorMetadata* meta = findMetadata(current_id);
+        if (!meta) {
+            break;  // End of valid chain
+        }
+        fn(current_id, meta->original_id);
+        current_id = meta->next_id;
+        visited++;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Write-ahead log of inserts (<index>.wal, see add_element_to_index --ingest)
+// append() only queues a record; commit() makes it durable. Concurrent committers share one
+// write + fsync (group commit): the first one to find its record not yet durable syncs everything
+// appended so far, the others wait for that sync instead of issuing their own.
+// Records carry a CRC32, so open() drops a torn tail left by a crash. checkpoint() empties the
+// log once its records are applied to the index and the index is synced (DiskBPlusTree::sync).
+class WriteAheadLog {
+public:
+    struct Record {
+        uint64_t lsn = 0;
+        int key = 0;
+        int32_t original_id = 0;
+        std::vector<float> vector;
+    };
+
+    WriteAheadLog() = default;
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Open or create the log; records left by an earlier run go to recovered (in log order)
+    bool open(const std::string& path, std::vector<Record>* recovered = nullptr);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    // Queue a record (thread-safe); returns its log sequence number
+    uint64_t append(int key, int32_t original_id, const float* vector, uint32_t size);
+    // Block until lsn is durable (thread-safe, group commit). False once a write or sync failed.
+    bool commit(uint64_t lsn);
+    // Commit everything appended so far
+    bool commitAll();
+    // Drop every record (they must all be applied and synced to the index)
+    bool checkpoint();
+
+    uint64_t lastLsn() const;
+    uint64_t durableLsn() const;
+    uint64_t syncCount() const;  // fsyncs issued by commit()
+
+private:
+    int fd_ = -1;
+    std::string path_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<char> pending_;   // encoded records not yet written
+    uint64_t next_lsn_ = 1;
+    uint64_t durable_lsn_ = 0;
+    uint64_t syncs_ = 0;
+    bool syncing_ = false;        // a committer is writing pending_ out
+    bool failed_ = false;
+
+    bool recover(std::vector<Record>* recovered);
+    bool writeAll(const char* data, size_t size);
+};
@@ -3,12 +3,15 @@
 #include "index_directory.h"
 #include "query_cache.h"
 #include "logger.h"
+#include "distance.h"
+#include "write_ahead_log.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <sstream>
 #include <cmath>
+#include <filesystem>
 
 // Parse comma-separated vector string into vector<float>
 std::vector<float> parse_vector(const std::string& str) {
@@ -21,18 +24,130 @@ std::vector<float> parse_vector(const std::string& str) {
     return result;
 }
 
+// Distance function for cache updates
+static double cache_distance(const std::vector<float>& a, const std::vector<float>& b) {
+    return std::sqrt(static_cast<double>(l2_sqr(a, b)));
+}
+
+// Insert logged records as one batch, update the caches, make the index durable and empty the log
+static bool apply_records(DiskBPlusTree& tree, QueryCache& cache, WriteAheadLog& wal,
+                          const std::vector<WriteAheadLog::Record>& records) {
+    if (!records.empty()) {
+        std::vector<DataObject> objects;
+        objects.reserve(records.size());
+        for (const WriteAheadLog::Record& record : records) {
+            objects.emplace_back(record.vector, record.key);
+            objects.back().set_id(record.original_id);
+        }
+        tree.insert_batch(objects);
+        int updated_caches = cache.update_for_inserted_objects(objects);
+        std::ostringstream apply_log;
+        apply_log << "ADD | Applied " << records.size() << " logged inserts | Updated " << updated_caches << " cached queries";
+        Logger::log_node_operation("ADD", apply_log.str());
+    }
+    if (!tree.sync()) {
+        std::cerr << "Error: Failed to sync the index files" << std::endl;
+        return false;
+    }
+    return wal.checkpoint();
+}
+
+// Apply records a crashed run logged but did not apply (their original ids are above the index's)
+static bool replay_log(DiskBPlusTree& tree, QueryCache& cache, WriteAheadLog& wal,
+                       std::vector<WriteAheadLog::Record>& recovered) {
+    const int32_t applied_id = tree.getMaxOriginalId();
+    std::vector<WriteAheadLog::Record> pending;
+    for (WriteAheadLog::Record& record : recovered) {
+        if (record.original_id > applied_id) pending.push_back(std::move(record));
+    }
+    if (!recovered.empty()) {
+        std::cout << "Recovery: " << recovered.size() << " logged inserts, " << pending.size() << " not yet applied" << std::endl;
+        Logger::info("WAL recovery: replaying " + std::to_string(pending.size()) + " of " +
+                     std::to_string(recovered.size()) + " logged inserts");
+    }
+    recovered.clear();
+    return apply_records(tree, cache, wal, pending);
+}
+
+// Ingest "<key> <v1,v2,...>" lines: log each, acknowledge after the group's fsync, apply in batches
+static bool ingest(DiskBPlusTree& tree, QueryCache& cache, WriteAheadLog& wal, std::istream& in,
+                   size_t group_commit, size_t apply_batch) {
+    int32_t next_id = tree.getMaxOriginalId() + 1;
+    std::vector<WriteAheadLog::Record> unapplied;
+    size_t group = 0;
+    size_t line_number = 0;
+    uint64_t ingested = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        line_number++;
+        std::istringstream fields(line);
+        std::string key_str, vector_str;
+        if (!(fields >> key_str)) continue;  // blank line
+        if (!(fields >> vector_str)) {
+            std::cerr << "Warning: Skipping line " << line_number << " (expected <key> <v1,v2,...>)" << std::endl;
+            continue;
+        }
+        WriteAheadLog::Record record;
+        try {
+            record.key = key_str.find('.') != std::string::npos ? static_cast<int>(std::stof(key_str)) : std::stoi(key_str);
+        } catch (const std::exception&) {
+            std::cerr << "Warning: Skipping line " << line_number << " (bad key " << key_str << ")" << std::endl;
+            continue;
+        }
+        record.original_id = next_id++;
+        record.vector = parse_vector(vector_str);
+        record.lsn = wal.append(record.key, record.original_id, record.vector.data(),
+                                static_cast<uint32_t>(record.vector.size()));
+        unapplied.push_back(std::move(record));
+        group++;
+
+        // Commit when the group is full or the input has nothing more buffered right now
+        if (group >= group_commit || in.rdbuf()->in_avail() <= 0) {
+            if (!wal.commitAll()) return false;
+            std::cout << "Committed ids " << unapplied[unapplied.size() - group].original_id << ".."
+                      << unapplied.back().original_id << std::endl;
+            ingested += group;
+            group = 0;
+        }
+        if (unapplied.size() >= apply_batch && group == 0) {
+            if (!apply_records(tree, cache, wal, unapplied)) return false;
+            unapplied.clear();
+        }
+    }
+    if (group > 0) {
+        if (!wal.commitAll()) return false;
+        std::cout << "Committed ids " << unapplied[unapplied.size() - group].original_id << ".."
+                  << unapplied.back().original_id << std::endl;
+        ingested += group;
+    }
+    if (!apply_records(tree, cache, wal, unapplied)) return false;
+    std::cout << "Ingested " << ingested << " vectors with " << wal.syncCount() << " log syncs" << std::endl;
+    Logger::info("Ingested " + std::to_string(ingested) + " vectors with " + std::to_string(wal.syncCount()) + " log syncs");
+    return true;
+}
+
 void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " --index <index_dir> --key <key> --vector <v1,v2,...>" << std::endl;
+    std::cout << "       " << program_name << " --index <index_dir> --ingest <file|-> [options]" << std::endl;
     std::cout << std::endl;
     std::cout << "Flags:" << std::endl;
-    std::cout << "  --index, -i   Path to the index directory (required)" << std::endl;
-    std::cout << "  --key, -k     Key value for the new node (required)" << std::endl;
-    std::cout << "  --vector, -v  Vector data (comma-separated, e.g., 1.0,2.0,3.0)" << std::endl;
-    std::cout << "  --help, -h    Show this help message" << std::endl;
+    std::cout << "  --index, -i     Path to the index directory (required)" << std::endl;
+    std::cout << "  --key, -k       Key value for the new node (required without --ingest)" << std::endl;
+    std::cout << "  --vector, -v    Vector data (comma-separated, e.g., 1.0,2.0,3.0)" << std::endl;
+    std::cout << "  --ingest        Insert \"<key> <v1,v2,...>\" lines from a file or stdin (-) through the" << std::endl;
+    std::cout << "                  write-ahead log (<index>/index.bpt.wal): lines are acknowledged once" << std::endl;
+    std::cout << "                  their group is fsynced, then applied to the tree in batches" << std::endl;
+    std::cout << "  --group-commit  Most records per log fsync (default: 256)" << std::endl;
+    std::cout << "  --apply-batch   Records applied to the tree per batch (default: 10000)" << std::endl;
+    std::cout << "  --recover       Only replay the write-ahead log of a crashed run" << std::endl;
+    std::cout << "  --help, -h      Show this help message" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Logged inserts a crashed run did not apply are replayed by the next run." << std::endl;
     std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  Add integer key:  " << program_name << " --index data/my_index --key 42 --vector 1.0,2.0,3.0" << std::endl;
     std::cout << "  Add float key:    " << program_name << " --index data/my_index --key 42.5 --vector 1.0,2.0,3.0" << std::endl;
+    std::cout << "  Stream inserts:   producer | " << program_name << " --index data/my_index --ingest -" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -42,6 +157,10 @@ int main(int argc, char* argv[]) {
     bool has_index = false;
     bool has_key = false;
     bool has_vector = false;
+    std::string ingest_path;
+    size_t group_commit = 256;
+    size_t apply_batch = 10000;
+    bool recover_only = false;
     
     // Parse command line flags
     for (int i = 1; i < argc; i++) {
@@ -56,6 +175,14 @@ int main(int argc, char* argv[]) {
         } else if ((arg == "--vector" || arg == "-v") && i + 1 < argc) {
             vector_data = parse_vector(argv[++i]);
             has_vector = true;
+        } else if (arg == "--ingest" && i + 1 < argc) {
+            ingest_path = argv[++i];
+        } else if (arg == "--group-commit" && i + 1 < argc) {
+            group_commit = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--apply-batch" && i + 1 < argc) {
+            apply_batch = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--recover") {
+            recover_only = true;
         } else if (arg == "--help" || arg == "-h") {
             print_usage(argv[0]);
             return 0;
@@ -68,13 +195,17 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
-    if (!has_key) {
+    const bool batch_mode = !ingest_path.empty() || recover_only;
+    if (ingest_path == "-") {
+        std::ios::sync_with_stdio(false);  // lets in_avail() see buffered stdin lines
+    }
+    if (!has_key && !batch_mode) {
         std::cerr << "Error: Missing required --key flag" << std::endl;
         print_usage(argv[0]);
         return 1;
     }
     
-    if (!has_vector) {
+    if (!has_vector && !batch_mode) {
         std::cerr << "Error: Missing required --vector flag" << std::endl;
         print_usage(argv[0]);
         return 1;
@@ -105,6 +236,33 @@ int main(int argc, char* argv[]) {
         QueryCache cache(index_dir, true);
         cache.load_config(idx_dir.get_config_file_path());
         
+        // Replay what a crashed run logged but did not apply, then serve --ingest
+        const std::string wal_path = index_file + ".wal";
+        if (batch_mode || std::filesystem::exists(wal_path)) {
+            WriteAheadLog wal;
+            std::vector<WriteAheadLog::Record> recovered;
+            if (!wal.open(wal_path, &recovered) || !replay_log(dataTree, cache, wal, recovered)) {
+                std::cerr << "Error: Write-ahead log recovery failed" << std::endl;
+                return 1;
+            }
+            if (recover_only) {
+                std::cout << "Recovery complete" << std::endl;
+                return 0;
+            }
+            if (!ingest_path.empty()) {
+                std::ifstream ingest_file;
+                if (ingest_path != "-") {
+                    ingest_file.open(ingest_path);
+                    if (!ingest_file.is_open()) {
+                        std::cerr << "Error: Cannot open ingest file: " << ingest_path << std::endl;
+                        return 1;
+                    }
+                }
+                std::istream& in = ingest_path == "-" ? std::cin : ingest_file;
+                return ingest(dataTree, cache, wal, in, group_commit, apply_batch) ? 0 : 1;
+            }
+        }
+        
         // Determine if key is integer or float
         bool is_float_key = key_str.find('.') != std::string::npos;
         
@@ -142,18 +300,7 @@ int main(int argc, char* argv[]) {
         // Update affected cache entries - insert new object if it's closer than furthest cached neighbor
         int key_for_cache = is_float_key ? static_cast<int>(std::stof(key_str)) : std::stoi(key_str);
         
-        // Distance function for cache update
-        auto distance_fn = [](const std::vector<float>& a, const std::vector<float>& b) -> double {
-            double sum = 0.0;
-            size_t min_size = std::min(a.size(), b.size());
-            for (size_t i = 0; i < min_size; i++) {
-                double diff = a[i] - b[i];
-                sum += diff * diff;
-            }
-            return std::sqrt(sum);
-        };
-        
-        int updated_caches = cache.update_for_inserted_object(key_for_cache, vector_data, distance_fn, new_original_id);
+        int updated_caches = cache.update_for_inserted_object(key_for_cache, vector_data, cache_distance, new_original_id);
         
         if (updated_caches > 0) {
             std::cout << "Updated " << updated_caches << " cached queries with new closer neighbor" << std::endl;
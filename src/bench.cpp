@@ -0,0 +1,435 @@
+#include "bplustree_disk.h"
+#include "index_directory.h"
+#include "logger.h"
+#include "distance.h"
+#include "dataset_io.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <thread>
+#include <nlohmann/json.hpp>
+
+// Repeatable KNN benchmark: sweeps search mode (disk / memory index), concurrent queries, K and
+// range selectivity over one query set, and writes recall, QPS and latency percentiles as JSON.
+// Every configuration runs --warmup unmeasured passes, then --repeat measured passes over all
+// queries through search_knn_batch. The query cache is not used.
+
+namespace {
+
+// Comma-separated list of values
+template <typename T, typename Parse>
+std::vector<T> parse_list(const std::string& str, Parse parse) {
+    std::vector<T> values;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) values.push_back(parse(item));
+    }
+    return values;
+}
+
+// Query ranges of one sweep point; groundtruth (per query) is only set for the --qrange-path
+// ranges, recall is otherwise measured against an exact reference search
+struct Workload {
+    std::string name;         // "file" or the selectivity, e.g. "0.01"
+    double selectivity = -1;  // fraction of the key span; -1 for the --qrange-path ranges
+    std::vector<std::pair<int, int>> ranges;
+    std::vector<std::vector<int32_t>> groundtruth;
+    double avg_vectors_in_range = 0.0;
+};
+
+struct LatencySummary {
+    double mean_us = 0.0;
+    double p50_us = 0.0;
+    double p95_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+// Nearest-rank percentiles over all measured query latencies (sorts latencies_ns)
+LatencySummary summarize(std::vector<long long>& latencies_ns) {
+    LatencySummary summary;
+    if (latencies_ns.empty()) return summary;
+    std::sort(latencies_ns.begin(), latencies_ns.end());
+    auto percentile = [&](double p) {
+        size_t rank = static_cast<size_t>(std::ceil(p * latencies_ns.size()));
+        return latencies_ns[std::min(latencies_ns.size(), std::max<size_t>(rank, 1)) - 1] / 1000.0;
+    };
+    double total = 0.0;
+    for (long long ns : latencies_ns) total += ns;
+    summary.mean_us = total / latencies_ns.size() / 1000.0;
+    summary.p50_us = percentile(0.50);
+    summary.p95_us = percentile(0.95);
+    summary.p99_us = percentile(0.99);
+    summary.max_us = latencies_ns.back() / 1000.0;
+    return summary;
+}
+
+std::string utc_timestamp() {
+    std::time_t now = std::time(nullptr);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    return buffer;
+}
+
+}  // namespace
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " --index <index_dir> --queries <file> [options]" << "\n";
+    std::cout << "\n";
+    std::cout << "Flags:" << "\n";
+    std::cout << "  --index, -i      Path to the index directory (required)" << "\n";
+    std::cout << "  --queries, -q    Path to query vectors file (.fvecs format, required)" << "\n";
+    std::cout << "  --groundtruth    Groundtruth (.ivecs) for the --qrange-path ranges (used for K up to its depth)" << "\n";
+    std::cout << "  --qrange-path    Query range JSON [left0, right0, ...]; adds a \"file\" workload" << "\n";
+    std::cout << "  --num-queries    Number of queries to run (default: all)" << "\n";
+    std::cout << "  --modes          Search modes to sweep: disk, memory (default: disk,memory)" << "\n";
+    std::cout << "  --threads        Concurrent queries to sweep, 0 = hardware threads (default: 1,0)" << "\n";
+    std::cout << "  --k              K values to sweep (default: 10)" << "\n";
+    std::cout << "  --selectivity    Range widths to sweep as fractions of the key span (default: 0.01,0.1,1.0)" << "\n";
+    std::cout << "                   Ranges are placed uniformly at random (--seed); recall is against an exact search" << "\n";
+    std::cout << "  --warmup         Unmeasured passes per configuration (default: 1)" << "\n";
+    std::cout << "  --repeat         Measured passes per configuration (default: 3)" << "\n";
+    std::cout << "  --seed           Seed for the selectivity ranges (default: 42)" << "\n";
+    std::cout << "  --mmap           Memory-map index pages and vector store for every mode" << "\n";
+    std::cout << "  --prune          Skip leaves by their centroid/radius summaries (built with --leaf-summaries, exact)" << "\n";
+    std::cout << "  --label          Free-form run label stored in the JSON (e.g. a version or commit)" << "\n";
+    std::cout << "  --output, -o     JSON results file (default: bench_results.json)" << "\n";
+    std::cout << "\n";
+    std::cout << "Example:" << "\n";
+    std::cout << "  " << program_name << " --index data/sift_index --queries data/dataset/siftsmall_query.fvecs \\" << "\n";
+    std::cout << "    --threads 1,4 --k 10,100 --selectivity 0.001,0.01,0.1 --label v1.2 -o bench.json" << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string index_dir;
+    std::string queries_path;
+    std::string groundtruth_path;
+    std::string qrange_path;
+    std::string output_path = "bench_results.json";
+    std::string label;
+    int num_queries = -1;
+    std::vector<std::string> modes = {"disk", "memory"};
+    std::vector<int> thread_counts = {1, 0};
+    std::vector<int> k_values = {10};
+    std::vector<double> selectivities = {0.01, 0.1, 1.0};
+    int warmup = 1;
+    int repeat = 3;
+    unsigned seed = 42;
+    bool use_mmap = false;
+    bool use_prune = false;
+
+    auto to_int = [](const std::string& s) { return std::atoi(s.c_str()); };
+    auto to_double = [](const std::string& s) { return std::atof(s.c_str()); };
+    auto to_string = [](const std::string& s) { return s; };
+
+    // Parse command line flags
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if ((arg == "--index" || arg == "-i") && i + 1 < argc) {
+            index_dir = argv[++i];
+        } else if ((arg == "--queries" || arg == "-q") && i + 1 < argc) {
+            queries_path = argv[++i];
+        } else if (arg == "--groundtruth" && i + 1 < argc) {
+            groundtruth_path = argv[++i];
+        } else if (arg == "--qrange-path" && i + 1 < argc) {
+            qrange_path = argv[++i];
+        } else if (arg == "--num-queries" && i + 1 < argc) {
+            num_queries = std::atoi(argv[++i]);
+        } else if (arg == "--modes" && i + 1 < argc) {
+            modes = parse_list<std::string>(argv[++i], to_string);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            thread_counts = parse_list<int>(argv[++i], to_int);
+        } else if (arg == "--k" && i + 1 < argc) {
+            k_values = parse_list<int>(argv[++i], to_int);
+        } else if (arg == "--selectivity" && i + 1 < argc) {
+            selectivities = parse_list<double>(argv[++i], to_double);
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--mmap") {
+            use_mmap = true;
+        } else if (arg == "--prune") {
+            use_prune = true;
+        } else if (arg == "--label" && i + 1 < argc) {
+            label = argv[++i];
+        } else if ((arg == "--output" || arg == "-o") && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (index_dir.empty() || queries_path.empty()) {
+        std::cerr << "Error: Missing required --index or --queries flag" << "\n";
+        print_usage(argv[0]);
+        return 1;
+    }
+    for (const std::string& mode : modes) {
+        if (mode != "disk" && mode != "memory") {
+            std::cerr << "Error: Unknown mode '" << mode << "' (expected disk or memory)" << "\n";
+            return 1;
+        }
+    }
+    for (int& threads : thread_counts) {
+        if (threads <= 0) threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+    k_values.erase(std::remove_if(k_values.begin(), k_values.end(), [](int k) { return k <= 0; }), k_values.end());
+    for (double s : selectivities) {
+        if (s <= 0.0 || s > 1.0) {
+            std::cerr << "Error: --selectivity values must be in (0.0, 1.0]" << "\n";
+            return 1;
+        }
+    }
+    if (k_values.empty() || thread_counts.empty() || modes.empty()) {
+        std::cerr << "Error: --modes, --threads and --k need at least one value" << "\n";
+        return 1;
+    }
+
+    IndexDirectory idx_dir(index_dir);
+    if (!idx_dir.index_exists()) {
+        std::cerr << "Error: Index file not found: " << idx_dir.get_index_file_path() << "\n";
+        return 1;
+    }
+
+    std::vector<std::vector<float>> queries = load_fvecs_queries(queries_path);
+    if (queries.empty()) {
+        std::cerr << "Error: No queries loaded from " << queries_path << "\n";
+        return 1;
+    }
+    if (num_queries > 0 && num_queries < static_cast<int>(queries.size())) queries.resize(num_queries);
+    const size_t query_count = queries.size();
+
+    Logger::init(index_dir, "bench");
+    Logger::set_log_level(LogLevel::INFO);
+
+    DiskBPlusTree dataTree(idx_dir.get_index_file_path());
+    if (use_prune && !dataTree.loadLeafSummaries()) {
+        std::cerr << "Warning: no usable leaf summaries (build with --leaf-summaries), scanning every leaf" << "\n";
+        use_prune = false;
+    }
+    if (use_mmap) {
+        use_mmap = dataTree.mapIndex();
+        use_mmap = dataTree.mapVectors() || use_mmap;
+        if (!use_mmap) std::cerr << "Warning: failed to memory-map the index, using file reads" << "\n";
+    }
+
+    const std::pair<int, int> key_range = dataTree.get_key_range();
+    if (key_range.first > key_range.second) {
+        std::cerr << "Error: Index is empty" << "\n";
+        return 1;
+    }
+    const uint64_t total_vectors = dataTree.count_range(key_range.first, key_range.second);
+
+    // Workloads: the --qrange-path ranges, then one random placement per selectivity
+    std::vector<Workload> workloads;
+    if (!qrange_path.empty()) {
+        Workload file;
+        file.name = "file";
+        file.ranges = read_qrange_json(qrange_path, static_cast<int>(query_count));
+        if (file.ranges.size() < query_count) {
+            std::cerr << "Error: " << qrange_path << " has " << file.ranges.size() << " ranges for "
+                      << query_count << " queries" << "\n";
+            return 1;
+        }
+        if (!groundtruth_path.empty()) {
+            file.groundtruth = load_ivecs_groundtruth(groundtruth_path);
+            if (file.groundtruth.size() < query_count) {
+                std::cerr << "Warning: groundtruth covers " << file.groundtruth.size() << " of " << query_count
+                          << " queries, measuring recall against an exact search" << "\n";
+                file.groundtruth.clear();
+            }
+        }
+        workloads.push_back(std::move(file));
+    } else if (!groundtruth_path.empty()) {
+        std::cerr << "Warning: --groundtruth needs --qrange-path, ignoring it" << "\n";
+    }
+    const long long key_span = static_cast<long long>(key_range.second) - key_range.first + 1;
+    for (double s : selectivities) {
+        Workload w;
+        std::ostringstream name;
+        name << s;
+        w.name = name.str();
+        w.selectivity = s;
+        const long long width = std::max(1LL, static_cast<long long>(std::llround(s * key_span)));
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<long long> start(key_range.first, key_range.second - width + 1);
+        for (size_t q = 0; q < query_count; q++) {
+            long long lo = start(rng);
+            w.ranges.push_back({static_cast<int>(lo), static_cast<int>(lo + width - 1)});
+        }
+        workloads.push_back(std::move(w));
+    }
+    for (Workload& w : workloads) {
+        w.ranges.resize(query_count);
+        double in_range = 0.0;
+        for (const auto& range : w.ranges) in_range += dataTree.count_range(range.first, range.second);
+        w.avg_vectors_in_range = in_range / query_count;
+    }
+
+    std::cout << "=== RFANN B+ Tree Bench ===" << "\n";
+    std::cout << "Index: " << index_dir << " (" << total_vectors << " vectors, keys [" << key_range.first
+              << ", " << key_range.second << "])" << "\n";
+    std::cout << "Queries: " << query_count << " | Warmup: " << warmup << " | Repeat: " << repeat
+              << " | Kernel: " << get_l2_sqr_kernel_name()
+              << (has_fixed_l2_sqr_kernel(dataTree.getMaxVectorSize()) ? " (fixed dim)" : "") << "\n";
+    std::cout << "\n";
+    std::cout << std::left << std::setw(8) << "mode" << std::setw(10) << "range" << std::setw(6) << "K"
+              << std::setw(9) << "threads" << std::right << std::setw(9) << "recall" << std::setw(11) << "QPS"
+              << std::setw(11) << "p50 us" << std::setw(11) << "p95 us" << std::setw(11) << "p99 us" << "\n";
+
+    nlohmann::ordered_json results = nlohmann::ordered_json::array();
+    bool memory_loaded = false;
+    double memory_load_ms = 0.0;
+    std::vector<KNNResult> hits;
+
+    for (const Workload& w : workloads) {
+        for (int k : k_values) {
+            // Reference ids for recall: the groundtruth when it is at least K deep, otherwise an
+            // exact single-threaded scan
+            bool groundtruth_deep_enough = !w.groundtruth.empty();
+            for (const auto& row : w.groundtruth) {
+                if (static_cast<int>(row.size()) < k) groundtruth_deep_enough = false;
+            }
+            std::vector<std::vector<int32_t>> reference;
+            if (groundtruth_deep_enough) {
+                reference = w.groundtruth;
+            } else {
+                reference.resize(query_count);
+                for (size_t q = 0; q < query_count; q++) {
+                    dataTree.search_knn_into(queries[q], w.ranges[q].first, w.ranges[q].second, k, hits, memory_loaded);
+                    for (const KNNResult& hit : hits) reference[q].push_back(hit.original_id);
+                }
+            }
+
+            for (const std::string& mode : modes) {
+                const bool use_memory_index = mode == "memory";
+                if (use_memory_index && !memory_loaded) {
+                    auto load_start = std::chrono::steady_clock::now();
+                    memory_loaded = dataTree.loadIntoMemory();
+                    auto load_end = std::chrono::steady_clock::now();
+                    memory_load_ms = std::chrono::duration<double, std::milli>(load_end - load_start).count();
+                    if (!memory_loaded) {
+                        std::cerr << "Error: Failed to load the index into memory" << "\n";
+                        return 1;
+                    }
+                }
+
+                for (int threads : thread_counts) {
+                    // Latency per query: from its lookup hook (right before the search) to on_result
+                    std::vector<std::chrono::steady_clock::time_point> started(query_count);
+                    std::vector<long long> latencies_ns;
+                    latencies_ns.reserve(query_count * repeat);
+                    std::vector<long long> pass_ns(query_count);
+                    std::vector<std::vector<int>> retrieved(query_count);
+                    bool measured = false;
+
+                    KNNBatchHooks hooks;
+                    hooks.lookup = [&](size_t q) -> bool {
+                        started[q] = std::chrono::steady_clock::now();
+                        return false;
+                    };
+                    hooks.on_result = [&](size_t q, const std::vector<KNNResult>& result, bool, long long) {
+                        pass_ns[q] = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - started[q]).count();
+                        if (!measured) return;
+                        std::vector<int>& ids = retrieved[q];
+                        ids.clear();
+                        for (const KNNResult& hit : result) ids.push_back(hit.original_id);
+                    };
+
+                    for (int pass = 0; pass < warmup; pass++) {
+                        dataTree.search_knn_batch(queries, w.ranges, k, hooks, threads, use_memory_index);
+                    }
+                    measured = true;
+                    double wall_s = 0.0;
+                    for (int pass = 0; pass < repeat; pass++) {
+                        auto wall_start = std::chrono::steady_clock::now();
+                        dataTree.search_knn_batch(queries, w.ranges, k, hooks, threads, use_memory_index);
+                        wall_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+                        latencies_ns.insert(latencies_ns.end(), pass_ns.begin(), pass_ns.end());
+                    }
+
+                    // Queries with an empty reference count when they return nothing, as in search_index_test
+                    double recall_sum = 0.0;
+                    for (size_t q = 0; q < query_count; q++) {
+                        if (reference[q].empty()) {
+                            recall_sum += retrieved[q].empty() ? 1.0 : 0.0;
+                        } else {
+                            recall_sum += calculate_recall(retrieved[q], reference[q], k);
+                        }
+                    }
+                    const double recall = recall_sum / query_count;
+                    const double qps = wall_s > 0.0 ? query_count * repeat / wall_s : 0.0;
+                    LatencySummary latency = summarize(latencies_ns);
+
+                    std::cout << std::left << std::setw(8) << mode << std::setw(10) << w.name << std::setw(6) << k
+                              << std::setw(9) << threads << std::right << std::fixed << std::setprecision(4)
+                              << std::setw(9) << recall << std::setprecision(1) << std::setw(11) << qps
+                              << std::setw(11) << latency.p50_us << std::setw(11) << latency.p95_us
+                              << std::setw(11) << latency.p99_us << "\n";
+                    std::cout.unsetf(std::ios::fixed);
+
+                    nlohmann::ordered_json entry;
+                    entry["mode"] = mode;
+                    entry["workload"] = w.name;
+                    if (w.selectivity > 0) {
+                        entry["selectivity"] = w.selectivity;
+                    } else {
+                        entry["selectivity"] = nullptr;
+                    }
+                    entry["avg_vectors_in_range"] = w.avg_vectors_in_range;
+                    entry["k"] = k;
+                    entry["threads"] = threads;
+                    entry["queries"] = query_count;
+                    entry["recall_reference"] = groundtruth_deep_enough ? "groundtruth" : "exact_search";
+                    entry["recall"] = recall;
+                    entry["qps"] = qps;
+                    entry["latency_us"] = {
+                        {"mean", latency.mean_us}, {"p50", latency.p50_us}, {"p95", latency.p95_us},
+                        {"p99", latency.p99_us}, {"max", latency.max_us}};
+                    results.push_back(std::move(entry));
+                }
+            }
+        }
+    }
+
+    nlohmann::ordered_json report;
+    report["label"] = label;
+    report["timestamp"] = utc_timestamp();
+    report["index"] = {
+        {"path", index_dir}, {"vectors", total_vectors}, {"dimension", queries[0].size()},
+        {"min_key", key_range.first}, {"max_key", key_range.second}};
+    report["config"] = {
+        {"queries", queries_path}, {"num_queries", query_count}, {"warmup", warmup}, {"repeat", repeat},
+        {"seed", seed}, {"mmap", use_mmap}, {"prune", use_prune}, {"distance_kernel", get_l2_sqr_kernel_name()},
+        {"hardware_threads", std::thread::hardware_concurrency()}, {"memory_load_ms", memory_load_ms}};
+    report["results"] = std::move(results);
+
+    std::ofstream out(output_path);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot write results to " << output_path << "\n";
+        return 1;
+    }
+    out << report.dump(2) << "\n";
+    std::cout << "\n" << "Results written to " << output_path << "\n";
+    Logger::info("Bench results written to " + output_path);
+    return 0;
+}
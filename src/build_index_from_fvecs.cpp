@@ -1,4 +1,5 @@
 #include "bplustree_disk.h"
+#include "bulk_builder.h"
 #include "bptree_config.h"
 #include "DataObject.h"
 #include "index_directory.h"
@@ -22,6 +23,18 @@ void print_usage(const char* program_name) {
     std::cout << "  --order                  B+ tree order (default: auto-calculated based on vector dimension)" << "\n";
     std::cout << "  --batch-size             Number of vectors to read and process per chunk (default: 10000)" << "\n";
     std::cout << "  --max-cache-size         Maximum cache size in MB (default: 100)" << "\n";
+    std::cout << "  --bulk-load              Build bottom-up with a streaming sort: each leaf's vectors are written" << "\n";
+    std::cout << "                           as one contiguous block (inputs over --build-memory are sorted externally)" << "\n";
+    std::cout << "  --build-memory           Memory budget of --bulk-load in MB (default: 1024)" << "\n";
+    std::cout << "  --threads                Parse/sort threads of --bulk-load (default: 0 = all cores)" << "\n";
+    std::cout << "  --sq8                    Also write 8-bit quantized codes (<index>/index.bpt.vectors.sq8)" << "\n";
+    std::cout << "                           for search --sq8 (one byte per dimension)" << "\n";
+    std::cout << "  --leaf-summaries         Also write per-leaf centroid/radius summaries" << "\n";
+    std::cout << "                           (<index>/index.bpt.vectors.leafsum) for search --prune" << "\n";
+    std::cout << "  --graph                  Also build per-segment proximity graphs (<index>/index.bpt.vectors.graph)" << "\n";
+    std::cout << "                           for search --graph on wide ranges" << "\n";
+    std::cout << "  --graph-segment          Vectors per graph segment (default: 8192)" << "\n";
+    std::cout << "  --graph-degree           Neighbors per graph node (default: 32)" << "\n";
     std::cout << "  --label-path                  Path to label JSON file for RFANN mode (optional)" << "\n";
     std::cout << "                           Format: [42, 17, 99, ...] one integer per vector" << "\n";
     std::cout << "                           When set, vectors are sorted by attribute and the label" << "\n";
@@ -48,6 +61,14 @@ int main(int argc, char* argv[]) {
     bool has_input = false;
     bool has_index = false;
     bool has_label = false;
+    bool use_bulk_load = false;
+    size_t build_memory_mb = 1024;
+    int build_threads = 0;
+    bool build_sq8 = false;
+    bool build_leaf_summaries = false;
+    bool build_graphs = false;
+    size_t graph_segment = 8192;
+    uint32_t graph_degree = 32;
     // seperate vector storage: vectors are always stored separately (no inline storage option)
     size_t max_cache_size_mb = 100;
 
@@ -70,6 +91,22 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--max-cache-size" && i + 1 < argc) {
             max_cache_size_mb = std::stoull(argv[++i]);
             if (max_cache_size_mb == 0) max_cache_size_mb = 100;
+        } else if (arg == "--bulk-load") {
+            use_bulk_load = true;
+        } else if (arg == "--build-memory" && i + 1 < argc) {
+            build_memory_mb = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            build_threads = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--sq8") {
+            build_sq8 = true;
+        } else if (arg == "--leaf-summaries") {
+            build_leaf_summaries = true;
+        } else if (arg == "--graph") {
+            build_graphs = true;
+        } else if (arg == "--graph-segment" && i + 1 < argc) {
+            graph_segment = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--graph-degree" && i + 1 < argc) {
+            graph_degree = static_cast<uint32_t>(std::max(2, std::atoi(argv[++i])));
         } else if (arg == "--label-path" && i + 1 < argc) {
             label_path = argv[++i];
             has_label = true;
@@ -137,6 +174,19 @@ int main(int argc, char* argv[]) {
     std::cout << "Index file: " << idx_dir.get_index_file_path() << "\n";
     std::cout << "Cache: enabled (max " << max_cache_size_mb << " MB)" << "\n";
     std::cout << "Batch size: " << batch_size << " vectors" << "\n";
+    if (use_bulk_load) {
+        std::cout << "Bulk load: enabled (" << build_memory_mb << " MB, "
+                  << (build_threads > 0 ? std::to_string(build_threads) : std::string("auto")) << " threads)" << "\n";
+    } else {
+        std::cout << "Bulk load: disabled" << "\n";
+    }
+    std::cout << "SQ8 codes: " << (build_sq8 ? "enabled" : "disabled") << "\n";
+    std::cout << "Leaf summaries: " << (build_leaf_summaries ? "enabled" : "disabled") << "\n";
+    if (build_graphs) {
+        std::cout << "Segment graphs: " << graph_segment << " vectors per segment, degree " << graph_degree << "\n";
+    } else {
+        std::cout << "Segment graphs: disabled" << "\n";
+    }
     std::cout << "\n";
     std::cout << "B+ Tree Configuration:" << "\n";
     std::cout << "  Vector dimension: " << dimension << "\n";
@@ -161,28 +211,51 @@ int main(int argc, char* argv[]) {
 
     int vector_count = 0;
 
+    // Read label JSON: [42, 17, 99, ...]
+    std::vector<int> labels;
     if (has_label) {
-        // RFANN Mode: Load labels, read vectors in chunks, sort each chunk by label, insert
         std::cout << "RFANN Mode: Sorting vectors by label from " << label_path << "\n";
         Logger::info("RFANN Mode: reading labels from " + label_path);
+        std::ifstream label_file(label_path);
+        if (!label_file.is_open()) {
+            std::cerr << "Error: Cannot open label file: " << label_path << "\n";
+            file.close();
+            Logger::close();
+            return 1;
+        }
+        nlohmann::json j;
+        label_file >> j;
+        label_file.close();
+        labels = j.get<std::vector<int>>();
+        std::cout << "Loaded " << labels.size() << " labels" << "\n";
+    }
 
-        // Read label JSON: [42, 17, 99, ...]
-        std::vector<int> labels;
-        {
-            std::ifstream label_file(label_path);
-            if (!label_file.is_open()) {
-                std::cerr << "Error: Cannot open label file: " << label_path << "\n";
-                file.close();
-                Logger::close();
-                return 1;
-            }
-            nlohmann::json j;
-            label_file >> j;
-            label_file.close();
-            labels = j.get<std::vector<int>>();
+    if (use_bulk_load) {
+        // Bulk Mode: stream the file through a parallel (external) sort into the bottom-up loader
+        file.close();
+        BulkBuildOptions build_options;
+        build_options.memory_mb = build_memory_mb;
+        build_options.threads = build_threads;
+        build_options.temp_dir = index_dir;
+        BulkBuilder builder(dataTree, build_options);
+        bool built = false;
+        try {
+            built = builder.build(input_path, has_label ? &labels : nullptr);
+        } catch (const std::exception& e) {
+            std::cerr << "ERROR during bulk load: " << e.what() << "\n";
+            Logger::error("ERROR during bulk load: " + std::string(e.what()));
+        }
+        if (!built) {
+            Logger::error("Bulk load failed");
+            Logger::close();
+            return 1;
         }
+        vector_count = static_cast<int>(builder.vectorCount());
+        Logger::info("Bulk loaded " + std::to_string(vector_count) + " vectors in " +
+                     std::to_string(builder.runCount()) + " sorted run(s)");
+    } else if (has_label) {
+        // RFANN Mode: read vectors in chunks, sort each chunk by label, insert
         size_t total_labels = labels.size();
-        std::cout << "Loaded " << total_labels << " labels" << "\n";
 
         // Process vectors in chunks of batch_size
         size_t global_idx = 0;
@@ -321,6 +394,30 @@ int main(int argc, char* argv[]) {
     }
     Logger::info("Finished reading input file");
 
+    if (build_sq8) {
+        if (!dataTree.buildQuantizedStore()) {
+            std::cerr << "ERROR: failed to build SQ8 codes" << "\n";
+            Logger::error("Failed to build SQ8 codes");
+            Logger::close();
+            return 1;
+        }
+        Logger::info("Built SQ8 codes");
+    }
+
+    if (build_leaf_summaries && !dataTree.buildLeafSummaries()) {
+        std::cerr << "ERROR: failed to build leaf summaries" << "\n";
+        Logger::error("Failed to build leaf summaries");
+        Logger::close();
+        return 1;
+    }
+
+    if (build_graphs && !dataTree.buildSegmentGraphs(graph_segment, graph_degree)) {
+        std::cerr << "ERROR: failed to build segment graphs" << "\n";
+        Logger::error("Failed to build segment graphs");
+        Logger::close();
+        return 1;
+    }
+
     // End timing
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
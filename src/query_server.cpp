@@ -0,0 +1,673 @@
+#include "bplustree_disk.h"
+#include "DataObject.h"
+#include "index_directory.h"
+#include "query_cache.h"
+#include "logger.h"
+#include "distance.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <memory>
+#include <map>
+#include <set>
+#include <csignal>
+#include <cstring>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// Long-running query server: opens the index once (memory index, mmap, leaf summaries, cache)
+// and answers requests over a Unix socket. One request per line, one response per request:
+//   KNN <min> <max> <k> <v1,v2,...>   OK <n> <exact|similar|partial|search>, then n lines
+//                                       "<original_id> <key> <distance>" (nearest first)
+//   RANGE <min> <max> [limit]          OK <n>, then n lines "<original_id> <key>"
+//   STATS                              OK 1, then one line of counters
+//   PING                               OK 0
+//   QUIT                               closes the connection
+//   SHUTDOWN                           OK 0, then the server stops
+// Failures answer "ERR <message>". Requests of all connections go through one dispatcher,
+// which runs the KNN requests queued at the time as one search_knn_batch.
+
+// Parse comma-separated vector string into vector<float>
+std::vector<float> parse_vector(const std::string& str) {
+    std::vector<float> result;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        result.push_back(static_cast<float>(std::atof(item.c_str())));
+    }
+    return result;
+}
+
+void print_usage(const char* program_name) {
+    std::cout << "Usage: " << program_name << " --index <index_dir> [options]" << "\n";
+    std::cout << "\n";
+    std::cout << "Flags:" << "\n";
+    std::cout << "  --index, -i      Path to the index directory (required)" << "\n";
+    std::cout << "  --socket         Unix socket path (default: <index_dir>/query.sock)" << "\n";
+    std::cout << "  --threads        Concurrent queries per batch (0 = auto, default)" << "\n";
+    std::cout << "  --batch-size     Most KNN requests answered in one batch (default: 64)" << "\n";
+    std::cout << "  --batch-wait-us  Wait for more requests before a batch that is not full (default: 0)" << "\n";
+    std::cout << "  --no-cache       Disable query caching" << "\n";
+    std::cout << "  --memory-index   Load entire index into memory once at startup" << "\n";
+    std::cout << "  --buffer-pool    Cache up to <MB> of tree nodes in a bounded buffer pool (default: off)" << "\n";
+    std::cout << "  --prefetch       Leaves read ahead asynchronously on disk-path scans (default: 0 = off)" << "\n";
+    std::cout << "  --mmap           Memory-map index pages and vector store, read both in place (read-only)" << "\n";
+    std::cout << "  --prune          Skip leaves by their centroid/radius summaries (built with --leaf-summaries, exact)" << "\n";
+    std::cout << "  --vec-sim        Vector similarity threshold for cache matching [0.0-1.0] (default: 1.0 = exact)" << "\n";
+    std::cout << "  --range-sim      Range similarity threshold for cache matching [0.0-1.0] (default: 1.0 = exact)" << "\n";
+    std::cout << "\n";
+    std::cout << "Protocol (one request per line):" << "\n";
+    std::cout << "  KNN <min> <max> <k> <v1,v2,...> | RANGE <min> <max> [limit] | STATS | PING | QUIT | SHUTDOWN" << "\n";
+    std::cout << "\n";
+    std::cout << "Example:" << "\n";
+    std::cout << "  " << program_name << " --index data/sift_index --memory-index &" << "\n";
+    std::cout << "  echo 'KNN 0 1000 10 1,2,3' | nc -U data/sift_index/query.sock" << "\n";
+}
+
+#ifdef _WIN32
+
+int main(int argc, char* argv[]) {
+    (void)argc;
+    std::cerr << "Error: " << argv[0] << " needs Unix domain sockets, which this build does not support" << std::endl;
+    return 1;
+}
+
+#else
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+void handle_signal(int) {
+    g_stop = true;
+}
+
+// A parsed KNN or RANGE request waiting for the dispatcher
+struct Request {
+    enum class Type { KNN, Range } type = Type::KNN;
+    int min_key = 0;
+    int max_key = 0;
+    int k = 0;
+    int limit = -1;
+    std::vector<float> vector;
+    std::promise<std::string> response;
+};
+
+// Counters reported by STATS
+struct ServerStats {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> knn{0};
+    std::atomic<uint64_t> exact_hits{0};
+    std::atomic<uint64_t> similar_hits{0};
+    std::atomic<uint64_t> partial_hits{0};
+    std::atomic<uint64_t> searches{0};
+    std::atomic<uint64_t> range{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> connections{0};
+};
+
+class RequestQueue {
+public:
+    void push(std::shared_ptr<Request> request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_) {
+                // the dispatcher may already have drained the queue
+                request->response.set_value("ERR server shutting down\n");
+                return;
+            }
+            pending_.push_back(std::move(request));
+        }
+        cv_.notify_one();
+    }
+
+    // Block for the next batch: whatever is queued, up to max_size, after waiting up to wait_us
+    // for it to fill; empty once stopped
+    std::vector<std::shared_ptr<Request>> pop_batch(size_t max_size, long long wait_us) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return stopped_ || !pending_.empty(); });
+        if (wait_us > 0 && pending_.size() < max_size) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(wait_us);
+            cv_.wait_until(lock, deadline, [&] { return stopped_ || pending_.size() >= max_size; });
+        }
+        std::vector<std::shared_ptr<Request>> batch;
+        while (!pending_.empty() && batch.size() < max_size) {
+            batch.push_back(std::move(pending_.front()));
+            pending_.pop_front();
+        }
+        return batch;
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    // Requests left when the dispatcher stopped
+    std::deque<std::shared_ptr<Request>> drain() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::deque<std::shared_ptr<Request>> left;
+        left.swap(pending_);
+        return left;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Request>> pending_;
+    bool stopped_ = false;
+};
+
+struct ServerOptions {
+    bool cache_enabled = true;
+    bool use_memory_index = false;
+    int num_threads = 0;
+    size_t batch_size = 64;
+    long long batch_wait_us = 0;
+    double vec_sim_threshold = 1.0;
+    double range_sim_threshold = 1.0;
+};
+
+// Owns the tree: every search runs on the dispatcher thread (search_knn_batch fans out itself)
+class Dispatcher {
+public:
+    Dispatcher(DiskBPlusTree& tree, QueryCache& cache, const ServerOptions& options,
+               RequestQueue& queue, ServerStats& stats)
+        : tree_(tree), cache_(cache), options_(options), queue_(queue), stats_(stats) {}
+
+    void run() {
+        while (true) {
+            std::vector<std::shared_ptr<Request>> batch = queue_.pop_batch(options_.batch_size, options_.batch_wait_us);
+            if (batch.empty()) break;
+            stats_.batches++;
+
+            // KNN requests grouped by K (one search_knn_batch each); ranges one by one
+            std::map<int, std::vector<std::shared_ptr<Request>>> knn_by_k;
+            for (auto& request : batch) {
+                if (request->type == Request::Type::KNN) {
+                    knn_by_k[request->k].push_back(request);
+                } else {
+                    answer_range(*request);
+                }
+            }
+            for (auto& group : knn_by_k) answer_knn(group.first, group.second);
+        }
+        for (auto& request : queue_.drain()) request->response.set_value("ERR server shutting down\n");
+    }
+
+private:
+    DiskBPlusTree& tree_;
+    QueryCache& cache_;
+    const ServerOptions& options_;
+    RequestQueue& queue_;
+    ServerStats& stats_;
+
+    static void append_neighbors(std::ostringstream& out, const std::vector<CachedNeighbor>& neighbors) {
+        for (const CachedNeighbor& neighbor : neighbors) {
+            out << neighbor.original_id << " " << neighbor.key << " " << neighbor.distance << "\n";
+        }
+    }
+
+    void answer_range(Request& request) {
+        stats_.range++;
+        std::vector<DataObject*> results = tree_.search_range(request.min_key, request.max_key, options_.use_memory_index);
+        size_t count = results.size();
+        if (request.limit >= 0) count = std::min(count, static_cast<size_t>(request.limit));
+        std::ostringstream out;
+        out << "OK " << count << "\n";
+        for (size_t i = 0; i < count; i++) {
+            const DataObject* obj = results[i];
+            int key = obj->is_int_value() ? obj->get_int_value() : static_cast<int>(obj->get_float_value());
+            out << obj->get_id() << " " << key << "\n";
+        }
+        for (DataObject* obj : results) delete obj;
+        request.response.set_value(out.str());
+    }
+
+    void answer_knn(int k, std::vector<std::shared_ptr<Request>>& requests) {
+        // Per-request state, filled by the batch hooks (each request is handled by one worker)
+        struct State {
+            std::string query_hash;
+            std::string used_similar_query_id;
+            bool partial_hit = false;
+            std::vector<CachedNeighbor> cover_neighbors;
+        };
+        std::vector<State> states(requests.size());
+        std::vector<std::vector<float>> queries(requests.size());
+        std::vector<std::pair<int, int>> ranges(requests.size());
+        for (size_t i = 0; i < requests.size(); i++) {
+            queries[i] = std::move(requests[i]->vector);
+            ranges[i] = {requests[i]->min_key, requests[i]->max_key};
+        }
+        stats_.knn += requests.size();
+
+        KNNBatchHooks hooks;
+        hooks.lookup = [&](size_t q) -> bool {
+            State& st = states[q];
+            st.query_hash = cache_.compute_query_hash(queries[q], ranges[q].first, ranges[q].second);
+            if (!options_.cache_enabled) return false;
+
+            SimilarCacheMatch match = cache_.find_similar_cached_result(
+                queries[q], ranges[q].first, ranges[q].second, k,
+                SimilarityThresholds(options_.vec_sim_threshold, options_.range_sim_threshold));
+            if (!match.found) return false;
+
+            const bool exact = match.vector_similarity >= 1.0 && match.range_similarity >= 1.0;
+            (exact ? stats_.exact_hits : stats_.similar_hits)++;
+            cache_.store_result(st.query_hash, queries[q], ranges[q].first, ranges[q].second,
+                                k, match.result.neighbors, match.query_id);  // touches the match
+            std::ostringstream out;
+            out << "OK " << match.result.neighbors.size() << (exact ? " exact" : " similar") << "\n";
+            append_neighbors(out, match.result.neighbors);
+            requests[q]->response.set_value(out.str());
+            return true;
+        };
+
+        // Partial reuse: cached sub-ranges of the same query narrow the search to the uncovered keys
+        hooks.narrow = [&](size_t q, std::vector<std::pair<int, int>>& intervals) -> bool {
+            if (!options_.cache_enabled) return false;
+            RangeCoverMatch cover = cache_.find_range_cover(queries[q], ranges[q].first, ranges[q].second, k);
+            if (!cover.found) return false;
+            states[q].partial_hit = true;
+            states[q].cover_neighbors = std::move(cover.neighbors);
+            intervals = std::move(cover.residual);
+            stats_.partial_hits++;
+            return true;
+        };
+
+        hooks.on_result = [&](size_t q, const std::vector<KNNResult>& hits, bool searched, long long) {
+            if (!searched) return;  // answered by lookup
+            State& st = states[q];
+            if (!st.partial_hit) stats_.searches++;
+
+            std::vector<CachedNeighbor> neighbors;
+            neighbors.reserve(hits.size());
+            for (const KNNResult& hit : hits) {
+                CachedNeighbor neighbor;
+                if (options_.cache_enabled) tree_.get_result_vector(hit, neighbor.vector);
+                neighbor.key = hit.key;
+                neighbor.original_id = hit.original_id;
+                neighbor.distance = std::sqrt(hit.distance);
+                neighbors.push_back(std::move(neighbor));
+            }
+            if (st.partial_hit) {
+                // hits only cover the residual intervals
+                QueryCache::merge_neighbors(st.cover_neighbors, neighbors, k);
+                neighbors.swap(st.cover_neighbors);
+            }
+
+            std::ostringstream out;
+            out << "OK " << neighbors.size() << (st.partial_hit ? " partial" : " search") << "\n";
+            append_neighbors(out, neighbors);
+            requests[q]->response.set_value(out.str());
+
+            if (options_.cache_enabled && !neighbors.empty()) {
+                cache_.store_result(st.query_hash, queries[q], ranges[q].first, ranges[q].second, k, neighbors);
+            }
+        };
+
+        tree_.search_knn_batch(queries, ranges, k, hooks, options_.num_threads, options_.use_memory_index);
+    }
+};
+
+bool write_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t put = ::send(fd, data.data() + sent, data.size() - sent, 0);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        sent += static_cast<size_t>(put);
+    }
+    return true;
+}
+
+// Parse one request line; returns a response for requests answered here (or on errors), an
+// empty string once request is set for the dispatcher. KNN vectors must have dim elements.
+std::string parse_request(const std::string& line, std::shared_ptr<Request>& request, bool& quit,
+                          ServerStats& stats, size_t dim) {
+    std::istringstream in(line);
+    std::string command;
+    in >> command;
+    std::transform(command.begin(), command.end(), command.begin(), ::toupper);
+
+    if (command == "PING") return "OK 0\n";
+    if (command == "QUIT") {
+        quit = true;
+        return std::string();
+    }
+    if (command == "SHUTDOWN") {
+        g_stop = true;
+        quit = true;
+        return "OK 0\n";
+    }
+    if (command == "STATS") {
+        std::ostringstream out;
+        out << "OK 1\n"
+            << "requests=" << stats.requests << " batches=" << stats.batches << " knn=" << stats.knn
+            << " exact_hits=" << stats.exact_hits << " similar_hits=" << stats.similar_hits
+            << " partial_hits=" << stats.partial_hits << " searches=" << stats.searches
+            << " range=" << stats.range << " errors=" << stats.errors
+            << " connections=" << stats.connections << "\n";
+        return out.str();
+    }
+
+    auto made = std::make_shared<Request>();
+    if (command == "KNN") {
+        std::string vector_str;
+        if (!(in >> made->min_key >> made->max_key >> made->k >> vector_str)) {
+            return "ERR usage: KNN <min> <max> <k> <v1,v2,...>\n";
+        }
+        if (made->k <= 0) return "ERR K must be a positive integer\n";
+        made->type = Request::Type::KNN;
+        made->vector = parse_vector(vector_str);
+        if (made->vector.empty()) return "ERR empty query vector\n";
+        if (made->vector.size() != dim) {
+            return "ERR query has " + std::to_string(made->vector.size()) + " dimensions, index has " +
+                   std::to_string(dim) + "\n";
+        }
+    } else if (command == "RANGE") {
+        if (!(in >> made->min_key >> made->max_key)) return "ERR usage: RANGE <min> <max> [limit]\n";
+        if (!(in >> made->limit)) made->limit = -1;
+        made->type = Request::Type::Range;
+    } else if (command.empty()) {
+        return "ERR empty request\n";
+    } else {
+        return "ERR unknown command: " + command + "\n";
+    }
+    if (made->min_key > made->max_key) return "ERR min must be less than or equal to max\n";
+    request = std::move(made);
+    return std::string();
+}
+
+void serve_connection(int fd, RequestQueue& queue, ServerStats& stats, size_t dim) {
+    std::string buffer;
+    char chunk[1 << 16];
+    bool quit = false;
+    while (!quit) {
+        ssize_t got = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        buffer.append(chunk, static_cast<size_t>(got));
+
+        size_t start = 0, end;
+        while (!quit && (end = buffer.find('\n', start)) != std::string::npos) {
+            std::string line = buffer.substr(start, end - start);
+            start = end + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            stats.requests++;
+
+            std::shared_ptr<Request> request;
+            std::string response = parse_request(line, request, quit, stats, dim);
+            if (request) {
+                std::future<std::string> result = request->response.get_future();
+                queue.push(std::move(request));
+                response = result.get();
+            }
+            if (response.compare(0, 3, "ERR") == 0) stats.errors++;
+            if (!response.empty() && !write_all(fd, response)) quit = true;
+        }
+        buffer.erase(0, start);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string index_dir;
+    std::string socket_path;
+    bool has_index = false;
+    ServerOptions options;
+    bool use_mmap = false;
+    bool use_prune = false;
+    size_t buffer_pool_mb = 0;
+    size_t prefetch_window = 0;
+
+    // Parse command line flags
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if ((arg == "--index" || arg == "-i") && i + 1 < argc) {
+            index_dir = argv[++i];
+            has_index = true;
+        } else if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.num_threads = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--batch-size" && i + 1 < argc) {
+            options.batch_size = static_cast<size_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--batch-wait-us" && i + 1 < argc) {
+            options.batch_wait_us = std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--no-cache") {
+            options.cache_enabled = false;
+        } else if (arg == "--memory-index") {
+            options.use_memory_index = true;
+        } else if (arg == "--mmap") {
+            use_mmap = true;
+        } else if (arg == "--prune") {
+            use_prune = true;
+        } else if (arg == "--buffer-pool" && i + 1 < argc) {
+            buffer_pool_mb = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--prefetch" && i + 1 < argc) {
+            prefetch_window = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--vec-sim" && i + 1 < argc) {
+            options.vec_sim_threshold = std::atof(argv[++i]);
+            if (options.vec_sim_threshold < 0.0 || options.vec_sim_threshold > 1.0) {
+                std::cerr << "Error: --vec-sim must be between 0.0 and 1.0" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--range-sim" && i + 1 < argc) {
+            options.range_sim_threshold = std::atof(argv[++i]);
+            if (options.range_sim_threshold < 0.0 || options.range_sim_threshold > 1.0) {
+                std::cerr << "Error: --range-sim must be between 0.0 and 1.0" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage(argv[0]);
+            return 0;
+        }
+    }
+
+    if (!has_index) {
+        std::cerr << "Error: Missing required --index flag" << std::endl;
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    IndexDirectory idx_dir(index_dir);
+    if (!idx_dir.index_exists()) {
+        std::cerr << "Error: Index file not found: " << idx_dir.get_index_file_path() << std::endl;
+        return 1;
+    }
+    if (socket_path.empty()) socket_path = idx_dir.get_base_dir() + "/query.sock";
+
+    // Check index cache configuration - this overrides command line --no-cache
+    if (options.cache_enabled && !idx_dir.read_cache_config()) {
+        std::cout << "Note: Index was created with --no-cache, disabling cache for this server." << std::endl;
+        options.cache_enabled = false;
+    }
+
+    // Initialize logging
+    Logger::init(index_dir, "server");
+    Logger::set_log_level(LogLevel::INFO);
+
+    DiskBPlusTree dataTree(idx_dir.get_index_file_path());
+    QueryCache cache(idx_dir.get_base_dir(), options.cache_enabled);
+    if (options.cache_enabled) {
+        cache.load_config(idx_dir.get_config_file_path());
+    }
+
+    if (use_prune) {
+        if (dataTree.loadLeafSummaries()) {
+            std::cout << "Leaf summaries loaded" << std::endl;
+        } else {
+            std::cerr << "Warning: no usable leaf summaries (build with --leaf-summaries), scanning every leaf" << std::endl;
+            use_prune = false;
+        }
+    }
+
+    // Everything is loaded once; requests then only pay for their search
+    if (options.use_memory_index) {
+        std::cout << "Loading index into memory..." << std::endl;
+        auto load_start = std::chrono::high_resolution_clock::now();
+        dataTree.loadIntoMemory();
+        auto load_end = std::chrono::high_resolution_clock::now();
+        auto load_duration = std::chrono::duration_cast<std::chrono::milliseconds>(load_end - load_start);
+        std::cout << "Index loaded into memory in " << load_duration.count() << " ms" << std::endl;
+    }
+
+    dataTree.setPrefetchWindow(prefetch_window);
+
+    if (buffer_pool_mb > 0) {
+        dataTree.enableBufferPool(buffer_pool_mb);
+        std::cout << "Buffer pool: " << buffer_pool_mb << " MB (" << dataTree.getBufferPoolStats().capacity << " nodes)" << std::endl;
+    }
+
+    if (use_mmap) {
+        if (dataTree.mapIndex()) {
+            std::cout << "Index pages memory-mapped" << std::endl;
+        } else {
+            std::cerr << "Warning: failed to memory-map index pages, using file reads" << std::endl;
+        }
+        if (dataTree.mapVectors()) {
+            std::cout << "Vector store memory-mapped" << std::endl;
+        } else {
+            std::cerr << "Warning: failed to memory-map vector store, using file reads" << std::endl;
+        }
+        use_mmap = dataTree.isIndexMapped() || dataTree.isVectorStoreMapped();
+    }
+
+    // Listen on the socket (a stale socket file from a killed server is replaced)
+    sockaddr_un addr{};
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: Socket path too long: " << socket_path << std::endl;
+        return 1;
+    }
+    addr.sun_family = AF_UNIX;
+    std::copy(socket_path.begin(), socket_path.end(), addr.sun_path);
+
+    struct stat existing;
+    if (::stat(socket_path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << "Error: " << socket_path << " exists and is not a socket" << std::endl;
+            return 1;
+        }
+        ::unlink(socket_path.c_str());
+    }
+
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 ||
+        ::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd, 64) != 0) {
+        std::cerr << "Error: Cannot listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        if (listen_fd >= 0) ::close(listen_fd);
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    std::ostringstream config_log;
+    config_log << "Server configuration | Socket: " << socket_path
+               << " | Cache: " << (options.cache_enabled ? "enabled" : "disabled")
+               << " | Memory Index: " << (options.use_memory_index ? "enabled" : "disabled")
+               << " | Mmap: " << (use_mmap ? "enabled" : "disabled")
+               << " | Leaf pruning: " << (use_prune ? "enabled" : "disabled")
+               << " | Threads: " << options.num_threads
+               << " | Batch: " << options.batch_size << " (wait " << options.batch_wait_us << " us)"
+               << " | Buffer pool: " << buffer_pool_mb << " MB"
+               << " | Prefetch: " << prefetch_window << " leaves"
+               << " | Distance kernel: " << get_l2_sqr_kernel_name()
+               << (has_fixed_l2_sqr_kernel(dataTree.getMaxVectorSize()) ? " (fixed dim)" : "");
+    Logger::log_config(config_log.str());
+    std::cout << "Listening on " << socket_path << std::endl;
+
+    RequestQueue queue;
+    ServerStats stats;
+    Dispatcher dispatcher(dataTree, cache, options, queue, stats);
+    const size_t dim = dataTree.getMaxVectorSize();
+    std::thread dispatch_thread([&] { dispatcher.run(); });
+
+    // Accept until SIGINT/SIGTERM or SHUTDOWN; one detached thread per connection, which closes
+    // its descriptor under connections_mutex (so shutdown never touches a reused number)
+    std::mutex connections_mutex;
+    std::condition_variable connections_closed;
+    std::set<int> open_fds;
+    auto close_connection = [&](int fd) {
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        open_fds.erase(fd);
+        ::close(fd);
+        connections_closed.notify_all();
+    };
+    while (!g_stop) {
+        pollfd pfd{listen_fd, POLLIN, 0};
+        int ready = ::poll(&pfd, 1, 200);
+        if (ready <= 0) continue;
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        stats.connections++;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            open_fds.insert(fd);
+        }
+        try {
+            std::thread([&, fd] {
+                serve_connection(fd, queue, stats, dim);
+                close_connection(fd);
+            }).detach();
+        } catch (const std::system_error& e) {
+            Logger::error(std::string("Cannot start connection thread: ") + e.what());
+            close_connection(fd);
+        }
+    }
+
+    std::cout << "Shutting down..." << std::endl;
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+    {
+        // Wake connections blocked in recv
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        for (int fd : open_fds) ::shutdown(fd, SHUT_RDWR);
+    }
+    queue.stop();
+    dispatch_thread.join();
+    {
+        std::unique_lock<std::mutex> lock(connections_mutex);
+        connections_closed.wait(lock, [&] { return open_fds.empty(); });
+    }
+
+    std::ostringstream summary;
+    summary << "Server stopped | Requests: " << stats.requests << " | Batches: " << stats.batches
+            << " | KNN: " << stats.knn << " (exact " << stats.exact_hits << ", similar " << stats.similar_hits
+            << ", partial " << stats.partial_hits << ", searched " << stats.searches << ")"
+            << " | Range: " << stats.range;
+    Logger::info(summary.str());
+    std::cout << summary.str() << std::endl;
+    return 0;
+}
+
+#endif
@@ -127,17 +127,11 @@ int main(int argc, char* argv[]) {
             return 0;
         }
         
-        // Get all cache files
-        std::vector<std::string> cache_files;
-        for (const auto& entry : fs::directory_iterator(cache_dir)) {
-            if (entry.is_regular_file() && entry.path().extension() == ".qcache") {
-                std::string filename = entry.path().stem().string();
-                cache_files.push_back(filename);
-            }
-        }
+        // Cached queries, most recently used first
+        std::vector<std::string> cache_files = cache.list_query_ids();
         
         if (cache_files.empty()) {
-            std::cout << "No cache files found in: " << cache_dir << std::endl;
+            std::cout << "No cached queries found in: " << cache_dir << std::endl;
             return 0;
         }
         
@@ -145,6 +139,7 @@ int main(int argc, char* argv[]) {
         std::cout << "Index directory: " << index_dir << std::endl;
         std::cout << "Cache directory: " << cache_dir << std::endl;
         std::cout << "Total cached queries: " << cache_files.size() << std::endl;
+        std::cout << "Cache size: " << (cache.get_cache_size() / 1024.0) << " KB" << std::endl;
         std::cout << std::endl;
         
         if (has_specific_query) {
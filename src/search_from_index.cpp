@@ -2,7 +2,9 @@
 #include "DataObject.h"
 #include "index_directory.h"
 #include "query_cache.h"
+#include "query_planner.h"
 #include "logger.h"
+#include "distance.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -14,13 +16,7 @@
 
 // Calculate Euclidean distance between two vectors
 double calculate_distance(const std::vector<float>& v1, const std::vector<float>& v2) {
-    double sum = 0.0;
-    size_t min_size = std::min(v1.size(), v2.size());
-    for (size_t i = 0; i < min_size; i++) {
-        double diff = static_cast<double>(v1[i]) - static_cast<double>(v2[i]);
-        sum += diff * diff;
-    }
-    return std::sqrt(sum);
+    return std::sqrt(static_cast<double>(l2_sqr(v1, v2)));
 }
 
 // Parse comma-separated vector string like "1.0,2.0,3.0" into vector<float>
@@ -48,7 +44,17 @@ void print_usage(const char* program_name) {
     std::cout << "  --no-cache    Disable query caching" << std::endl;
     std::cout << "  --parallel    Enable parallel KNN search (auto-detects optimal thread count)" << std::endl;
     std::cout << "  --threads     Number of threads for parallel search (0 = auto, default)" << std::endl;
+    std::cout << "  --auto        Plan each KNN query: cache reuse, single-threaded or parallel scan" << std::endl;
+    std::cout << "                (from the estimated vectors in range; --threads caps the thread count)" << std::endl;
     std::cout << "  --memory-index  Load entire index into memory before searching (faster for multiple queries)" << std::endl;
+    std::cout << "  --buffer-pool Cache up to <MB> of tree nodes in a bounded buffer pool (default: off)" << std::endl;
+    std::cout << "  --prefetch    Leaves read ahead asynchronously on disk-path scans (default: 0 = off)" << std::endl;
+    std::cout << "  --mmap        Memory-map index pages and vector store, read both in place (read-only)" << std::endl;
+    std::cout << "  --sq8         Scan 8-bit quantized codes (built with build_index_fvecs --sq8), re-rank exactly" << std::endl;
+    std::cout << "  --rerank      Candidates re-ranked per neighbor with --sq8 (default: 4)" << std::endl;
+    std::cout << "  --prune       Skip leaves by their centroid/radius summaries (built with --leaf-summaries, exact)" << std::endl;
+    std::cout << "  --graph       Search segments inside the range through their graphs (built with --graph), scan the edges" << std::endl;
+    std::cout << "  --ef          Graph search beam width with --graph (default: 64)" << std::endl;
     std::cout << "  --vec-sim     Vector similarity threshold for cache matching [0.0-1.0] (default: 1.0 = exact)" << std::endl;
     std::cout << "  --range-sim   Range similarity threshold for cache matching [0.0-1.0] (default: 1.0 = exact)" << std::endl;
     std::cout << std::endl;
@@ -85,6 +91,15 @@ int main(int argc, char* argv[]) {
     bool has_k = false;
     bool cache_enabled = true;
     bool use_memory_index = false;
+    bool auto_plan = false;
+    bool use_mmap = false;
+    bool use_sq8 = false;
+    bool use_prune = false;
+    bool use_graph = false;
+    int graph_ef = 64;
+    int rerank_factor = 4;
+    size_t buffer_pool_mb = 0;
+    size_t prefetch_window = 0;
     double vec_sim_threshold = 1.0;   // Default: exact match only
     double range_sim_threshold = 1.0; // Default: exact match only
 
@@ -119,8 +134,26 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--threads" && i + 1 < argc) {
             num_threads = std::atoi(argv[++i]);
             use_parallel = true;  // Implicitly enable parallel if threads specified
+        } else if (arg == "--auto") {
+            auto_plan = true;
         } else if (arg == "--memory-index") {
             use_memory_index = true;
+        } else if (arg == "--mmap") {
+            use_mmap = true;
+        } else if (arg == "--sq8") {
+            use_sq8 = true;
+        } else if (arg == "--prune") {
+            use_prune = true;
+        } else if (arg == "--graph") {
+            use_graph = true;
+        } else if (arg == "--ef" && i + 1 < argc) {
+            graph_ef = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--rerank" && i + 1 < argc) {
+            rerank_factor = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--buffer-pool" && i + 1 < argc) {
+            buffer_pool_mb = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--prefetch" && i + 1 < argc) {
+            prefetch_window = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
         } else if (arg == "--vec-sim" && i + 1 < argc) {
             vec_sim_threshold = std::atof(argv[++i]);
             if (vec_sim_threshold < 0.0 || vec_sim_threshold > 1.0) {
@@ -199,6 +232,36 @@ int main(int argc, char* argv[]) {
         cache.load_config(idx_dir.get_config_file_path());
     }
 
+    // Quantized codes first, so loadIntoMemory can leave the full vectors on disk
+    if (use_sq8) {
+        if (dataTree.loadQuantizedStore()) {
+            dataTree.setQuantizedRerank(rerank_factor);
+            std::cout << "SQ8 codes loaded (re-rank x" << rerank_factor << ")" << std::endl;
+        } else {
+            std::cerr << "Warning: no SQ8 codes for this index (build with --sq8), using exact search" << std::endl;
+            use_sq8 = false;
+        }
+    }
+
+    if (use_prune) {
+        if (dataTree.loadLeafSummaries()) {
+            std::cout << "Leaf summaries loaded" << std::endl;
+        } else {
+            std::cerr << "Warning: no usable leaf summaries (build with --leaf-summaries), scanning every leaf" << std::endl;
+            use_prune = false;
+        }
+    }
+
+    if (use_graph) {
+        if (dataTree.loadSegmentGraphs()) {
+            dataTree.setGraphSearch(graph_ef);
+            std::cout << "Segment graphs loaded (ef " << graph_ef << ")" << std::endl;
+        } else {
+            std::cerr << "Warning: no usable segment graphs (build with --graph), using exact search" << std::endl;
+            use_graph = false;
+        }
+    }
+
     // Load index into memory if requested
     if (use_memory_index) {
         std::cout << "Loading index into memory..." << std::endl;
@@ -209,14 +272,110 @@ int main(int argc, char* argv[]) {
         std::cout << "Index loaded into memory in " << load_duration.count() << " ms" << std::endl;
     }
 
+    // Disk-path read-ahead window
+    dataTree.setPrefetchWindow(prefetch_window);
+
+    // Bounded node cache if requested
+    if (buffer_pool_mb > 0) {
+        dataTree.enableBufferPool(buffer_pool_mb);
+        std::cout << "Buffer pool: " << buffer_pool_mb << " MB (" << dataTree.getBufferPoolStats().capacity << " nodes)" << std::endl;
+    }
+
+    // Map index pages and vector store read-only if requested
+    if (use_mmap) {
+        if (dataTree.mapIndex()) {
+            std::cout << "Index pages memory-mapped" << std::endl;
+        } else {
+            std::cerr << "Warning: failed to memory-map index pages, using file reads" << std::endl;
+        }
+        if (dataTree.mapVectors()) {
+            std::cout << "Vector store memory-mapped" << std::endl;
+        } else {
+            std::cerr << "Warning: failed to memory-map vector store, using file reads" << std::endl;
+        }
+        use_mmap = dataTree.isIndexMapped() || dataTree.isVectorStoreMapped();
+    }
+
     // Log query configuration
     std::ostringstream config_log;
     config_log << "Query configuration | Cache: " << (cache_enabled ? "enabled" : "disabled")
                << " | Parallel: " << (use_parallel ? "enabled" : "disabled")
-               << " | Memory Index: " << (use_memory_index ? "enabled" : "disabled");
+               << " | Memory Index: " << (use_memory_index ? "enabled" : "disabled")
+               << " | Mmap: " << (use_mmap ? "enabled" : "disabled")
+               << " | Leaf pruning: " << (use_prune ? "enabled" : "disabled")
+               << " | Graph: " << (use_graph ? "ef " + std::to_string(graph_ef) : std::string("disabled"))
+               << " | SQ8: " << (use_sq8 ? "re-rank x" + std::to_string(rerank_factor) : std::string("disabled"))
+               << " | Buffer pool: " << buffer_pool_mb << " MB"
+               << " | Prefetch: " << prefetch_window << " leaves"
+               << " | Distance kernel: " << get_l2_sqr_kernel_name()
+               << (has_fixed_l2_sqr_kernel(dataTree.getMaxVectorSize()) ? " (fixed dim)" : "");
     if (use_parallel) config_log << " | Threads: " << num_threads;
+    if (auto_plan) config_log << " | Planner: auto";
     Logger::log_config(config_log.str());
 
+    // Consult the cache before searching: a hit skips the scan, and cached sub-ranges of the same
+    // query vector (a partial cover) narrow it to the keys they leave uncovered
+    bool skip_search = false;
+    bool have_planned_match = false;
+    SimilarCacheMatch planned_match;
+    long long planned_lookup_us = 0;
+    RangeCoverMatch cover;
+    const int plan_min = has_value ? search_value : min_key;
+    const int plan_max = has_value ? search_value : max_key;
+    if (cache_enabled && has_vector && has_k) {
+        auto lookup_start = std::chrono::high_resolution_clock::now();
+        planned_match = cache.find_similar_cached_result(
+            query_vector, plan_min, plan_max, k_neighbors, SimilarityThresholds(vec_sim_threshold, range_sim_threshold));
+        auto lookup_end = std::chrono::high_resolution_clock::now();
+        planned_lookup_us = std::chrono::duration_cast<std::chrono::microseconds>(lookup_end - lookup_start).count();
+        have_planned_match = true;
+        skip_search = planned_match.found;
+        if (!planned_match.found) {
+            cover = cache.find_range_cover(query_vector, plan_min, plan_max, k_neighbors);
+        }
+    }
+    
+    // Plan the KNN query from the cache and the size of its range
+    if (auto_plan && has_vector && has_k && !cover.found) {
+        QueryPlanner planner(dataTree, num_threads);
+        KNNPlan plan = planner.plan(plan_min, plan_max, planned_match.found, use_memory_index);
+        std::cout << plan.describe() << std::endl;
+        Logger::info(plan.describe());
+        
+        skip_search = plan.strategy == KNNPlan::Strategy::CacheReuse;
+        use_parallel = plan.strategy == KNNPlan::Strategy::Parallel;
+        if (use_parallel) num_threads = plan.threads;
+    }
+
+    // Residual scan of a partial cover, merged with the cached neighbors into the exact top K
+    auto search_with_cover = [&]() {
+        long long total_keys = static_cast<long long>(plan_max) - plan_min + 1;
+        std::cout << "Cache PARTIAL HIT: " << cover.query_ids.size() << " cached sub-range(s) cover "
+                  << cover.covered_keys << "/" << total_keys << " keys, searching "
+                  << cover.residual.size() << " residual interval(s)" << std::endl;
+        std::vector<KNNResult> hits;
+        dataTree.search_knn_ranges_into(query_vector, cover.residual, k_neighbors, hits, use_memory_index);
+        std::vector<CachedNeighbor> residual;
+        residual.reserve(hits.size());
+        for (const KNNResult& hit : hits) {
+            CachedNeighbor neighbor;
+            dataTree.get_result_vector(hit, neighbor.vector);
+            neighbor.key = hit.key;
+            neighbor.original_id = hit.original_id;
+            neighbor.distance = std::sqrt(hit.distance);
+            residual.push_back(std::move(neighbor));
+        }
+        QueryCache::merge_neighbors(cover.neighbors, residual, k_neighbors);
+        std::vector<DataObject*> merged;
+        merged.reserve(cover.neighbors.size());
+        for (const CachedNeighbor& neighbor : cover.neighbors) {
+            DataObject* obj = new DataObject(neighbor.vector, neighbor.key);
+            obj->set_id(neighbor.original_id);
+            merged.push_back(obj);
+        }
+        return merged;
+    };
+
     // Start timing
     auto query_start = std::chrono::high_resolution_clock::now();
 
@@ -236,7 +395,11 @@ int main(int argc, char* argv[]) {
         
         if (has_vector && has_k) {
             // Use optimized KNN search for value queries with vector
-            if (use_parallel) {
+            if (skip_search) {
+                // answered from the cache below
+            } else if (cover.found) {
+                results = search_with_cover();
+            } else if (use_parallel) {
                 results = dataTree.search_knn_parallel(query_vector, search_value, search_value, k_neighbors, num_threads, use_memory_index);
             } else {
                 results = dataTree.search_knn_optimized(query_vector, search_value, search_value, k_neighbors, use_memory_index);
@@ -258,7 +421,11 @@ int main(int argc, char* argv[]) {
         
         if (has_vector && has_k) {
             // Use optimized KNN search for range queries with vector
-            if (use_parallel) {
+            if (skip_search) {
+                // answered from the cache below
+            } else if (cover.found) {
+                results = search_with_cover();
+            } else if (use_parallel) {
                 results = dataTree.search_knn_parallel(query_vector, min_key, max_key, k_neighbors, num_threads, use_memory_index);
             } else {
                 results = dataTree.search_knn_optimized(query_vector, min_key, max_key, k_neighbors, use_memory_index);
@@ -298,10 +465,11 @@ int main(int argc, char* argv[]) {
         if (cache_enabled) {
             SimilarityThresholds thresholds(vec_sim_threshold, range_sim_threshold);
             auto cache_start = std::chrono::high_resolution_clock::now();
-            SimilarCacheMatch match = cache.find_similar_cached_result(
+            SimilarCacheMatch match = have_planned_match ? planned_match : cache.find_similar_cached_result(
                 query_vector, cache_min, cache_max, k_neighbors, thresholds);
             auto cache_end = std::chrono::high_resolution_clock::now();
-            auto cache_duration = std::chrono::duration_cast<std::chrono::microseconds>(cache_end - cache_start);
+            long long cache_duration = have_planned_match ? planned_lookup_us :
+                std::chrono::duration_cast<std::chrono::microseconds>(cache_end - cache_start).count();
             
             if (match.found) {
                 cache_hit = true;
@@ -324,7 +492,7 @@ int main(int argc, char* argv[]) {
                     std::cout << "]  (" << match.result.neighbors[i].key << ")" << std::endl;
                 }
                 
-                std::cout << std::endl << "Query execution time (from cache): " << cache_duration.count() << " us" << std::endl;
+                std::cout << std::endl << "Query execution time (from cache): " << cache_duration << " us" << std::endl;
                 
                 // Clean up results that were fetched but not needed
                 for (DataObject* obj : results) {
@@ -401,5 +569,14 @@ int main(int argc, char* argv[]) {
         std::cout << std::endl << "Query execution time: " << range_duration.count() << " us" << std::endl;
     }
 
+    if (dataTree.hasBufferPool()) {
+        BufferPool::Stats pool_stats = dataTree.getBufferPoolStats();
+        std::cout << std::endl << "=== Buffer Pool ===" << std::endl;
+        std::cout << "Hits: " << pool_stats.hits << " | Misses: " << pool_stats.misses
+                  << " | Hit rate: " << (pool_stats.hit_rate() * 100.0) << "%" << std::endl;
+        std::cout << "Evictions: " << pool_stats.evictions << " | Resident: " << pool_stats.resident
+                  << "/" << pool_stats.capacity << " nodes" << std::endl;
+    }
+
     return 0;
 }
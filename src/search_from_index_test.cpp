@@ -2,7 +2,11 @@
 #include "DataObject.h"
 #include "index_directory.h"
 #include "query_cache.h"
+#include "query_planner.h"
 #include "logger.h"
+#include "distance.h"
+#include "dataset_io.h"
+#include "metrics.h"
 #include <iostream>
 #include <fstream>
 #include <string>
@@ -12,21 +16,10 @@
 #include <algorithm>
 #include <sstream>
 #include <chrono>
-#include <set>
 #include <cstdint>
 #include <thread>
-#include <nlohmann/json.hpp>
-
-// Calculate Euclidean distance between two vectors
-double calculate_distance(const std::vector<float>& v1, const std::vector<float>& v2) {
-    double sum = 0.0;
-    size_t min_size = std::min(v1.size(), v2.size());
-    for (size_t i = 0; i < min_size; i++) {
-        double diff = static_cast<double>(v1[i]) - static_cast<double>(v2[i]);
-        sum += diff * diff;
-    }
-    return std::sqrt(sum);
-}
+#include <mutex>
+#include <iomanip>
 
 // Parse comma-separated vector string into vector<float>
 std::vector<float> parse_vector(const std::string& str) {
@@ -39,80 +32,6 @@ std::vector<float> parse_vector(const std::string& str) {
     return result;
 }
 
-// Load queries from fvecs file
-std::vector<std::vector<float>> load_fvecs_queries(const std::string& path) {
-    std::vector<std::vector<float>> queries;
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error: Cannot open query file: " << path << "\n";
-        return queries;
-    }
-
-    int32_t dimension;
-    while (file.read(reinterpret_cast<char*>(&dimension), sizeof(int32_t))) {
-        std::vector<float> vec(dimension);
-        file.read(reinterpret_cast<char*>(vec.data()), dimension * sizeof(float));
-        if (file) {
-            queries.push_back(vec);
-        }
-    }
-    return queries;
-}
-
-// Load groundtruth from ivecs file
-std::vector<std::vector<int32_t>> load_ivecs_groundtruth(const std::string& path) {
-    std::vector<std::vector<int32_t>> groundtruth;
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Error: Cannot open groundtruth file: " << path << "\n";
-        return groundtruth;
-    }
-
-    int32_t count;
-    while (file.read(reinterpret_cast<char*>(&count), sizeof(int32_t))) {
-        std::vector<int32_t> neighbors(count);
-        file.read(reinterpret_cast<char*>(neighbors.data()), count * sizeof(int32_t));
-        if (file) {
-            groundtruth.push_back(neighbors);
-        }
-    }
-    return groundtruth;
-}
-
-// Calculate recall@K
-double calculate_recall(const std::vector<int>& retrieved, const std::vector<int32_t>& groundtruth, int k) {
-    if (groundtruth.empty() || k <= 0) return 0.0;
-    
-    std::set<int> gt_set(groundtruth.begin(), groundtruth.begin() + std::min(k, static_cast<int>(groundtruth.size())));
-    int hits = 0;
-    for (int i = 0; i < std::min(k, static_cast<int>(retrieved.size())); i++) {
-        if (gt_set.count(retrieved[i]) > 0) {
-            hits++;
-        }
-    }
-    return static_cast<double>(hits) / std::min(k, static_cast<int>(gt_set.size()));
-}
-
-// Read qrange JSON: [left0, right0, left1, right1, ...]
-std::vector<std::pair<int, int>> read_qrange_json(const std::string& path, int num_queries) {
-    std::ifstream in(path);
-    if (!in.is_open()) {
-        std::cerr << "Error: Cannot open qrange file: " << path << "\n";
-        return {};
-    }
-    nlohmann::json j;
-    in >> j;
-    in.close();
-    std::vector<int> raw = j.get<std::vector<int>>();
-    int limit = num_queries * 2;
-    if (static_cast<int>(raw.size()) > limit) raw.resize(limit);
-    std::vector<std::pair<int, int>> ranges;
-    for (size_t i = 0; i + 1 < raw.size(); i += 2) {
-        ranges.push_back({raw[i], raw[i + 1]});
-    }
-    return ranges;
-}
-
 void print_usage(const char* program_name) {
     std::cout << "Usage: " << program_name << " --index <index_dir> [options]" << "\n";
     std::cout << "\n";
@@ -125,11 +44,26 @@ void print_usage(const char* program_name) {
     std::cout << "                   Used directly as B+ tree key ranges (index must be built with --label-path)" << "\n";
     std::cout << "  --num-queries    Number of queries to run (default: all)" << "\n";
     std::cout << "  --no-cache       Disable query caching" << "\n";
-    std::cout << "  --parallel       Enable parallel multi-query execution (requires --memory-index)" << "\n";
+    std::cout << "  --parallel       Run queries concurrently on a persistent thread pool" << "\n";
     std::cout << "  --threads        Number of concurrent queries for --parallel (0 = auto, default)" << "\n";
+    std::cout << "  --auto           Plan each query: cache reuse, single-threaded or parallel scan, run one" << "\n";
+    std::cout << "                   at a time (from the estimated vectors in range; --threads caps threads)" << "\n";
     std::cout << "  --memory-index   Load entire index into memory before searching (faster for multiple queries)" << "\n";
+    std::cout << "  --buffer-pool    Cache up to <MB> of tree nodes in a bounded buffer pool (default: off)" << "\n";
+    std::cout << "  --prefetch       Leaves read ahead asynchronously on disk-path scans (default: 0 = off)" << "\n";
+    std::cout << "  --mmap           Memory-map index pages and vector store, read both in place (read-only)" << "\n";
+    std::cout << "  --sq8            Scan 8-bit quantized codes (built with build_index_fvecs --sq8), re-rank exactly" << "\n";
+    std::cout << "                   (single-threaded runs; --parallel and --shared-scan stay exact)" << "\n";
+    std::cout << "  --rerank         Candidates re-ranked per neighbor with --sq8 (default: 4)" << "\n";
+    std::cout << "  --prune          Skip leaves by their centroid/radius summaries (built with --leaf-summaries, exact)" << "\n";
+    std::cout << "  --graph          Search segments inside the range through their graphs (built with --graph), scan the edges" << "\n";
+    std::cout << "                   (single-threaded runs; --parallel and --shared-scan stay exact)" << "\n";
+    std::cout << "  --ef             Graph search beam width with --graph (default: 64)" << "\n";
+    std::cout << "  --shared-scan    Answer all queries in one sweep of the leaf chain (overlapping ranges share reads)" << "\n";
     std::cout << "  --vec-sim        Vector similarity threshold for cache matching [0.0-1.0] (default: 1.0 = exact)" << "\n";
     std::cout << "  --range-sim      Range similarity threshold for cache matching [0.0-1.0] (default: 1.0 = exact)" << "\n";
+    std::cout << "  --metrics        Collect search stage metrics (counters, latency histograms) and print them" << "\n";
+    std::cout << "  --metrics-out    Also write the metrics to <file> in Prometheus text format (implies --metrics)" << "\n";
     std::cout << "\n";
     std::cout << "Examples:" << "\n";
     std::cout << "  Batch RFANN test:" << "\n";
@@ -154,6 +88,18 @@ int main(int argc, char* argv[]) {
     bool use_parallel = false;
     int num_threads = 0;  // 0 = auto-detect
     bool use_memory_index = false;
+    bool use_mmap = false;
+    bool use_sq8 = false;
+    bool use_prune = false;
+    bool use_graph = false;
+    int graph_ef = 64;
+    int rerank_factor = 4;
+    bool use_shared_scan = false;
+    bool use_metrics = false;
+    std::string metrics_out;
+    bool auto_plan = false;
+    size_t buffer_pool_mb = 0;
+    size_t prefetch_window = 0;
     double vec_sim_threshold = 1.0;   // Default: exact match only
     double range_sim_threshold = 1.0; // Default: exact match only
 
@@ -184,6 +130,31 @@ int main(int argc, char* argv[]) {
             use_parallel = true;  // Implicitly enable parallel if threads specified
         } else if (arg == "--memory-index") {
             use_memory_index = true;
+        } else if (arg == "--mmap") {
+            use_mmap = true;
+        } else if (arg == "--sq8") {
+            use_sq8 = true;
+        } else if (arg == "--prune") {
+            use_prune = true;
+        } else if (arg == "--graph") {
+            use_graph = true;
+        } else if (arg == "--ef" && i + 1 < argc) {
+            graph_ef = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--rerank" && i + 1 < argc) {
+            rerank_factor = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--auto") {
+            auto_plan = true;
+        } else if (arg == "--shared-scan") {
+            use_shared_scan = true;
+        } else if (arg == "--metrics") {
+            use_metrics = true;
+        } else if (arg == "--metrics-out" && i + 1 < argc) {
+            metrics_out = argv[++i];
+            use_metrics = true;
+        } else if (arg == "--buffer-pool" && i + 1 < argc) {
+            buffer_pool_mb = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        } else if (arg == "--prefetch" && i + 1 < argc) {
+            prefetch_window = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
         } else if (arg == "--vec-sim" && i + 1 < argc) {
             vec_sim_threshold = std::atof(argv[++i]);
             if (vec_sim_threshold < 0.0 || vec_sim_threshold > 1.0) {
@@ -240,6 +211,36 @@ int main(int argc, char* argv[]) {
         cache.load_config(idx_dir.get_config_file_path());
     }
 
+    // Quantized codes first, so loadIntoMemory can leave the full vectors on disk
+    if (use_sq8) {
+        if (dataTree.loadQuantizedStore()) {
+            dataTree.setQuantizedRerank(rerank_factor);
+            std::cout << "SQ8 codes loaded (re-rank x" << rerank_factor << ")" << "\n";
+        } else {
+            std::cerr << "Warning: no SQ8 codes for this index (build with --sq8), using exact search" << "\n";
+            use_sq8 = false;
+        }
+    }
+
+    if (use_prune) {
+        if (dataTree.loadLeafSummaries()) {
+            std::cout << "Leaf summaries loaded" << "\n";
+        } else {
+            std::cerr << "Warning: no usable leaf summaries (build with --leaf-summaries), scanning every leaf" << "\n";
+            use_prune = false;
+        }
+    }
+
+    if (use_graph) {
+        if (dataTree.loadSegmentGraphs()) {
+            dataTree.setGraphSearch(graph_ef);
+            std::cout << "Segment graphs loaded (ef " << graph_ef << ")" << "\n";
+        } else {
+            std::cerr << "Warning: no usable segment graphs (build with --graph), using exact search" << "\n";
+            use_graph = false;
+        }
+    }
+
     // Load index into memory if requested
     if (use_memory_index) {
         std::cout << "Loading index into memory..." << "\n";
@@ -250,11 +251,46 @@ int main(int argc, char* argv[]) {
         std::cout << "Index loaded into memory in " << load_duration.count() << " ms" << "\n";
     }
 
+    // Disk-path read-ahead window
+    dataTree.setPrefetchWindow(prefetch_window);
+
+    // Bounded node cache if requested
+    if (buffer_pool_mb > 0) {
+        dataTree.enableBufferPool(buffer_pool_mb);
+        std::cout << "Buffer pool: " << buffer_pool_mb << " MB (" << dataTree.getBufferPoolStats().capacity << " nodes)" << "\n";
+    }
+
+    // Map index pages and vector store read-only if requested
+    if (use_mmap) {
+        if (dataTree.mapIndex()) {
+            std::cout << "Index pages memory-mapped" << "\n";
+        } else {
+            std::cerr << "Warning: failed to memory-map index pages, using file reads" << "\n";
+        }
+        if (dataTree.mapVectors()) {
+            std::cout << "Vector store memory-mapped" << "\n";
+        } else {
+            std::cerr << "Warning: failed to memory-map vector store, using file reads" << "\n";
+        }
+        use_mmap = dataTree.isIndexMapped() || dataTree.isVectorStoreMapped();
+    }
+
     // Log test configuration
     std::ostringstream config_log;
     config_log << "Search test configuration | Cache: " << (cache_enabled ? "enabled" : "disabled")
                << " | Parallel: " << (use_parallel ? "enabled" : "disabled")
-               << " | Memory Index: " << (use_memory_index ? "enabled" : "disabled");
+               << " | Memory Index: " << (use_memory_index ? "enabled" : "disabled")
+               << " | Mmap: " << (use_mmap ? "enabled" : "disabled")
+               << " | Leaf pruning: " << (use_prune ? "enabled" : "disabled")
+               << " | Graph: " << (use_graph ? "ef " + std::to_string(graph_ef) : std::string("disabled"))
+               << " | SQ8: " << (use_sq8 ? "re-rank x" + std::to_string(rerank_factor) : std::string("disabled"))
+               << " | Shared scan: " << (use_shared_scan ? "enabled" : "disabled")
+               << " | Planner: " << (auto_plan ? "auto" : "disabled")
+               << " | Metrics: " << (use_metrics ? "enabled" : "disabled")
+               << " | Buffer pool: " << buffer_pool_mb << " MB"
+               << " | Prefetch: " << prefetch_window << " leaves"
+               << " | Distance kernel: " << get_l2_sqr_kernel_name()
+               << (has_fixed_l2_sqr_kernel(dataTree.getMaxVectorSize()) ? " (fixed dim)" : "");
     if (use_parallel) config_log << " | Threads: " << num_threads;
     if (has_queries) config_log << " | Query file provided: yes";
     Logger::log_config(config_log.str());
@@ -355,173 +391,231 @@ int main(int argc, char* argv[]) {
     std::cout << "Parallel: " << (use_parallel ? "enabled" : "disabled");
     if (use_parallel) std::cout << " | Threads: " << (num_threads > 0 ? std::to_string(num_threads) : "auto-detect");
     std::cout << "\n";
-    std::cout << "Memory Index: " << (use_memory_index ? "enabled" : "disabled") << "\n" << "\n";
+    std::cout << "Memory Index: " << (use_memory_index ? "enabled" : "disabled") << "\n";
+    std::cout << "Shared scan: " << (use_shared_scan ? "enabled" : "disabled") << "\n" << "\n";
     
     double total_recall = 0.0;
     long long total_query_time_sum = 0;  // Sum of individual query durations (for avg latency)
     int valid_queries = 0;
     int cache_hits = 0;
+    int partial_hits = 0;
 
     // Determine parallelism
     int effective_threads = 1;
+    if (use_parallel && use_shared_scan) {
+        std::cout << "Note: --shared-scan runs as a single sweep, ignoring --parallel" << "\n";
+        use_parallel = false;
+    }
+    if (auto_plan && use_shared_scan) {
+        std::cout << "Note: --shared-scan runs as a single sweep, ignoring --auto" << "\n";
+        auto_plan = false;
+    }
+    if (auto_plan && use_parallel) {
+        std::cout << "Note: --auto picks the threads per query (--threads only caps them)" << "\n";
+        use_parallel = false;
+    }
     if (use_parallel) {
-        if (!use_memory_index) {
-            std::cerr << "Warning: --parallel requires --memory-index for multi-query parallelism. Falling back to sequential." << "\n";
-            use_parallel = false;
-        } else {
-            effective_threads = (num_threads > 0) ? num_threads : static_cast<int>(std::thread::hardware_concurrency());
-            if (effective_threads <= 0) effective_threads = 4;
-            std::cout << "Parallel query execution: " << effective_threads << " concurrent queries" << "\n";
-        }
+        effective_threads = (num_threads > 0) ? num_threads : static_cast<int>(std::thread::hardware_concurrency());
+        if (effective_threads <= 0) effective_threads = 4;
+        std::cout << "Parallel query execution: " << effective_threads << " concurrent queries" << "\n";
     }
 
-    auto wall_start = std::chrono::high_resolution_clock::now();
-    for (int batch_start = 0; batch_start < queries_to_run; batch_start += effective_threads) {
-        int batch_end = std::min(batch_start + effective_threads, queries_to_run);
-        int batch_count = batch_end - batch_start;
-
-        // Per-query state for this batch
-        struct QueryState {
-            int q_min = 0, q_max = 0;
-            bool skipped = false;
-            bool cache_hit = false;
-            std::string query_hash;
-            std::string used_similar_query_id;
-            std::vector<int> retrieved;
-            std::vector<DataObject*> knn_results;
-            long long search_duration_us = 0;
-        };
-        std::vector<QueryState> states(batch_count);
-
-        // Phase 1: Range setup + cache check (sequential)
-        for (int t = 0; t < batch_count; t++) {
-            int q = batch_start + t;
-            QueryState& st = states[t];
-            st.q_min = min_key;
-            st.q_max = max_key;
-            if (use_per_query_range && q < static_cast<int>(query_ranges.size())) {
-                st.q_min = query_ranges[q].first;
-                st.q_max = query_ranges[q].second;
-                if (st.q_min > st.q_max) {
-                    st.skipped = true;
-                    continue;
-                }
-            }
-
-            st.query_hash = cache.compute_query_hash(queries[q], st.q_min, st.q_max);
-
-            if (cache_enabled) {
-                SimilarityThresholds thresholds(vec_sim_threshold, range_sim_threshold);
-                auto cache_start = std::chrono::high_resolution_clock::now();
-                SimilarCacheMatch match = cache.find_similar_cached_result(
-                    queries[q], st.q_min, st.q_max, k_neighbors, thresholds);
-                auto cache_end = std::chrono::high_resolution_clock::now();
-                long long cache_duration = std::chrono::duration_cast<std::chrono::microseconds>(cache_end - cache_start).count();
-
-                if (match.found) {
-                    st.cache_hit = true;
-                    st.used_similar_query_id = match.query_id;
-                    total_query_time_sum += cache_duration;
-                    for (const auto& neighbor : match.result.neighbors) {
-                        st.retrieved.push_back(static_cast<int>(neighbor.original_id));
-                    }
-                    cache_hits++;
-                    std::ostringstream cache_log;
-                    if (match.vector_similarity >= 1.0 && match.range_similarity >= 1.0) {
-                        cache_log << "Query #" << (q + 1) << " | CACHE HIT (exact) | Results: " << match.result.neighbors.size();
-                    } else {
-                        cache_log << "Query #" << (q + 1) << " | CACHE HIT (similar: vec=" << (match.vector_similarity * 100)
-                                  << "%, range=" << (match.range_similarity * 100) << "%) | Results: " << match.result.neighbors.size();
-                    }
-                    Logger::log_query("KNN_CACHE", cache_log.str(), cache_duration / 1000.0, match.result.neighbors.size());
-                }
-            }
+    // Per-query state, filled by the batch hooks
+    struct QueryState {
+        int q_min = 0, q_max = 0;
+        bool skipped = false;
+        bool cache_hit = false;
+        bool partial_hit = false;
+        std::vector<CachedNeighbor> cover_neighbors;  // cached part of a partial hit
+        std::string query_hash;
+        std::string used_similar_query_id;
+        std::vector<int> retrieved;
+    };
+    std::vector<QueryState> states(queries_to_run);
+    std::vector<std::pair<int, int>> ranges(queries_to_run);
+    for (int q = 0; q < queries_to_run; q++) {
+        QueryState& st = states[q];
+        st.q_min = min_key;
+        st.q_max = max_key;
+        if (use_per_query_range && q < static_cast<int>(query_ranges.size())) {
+            st.q_min = query_ranges[q].first;
+            st.q_max = query_ranges[q].second;
+            st.skipped = st.q_min > st.q_max;
         }
+        ranges[q] = {st.q_min, st.q_max};
+    }
 
-        // Phase 2: Search (parallel or sequential)
-        if (use_parallel) {
-            std::vector<std::thread> threads;
-            for (int t = 0; t < batch_count; t++) {
-                if (states[t].skipped || states[t].cache_hit) continue;
-                int q = batch_start + t;
-                threads.emplace_back([&dataTree, &queries, &states, q, t, k_neighbors, use_memory_index]() {
-                    auto start = std::chrono::high_resolution_clock::now();
-                    states[t].knn_results = dataTree.search_knn_optimized(
-                        queries[q], states[t].q_min, states[t].q_max,
-                        k_neighbors, use_memory_index);
-                    auto end = std::chrono::high_resolution_clock::now();
-                    states[t].search_duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-                });
-            }
-            for (auto& th : threads) th.join();
+    // Workers look up and fill the (thread-safe) QueryCache directly; the counters below are shared
+    std::mutex results_mutex;
+    int completed = 0;
+
+    KNNBatchHooks hooks;
+    hooks.lookup = [&](size_t q) -> bool {
+        QueryState& st = states[q];
+        if (st.skipped) return true;
+
+        st.query_hash = cache.compute_query_hash(queries[q], st.q_min, st.q_max);
+        if (!cache_enabled) return false;
+
+        SimilarityThresholds thresholds(vec_sim_threshold, range_sim_threshold);
+        auto cache_start = std::chrono::high_resolution_clock::now();
+        SimilarCacheMatch match = cache.find_similar_cached_result(
+            queries[q], st.q_min, st.q_max, k_neighbors, thresholds);
+        auto cache_end = std::chrono::high_resolution_clock::now();
+        long long cache_duration = std::chrono::duration_cast<std::chrono::microseconds>(cache_end - cache_start).count();
+        if (!match.found) return false;
+
+        st.cache_hit = true;
+        st.used_similar_query_id = match.query_id;
+        for (const auto& neighbor : match.result.neighbors) {
+            st.retrieved.push_back(static_cast<int>(neighbor.original_id));
+        }
+        {
+            std::lock_guard<std::mutex> lock(results_mutex);
+            total_query_time_sum += cache_duration;
+            cache_hits++;
+        }
+        std::ostringstream cache_log;
+        if (match.vector_similarity >= 1.0 && match.range_similarity >= 1.0) {
+            cache_log << "Query #" << (q + 1) << " | CACHE HIT (exact) | Results: " << match.result.neighbors.size();
         } else {
-            for (int t = 0; t < batch_count; t++) {
-                if (states[t].skipped || states[t].cache_hit) continue;
-                int q = batch_start + t;
-                auto start = std::chrono::high_resolution_clock::now();
-                states[t].knn_results = dataTree.search_knn_optimized(
-                    queries[q], states[t].q_min, states[t].q_max,
-                    k_neighbors, use_memory_index);
-                auto end = std::chrono::high_resolution_clock::now();
-                states[t].search_duration_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+            cache_log << "Query #" << (q + 1) << " | CACHE HIT (similar: vec=" << (match.vector_similarity * 100)
+                      << "%, range=" << (match.range_similarity * 100) << "%) | Results: " << match.result.neighbors.size();
+        }
+        Logger::log_query("KNN_CACHE", cache_log.str(), cache_duration / 1000.0, match.result.neighbors.size());
+        return true;
+    };
+
+    // Partial reuse: cached sub-ranges of the same query narrow the search to the uncovered keys
+    hooks.narrow = [&](size_t q, std::vector<std::pair<int, int>>& intervals) -> bool {
+        if (!cache_enabled) return false;
+        QueryState& st = states[q];
+
+        RangeCoverMatch cover = cache.find_range_cover(queries[q], st.q_min, st.q_max, k_neighbors);
+        if (!cover.found) return false;
+
+        st.partial_hit = true;
+        st.cover_neighbors = std::move(cover.neighbors);
+        intervals = std::move(cover.residual);
+        {
+            std::lock_guard<std::mutex> lock(results_mutex);
+            partial_hits++;
+        }
+        Logger::debug("Query #" + std::to_string(q + 1) + " | CACHE PARTIAL HIT | " +
+                      std::to_string(cover.query_ids.size()) + " cached sub-range(s), " +
+                      std::to_string(cover.covered_keys) + " keys covered, " +
+                      std::to_string(intervals.size()) + " residual interval(s)");
+        return true;
+    };
+
+    hooks.on_result = [&](size_t q, const std::vector<KNNResult>& hits, bool searched, long long search_us) {
+        QueryState& st = states[q];
+
+        // Vectors are only fetched when the result goes into the cache (outside the lock)
+        std::vector<CachedNeighbor> results_for_cache;
+        if (searched && cache_enabled && !hits.empty()) {
+            results_for_cache.reserve(hits.size());
+            for (const KNNResult& hit : hits) {
+                CachedNeighbor neighbor;
+                dataTree.get_result_vector(hit, neighbor.vector);
+                neighbor.key = hit.key;
+                neighbor.original_id = hit.original_id;
+                neighbor.distance = std::sqrt(hit.distance);
+                results_for_cache.push_back(std::move(neighbor));
             }
         }
+        if (searched && st.partial_hit) {
+            // hits only cover the residual intervals
+            QueryCache::merge_neighbors(st.cover_neighbors, results_for_cache, k_neighbors);
+            results_for_cache.swap(st.cover_neighbors);
+            std::vector<CachedNeighbor>().swap(st.cover_neighbors);
+        }
+
+        if (searched && !results_for_cache.empty()) {
+            cache.store_result(st.query_hash, queries[q], st.q_min, st.q_max,
+                               k_neighbors, results_for_cache, st.used_similar_query_id);
+        }
+
+        std::lock_guard<std::mutex> lock(results_mutex);
+        if (searched) {
+            total_query_time_sum += search_us;
+            const size_t result_count = st.partial_hit ? results_for_cache.size() : hits.size();
+
+            std::ostringstream query_params;
+            query_params << "Query #" << (q + 1) << " | K=" << k_neighbors
+                         << " | Range=[" << st.q_min << "," << st.q_max << "] | Results: "
+                         << result_count << " | Time: " << (search_us / 1000.0) << " ms";
+            Logger::log_query(st.partial_hit ? "KNN_PARTIAL" : "KNN", query_params.str(), search_us / 1000.0, result_count);
 
-        // Phase 3: Post-process (sequential)
-        for (int t = 0; t < batch_count; t++) {
-            int q = batch_start + t;
-            QueryState& st = states[t];
-            if (st.skipped) continue;
-
-            if (!st.cache_hit) {
-                total_query_time_sum += st.search_duration_us;
-
-                std::ostringstream query_params;
-                query_params << "Query #" << (q + 1) << " | K=" << k_neighbors
-                             << " | Range=[" << st.q_min << "," << st.q_max << "] | Results: "
-                             << st.knn_results.size() << " | Time: " << (st.search_duration_us / 1000.0) << " ms";
-                Logger::log_query("KNN", query_params.str(), st.search_duration_us / 1000.0, st.knn_results.size());
-
-                if (!st.knn_results.empty()) {
-                    std::vector<CachedNeighbor> results_for_cache;
-                    for (size_t i = 0; i < st.knn_results.size(); i++) {
-                        int key = st.knn_results[i]->is_int_value() ?
-                            st.knn_results[i]->get_int_value() :
-                            static_cast<int>(st.knn_results[i]->get_float_value());
-                        st.retrieved.push_back(static_cast<int>(st.knn_results[i]->get_id()));
-                        CachedNeighbor neighbor;
-                        neighbor.vector = st.knn_results[i]->get_vector();
-                        neighbor.key = key;
-                        neighbor.original_id = st.knn_results[i]->get_id();
-                        neighbor.distance = calculate_distance(queries[q], neighbor.vector);
-                        results_for_cache.push_back(neighbor);
-                    }
-                    if (cache_enabled) {
-                        cache.store_result(st.query_hash, queries[q], st.q_min, st.q_max,
-                                           k_neighbors, results_for_cache, st.used_similar_query_id);
-                    }
+            if (st.partial_hit) {
+                for (const CachedNeighbor& neighbor : results_for_cache) {
+                    st.retrieved.push_back(static_cast<int>(neighbor.original_id));
                 }
-                for (DataObject* obj : st.knn_results) {
-                    delete obj;
+            } else {
+                for (const KNNResult& hit : hits) {
+                    st.retrieved.push_back(static_cast<int>(hit.original_id));
                 }
             }
+        }
 
-            // Calculate recall
-            if (has_groundtruth && q < static_cast<int>(groundtruth.size())) {
-                if (groundtruth[q].empty()) {
-                    // Empty groundtruth: correct only if search returned nothing
-                    total_recall += st.retrieved.empty() ? 1.0 : 0.0;
-                } else {
-                    total_recall += calculate_recall(st.retrieved, groundtruth[q], k_neighbors);
-                }
-                valid_queries++;
+        // Calculate recall
+        if (!st.skipped && has_groundtruth && q < groundtruth.size()) {
+            if (groundtruth[q].empty()) {
+                // Empty groundtruth: correct only if search returned nothing
+                total_recall += st.retrieved.empty() ? 1.0 : 0.0;
+            } else {
+                total_recall += calculate_recall(st.retrieved, groundtruth[q], k_neighbors);
             }
+            valid_queries++;
         }
 
         // Progress
-        if (batch_end % 10 == 0 || batch_end >= queries_to_run) {
-            std::cout << "\rProgress: " << batch_end << "/" << queries_to_run << " queries" << std::flush;
+        completed++;
+        if (completed % 10 == 0 || completed >= queries_to_run) {
+            std::cout << "\rProgress: " << completed << "/" << queries_to_run << " queries" << std::flush;
+        }
+    };
+
+    // Stage metrics cover the queries only, not loading
+    Metrics::set_enabled(use_metrics);
+    auto wall_start = std::chrono::high_resolution_clock::now();
+    int planned[3] = {0, 0, 0};  // --auto: queries per KNNPlan::Strategy
+    if (use_shared_scan) {
+        dataTree.search_knn_shared_scan(queries, ranges, k_neighbors, hooks, use_memory_index);
+    } else if (auto_plan) {
+        // One query at a time with its planned strategy; the lookup hook is the cache-reuse path
+        QueryPlanner planner(dataTree, num_threads);
+        std::vector<KNNResult> hits;
+        for (size_t q = 0; q < ranges.size(); q++) {
+            if (hooks.lookup(q)) {
+                if (!states[q].skipped) planned[static_cast<int>(KNNPlan::Strategy::CacheReuse)]++;
+                hits.clear();
+                hooks.on_result(q, hits, false, 0);
+                continue;
+            }
+            std::vector<std::pair<int, int>> intervals;
+            if (hooks.narrow(q, intervals)) {
+                // the residual intervals of a partial hit are scanned serially
+                planned[static_cast<int>(KNNPlan::Strategy::Serial)]++;
+                auto search_start = std::chrono::high_resolution_clock::now();
+                dataTree.search_knn_ranges_into(queries[q], intervals, k_neighbors, hits, use_memory_index);
+                auto search_end = std::chrono::high_resolution_clock::now();
+                hooks.on_result(q, hits, true,
+                                std::chrono::duration_cast<std::chrono::microseconds>(search_end - search_start).count());
+                continue;
+            }
+            KNNPlan plan = planner.plan(ranges[q].first, ranges[q].second, false, use_memory_index);
+            planned[static_cast<int>(plan.strategy)]++;
+            Logger::debug("Query #" + std::to_string(q + 1) + " | " + plan.describe());
+            
+            auto search_start = std::chrono::high_resolution_clock::now();
+            planner.execute(plan, queries[q], ranges[q].first, ranges[q].second, k_neighbors, hits, use_memory_index);
+            auto search_end = std::chrono::high_resolution_clock::now();
+            hooks.on_result(q, hits, true,
+                            std::chrono::duration_cast<std::chrono::microseconds>(search_end - search_start).count());
         }
+    } else {
+        dataTree.search_knn_batch(queries, ranges, k_neighbors, hooks, effective_threads, use_memory_index);
     }
     std::cout << "\n";
     auto wall_end = std::chrono::high_resolution_clock::now();
@@ -531,7 +625,13 @@ int main(int argc, char* argv[]) {
     std::cout << "\n" << "=== Benchmark Results ===" << "\n";
     std::cout << "Total queries: " << queries_to_run << "\n";
     std::cout << "Cache hits: " << cache_hits << "\n";
+    if (partial_hits > 0) std::cout << "Partial cache hits: " << partial_hits << " (residual intervals searched)" << "\n";
     std::cout << "Tree searches: " << (queries_to_run - cache_hits) << "\n";
+    if (auto_plan) {
+        std::cout << "Planned: " << planned[static_cast<int>(KNNPlan::Strategy::CacheReuse)] << " cache, "
+                  << planned[static_cast<int>(KNNPlan::Strategy::Serial)] << " serial, "
+                  << planned[static_cast<int>(KNNPlan::Strategy::Parallel)] << " parallel" << "\n";
+    }
     if (cache_enabled && queries_to_run > 0) {
         double cache_hit_rate = (double)cache_hits / queries_to_run * 100.0;
         std::cout << "Cache hit rate: " << std::fixed << std::setprecision(1) << cache_hit_rate << "%" << "\n";
@@ -554,5 +654,32 @@ int main(int argc, char* argv[]) {
         std::cout << "Recall@" << k_neighbors << ": " << (total_recall / valid_queries * 100.0) << "%" << "\n";
     }
 
+    if (dataTree.hasBufferPool()) {
+        BufferPool::Stats pool_stats = dataTree.getBufferPoolStats();
+        std::cout << "\n" << "=== Buffer Pool ===" << "\n";
+        std::cout << "Hits: " << pool_stats.hits << " | Misses: " << pool_stats.misses
+                  << " | Hit rate: " << (pool_stats.hit_rate() * 100.0) << "%" << "\n";
+        std::cout << "Evictions: " << pool_stats.evictions << " | Resident: " << pool_stats.resident
+                  << "/" << pool_stats.capacity << " nodes" << "\n";
+    }
+
+    if (use_metrics) {
+        Metrics::set_enabled(false);
+        MetricsSnapshot snapshot = Metrics::snapshot();
+        std::cout << "\n" << "=== Search Metrics ===" << "\n";
+        std::cout << Metrics::format_summary(snapshot);
+        std::cout << "  (distance and vector_fetch sampled 1 in " << Metrics::SAMPLE_EVERY << " vectors, heap 1 in "
+                  << Metrics::HEAP_SAMPLE_EVERY << " heap inserts)" << "\n";
+        if (!metrics_out.empty()) {
+            std::ofstream out(metrics_out);
+            if (out.is_open()) {
+                out << Metrics::to_prometheus(snapshot);
+                std::cout << "Metrics written to " << metrics_out << "\n";
+            } else {
+                std::cerr << "Error: Cannot write metrics to " << metrics_out << "\n";
+            }
+        }
+    }
+
     return 0;
 }
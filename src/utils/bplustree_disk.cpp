@@ -1,29 +1,167 @@
 #include "bplustree_disk.h"
 #include "DataObject.h"
 #include "logger.h"
+#include "distance.h"
+#include "metrics.h"
+#include <limits>
 #include <iostream>
 #include <queue>
 #include <vector>
 #include <algorithm>
+#include <iterator>
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <cmath>
 #include <chrono>
 #include <numeric>
+#include <deque>
+#include <stdexcept>
 
 DiskBPlusTree::DiskBPlusTree(const std::string& filename)
-    : pm(std::make_unique<PageManager>(filename)) {}
+    : pm(std::make_unique<PageManager>(filename)), l2_sqr_kernel_(get_l2_sqr_kernel(pm->getConfig().max_vector_size)) {}
 
 DiskBPlusTree::DiskBPlusTree(const std::string& filename, const BPTreeConfig& config)
-    : pm(std::make_unique<PageManager>(filename, config)) {}
+    : pm(std::make_unique<PageManager>(filename, config)),
+      l2_sqr_kernel_(get_l2_sqr_kernel(pm->getConfig().max_vector_size)) {}
+
+DiskBPlusTree::~DiskBPlusTree() {
+    // The remap table is not saved: shadow pages go home while it still exists
+    if (pm->snapshotsEnabled()) {
+        try {
+            foldSnapshotPages(true);
+        } catch (const std::exception& e) {
+            Logger::error(std::string("Folding snapshot pages failed: ") + e.what());
+        }
+    }
+}
 
 void DiskBPlusTree::read(uint32_t pid, BPlusNode& node) {
-    pm->readNode(pid, node);
+    readPage(pm->resolve(pid), node);
+}
+
+void DiskBPlusTree::readPage(uint32_t page, BPlusNode& node) {
+    if (buffer_pool_ && page != INVALID_PAGE) {
+        BufferPool::PinnedNode cached = buffer_pool_->fetch(page, [&](BPlusNode& loaded) {
+            pm->readNode(page, loaded);
+        });
+        node = *cached;
+        return;
+    }
+    pm->readNode(page, node);
+}
+
+LeafPrefetcher& DiskBPlusTree::getLeafPrefetcher() {
+    if (!prefetcher_) {
+        // Runs on the worker: same sources as fetchNodeConcurrent (buffer pool, positional reads)
+        auto read_leaf = [this](uint32_t pid, BPlusNode& node, std::vector<char>& buffer) {
+            PageManager::SnapshotScope snapshot(*pm, prefetch_snapshot_);
+            const uint32_t page = pm->resolve(pid);
+            if (buffer_pool_) {
+                BufferPool::PinnedNode cached = buffer_pool_->fetch(page, [&](BPlusNode& loaded) {
+                    pm->readNodeAt(page, loaded, buffer);
+                });
+                node = *cached;
+                return;
+            }
+            pm->readNodeAt(page, node, buffer);
+        };
+        // Keys are sorted, so the lists in range are one slice of the leaf
+        auto hint_vectors = [this](const BPlusNode& leaf, int min_key, int max_key) {
+            const VectorStore* store = pm->getVectorStore();
+            if (!store) return;
+            int first = 0;
+            while (first < leaf.keyCount && leaf.keys[first] < min_key) first++;
+            int last = first;
+            while (last < leaf.keyCount && leaf.keys[last] <= max_key) last++;
+            store->prefetchLists(leaf.vector_list_ids.data() + first, leaf.vector_counts.data() + first,
+                                 static_cast<size_t>(last - first));
+        };
+        prefetcher_ = std::make_unique<LeafPrefetcher>(read_leaf, hint_vectors);
+    }
+    return *prefetcher_;
 }
 
 void DiskBPlusTree::write(uint32_t pid, const BPlusNode& node) {
-    pm->writeNode(pid, node);
+    writePage(pm->pageForWrite(pid), node);
+}
+
+void DiskBPlusTree::writePage(uint32_t page, const BPlusNode& node) {
+    pm->writeNode(page, node);
+    if (buffer_pool_) {
+        buffer_pool_->put(page, node);
+    }
+    // Pages past the loaded arena are read from disk instead
+    if (memory_index_loaded_) {
+        memory_index_.store(page, node);
+    }
+}
+
+void DiskBPlusTree::beginWrite() {
+    write_mutex_.lock();
+    write_depth_++;
+}
+
+void DiskBPlusTree::endWrite() {
+    if (--write_depth_ == 0 && pm->snapshotsEnabled()) {
+        try {
+            foldSnapshotPages(false);
+            pm->publish();
+        } catch (const std::exception& e) {
+            Logger::error(std::string("Publishing snapshot failed: ") + e.what());
+        }
+    }
+    write_mutex_.unlock();
+}
+
+void DiskBPlusTree::foldSnapshotPages(bool all) {
+    if (all) {
+        // Once the readers of the current snapshot are gone, no reader sees any shadowed home
+        pm->publish();
+        pm->waitForReaders();
+    }
+    std::vector<std::pair<uint32_t, uint32_t>> pages;
+    pm->foldablePages(pages);
+    BPlusNode node;
+    for (const auto& page : pages) {
+        readPage(page.second, node);
+        writePage(page.first, node);
+        pm->finishFold(page.first);
+    }
+    if (all) pm->publish();
+}
+
+bool DiskBPlusTree::enableSnapshots() {
+    WriteScope scope(*this);
+    if (pm->snapshotsEnabled()) return true;
+    // Both describe the tree as built, so the first write would drop them under running readers
+    leaf_summaries_.clear();
+    segment_graphs_.close();
+    return pm->enableSnapshots();
+}
+
+bool DiskBPlusTree::sync() {
+    WriteScope scope(*this);
+    if (pm->snapshotsEnabled()) {
+        foldSnapshotPages(true);
+    }
+    return pm->sync();
+}
+
+void DiskBPlusTree::enableBufferPool(size_t budget_mb, size_t shards) {
+    if (budget_mb == 0) {
+        buffer_pool_.reset();
+        return;
+    }
+    buffer_pool_ = std::make_unique<BufferPool>(budget_mb * 1024 * 1024, pm->estimateNodeBytes(), shards);
+}
+
+void DiskBPlusTree::disableBufferPool() {
+    buffer_pool_.reset();
+}
+
+BufferPool::Stats DiskBPlusTree::getBufferPoolStats() const {
+    return buffer_pool_ ? buffer_pool_->getStats() : BufferPool::Stats();
 }
 
 size_t DiskBPlusTree::estimateTotalMemoryMB() const {
@@ -73,6 +211,13 @@ bool DiskBPlusTree::loadIntoMemory(size_t max_memory_mb) {
     
     memory_index_loaded_ = true;
     
+    // quantized search scans the mapped codes and only re-ranks a few full vectors from disk
+    if (quantized_rerank_ > 0 && hasQuantizedStore()) {
+        std::cout << "Quantized search: vectors stay on disk (codes: "
+                  << (quantized_->codeBytes() / (1024 * 1024)) << " MB)" << std::endl;
+        return true;
+    }
+    
     // load vectors into memory
     if (pm->getVectorStore()) {
         pm->getVectorStore()->loadAllVectorsIntoMemory(vector_memory_mb);
@@ -91,24 +236,6 @@ void DiskBPlusTree::clearMemoryIndex() {
     }
 }
 
-void DiskBPlusTree::readFromMemory(uint32_t pid, BPlusNode& node) const {
-    auto it = memory_index_.find(pid);
-    if (it != memory_index_.end()) {
-        node = it->second;
-    } else {
-        // fallback to disk read if not found in memory (shouldn't happen if properly loaded)
-        pm->readNode(pid, node);
-    }
-}
-
-const BPlusNode* DiskBPlusTree::getNodeFromMemory(uint32_t pid) const {
-    auto it = memory_index_.find(pid);
-    if (it != memory_index_.end()) {
-        return &(it->second);
-    }
-    return nullptr;
-}
-
 BPlusNode DiskBPlusTree::createNode() const {
     BPlusNode node;
     node.init(pm->getOrder(), pm->getMaxVectorSize());
@@ -141,7 +268,46 @@ void DiskBPlusTree::splitLeaf(uint32_t leafPid, BPlusNode& leaf, int& promotedKe
     write(newLeafPid, newLeaf);
 }
 
+void DiskBPlusTree::adjustPathCounts(const std::vector<uint32_t>& path, const std::vector<int>& pathIndex,
+                                     size_t levels, int64_t delta) {
+    if (!pm->hasSubtreeCounts()) return;
+    BPlusNode ancestor;
+    for (size_t level = 0; level < levels; level++) {
+        read(path[level], ancestor);
+        ancestor.child_counts[pathIndex[level]] += delta;
+        write(path[level], ancestor);
+    }
+}
+
+void DiskBPlusTree::onTreeModified() {
+    // Only touched when present: snapshot readers may be checking them
+    if (hasLeafSummaries()) leaf_summaries_.clear();
+    if (hasSegmentGraphs()) segment_graphs_.close();
+    total_leaves_ = 0;
+    pm->noteModification();
+}
+
+void DiskBPlusTree::insert_batch(const std::vector<DataObject>& objects) {
+    WriteScope scope(*this);  // one snapshot for the whole batch
+    VectorStore* vector_store = pm->getVectorStore();
+    pm->beginBatchWrite();
+    vector_store->beginBulkAppend();
+    try {
+        for (const DataObject& obj : objects) {
+            insert_data_object(obj);
+        }
+    } catch (...) {
+        vector_store->endBulkAppend();
+        pm->endBatchWrite();
+        throw;
+    }
+    vector_store->endBulkAppend();
+    pm->endBatchWrite();
+}
+
 void DiskBPlusTree::insert_data_object(const DataObject& obj) {
+    WriteScope scope(*this);
+    onTreeModified();
     int key;
     if (obj.is_int_value()) {
         key = obj.get_int_value();
@@ -213,6 +379,7 @@ void DiskBPlusTree::insert_data_object(const DataObject& obj) {
         node.vector_list_ids[existingIdx] = new_first_id;
         node.vector_counts[existingIdx]++;
         write(pid, node);
+        adjustPathCounts(path, pathIndex, path.size() - 1, 1);
         return;
     }
 
@@ -236,17 +403,21 @@ void DiskBPlusTree::insert_data_object(const DataObject& obj) {
     // if leaf doesn't overflow, just write and return
     if (node.keyCount < static_cast<int>(order)) {
         write(pid, node);
+        adjustPathCounts(path, pathIndex, path.size() - 1, 1);
         return;
     }
 
     // leaf overflows - need to split
     int promoted;
     uint32_t newNodePid;
+    const uint64_t splitCount = node.vectorCount();
     splitLeaf(pid, node, promoted, newNodePid);
 
-    // propagate split up the tree
+    // propagate split up the tree, with the vector counts of both halves
     uint32_t childPid = newNodePid;
     int promotedKey = promoted;
+    uint64_t leftCount = node.vectorCount();
+    uint64_t rightCount = splitCount - leftCount;
     
     for (int level = static_cast<int>(path.size()) - 2; level >= 0; level--) {
         uint32_t parentPid = path[level];
@@ -258,16 +429,20 @@ void DiskBPlusTree::insert_data_object(const DataObject& obj) {
         while (j >= 0 && parent.keys[j] > promotedKey) {
             parent.keys[j + 1] = parent.keys[j];
             parent.children[j + 2] = parent.children[j + 1];
+            parent.child_counts[j + 2] = parent.child_counts[j + 1];
             j--;
         }
 
         parent.keys[j + 1] = promotedKey;
         parent.children[j + 2] = childPid;
+        parent.child_counts[j + 1] = leftCount;
+        parent.child_counts[j + 2] = rightCount;
         parent.keyCount++;
 
         // if parent doesn't overflow, write and return
         if (parent.keyCount < static_cast<int>(order)) {
             write(parentPid, parent);
+            adjustPathCounts(path, pathIndex, static_cast<size_t>(level), 1);
             return;
         }
 
@@ -285,9 +460,12 @@ void DiskBPlusTree::insert_data_object(const DataObject& obj) {
         
         for (int k = 0; k <= newInternal.keyCount; k++) {
             newInternal.children[k] = parent.children[mid + 1 + k];
+            newInternal.child_counts[k] = parent.child_counts[mid + 1 + k];
         }
         
         parent.keyCount = mid;
+        leftCount = parent.vectorCount();
+        rightCount = newInternal.vectorCount();
 
         uint32_t newInternalPid = pm->allocatePage();
         write(parentPid, parent);
@@ -303,6 +481,8 @@ void DiskBPlusTree::insert_data_object(const DataObject& obj) {
     newRoot.keys[0] = promotedKey;
     newRoot.children[0] = rootPid;
     newRoot.children[1] = childPid;
+    newRoot.child_counts[0] = leftCount;
+    newRoot.child_counts[1] = rightCount;
 
     uint32_t newRootPid = pm->allocatePage();
     write(newRootPid, newRoot);
@@ -311,26 +491,14 @@ void DiskBPlusTree::insert_data_object(const DataObject& obj) {
 
 void DiskBPlusTree::bulk_load(std::vector<DataObject>& objects, float fill_factor) {
     if (objects.empty()) {
+        onTreeModified();
         return;
     }
     
-    // validate fill_factor
-    if (fill_factor < 0.5f) fill_factor = 0.5f;
-    if (fill_factor > 1.0f) fill_factor = 1.0f;
-    
-    uint32_t order = pm->getOrder();
-    int keys_per_leaf = static_cast<int>(order * fill_factor);
-    if (keys_per_leaf < 1) keys_per_leaf = 1;
-    if (keys_per_leaf >= static_cast<int>(order)) keys_per_leaf = order - 1;
-    
-    std::cout << "Bulk loading " << objects.size() << " objects with fill_factor=" 
-              << fill_factor << " (keys_per_leaf=" << keys_per_leaf << ")" << std::endl;
+    std::cout << "Bulk loading " << objects.size() << " objects with fill_factor=" << fill_factor << std::endl;
     
     auto start_time = std::chrono::high_resolution_clock::now();
     
-    // pre-reserve VectorStore  metadata to avoid rehashing during bulk insert
-    pm->getVectorStore()->reserveMetadata(objects.size());
-    
     // step 1: extract keys once into a flat array (avoids variant dispatch per comparison)
     size_t N = objects.size();
     std::vector<int> keys(N);
@@ -339,154 +507,168 @@ void DiskBPlusTree::bulk_load(std::vector<DataObject>& objects, float fill_facto
                                             : static_cast<int>(objects[i].get_float_value());
     }
     
-    // step 1b: permutation-based sort — sort lightweight int indices, then reorder DataObjects
+    // step 2: sort lightweight int indices by key (the objects themselves are not moved)
     std::vector<int> perm(N);
     std::iota(perm.begin(), perm.end(), 0);
     std::sort(perm.begin(), perm.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
     
-    // reorder keys array to sorted order (needed for grouping below)
-    {
-        std::vector<int> sorted_keys(N);
-        for (size_t i = 0; i < N; i++) sorted_keys[i] = keys[perm[i]];
-        keys = std::move(sorted_keys);
+    // step 3: stream them into the bottom-up builder in key order
+    BulkLoader loader(*this, fill_factor);
+    loader.reserve(N);
+    for (int idx : perm) {
+        const std::vector<float>& vec = objects[idx].get_vector();
+        loader.add(keys[idx], vec.data(), static_cast<uint32_t>(vec.size()), objects[idx].get_id());
     }
+    loader.finish();
     
-    // apply permutation in-place using cycle-following (each DataObject  moved at most once)
-    {
-        std::vector<bool> placed(N, false);
-        for (size_t i = 0; i < N; i++) {
-            if (placed[i] || perm[i] == static_cast<int>(i)) continue;
-            DataObject temp = std::move(objects[i]);
-            size_t j = i;
-            while (perm[j] != static_cast<int>(i)) {
-                objects[j] = std::move(objects[perm[j]]);
-                placed[j] = true;
-                j = perm[j];
-            }
-            objects[j] = std::move(temp);
-            placed[j] = true;
-        }
-    }
-    perm.clear();
-    perm.shrink_to_fit();
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
     
-    // step 2: group objects by key using pre-extracted sorted keys (no variant dispatch)
-    struct KeyGroup {
-        int key;
-        std::vector<const DataObject*> objects;
-    };
-    std::vector<KeyGroup> key_groups;
+    std::cout << "Bulk load completed in " << duration.count() << " ms" << std::endl;
+    std::cout << "  Root page: " << pm->getRoot() << std::endl;
+}
+
+DiskBPlusTree::BulkLoader::BulkLoader(DiskBPlusTree& tree, float fill_factor) : tree_(tree) {
+    // The new tree goes to fresh pages, so readers keep the old one until the loader is done
+    tree_.beginWrite();
+    tree_.onTreeModified();
     
-    int current_key = keys[0];
-    key_groups.push_back({current_key, {&objects[0]}});
+    // validate fill_factor
+    if (fill_factor < 0.5f) fill_factor = 0.5f;
+    if (fill_factor > 1.0f) fill_factor = 1.0f;
     
-    for (size_t i = 1; i < N; i++) {
-        if (keys[i] == current_key) {
-            key_groups.back().objects.push_back(&objects[i]);
-        } else {
-            current_key = keys[i];
-            key_groups.push_back({current_key, {&objects[i]}});
+    const uint32_t order = tree_.pm->getOrder();
+    keys_per_node_ = static_cast<int>(order * fill_factor);
+    if (keys_per_node_ < 1) keys_per_node_ = 1;
+    if (keys_per_node_ >= static_cast<int>(order)) keys_per_node_ = order - 1;
+    
+    leaf_ = tree_.createNode();
+    leaf_.isLeaf = true;
+    
+    tree_.pm->getVectorStore()->beginBulkAppend();
+    tree_.pm->beginBulkWrite();
+}
+
+DiskBPlusTree::BulkLoader::~BulkLoader() {
+    tree_.pm->getVectorStore()->endBulkAppend();
+    tree_.pm->endBulkWrite();
+    tree_.endWrite();
+}
+
+void DiskBPlusTree::BulkLoader::reserve(size_t vectors) {
+    tree_.pm->getVectorStore()->reserveMetadata(vectors);
+}
+
+void DiskBPlusTree::BulkLoader::add(int key, const float* vector, uint32_t size, int32_t original_id) {
+    if (has_group_ && key != group_key_) {
+        if (key < group_key_) {
+            throw std::runtime_error("BulkLoader: key " + std::to_string(key) + " added after " + std::to_string(group_key_));
         }
+        flushGroup();
     }
-    keys.clear();
-    keys.shrink_to_fit();
+    has_group_ = true;
+    group_key_ = key;
+    group_data_.insert(group_data_.end(), vector, vector + size);
+    group_sizes_.push_back(size);
+    group_ids_.push_back(original_id);
+    vectors_++;
+}
+
+void DiskBPlusTree::BulkLoader::flushGroup() {
+    if (!has_group_) return;
+    VectorStore* store = tree_.pm->getVectorStore();
     
-    std::cout << "  Grouped into " << key_groups.size() << " unique keys" << std::endl;
+    // every leaf gets one aligned block: its key lists are stored back to back as a
+    // single id sequence, so a leaf scan is one sequential read
+    if (leaf_.keyCount == 0) {
+        store->alignNextRecord();
+    }
+    uint64_t first_vector_id = store->storeVectorSequence(group_data_.data(), group_sizes_.data(), group_ids_.data(),
+                                                          group_ids_.size());
     
-    // step 3: build leaf nodes
-    // keep previous leaf in memory to avoid re-reading from disk for next-pointer linking
-    std::vector<uint32_t> leaf_pids;
-    std::vector<int> leaf_first_keys;
-    BPlusNode prev_leaf;
-    uint32_t prev_leaf_pid = INVALID_PAGE;
+    leaf_.keys[leaf_.keyCount] = group_key_;
+    leaf_.vector_list_ids[leaf_.keyCount] = first_vector_id;
+    leaf_.vector_counts[leaf_.keyCount] = static_cast<uint32_t>(group_ids_.size());
+    leaf_.keyCount++;
+    keys_++;
     
-    size_t group_idx = 0;
-    while (group_idx < key_groups.size()) {
-        BPlusNode leaf = createNode();
-        leaf.isLeaf = true;
-        leaf.keyCount = 0;
-        
-        // fill this leaf with keys up to keys_per_leaf
-        while (leaf.keyCount < keys_per_leaf && group_idx < key_groups.size()) {
-            const KeyGroup& group = key_groups[group_idx];
-            
-            // store all vectors for this key
-            uint64_t first_vector_id = 0;
-            uint32_t vector_count = 0;
-            
-            for (const DataObject* obj : group.objects) {
-                const std::vector<float>& vec = obj->get_vector();
-                uint32_t vec_size = static_cast<uint32_t>(vec.size());
-                int32_t orig_id = obj->get_id();
-                
-                if (first_vector_id == 0) {
-                    first_vector_id = pm->getVectorStore()->storeVector(vec, vec_size, orig_id);
-                } else {
-                    first_vector_id = pm->getVectorStore()->appendVectorToList(first_vector_id, vec, vec_size, orig_id);
-                }
-                vector_count++;
-            }
-            
-            leaf.keys[leaf.keyCount] = group.key;
-            leaf.vector_list_ids[leaf.keyCount] = first_vector_id;
-            leaf.vector_counts[leaf.keyCount] = vector_count;
-            leaf.keyCount++;
-            group_idx++;
-        }
-        
-        uint32_t leaf_pid = pm->allocatePageDeferred();
-        leaf_pids.push_back(leaf_pid);
-        leaf_first_keys.push_back(leaf.keys[0]);
-        
-        // link previous leaf to this one (using in-memory copy, no disk re-read)
-        if (prev_leaf_pid != INVALID_PAGE) {
-            prev_leaf.next = leaf_pid;
-            write(prev_leaf_pid, prev_leaf);
-        }
-        
-        leaf.next = INVALID_PAGE;
-        prev_leaf = leaf;
-        prev_leaf_pid = leaf_pid;
+    has_group_ = false;
+    group_data_.clear();
+    group_sizes_.clear();
+    group_ids_.clear();
+    
+    if (leaf_.keyCount >= keys_per_node_) {
+        flushLeaf();
     }
+}
+
+void DiskBPlusTree::BulkLoader::flushLeaf() {
+    if (leaf_.keyCount == 0) return;
     
-    // write the last leaf (its next pointer is already INVALID_PAGE)
-    if (prev_leaf_pid != INVALID_PAGE) {
-        write(prev_leaf_pid, prev_leaf);
+    uint32_t leaf_pid = tree_.pm->allocatePageDeferred();
+    leaf_pids_.push_back(leaf_pid);
+    leaf_first_keys_.push_back(leaf_.keys[0]);
+    leaf_counts_.push_back(leaf_.vectorCount());
+    
+    // link previous leaf to this one (using in-memory copy, no disk re-read)
+    if (prev_leaf_pid_ != INVALID_PAGE) {
+        prev_leaf_.next = leaf_pid;
+        tree_.write(prev_leaf_pid_, prev_leaf_);
     }
     
-    std::cout << "  Created " << leaf_pids.size() << " leaf nodes" << std::endl;
+    leaf_.next = INVALID_PAGE;
+    std::swap(prev_leaf_, leaf_);
+    prev_leaf_pid_ = leaf_pid;
+    leaf_ = tree_.createNode();
+    leaf_.isLeaf = true;
+}
+
+void DiskBPlusTree::BulkLoader::finish() {
+    if (finished_) return;
+    finished_ = true;
+    flushGroup();
+    flushLeaf();
+    if (leaf_pids_.empty()) return;
+    
+    PageManager* pm = tree_.pm.get();
+    
+    // write the last leaf (its next pointer is already INVALID_PAGE)
+    tree_.write(prev_leaf_pid_, prev_leaf_);
+    
+    std::cout << "  Grouped into " << keys_ << " unique keys" << std::endl;
+    std::cout << "  Created " << leaf_pids_.size() << " leaf nodes" << std::endl;
     
-    // step 4: build internal nodes bottom-up
-    if (leaf_pids.size() == 1) {
-        pm->setRootDeferred(leaf_pids[0]);
+    // build internal nodes bottom-up
+    if (leaf_pids_.size() == 1) {
+        pm->setRootDeferred(leaf_pids_[0]);
     } else {
         // build internal node levels
-        std::vector<uint32_t> current_level_pids = leaf_pids;
-        std::vector<int> current_level_keys = leaf_first_keys;
-        
-        int keys_per_internal = static_cast<int>(order * fill_factor);
-        if (keys_per_internal < 1) keys_per_internal = 1;
-        if (keys_per_internal >= static_cast<int>(order)) keys_per_internal = order - 1;
+        std::vector<uint32_t> current_level_pids = std::move(leaf_pids_);
+        std::vector<int> current_level_keys = std::move(leaf_first_keys_);
+        std::vector<uint64_t> current_level_counts = std::move(leaf_counts_);
         
         while (current_level_pids.size() > 1) {
             std::vector<uint32_t> next_level_pids;
             std::vector<int> next_level_keys;
+            std::vector<uint64_t> next_level_counts;
             
             size_t child_idx = 0;
             while (child_idx < current_level_pids.size()) {
-                BPlusNode internal = createNode();
+                BPlusNode internal = tree_.createNode();
                 internal.isLeaf = false;
                 internal.keyCount = 0;
                 
                 // first child pointer
                 internal.children[0] = current_level_pids[child_idx];
+                internal.child_counts[0] = current_level_counts[child_idx];
                 int first_key = current_level_keys[child_idx];
                 child_idx++;
                 
                 // add keys and child pointers
-                while (internal.keyCount < keys_per_internal && child_idx < current_level_pids.size()) {
+                while (internal.keyCount < keys_per_node_ && child_idx < current_level_pids.size()) {
                     internal.keys[internal.keyCount] = current_level_keys[child_idx];
                     internal.children[internal.keyCount + 1] = current_level_pids[child_idx];
+                    internal.child_counts[internal.keyCount + 1] = current_level_counts[child_idx];
                     internal.keyCount++;
                     child_idx++;
                 }
@@ -494,29 +676,29 @@ void DiskBPlusTree::bulk_load(std::vector<DataObject>& objects, float fill_facto
                 uint32_t internal_pid = pm->allocatePageDeferred();
                 next_level_pids.push_back(internal_pid);
                 next_level_keys.push_back(first_key);
-                write(internal_pid, internal);
+                next_level_counts.push_back(internal.vectorCount());
+                tree_.write(internal_pid, internal);
             }
             
             std::cout << "  Created " << next_level_pids.size() << " internal nodes at level" << std::endl;
             current_level_pids = std::move(next_level_pids);
             current_level_keys = std::move(next_level_keys);
+            current_level_counts = std::move(next_level_counts);
         }
         
         pm->setRootDeferred(current_level_pids[0]);
     }
     
+    // the new tree replaces whatever the file held, so its counts are complete
+    pm->setSubtreeCounts();
+    
     // single header save + vector store flush at the end (instead of per-allocation)
     pm->getVectorStore()->flush();
     pm->saveHeader();
-    
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-    
-    std::cout << "Bulk load completed in " << duration.count() << " ms" << std::endl;
-    std::cout << "  Root page: " << pm->getRoot() << std::endl;
 }
 
 DataObject* DiskBPlusTree::search_data_object(const DataObject& obj, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
     int key;
     if (obj.is_int_value()) {
         key = obj.get_int_value();
@@ -528,30 +710,24 @@ DataObject* DiskBPlusTree::search_data_object(const DataObject& obj, bool use_me
     if (pid == INVALID_PAGE) return nullptr;
     
     BPlusNode diskNode;
-    const BPlusNode* nodePtr = nullptr;
+    NodeView node;
     
     while (true) {
-        if (use_memory_index && memory_index_loaded_) {
-            nodePtr = getNodeFromMemory(pid);
-        } else {
-            read(pid, diskNode);
-            nodePtr = &diskNode;
-        }
+        node = fetchNode(pid, diskNode, use_memory_index);
         
-        int i = 0;
-        while (i < nodePtr->keyCount && key > nodePtr->keys[i]) i++;
+        int i = node.lowerBound(key);
         
-        if (nodePtr->isLeaf) break;
-        pid = nodePtr->children[i];
+        if (node.isLeaf) break;
+        pid = node.children[i];
     }
     
     // find unique key and retrieve first vector from its list
-    for (int i = 0; i < nodePtr->keyCount; i++) {
-        if (nodePtr->keys[i] == key) {
+    for (int i = 0; i < node.keyCount; i++) {
+        if (node.keys[i] == key) {
             std::vector<float> vec;
             uint32_t actual_size;
             int32_t original_id;
-            pm->getVectorStore()->retrieveVector(nodePtr->vector_list_ids[i], vec, actual_size, original_id);
+            pm->getVectorStore()->retrieveVector(node.vector_list_ids[i], vec, actual_size, original_id);
             DataObject* result = new DataObject(vec, key);
             result->set_id(original_id);
             return result;
@@ -562,40 +738,35 @@ DataObject* DiskBPlusTree::search_data_object(const DataObject& obj, bool use_me
 }
 
 DataObject* DiskBPlusTree::search_data_object(int key, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
     uint32_t pid = pm->getRoot();
     if (pid == INVALID_PAGE) return nullptr;
     
     BPlusNode diskNode;
-    const BPlusNode* nodePtr = nullptr;
+    NodeView node;
     
     // navigate to the leaf that should contain the key
     while (true) {
-        if (use_memory_index && memory_index_loaded_) {
-            nodePtr = getNodeFromMemory(pid);
-        } else {
-            read(pid, diskNode);
-            nodePtr = &diskNode;
-        }
+        node = fetchNode(pid, diskNode, use_memory_index);
         
-        int i = 0;
-        while (i < nodePtr->keyCount && key > nodePtr->keys[i]) i++;
+        int i = node.lowerBound(key);
         
-        if (nodePtr->isLeaf) break;
-        pid = nodePtr->children[i];
+        if (node.isLeaf) break;
+        pid = node.children[i];
     }
     
     // keys are unique per leaf, search for exact match
-    for (int i = 0; i < nodePtr->keyCount; i++) {
-        if (nodePtr->keys[i] == key) {
+    for (int i = 0; i < node.keyCount; i++) {
+        if (node.keys[i] == key) {
             std::vector<float> vec;
             uint32_t actual_size;
             int32_t original_id;
-            pm->getVectorStore()->retrieveVector(nodePtr->vector_list_ids[i], vec, actual_size, original_id);
+            pm->getVectorStore()->retrieveVector(node.vector_list_ids[i], vec, actual_size, original_id);
             DataObject* result = new DataObject(vec, key);
             result->set_id(original_id);
             return result;
         }
-        if (nodePtr->keys[i] > key) {
+        if (node.keys[i] > key) {
             return nullptr;
         }
     }
@@ -626,6 +797,8 @@ bool DiskBPlusTree::delete_data_object(float key) {
 }
 
 bool DiskBPlusTree::deleteDataObject(int key, const std::vector<float>& vector) {
+    WriteScope scope(*this);
+    onTreeModified();
     uint32_t rootPid = pm->getRoot();
     if (rootPid == INVALID_PAGE) {
         return false;
@@ -684,6 +857,7 @@ bool DiskBPlusTree::deleteDataObject(int key, const std::vector<float>& vector)
     if (new_count == node.vector_counts[keyIndex]) {
         return false;  // vector not found in list
     }
+    adjustPathCounts(path, pathIndex, path.size() - 1, -1);
     
     if (new_count > 0) {
         // list still has vectors, just update the reference
@@ -712,26 +886,9 @@ bool DiskBPlusTree::deleteDataObject(int key, const std::vector<float>& vector)
         return true;
     }
     
-    // update ancestor separator keys if needed
-    if (node.keyCount > 0) {
-        int replacementKey = node.keys[0];
-        for (int level = static_cast<int>(path.size()) - 2; level >= 0; level--) {
-            BPlusNode ancestor;
-            read(path[level], ancestor);
-            bool modified = false;
-            
-            for (int k = 0; k < ancestor.keyCount; k++) {
-                if (ancestor.keys[k] == key) {
-                    ancestor.keys[k] = replacementKey;
-                    modified = true;
-                }
-            }
-            
-            if (modified) {
-                write(path[level], ancestor);
-            }
-        }
-    }
+    // ancestor separators keep the deleted key: they still bound their children, while
+    // rewriting them to the leaf's new first key broke the bounds once duplicate keys spanned
+    // leaves (count_range and collect_leaf_pids rely on them)
     
     // If leaf has enough keys, just write and return
     if (node.keyCount >= minKeys) {
@@ -789,6 +946,8 @@ bool DiskBPlusTree::deleteDataObject(int key, const std::vector<float>& vector)
 }
 
 bool DiskBPlusTree::deleteKey(int key) {
+    WriteScope scope(*this);
+    onTreeModified();
     uint32_t rootPid = pm->getRoot();
     if (rootPid == INVALID_PAGE) {
         return false;
@@ -834,6 +993,7 @@ bool DiskBPlusTree::deleteKey(int key) {
     if (keyIndex == -1) {
         return false;
     }
+    adjustPathCounts(path, pathIndex, path.size() - 1, -static_cast<int64_t>(node.vector_counts[keyIndex]));
     
     // remove the key by shifting elements left
     for (int i = keyIndex; i < node.keyCount - 1; i++) {
@@ -854,28 +1014,9 @@ bool DiskBPlusTree::deleteKey(int key) {
         return true;
     }
     
-    // update all ancestor separator keys that match the deleted key
-    // this is necessary because b+ tree separators are copies of leaf keys
-    if (node.keyCount > 0) {
-        int replacementKey = node.keys[0]; // new first key of the leaf after deletion
-        for (int level = static_cast<int>(path.size()) - 2; level >= 0; level--) {
-            BPlusNode ancestor;
-            read(path[level], ancestor);
-            bool modified = false;
-            
-            // check all keys in this ancestor node
-            for (int k = 0; k < ancestor.keyCount; k++) {
-                if (ancestor.keys[k] == key) {
-                    ancestor.keys[k] = replacementKey;
-                    modified = true;
-                }
-            }
-            
-            if (modified) {
-                write(path[level], ancestor);
-            }
-        }
-    }
+    // ancestor separators keep the deleted key: they still bound their children, while
+    // rewriting them to the leaf's new first key broke the bounds once duplicate keys spanned
+    // leaves (count_range and collect_leaf_pids rely on them)
     
     // If leaf has enough keys, just write and return
     if (node.keyCount >= minKeys) {
@@ -973,15 +1114,19 @@ bool DiskBPlusTree::borrowFromLeftSibling(BPlusNode& parent, int childIdx, BPlus
         }
         for (int i = node.keyCount + 1; i > 0; i--) {
             node.children[i] = node.children[i - 1];
+            node.child_counts[i] = node.child_counts[i - 1];
         }
         
         node.keys[0] = parent.keys[childIdx - 1];
         node.children[0] = leftSibling.children[leftSibling.keyCount];
+        node.child_counts[0] = leftSibling.child_counts[leftSibling.keyCount];
         node.keyCount++;
         
         parent.keys[childIdx - 1] = leftSibling.keys[leftSibling.keyCount - 1];
         leftSibling.keyCount--;
     }
+    parent.child_counts[childIdx - 1] = leftSibling.vectorCount();
+    parent.child_counts[childIdx] = node.vectorCount();
     
     write(leftPid, leftSibling);
     write(nodePid, node);
@@ -1019,6 +1164,7 @@ bool DiskBPlusTree::borrowFromRightSibling(BPlusNode& parent, int childIdx, BPlu
         // internal node borrowing
         node.keys[node.keyCount] = parent.keys[childIdx];
         node.children[node.keyCount + 1] = rightSibling.children[0];
+        node.child_counts[node.keyCount + 1] = rightSibling.child_counts[0];
         node.keyCount++;
         
         parent.keys[childIdx] = rightSibling.keys[0];
@@ -1028,9 +1174,12 @@ bool DiskBPlusTree::borrowFromRightSibling(BPlusNode& parent, int childIdx, BPlu
         }
         for (int i = 0; i < rightSibling.keyCount; i++) {
             rightSibling.children[i] = rightSibling.children[i + 1];
+            rightSibling.child_counts[i] = rightSibling.child_counts[i + 1];
         }
         rightSibling.keyCount--;
     }
+    parent.child_counts[childIdx] = node.vectorCount();
+    parent.child_counts[childIdx + 1] = rightSibling.vectorCount();
     
     write(rightPid, rightSibling);
     write(nodePid, node);
@@ -1061,6 +1210,7 @@ void DiskBPlusTree::mergeWithLeftSibling(BPlusNode& parent, int childIdx, BPlusN
         }
         for (int i = 0; i <= node.keyCount; i++) {
             leftSibling.children[leftSibling.keyCount + i] = node.children[i];
+            leftSibling.child_counts[leftSibling.keyCount + i] = node.child_counts[i];
         }
         leftSibling.keyCount += node.keyCount;
     }
@@ -1072,7 +1222,9 @@ void DiskBPlusTree::mergeWithLeftSibling(BPlusNode& parent, int childIdx, BPlusN
     }
     for (int i = childIdx; i < parent.keyCount; i++) {
         parent.children[i] = parent.children[i + 1];
+        parent.child_counts[i] = parent.child_counts[i + 1];
     }
+    parent.child_counts[childIdx - 1] = leftSibling.vectorCount();
     parent.keyCount--;
 }
 
@@ -1100,6 +1252,7 @@ void DiskBPlusTree::mergeWithRightSibling(BPlusNode& parent, int childIdx, BPlus
         }
         for (int i = 0; i <= rightSibling.keyCount; i++) {
             node.children[node.keyCount + i] = rightSibling.children[i];
+            node.child_counts[node.keyCount + i] = rightSibling.child_counts[i];
         }
         node.keyCount += rightSibling.keyCount;
     }
@@ -1111,11 +1264,14 @@ void DiskBPlusTree::mergeWithRightSibling(BPlusNode& parent, int childIdx, BPlus
     }
     for (int i = childIdx + 1; i < parent.keyCount + 1; i++) {
         parent.children[i] = parent.children[i + 1];
+        parent.child_counts[i] = parent.child_counts[i + 1];
     }
+    parent.child_counts[childIdx] = node.vectorCount();
     parent.keyCount--;
 }
 
 std::vector<DataObject*> DiskBPlusTree::search_range(int min_key, int max_key, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
     std::vector<DataObject*> results;
     
     uint32_t pid = pm->getRoot();
@@ -1125,63 +1281,49 @@ std::vector<DataObject*> DiskBPlusTree::search_range(int min_key, int max_key, b
     
     // Find leaf node that contains min_key
     BPlusNode diskNode;
-    const BPlusNode* nodePtr = nullptr;
+    NodeView node;
     
     while (true) {
-        if (use_memory_index && memory_index_loaded_) {
-            nodePtr = getNodeFromMemory(pid);
-        } else {
-            read(pid, diskNode);
-            nodePtr = &diskNode;
-        }
+        node = fetchNode(pid, diskNode, use_memory_index);
         
-        int i = 0;
-        while (i < nodePtr->keyCount && min_key > nodePtr->keys[i]) i++;
+        int i = node.lowerBound(min_key);
         
-        if (nodePtr->isLeaf) {
+        if (node.isLeaf) {
             break;
         }
-        pid = nodePtr->children[i];
+        pid = node.children[i];
     }
     
     // Collect data from this leaf and subsequent leaves until max_key is reached
     uint32_t currentPid = pid;
     
     while (currentPid != INVALID_PAGE) {
-        const BPlusNode* leafPtr = nullptr;
-        BPlusNode diskLeaf;
-        if (use_memory_index && memory_index_loaded_) {
-            leafPtr = getNodeFromMemory(currentPid);
-        } else {
-            read(currentPid, diskLeaf);
-            leafPtr = &diskLeaf;
-        }
-        if (!leafPtr) break;
+        NodeView leaf = fetchNode(currentPid, diskNode, use_memory_index);
         
-        for (int i = 0; i < leafPtr->keyCount; i++) {
-            if (leafPtr->keys[i] >= min_key && leafPtr->keys[i] <= max_key) {
+        for (int i = 0; i < leaf.keyCount; i++) {
+            if (leaf.keys[i] >= min_key && leaf.keys[i] <= max_key) {
                 // retrieve all vectors for this key
                 std::vector<std::vector<float>> vectors;
                 std::vector<uint32_t> sizes;
                 std::vector<int32_t> original_ids;
                 pm->getVectorStore()->retrieveVectorList(
-                    leafPtr->vector_list_ids[i], 
-                    leafPtr->vector_counts[i],
+                    leaf.vector_list_ids[i], 
+                    leaf.vector_counts[i],
                     vectors, sizes, original_ids
                 );
                 
                 for (size_t v = 0; v < vectors.size(); v++) {
-                    DataObject* result = new DataObject(vectors[v], leafPtr->keys[i]);
+                    DataObject* result = new DataObject(vectors[v], leaf.keys[i]);
                     if (v < original_ids.size()) result->set_id(original_ids[v]);
                     results.push_back(result);
                 }
             }
-            else if (leafPtr->keys[i] > max_key) {
+            else if (leaf.keys[i] > max_key) {
                 return results;
             }
         }
         
-        uint32_t nextPid = leafPtr->next;
+        uint32_t nextPid = leaf.next;
         if (nextPid == currentPid) {
             break;
         }
@@ -1196,6 +1338,7 @@ std::vector<DataObject*> DiskBPlusTree::search_range(float min_key, float max_ke
 }
 
 bool DiskBPlusTree::search(const DataObject& obj, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
     int key;
     if (obj.is_int_value()) {
         key = obj.get_int_value();
@@ -1207,25 +1350,19 @@ bool DiskBPlusTree::search(const DataObject& obj, bool use_memory_index) {
     if (pid == INVALID_PAGE) return false;
     
     BPlusNode diskNode;
-    const BPlusNode* nodePtr = nullptr;
+    NodeView node;
     
     while (true) {
-        if (use_memory_index && memory_index_loaded_) {
-            nodePtr = getNodeFromMemory(pid);
-        } else {
-            read(pid, diskNode);
-            nodePtr = &diskNode;
-        }
+        node = fetchNode(pid, diskNode, use_memory_index);
         
-        int i = 0;
-        while (i < nodePtr->keyCount && key > nodePtr->keys[i]) i++;
+        int i = node.lowerBound(key);
         
-        if (nodePtr->isLeaf) break;
-        pid = nodePtr->children[i];
+        if (node.isLeaf) break;
+        pid = node.children[i];
     }
     
-    for (int i = 0; i < nodePtr->keyCount; i++) {
-        if (nodePtr->keys[i] == key) {
+    for (int i = 0; i < node.keyCount; i++) {
+        if (node.keys[i] == key) {
             return true;
         }
     }
@@ -1234,6 +1371,7 @@ bool DiskBPlusTree::search(const DataObject& obj, bool use_memory_index) {
 }
 
 void DiskBPlusTree::print_tree() {
+    PageManager::ReadSnapshot snapshot(*pm);
     uint32_t rootPid = pm->getRoot();
     if (rootPid == INVALID_PAGE) {
         std::cout << "(empty tree)" << std::endl;
@@ -1272,14 +1410,16 @@ void DiskBPlusTree::print_tree_recursive(uint32_t pid, int level) {
 }
 
 std::pair<int, int> DiskBPlusTree::get_key_range() {
+    PageManager::ReadSnapshot snapshot(*pm);
     uint32_t pid = pm->getRoot();
     if (pid == INVALID_PAGE) {
         return {0, -1};
     }
 
-    BPlusNode node;
+    BPlusNode scratch;
+    NodeView node;
     while (true) {
-        read(pid, node);
+        node = fetchNode(pid, scratch, false);
         if (node.isLeaf) {
             break;
         }
@@ -1295,8 +1435,7 @@ std::pair<int, int> DiskBPlusTree::get_key_range() {
 
     uint32_t currentPid = pid;
     while (currentPid != INVALID_PAGE) {
-        BPlusNode leaf;
-        read(currentPid, leaf);
+        NodeView leaf = fetchNode(currentPid, scratch, false);
 
         if (leaf.keyCount > 0) {
             max_key = leaf.keys[leaf.keyCount - 1];
@@ -1312,303 +1451,649 @@ std::pair<int, int> DiskBPlusTree::get_key_range() {
     return {min_key, max_key};
 }
 
-// Calculate Euclidean distance between two vectors
-static double calculate_euclidean_distance(const std::vector<float>& v1, const std::vector<float>& v2) {
-    double sum = 0.0;
-    size_t min_size = std::min(v1.size(), v2.size());
-    for (size_t i = 0; i < min_size; i++) {
-        double diff = static_cast<double>(v1[i]) - static_cast<double>(v2[i]);
-        sum += diff * diff;
+// Squared Euclidean distance between the query and a stored vector (read in place)
+// KNN ranking only needs the order, so the sqrt is skipped
+static inline double calculate_squared_distance(L2SqrKernel l2_sqr_kernel, const std::vector<float>& query, const float* vec, size_t size) {
+    return l2_sqr_kernel(query.data(), vec, std::min(query.size(), size));
+}
+
+// Keep the k best hits as a max-heap on distance (front = current worst)
+static inline void offer_knn_candidate(std::vector<KNNResult>& heap, size_t k, const KNNResult& hit) {
+    if (heap.size() < k) {
+        heap.push_back(hit);
+        std::push_heap(heap.begin(), heap.end());
+    } else if (hit.distance < heap.front().distance) {
+        std::pop_heap(heap.begin(), heap.end());
+        heap.back() = hit;
+        std::push_heap(heap.begin(), heap.end());
     }
-    return std::sqrt(sum);
 }
 
-std::vector<DataObject*> DiskBPlusTree::search_knn_optimized(const std::vector<float>& query_vector, int min_key, int max_key, int k, bool use_memory_index) {
-    auto search_start = std::chrono::high_resolution_clock::now();
-    std::vector<DataObject*> results;
+// Visit the vectors of every key of leaf in [min_key, max_key] as fn(key, view), in key order
+// Adjacent lists that form one id sequence (bulk_load leaf blocks) are read as a single block
+template <typename Fn>
+static void for_each_leaf_vector(VectorStore* store, const NodeView& leaf, int min_key, int max_key, Fn&& fn) {
+    int i = 0;
+    while (i < leaf.keyCount && leaf.keys[i] < min_key) i++;
+    
+    const bool block_reads = store->readsFromDisk();
+    while (i < leaf.keyCount && leaf.keys[i] <= max_key) {
+        // Grow a run over following keys whose lists continue the same id sequence
+        const uint64_t run_first = leaf.vector_list_ids[i];
+        uint64_t run_count = 0;
+        int j = i;
+        while (block_reads && j < leaf.keyCount && leaf.keys[j] <= max_key &&
+               leaf.vector_list_ids[j] == run_first + run_count &&
+               store->isSequentialList(leaf.vector_list_ids[j], leaf.vector_counts[j])) {
+            run_count += leaf.vector_counts[j];
+            j++;
+        }
+        
+        if (j - i < 2) {
+            const int key = leaf.keys[i];
+            store->forEachVectorInList(leaf.vector_list_ids[i], leaf.vector_counts[i],
+                                       [&](const VectorStore::VectorView& view) { fn(key, view); });
+            i++;
+            continue;
+        }
+        
+        int key_idx = i;
+        uint64_t key_end_id = run_first + leaf.vector_counts[i];
+        store->forEachVectorInIdRange(run_first, run_count, [&](const VectorStore::VectorView& view) {
+            while (view.id >= key_end_id) {
+                key_idx++;
+                key_end_id += leaf.vector_counts[key_idx];
+            }
+            fn(leaf.keys[key_idx], view);
+        });
+        i = j;
+    }
+}
+
+// True if no vector of leaf can come closer to query than kth (squared distance), by the
+// leaf's summary: |q - v| >= |q - centroid| - radius for every vector v of the leaf
+static inline bool leaf_cannot_improve(const LeafSummaries& summaries, const NodeView& leaf,
+                                       const std::vector<float>& query, double kth, L2SqrKernel l2_sqr_kernel) {
+    if (summaries.empty() || query.size() != summaries.dimension() || !std::isfinite(kth)) {
+        return false;
+    }
+    float radius;
+    const float* centroid = summaries.find(leaf, radius);
+    if (!centroid) return false;
     
-    uint32_t pid = pm->getRoot();
-    if (pid == INVALID_PAGE || k <= 0) {
-        return results;
+    double center_distance = std::sqrt(l2_sqr_kernel(query.data(), centroid, query.size()));
+    double gap = center_distance - radius;
+    // slack for float rounding, so a leaf that could still tie the K-th distance is scanned
+    return gap > 0.0 && gap > std::sqrt(kth) + 1e-5 * (center_distance + radius);
+}
+
+static inline double kth_distance(const std::vector<KNNResult>& heap, size_t k) {
+    return heap.size() >= k ? heap.front().distance : std::numeric_limits<double>::infinity();
+}
+
+static inline int count_keys_in_range(const NodeView& leaf, int min_key, int max_key) {
+    int n = 0;
+    for (int i = 0; i < leaf.keyCount; i++) {
+        if (leaf.keys[i] >= min_key && leaf.keys[i] <= max_key) n++;
+    }
+    return n;
+}
+
+static inline uint64_t count_vectors_in_range(const NodeView& leaf, int min_key, int max_key) {
+    uint64_t n = 0;
+    for (int i = 0; i < leaf.keyCount; i++) {
+        if (leaf.keys[i] >= min_key && leaf.keys[i] <= max_key) n += leaf.vector_counts[i];
+    }
+    return n;
+}
+
+bool DiskBPlusTree::mapVectors() {
+    VectorStore* store = pm->getVectorStore();
+    return store && store->mapReadOnly();
+}
+
+bool DiskBPlusTree::isVectorStoreMapped() const {
+    const VectorStore* store = pm->getVectorStore();
+    return store && store->isMapped();
+}
+
+void DiskBPlusTree::get_result_vector(const KNNResult& hit, std::vector<float>& vector) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    // Same read path as the search itself, so it is safe under concurrent readers
+    vector.clear();
+    pm->getVectorStore()->forEachVectorInList(hit.vector_id, 1, [&](const VectorStore::VectorView& view) {
+        vector.assign(view.data, view.data + view.size);
+    });
+}
+
+std::vector<DataObject*> DiskBPlusTree::materialize_knn_results(const std::vector<KNNResult>& hits) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    std::vector<DataObject*> results;
+    results.reserve(hits.size());
+    for (const KNNResult& hit : hits) {
+        std::vector<float> vector;
+        get_result_vector(hit, vector);
+        DataObject* obj = new DataObject(std::move(vector), hit.key);
+        obj->set_id(hit.original_id);
+        results.push_back(obj);
     }
+    return results;
+}
+
+std::vector<DataObject*> DiskBPlusTree::search_knn_optimized(const std::vector<float>& query_vector, int min_key, int max_key, int k, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    std::vector<KNNResult> hits;
+    search_knn_into(query_vector, min_key, max_key, k, hits, use_memory_index);
+    return materialize_knn_results(hits);
+}
+
+bool DiskBPlusTree::buildLeafSummaries() {
+    if (pm->snapshotsEnabled()) return false;  // see enableSnapshots
+    VectorStore* store = pm->getVectorStore();
+    uint32_t pid = pm->getRoot();
+    if (!store || pid == INVALID_PAGE) return false;
+    store->flush();
     
-    // Priority queue to maintain K nearest neighbors (max-heap by distance)
-    std::priority_queue<std::pair<double, DataObject*>> knn_heap;
+    const uint32_t dim = store->getMaxVectorSize();
+    leaf_summaries_.reset(dim);
     
-    // Find leaf node that contains min_key
-    auto traversal_start = std::chrono::high_resolution_clock::now();
-    BPlusNode diskNode;
-    const BPlusNode* nodePtr = nullptr;
-    int tree_reads = 0;
+    BPlusNode node;
+    read(pid, node);
+    while (!node.isLeaf) {
+        pid = node.children[0];
+        read(pid, node);
+    }
     
+    std::vector<float> vectors;  // the current leaf's vectors, zero-padded to dim
+    std::vector<double> sum(dim);
+    std::vector<float> centroid(dim);
     while (true) {
-        if (use_memory_index && memory_index_loaded_) {
-            nodePtr = getNodeFromMemory(pid);
-        } else {
-            read(pid, diskNode);
-            nodePtr = &diskNode;
-        }
-        tree_reads++;
-        
-        int i = 0;
-        while (i < nodePtr->keyCount && min_key > nodePtr->keys[i]) i++;
+        vectors.clear();
+        for_each_leaf_vector(store, node, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+            [&](int, const VectorStore::VectorView& view) {
+                size_t base = vectors.size();
+                vectors.resize(base + dim, 0.0f);
+                std::copy(view.data, view.data + std::min<uint32_t>(view.size, dim), vectors.begin() + base);
+            }
+        );
         
-        if (nodePtr->isLeaf) {
-            break;
-        }
-        pid = nodePtr->children[i];
-    }
-    
-    auto traversal_end = std::chrono::high_resolution_clock::now();
-    auto traversal_time = std::chrono::duration_cast<std::chrono::microseconds>(traversal_end - traversal_start).count();
-    Logger::debug("Tree traversal completed: " + std::to_string(tree_reads) + " node reads, " + std::to_string(traversal_time) + " μs");
-    
-    // Traverse leaves and maintain K best candidates
-    auto leaf_scan_start = std::chrono::high_resolution_clock::now();
-    uint32_t currentPid = pid;
-    int leaf_reads = 0;
-    int vectors_processed = 0;
-    long long vector_reconstruction_time = 0;
-    long long distance_calculation_time = 0;
-    long long heap_operation_time = 0;
-    long long readahead_time = 0;
-    
-    // Progress tracking
-    int range_size = max_key - min_key + 1;
-    int keys_processed = 0;
-    int last_progress_percent = -1;
-    auto last_progress_time = leaf_scan_start;
-    
-    // process all vectors from each key's list
-    if (use_memory_index && memory_index_loaded_) {
-        while (currentPid != INVALID_PAGE) {
-            const BPlusNode* leafPtr = getNodeFromMemory(currentPid);
-            if (!leafPtr) break;
-            leaf_reads++;
+        const size_t n = vectors.size() / dim;
+        if (n > 0) {
+            std::fill(sum.begin(), sum.end(), 0.0);
+            for (size_t v = 0; v < n; v++) {
+                for (uint32_t d = 0; d < dim; d++) sum[d] += vectors[v * dim + d];
+            }
+            for (uint32_t d = 0; d < dim; d++) centroid[d] = static_cast<float>(sum[d] / n);
             
-            for (int i = 0; i < leafPtr->keyCount; i++) {
-                if (leafPtr->keys[i] >= min_key && leafPtr->keys[i] <= max_key) {
-                    keys_processed++;
-                    
-                    // Progress logging
-                    int progress_percent = (keys_processed * 100) / range_size;
-                    if (progress_percent != last_progress_percent && progress_percent % 10 == 0) {
-                        auto current_time = std::chrono::high_resolution_clock::now();
-                        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - last_progress_time).count();
-                        Logger::info("Search progress: " + std::to_string(progress_percent) + "% (" + 
-                                    std::to_string(keys_processed) + "/" + std::to_string(range_size) + " keys) | " +
-                                    std::to_string(vectors_processed) + " vectors | " + std::to_string(elapsed) + "ms");
-                        last_progress_percent = progress_percent;
-                        last_progress_time = current_time;
-                    }
-                    
-                    // retrieve all vectors for this key
-                    std::vector<std::vector<float>> vectors;
-                    std::vector<uint32_t> sizes;
-                    std::vector<int32_t> original_ids;
-                    pm->getVectorStore()->retrieveVectorList(
-                        leafPtr->vector_list_ids[i], 
-                        leafPtr->vector_counts[i],
-                        vectors, sizes, original_ids
-                    );
-                    
-                    for (size_t v = 0; v < vectors.size(); v++) {
-                        vectors_processed++;
-                        double distance = calculate_euclidean_distance(query_vector, vectors[v]);
-                        DataObject* candidate = new DataObject(vectors[v], leafPtr->keys[i]);
-                        if (v < original_ids.size()) candidate->set_id(original_ids[v]);
-                        
-                        if (knn_heap.size() < static_cast<size_t>(k)) {
-                            knn_heap.push({distance, candidate});
-                        } else if (distance < knn_heap.top().first) {
-                            delete knn_heap.top().second;
-                            knn_heap.pop();
-                            knn_heap.push({distance, candidate});
-                        } else {
-                            delete candidate;
-                        }
-                    }
-                }
-                else if (leafPtr->keys[i] > max_key) {
-                    goto extract_results;
+            // radius against the stored (float) centroid, rounded up
+            double max_sq = 0.0;
+            for (size_t v = 0; v < n; v++) {
+                double sq = 0.0;
+                for (uint32_t d = 0; d < dim; d++) {
+                    double diff = static_cast<double>(vectors[v * dim + d]) - centroid[d];
+                    sq += diff * diff;
                 }
+                max_sq = std::max(max_sq, sq);
             }
-            currentPid = leafPtr->next;
+            float radius = std::nextafter(static_cast<float>(std::sqrt(max_sq)), std::numeric_limits<float>::infinity());
+            leaf_summaries_.add(node, centroid.data(), radius);
         }
-        goto extract_results;
+        
+        uint32_t nextPid = node.next;
+        if (nextPid == INVALID_PAGE || nextPid == pid) break;
+        pid = nextPid;
+        read(pid, node);
     }
     
-    // DISK PATH: Use read-ahead buffer for better I/O performance
-    {
-        const int READAHEAD_SIZE = 3;
-        std::vector<BPlusNode> readahead_buffer;
-        std::vector<uint32_t> readahead_pids;
-        
-        auto batch_read_start = std::chrono::high_resolution_clock::now();
-        BPlusNode current_leaf;
-        read(currentPid, current_leaf);
-        leaf_reads++;
-        
-        uint32_t next_pid = current_leaf.next;
-        for (int i = 0; i < READAHEAD_SIZE && next_pid != INVALID_PAGE; i++) {
-            BPlusNode ahead_leaf;
-            read(next_pid, ahead_leaf);
-            leaf_reads++;
-            readahead_buffer.push_back(ahead_leaf);
-            readahead_pids.push_back(next_pid);
-            next_pid = ahead_leaf.next;
-        }
-        auto batch_read_end = std::chrono::high_resolution_clock::now();
-        readahead_time += std::chrono::duration_cast<std::chrono::microseconds>(batch_read_end - batch_read_start).count();
-        
-        while (currentPid != INVALID_PAGE) {
-            const BPlusNode& leaf = current_leaf;
-                    
-            for (int i = 0; i < leaf.keyCount; i++) {
-                if (leaf.keys[i] >= min_key && leaf.keys[i] <= max_key) {
-                    keys_processed++;
-                    
-                    // Progress logging
-                    int progress_percent = (keys_processed * 100) / range_size;
-                    if (progress_percent != last_progress_percent && progress_percent % 10 == 0) {
-                        auto current_time = std::chrono::high_resolution_clock::now();
-                        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - last_progress_time).count();
-                        Logger::info("Search progress: " + std::to_string(progress_percent) + "% (" + 
-                                    std::to_string(keys_processed) + "/" + std::to_string(range_size) + " keys) | " +
-                                    std::to_string(vectors_processed) + " vectors | " + std::to_string(elapsed) + "ms");
-                        last_progress_percent = progress_percent;
-                        last_progress_time = current_time;
-                    }
-                    
-                    // retrieve all vectors for this key
-                    auto vec_start = std::chrono::high_resolution_clock::now();
-                    std::vector<std::vector<float>> vectors;
-                    std::vector<uint32_t> sizes;
-                    std::vector<int32_t> original_ids;
-                    pm->getVectorStore()->retrieveVectorList(
-                        leaf.vector_list_ids[i], 
-                        leaf.vector_counts[i],
-                        vectors, sizes, original_ids
-                    );
-                    auto vec_end = std::chrono::high_resolution_clock::now();
-                    vector_reconstruction_time += std::chrono::duration_cast<std::chrono::microseconds>(vec_end - vec_start).count();
-                    
-                    for (size_t v = 0; v < vectors.size(); v++) {
-                        vectors_processed++;
-                        
-                        auto dist_start = std::chrono::high_resolution_clock::now();
-                        double distance = calculate_euclidean_distance(query_vector, vectors[v]);
-                        auto dist_end = std::chrono::high_resolution_clock::now();
-                        distance_calculation_time += std::chrono::duration_cast<std::chrono::microseconds>(dist_end - dist_start).count();
-                        
-                        DataObject* candidate = new DataObject(vectors[v], leaf.keys[i]);
-                        if (v < original_ids.size()) candidate->set_id(original_ids[v]);
-                        
-                        auto heap_start = std::chrono::high_resolution_clock::now();
-                        if (knn_heap.size() < static_cast<size_t>(k)) {
-                            knn_heap.push({distance, candidate});
-                        } else if (distance < knn_heap.top().first) {
-                            delete knn_heap.top().second;
-                            knn_heap.pop();
-                            knn_heap.push({distance, candidate});
-                        } else {
-                            delete candidate;
-                        }
-                        auto heap_end = std::chrono::high_resolution_clock::now();
-                        heap_operation_time += std::chrono::duration_cast<std::chrono::microseconds>(heap_end - heap_start).count();
-                    }
+    if (!leaf_summaries_.save(store->getFilename() + ".leafsum", store->getNextVectorId())) {
+        leaf_summaries_.clear();
+        return false;
+    }
+    Logger::info("Built " + std::to_string(leaf_summaries_.size()) + " leaf summaries");
+    return true;
+}
+
+bool DiskBPlusTree::loadLeafSummaries() {
+    VectorStore* store = pm->getVectorStore();
+    if (!store || pm->snapshotsEnabled()) return false;
+    return leaf_summaries_.load(store->getFilename() + ".leafsum", store->getNextVectorId());
+}
+
+bool DiskBPlusTree::buildSegmentGraphs(size_t segment_vectors, uint32_t degree) {
+    if (pm->snapshotsEnabled()) return false;  // see enableSnapshots
+    VectorStore* store = pm->getVectorStore();
+    uint32_t pid = pm->getRoot();
+    if (!store || pid == INVALID_PAGE) return false;
+    store->flush();
+    segment_graphs_.close();
+    
+    const uint32_t dim = store->getMaxVectorSize();
+    const std::string path = store->getFilename() + ".graph";
+    SegmentGraphs::Builder builder(path, dim, degree, 2 * degree + 32);
+    if (!builder.ok()) return false;
+    
+    BPlusNode node;
+    read(pid, node);
+    while (!node.isLeaf) {
+        pid = node.children[0];
+        read(pid, node);
+    }
+    
+    // Segments are runs of whole leaves, so a segment's key range holds exactly its vectors
+    std::vector<SegmentGraphs::Node> nodes;
+    std::vector<float> vectors;
+    int32_t first_key = 0;
+    int32_t last_key = 0;
+    size_t segments = 0;
+    while (true) {
+        if (node.keyCount > 0) {
+            if (nodes.empty()) first_key = node.keys[0];
+            last_key = node.keys[node.keyCount - 1];
+            for_each_leaf_vector(store, node, std::numeric_limits<int>::min(), std::numeric_limits<int>::max(),
+                [&](int key, const VectorStore::VectorView& view) {
+                    nodes.push_back({view.id, key, view.original_id});
+                    size_t base = vectors.size();
+                    vectors.resize(base + dim, 0.0f);
+                    std::copy(view.data, view.data + std::min<uint32_t>(view.size, dim), vectors.begin() + base);
                 }
-                else if (leaf.keys[i] > max_key) {
-                    goto extract_results;
+            );
+        }
+        
+        uint32_t nextPid = node.next;
+        bool last_leaf = nextPid == INVALID_PAGE || nextPid == pid;
+        if (!nodes.empty() && (nodes.size() >= segment_vectors || last_leaf)) {
+            builder.addSegment(first_key, last_key, nodes, vectors);
+            segments++;
+            nodes.clear();
+            vectors.clear();
+        }
+        if (last_leaf) break;
+        pid = nextPid;
+        read(pid, node);
+    }
+    
+    if (!builder.finish(store->getNextVectorId(), pm->getModificationCount())) {
+        std::cerr << "Failed to write segment graphs: " << path << std::endl;
+        return false;
+    }
+    Logger::info("Built " + std::to_string(segments) + " segment graphs");
+    return loadSegmentGraphs();
+}
+
+bool DiskBPlusTree::loadSegmentGraphs() {
+    VectorStore* store = pm->getVectorStore();
+    if (!store || pm->snapshotsEnabled()) return false;
+    return segment_graphs_.open(store->getFilename() + ".graph", store->getNextVectorId(), pm->getModificationCount());
+}
+
+bool DiskBPlusTree::search_knn_graph_into(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                                          std::vector<KNNResult>& out, bool use_memory_index) {
+    if (k <= 0 || min_key > max_key || query_vector.size() != segment_graphs_.dimension()) return false;
+    auto [first, last] = segment_graphs_.coveredSegments(min_key, max_key);
+    if (first == last) return false;
+    
+    out.clear();
+    const size_t heap_k = static_cast<size_t>(k);
+    const L2SqrKernel l2_sqr_kernel = l2_sqr_kernel_;
+    
+    SegmentGraphs::Scratch scratch;
+    std::vector<std::pair<float, uint32_t>> found;
+    for (size_t s = first; s < last; s++) {
+        segment_graphs_.search(s, query_vector.data(), heap_k, static_cast<size_t>(graph_ef_), l2_sqr_kernel, scratch, found);
+        for (const auto& [distance, index] : found) {
+            const SegmentGraphs::Node& node = segment_graphs_.node(s, index);
+            offer_knn_candidate(out, heap_k, {distance, node.vector_id, node.key, node.original_id});
+        }
+    }
+    
+    // Partially covered segments at both ends: regular scans (they cover no segment themselves)
+    std::vector<KNNResult> edge;
+    auto scan_edge = [&](int lo, int hi) {
+        if (lo > hi) return;
+        search_knn_into(query_vector, lo, hi, k, edge, use_memory_index);
+        for (const KNNResult& hit : edge) offer_knn_candidate(out, heap_k, hit);
+    };
+    const int covered_min = segment_graphs_.segment(first).first_key;
+    const int covered_max = segment_graphs_.segment(last - 1).last_key;
+    if (min_key < covered_min) scan_edge(min_key, covered_min - 1);
+    if (max_key > covered_max) scan_edge(covered_max + 1, max_key);
+    
+    std::sort_heap(out.begin(), out.end());
+    if (Logger::is_enabled(LogLevel::DEBUG)) {
+        Logger::debug("Graph KNN: " + std::to_string(last - first) + " segments via graph, edges [" +
+                      std::to_string(min_key) + "," + std::to_string(covered_min - 1) + "] and [" +
+                      std::to_string(covered_max + 1) + "," + std::to_string(max_key) + "] scanned");
+    }
+    return true;
+}
+
+bool DiskBPlusTree::buildQuantizedStore() {
+    VectorStore* store = pm->getVectorStore();
+    if (!store) return false;
+    store->flush();
+    
+    const std::string path = store->getFilename() + ".sq8";
+    if (quantized_) quantized_->close();
+    if (!QuantizedStore::build(*store, path)) {
+        return false;
+    }
+    return loadQuantizedStore();
+}
+
+bool DiskBPlusTree::loadQuantizedStore() {
+    VectorStore* store = pm->getVectorStore();
+    if (!store) return false;
+    if (!quantized_) quantized_ = std::make_unique<QuantizedStore>();
+    return quantized_->open(store->getFilename() + ".sq8");
+}
+
+void DiskBPlusTree::setQuantizedRerank(int rerank_factor) {
+    quantized_rerank_ = std::max(0, rerank_factor);
+}
+
+void DiskBPlusTree::search_knn_quantized_into(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                                              std::vector<KNNResult>& out, bool use_memory_index) {
+    out.clear();
+    uint32_t pid = pm->getRoot();
+    if (pid == INVALID_PAGE || k <= 0 || min_key > max_key) return;
+    
+    VectorStore* vector_store = pm->getVectorStore();
+    const L2SqrKernel l2_sqr_kernel = l2_sqr_kernel_;
+    const QuantizedStore& codes = *quantized_;
+    
+    std::vector<float> table;
+    codes.buildDistanceTable(query_vector.data(), query_vector.size(), table);
+    
+    const size_t heap_k = static_cast<size_t>(k);
+    const size_t pool_k = heap_k * static_cast<size_t>(quantized_rerank_);
+    std::vector<KNNResult> pool;        // best candidates by quantized distance
+    std::vector<KNNResult> uncoded;     // stored after the codes were built: ranked exactly
+    pool.reserve(pool_k);
+    
+    BPlusNode scratch;
+    NodeView node;
+    while (true) {
+        node = fetchNode(pid, scratch, use_memory_index);
+        if (node.isLeaf) break;
+        int i = node.lowerBound(min_key);
+        pid = node.children[i];
+    }
+    
+    // Pass 1: codes only (list ids come from the metadata table, no vector reads)
+    size_t scanned = 0;
+    while (true) {
+        for (int i = 0; i < node.keyCount; i++) {
+            const int key = node.keys[i];
+            if (key < min_key) continue;
+            if (key > max_key) goto rerank;
+            
+            vector_store->forEachIdInList(node.vector_list_ids[i], node.vector_counts[i],
+                [&](uint64_t vector_id, int32_t original_id) {
+                    scanned++;
+                    const uint8_t* code = codes.code(vector_id);
+                    if (!code) {
+                        uncoded.push_back({0.0, vector_id, key, original_id});
+                        return;
+                    }
+                    offer_knn_candidate(pool, pool_k, {codes.distance(table, code), vector_id, key, original_id});
                 }
+            );
+        }
+        
+        uint32_t nextPid = node.next;
+        if (nextPid == INVALID_PAGE || nextPid == pid) break;
+        pid = nextPid;
+        node = fetchNode(pid, scratch, use_memory_index);
+    }
+    
+rerank:
+    // Pass 2: exact distances for the survivors, read in id (file) order
+    pool.insert(pool.end(), uncoded.begin(), uncoded.end());
+    std::sort(pool.begin(), pool.end(), [](const KNNResult& a, const KNNResult& b) {
+        return a.vector_id < b.vector_id;
+    });
+    
+    out.reserve(heap_k);
+    for (const KNNResult& candidate : pool) {
+        vector_store->forEachVectorInList(candidate.vector_id, 1, [&](const VectorStore::VectorView& view) {
+            double distance = calculate_squared_distance(l2_sqr_kernel, query_vector, view.data, view.size);
+            offer_knn_candidate(out, heap_k, {distance, candidate.vector_id, candidate.key, candidate.original_id});
+        });
+    }
+    std::sort_heap(out.begin(), out.end());
+    
+    if (Logger::is_enabled(LogLevel::DEBUG)) {
+        Logger::debug("Quantized KNN: " + std::to_string(scanned) + " codes scanned, " +
+                      std::to_string(pool.size()) + " re-ranked (" + std::to_string(uncoded.size()) + " without code)");
+    }
+}
+
+void DiskBPlusTree::search_knn_into(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                                    std::vector<KNNResult>& out, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    if (graph_ef_ > 0 && hasSegmentGraphs() &&
+        search_knn_graph_into(query_vector, min_key, max_key, k, out, use_memory_index)) {
+        return;
+    }
+    if (quantized_rerank_ > 0 && hasQuantizedStore()) {
+        search_knn_quantized_into(query_vector, min_key, max_key, k, out, use_memory_index);
+        return;
+    }
+    
+    MetricTimer search_timer(MetricStage::Search);
+    const bool debug_log = Logger::is_enabled(LogLevel::DEBUG);
+    const auto search_start = debug_log ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    out.clear();
+    
+    uint32_t pid = pm->getRoot();
+    if (pid == INVALID_PAGE || k <= 0) {
+        return;
+    }
+    Metrics::add(MetricCounter::Searches);
+    
+    VectorStore* vector_store = pm->getVectorStore();
+    const L2SqrKernel l2_sqr_kernel = l2_sqr_kernel_;
+    
+    // K nearest neighbors kept as a max-heap of PODs directly in the caller's buffer
+    const size_t heap_k = static_cast<size_t>(k);
+    out.reserve(heap_k);
+    
+    // Find leaf node that contains min_key
+    MetricTimer traversal_timer(MetricStage::Traversal);
+    BPlusNode diskNode;
+    NodeView node;
+    int tree_reads = 0;
+    
+    while (true) {
+        node = fetchNode(pid, diskNode, use_memory_index);
+        tree_reads++;
+        
+        int i = node.lowerBound(min_key);
+        
+        if (node.isLeaf) {
+            break;
+        }
+        pid = node.children[i];
+    }
+    
+    traversal_timer.stop();
+    Metrics::add(MetricCounter::NodesTraversed, static_cast<uint64_t>(tree_reads));
+    if (debug_log) {
+        Logger::debug("Tree traversal completed: " + std::to_string(tree_reads) + " node reads");
+    }
+    
+    // Traverse leaves and maintain K best candidates
+    uint32_t currentPid = pid;
+    int leaf_reads = 0;
+    int leaves_pruned = 0;
+    int vectors_processed = 0;
+    MetricVectorSampler sampler;
+    
+    // Score one vector; distance/heap timing is sampled (see MetricVectorSampler)
+    auto score = [&](int key, const VectorStore::VectorView& view) {
+        vectors_processed++;
+        sampler.begin();
+        double distance = calculate_squared_distance(l2_sqr_kernel, query_vector, view.data, view.size);
+        sampler.distance_done();
+        if (out.size() >= heap_k && distance >= out.front().distance) {
+            return;
+        }
+        sampler.offer_begin();
+        offer_knn_candidate(out, heap_k, {distance, view.id, key, view.original_id});
+        sampler.offered();
+    };
+    
+    // Scan the in-range vectors of one leaf, unless its summary rules it out
+    auto scan_leaf = [&](const NodeView& leaf) {
+        if (leaf_cannot_improve(leaf_summaries_, leaf, query_vector, kth_distance(out, heap_k), l2_sqr_kernel)) {
+            leaves_pruned++;
+            return;
+        }
+        MetricTimer scan_timer(MetricStage::LeafScan);
+        sampler.new_leaf();
+        for_each_leaf_vector(vector_store, leaf, min_key, max_key, score);
+    };
+    
+    // Progress (DEBUG only): by vectors under the range when the tree counts them (count_range),
+    // otherwise by distinct keys against the key width
+    const bool progress_by_vectors = pm->hasSubtreeCounts();
+    const uint64_t progress_total = !debug_log ? 1 : std::max<uint64_t>(1, progress_by_vectors
+        ? count_range(min_key, max_key, use_memory_index)
+        : static_cast<uint64_t>(static_cast<int64_t>(max_key) - min_key + 1));
+    uint64_t progress_done = 0;
+    int last_progress_percent = -1;
+    
+    auto log_progress = [&](const NodeView& leaf) {
+        if (!debug_log) return;
+        progress_done += progress_by_vectors ? count_vectors_in_range(leaf, min_key, max_key)
+                                             : static_cast<uint64_t>(count_keys_in_range(leaf, min_key, max_key));
+        int progress_percent = static_cast<int>(progress_done * 100 / progress_total) / 10 * 10;
+        if (progress_percent != last_progress_percent) {
+            Logger::debug("Search progress: " + std::to_string(progress_percent) + "% (" + 
+                          std::to_string(progress_done) + "/" + std::to_string(progress_total) +
+                          (progress_by_vectors ? " vectors" : " keys") + ") | " +
+                          std::to_string(vectors_processed) + " scored");
+            last_progress_percent = progress_percent;
+        }
+    };
+    
+    // process all vectors from each key's list: distances are computed on the stored data in place,
+    // a DataObject is only allocated when a vector actually enters the heap
+    // Resident and mapped leaves are viewed in place, so they need no read-ahead
+    if ((use_memory_index && memory_index_loaded_) || pm->isMapped()) {
+        while (currentPid != INVALID_PAGE) {
+            NodeView leaf = fetchNode(currentPid, diskNode, use_memory_index);
+            leaf_reads++;
+            
+            log_progress(leaf);
+            scan_leaf(leaf);
+            if (leaf.keyCount > 0 && leaf.keys[leaf.keyCount - 1] > max_key) {
+                goto extract_results;
             }
+            currentPid = leaf.next;
+        }
+        goto extract_results;
+    }
+    
+    // DISK PATH: leaves are read ahead of the scan, by the prefetch worker when enabled
+    // (see setPrefetchWindow), otherwise synchronously into a small read-ahead buffer
+    {
+        const size_t READAHEAD_SIZE = 3;
+        std::deque<BPlusNode> readahead_buffer;
+        
+        BPlusNode current_leaf;
+        
+        LeafPrefetcher* prefetcher = nullptr;
+        if (prefetch_window_ > 0 && pm->prepareConcurrentReads()) {
+            prefetcher = &getLeafPrefetcher();
+        }
+        LeafPrefetcher::Scan prefetch_scan(prefetcher);
+        
+        // One leaf read from disk, timed as a leaf read
+        auto read_leaf = [&](uint32_t leaf_pid, BPlusNode& into) {
+            MetricTimer read_timer(MetricStage::LeafRead);
+            read(leaf_pid, into);
+            leaf_reads++;
+        };
+        
+        // Keep READAHEAD_SIZE leaves buffered behind the current one
+        auto refill_readahead = [&]() {
+            if (prefetcher) return;
+            uint32_t next_pid = readahead_buffer.empty() ? current_leaf.next : readahead_buffer.back().next;
+            while (readahead_buffer.size() < READAHEAD_SIZE && next_pid != INVALID_PAGE) {
+                readahead_buffer.emplace_back();
+                read_leaf(next_pid, readahead_buffer.back());
+                next_pid = readahead_buffer.back().next;
+            }
+        };
+        
+        read_leaf(currentPid, current_leaf);
+        if (prefetcher && !(current_leaf.keyCount > 0 && current_leaf.keys[current_leaf.keyCount - 1] > max_key)) {
+            prefetch_snapshot_ = pm->pinnedSnapshot();
+            prefetcher->start(current_leaf.next, min_key, max_key, prefetch_window_);
+        }
+        refill_readahead();
+        
+        while (true) {
+            const BPlusNode& leaf = current_leaf;
             
-            // Move to next leaf using read-ahead buffer
-            if (!readahead_buffer.empty()) {
-                current_leaf = readahead_buffer.front();
-                readahead_buffer.erase(readahead_buffer.begin());
-                readahead_pids.erase(readahead_pids.begin());
-                currentPid = readahead_pids.empty() ? INVALID_PAGE : readahead_pids.front();
-                
-                if (!readahead_buffer.empty()) {
-                    BPlusNode last_leaf = readahead_buffer.back();
-                    next_pid = last_leaf.next;
-                    
-                    auto refill_start = std::chrono::high_resolution_clock::now();
-                    while (readahead_buffer.size() < READAHEAD_SIZE && next_pid != INVALID_PAGE) {
-                        BPlusNode ahead_leaf;
-                        read(next_pid, ahead_leaf);
-                        leaf_reads++;
-                        readahead_buffer.push_back(ahead_leaf);
-                        readahead_pids.push_back(next_pid);
-                        next_pid = ahead_leaf.next;
-                    }
-                    auto refill_end = std::chrono::high_resolution_clock::now();
-                    readahead_time += std::chrono::duration_cast<std::chrono::microseconds>(refill_end - refill_start).count();
+            log_progress(leaf);
+            scan_leaf(leaf);
+            
+            if (leaf.keyCount > 0 && leaf.keys[leaf.keyCount - 1] > max_key) {
+                goto extract_results;
+            }
+            
+            // Move to next leaf: from the prefetcher (time spent waiting on it counts as a leaf read)
+            if (prefetcher) {
+                MetricTimer wait_timer(MetricStage::LeafRead);
+                bool more = prefetcher->next(current_leaf);
+                wait_timer.stop();
+                if (!more) {
+                    break;
                 }
-            } else {
-                currentPid = INVALID_PAGE;
+                leaf_reads++;
+                continue;
+            }
+            // ... or the read-ahead buffer
+            if (readahead_buffer.empty()) {
+                break;
             }
+            current_leaf = std::move(readahead_buffer.front());
+            readahead_buffer.pop_front();
+            refill_readahead();
         }
     }  // End of DISK PATH block
     
 extract_results:
-    auto leaf_scan_end = std::chrono::high_resolution_clock::now();
-    auto leaf_scan_time = std::chrono::duration_cast<std::chrono::microseconds>(leaf_scan_end - leaf_scan_start).count();
-    
-    // Log detailed leaf scanning performance
-    Logger::debug("Leaf scanning completed: " + std::to_string(leaf_reads) + " leaf reads, " + 
-                  std::to_string(vectors_processed) + " vectors processed, " + 
-                  std::to_string(leaf_scan_time) + " μs total");
-    Logger::debug("  - Read-ahead I/O: " + std::to_string(readahead_time) + " μs (" + 
-                  std::to_string(readahead_time * 100.0 / leaf_scan_time) + "%)");
-    Logger::debug("  - Vector reconstruction: " + std::to_string(vector_reconstruction_time) + " μs (" + 
-                  std::to_string(vector_reconstruction_time * 100.0 / leaf_scan_time) + "%)");
-    Logger::debug("  - Distance calculation: " + std::to_string(distance_calculation_time) + " μs (" + 
-                  std::to_string(distance_calculation_time * 100.0 / leaf_scan_time) + "%)");
-    Logger::debug("  - Heap operations: " + std::to_string(heap_operation_time) + " μs (" + 
-                  std::to_string(heap_operation_time * 100.0 / leaf_scan_time) + "%)");
-    
-    // Extract results from heap and reverse order (heap gives largest first, we want smallest first)
-    auto extraction_start = std::chrono::high_resolution_clock::now();
-    results.reserve(knn_heap.size());
-    while (!knn_heap.empty()) {
-        results.push_back(knn_heap.top().second);
-        knn_heap.pop();
-    }
-    
-    // Reverse to get ascending order by distance
-    std::reverse(results.begin(), results.end());
-    
-    auto extraction_end = std::chrono::high_resolution_clock::now();
-    auto extraction_time = std::chrono::duration_cast<std::chrono::microseconds>(extraction_end - extraction_start).count();
-    
-    auto search_end = std::chrono::high_resolution_clock::now();
-    auto total_search_time = std::chrono::duration_cast<std::chrono::microseconds>(search_end - search_start).count();
-    
-    // Log overall search performance breakdown
-    Logger::info("KNN search completed: " + std::to_string(results.size()) + " results, " + 
-                 std::to_string(total_search_time) + " μs total");
-    Logger::info("  - Tree traversal: " + std::to_string(traversal_time) + " μs (" + 
-                 std::to_string(traversal_time * 100.0 / total_search_time) + "%)");
-    Logger::info("  - Leaf scanning: " + std::to_string(leaf_scan_time) + " μs (" + 
-                 std::to_string(leaf_scan_time * 100.0 / total_search_time) + "%)");
-    Logger::info("  - Result extraction: " + std::to_string(extraction_time) + " μs (" + 
-                 std::to_string(extraction_time * 100.0 / total_search_time) + "%)");
-    
-    return results;
+    sampler.flush();
+    Metrics::add(MetricCounter::LeafReads, static_cast<uint64_t>(leaf_reads));
+    Metrics::add(MetricCounter::LeavesScanned, static_cast<uint64_t>(leaf_reads - leaves_pruned));
+    Metrics::add(MetricCounter::LeavesPruned, static_cast<uint64_t>(leaves_pruned));
+    
+    // Turn the heap into ascending order by distance (in place, no allocation)
+    std::sort_heap(out.begin(), out.end());
+    
+    // Stage timings are in the metrics (Metrics::set_enabled), not in the log
+    if (debug_log) {
+        auto total_search_time = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - search_start).count();
+        Logger::debug("KNN search completed: " + std::to_string(out.size()) + " results, " +
+                      std::to_string(leaf_reads) + " leaf reads, " + std::to_string(leaves_pruned) + " leaves pruned, " +
+                      std::to_string(vectors_processed) + " vectors processed, " +
+                      std::to_string(total_search_time) + " μs total");
+    }
 }
 
 // Structure to hold sub-range KNN results with distance for efficient merging
 struct KNNCandidate {
-    double distance;
-    DataObject* obj;
+    KNNResult hit;
     int source_thread;  // Which thread this came from
     size_t next_index;  // Next index to fetch from this thread's results
     
     // For min-heap (smallest distance first)
     bool operator>(const KNNCandidate& other) const {
-        return distance > other.distance;
+        return hit.distance > other.hit.distance;
     }
 };
 
@@ -1619,239 +2104,699 @@ std::vector<DataObject*> DiskBPlusTree::search_knn_parallel(
     int k, 
     int num_threads,
     bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    std::vector<KNNResult> hits;
+    search_knn_parallel_into(query_vector, min_key, max_key, k, hits, num_threads, use_memory_index);
+    return materialize_knn_results(hits);
+}
+
+std::shared_ptr<ThreadPool> DiskBPlusTree::getSearchPool(size_t workers) {
+    std::lock_guard<std::mutex> lock(search_pool_mutex_);
+    if (!search_pool_ || search_pool_->size() != workers) {
+        // Queries still running on the old pool keep it alive through their shared_ptr
+        search_pool_ = std::make_shared<ThreadPool>(workers);
+    }
+    return search_pool_;
+}
+
+NodeView DiskBPlusTree::fetchNode(uint32_t pid, BPlusNode& scratch, bool use_memory_index) {
+    const uint32_t page = pm->resolve(pid);
+    if (use_memory_index && memory_index_loaded_) {
+        NodeView node = getNodeFromMemory(page);
+        if (node) return node;
+    }
+    if (pm->isMapped()) {
+        NodeView node = pm->mappedNode(page);
+        if (node) return node;
+    }
+    readPage(page, scratch);
+    return NodeView(scratch);
+}
+
+DiskBPlusTree::RangeEstimate DiskBPlusTree::estimate_range(int min_key, int max_key, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    RangeEstimate estimate;
+    std::vector<uint32_t> leaves;
+    collect_leaf_pids(min_key, max_key, leaves, use_memory_index);
+    estimate.leaves = leaves.size();
+    if (leaves.empty()) return estimate;
+    
+    // Subtree counts and resident leaves both give the exact count cheaply
+    if (pm->hasSubtreeCounts() || (use_memory_index && memory_index_loaded_)) {
+        estimate.vectors = count_range(min_key, max_key, use_memory_index);
+        estimate.exact = true;
+        return estimate;
+    }
+    
+    // Otherwise only internal nodes are read: scale by the average vectors per leaf
+    if (total_leaves_ == 0) {
+        std::vector<uint32_t> all;
+        collect_leaf_pids(std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), all, use_memory_index);
+        total_leaves_ = std::max<size_t>(1, all.size());
+    }
+    const VectorStore* store = pm->getVectorStore();
+    const double per_leaf = store ? static_cast<double>(store->getStoredCount()) / total_leaves_ : 0.0;
+    estimate.vectors = static_cast<uint64_t>(per_leaf * leaves.size());
+    return estimate;
+}
+
+uint64_t DiskBPlusTree::count_range(int min_key, int max_key, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    uint32_t rootPid = pm->getRoot();
+    if (rootPid == INVALID_PAGE || min_key > max_key) return 0;
     
-    auto parallel_start = std::chrono::high_resolution_clock::now();
-    std::vector<DataObject*> results;
+    if (pm->hasSubtreeCounts()) {
+        return count_range_recursive(rootPid, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(),
+                                     min_key, max_key, use_memory_index);
+    }
     
+    // Older files carry no counts: visit every overlapping leaf
+    std::vector<uint32_t> leaves;
+    collect_leaf_pids(min_key, max_key, leaves, use_memory_index);
+    BPlusNode scratch;
+    uint64_t total = 0;
+    for (uint32_t pid : leaves) {
+        total += count_vectors_in_range(fetchNode(pid, scratch, use_memory_index), min_key, max_key);
+    }
+    return total;
+}
+
+uint64_t DiskBPlusTree::count_range_recursive(uint32_t pid, int64_t lower, int64_t upper, int min_key, int max_key,
+                                              bool use_memory_index) {
+    BPlusNode scratch;
+    NodeView node = fetchNode(pid, scratch, use_memory_index);
+    if (node.isLeaf) return count_vectors_in_range(node, min_key, max_key);
+    
+    // Child i holds keys in [keys[i-1], keys[i]] (see collect_leaf_pids_recursive); a child whose
+    // bounds lie inside the range adds its stored count, so only the two boundary paths are read
+    uint64_t total = 0;
+    for (int i = 0; i <= node.keyCount; i++) {
+        int64_t child_lower = (i > 0) ? node.keys[i - 1] : lower;
+        int64_t child_upper = (i < node.keyCount) ? node.keys[i] : upper;
+        if (child_lower > max_key) break;
+        if (child_upper < min_key) continue;
+        
+        if (child_lower >= min_key && child_upper <= max_key) {
+            total += node.child_counts[i];
+        } else if (node.children[i] != INVALID_PAGE) {
+            total += count_range_recursive(node.children[i], child_lower, child_upper, min_key, max_key,
+                                           use_memory_index);
+        }
+    }
+    return total;
+}
+
+void DiskBPlusTree::collect_leaf_pids(int min_key, int max_key, std::vector<uint32_t>& leaves, bool use_memory_index,
+                                      std::vector<uint64_t>* leaf_counts) {
+    leaves.clear();
+    if (leaf_counts) leaf_counts->clear();
     uint32_t rootPid = pm->getRoot();
-    if (rootPid == INVALID_PAGE || k <= 0) {
-        return results;
+    if (rootPid == INVALID_PAGE || min_key > max_key) return;
+    if (!pm->hasSubtreeCounts()) leaf_counts = nullptr;
+    
+    // All leaves sit at the same depth; find it once so the last internal level can emit
+    // child pids without reading the leaves themselves
+    int leaf_depth = 0;
+    BPlusNode scratch;
+    uint32_t pid = rootPid;
+    while (true) {
+        NodeView node = fetchNode(pid, scratch, use_memory_index);
+        if (node.isLeaf) break;
+        pid = node.children[0];
+        leaf_depth++;
     }
     
-    uint32_t maxVecSize = pm->getMaxVectorSize();
-    int range_size = max_key - min_key + 1;
+    if (leaf_depth == 0) {
+        leaves.push_back(rootPid);
+        if (leaf_counts) leaf_counts->push_back(fetchNode(rootPid, scratch, use_memory_index).vectorCount());
+        return;
+    }
+    collect_leaf_pids_recursive(rootPid, 0, leaf_depth, min_key, max_key, leaves, leaf_counts, use_memory_index);
+}
+
+void DiskBPlusTree::collect_leaf_pids_recursive(uint32_t pid, int depth, int leaf_depth, int min_key, int max_key,
+                                                std::vector<uint32_t>& leaves, std::vector<uint64_t>* leaf_counts,
+                                                bool use_memory_index) {
     
-    Logger::debug("Parallel KNN search started: range=[" + std::to_string(min_key) + "," + 
-                  std::to_string(max_key) + "], size=" + std::to_string(range_size) + 
-                  ", K=" + std::to_string(k));
+    BPlusNode scratch;
+    NodeView node = fetchNode(pid, scratch, use_memory_index);
     
-    // Determine optimal thread count
-    // Rule: At least 1000 elements per thread to overcome I/O mutex overhead
-    // Parallel is only beneficial for large ranges due to disk I/O serialization
-    const int MIN_RANGE_PER_THREAD = 1000;
-    const int MIN_TOTAL_RANGE_FOR_PARALLEL = 5000;  // Don't parallelize small ranges
+    // Child i holds keys between keys[i-1] and keys[i]; bounds are inclusive on both sides
+    // because equal keys may sit on either side of a separator
+    for (int i = 0; i <= node.keyCount; i++) {
+        if (i > 0 && node.keys[i - 1] > max_key) break;
+        if (i < node.keyCount && node.keys[i] < min_key) continue;
+        
+        uint32_t child = node.children[i];
+        if (child == INVALID_PAGE) continue;
+        if (depth + 1 == leaf_depth) {
+            leaves.push_back(child);
+            if (leaf_counts) leaf_counts->push_back(node.child_counts[i]);
+        } else {
+            collect_leaf_pids_recursive(child, depth + 1, leaf_depth, min_key, max_key, leaves, leaf_counts,
+                                        use_memory_index);
+        }
+    }
+}
+
+NodeView DiskBPlusTree::fetchNodeConcurrent(uint32_t pid, BPlusNode& scratch, std::vector<char>& page_buffer,
+                                            BufferPool::PinnedNode& pinned, bool use_memory_index) {
+    const uint32_t page = pm->resolve(pid);
+    if (use_memory_index && memory_index_loaded_) {
+        NodeView node = getNodeFromMemory(page);
+        if (node) return node;
+    }
+    if (pm->isMapped()) {
+        NodeView node = pm->mappedNode(page);
+        if (node) return node;
+    }
+    if (buffer_pool_) {
+        const PageManager* page_reader = pm.get();
+        pinned = buffer_pool_->fetch(page, [&](BPlusNode& loaded) {
+            page_reader->readNodeAt(page, loaded, page_buffer);
+        });
+        return NodeView(*pinned);
+    }
+    pm->readNodeAt(page, scratch, page_buffer);
+    return NodeView(scratch);
+}
+
+void DiskBPlusTree::search_knn_concurrent(const std::vector<float>& query_vector, int min_key, int max_key, int k,
+                                          std::vector<KNNResult>& out, std::vector<char>& page_buffer,
+                                          bool use_memory_index) {
+    out.clear();
+    uint32_t pid = pm->getRoot();
+    if (pid == INVALID_PAGE || k <= 0 || min_key > max_key) return;
+    
+    MetricTimer search_timer(MetricStage::Search);
+    Metrics::add(MetricCounter::Searches);
+    
+    VectorStore* vector_store = pm->getVectorStore();
+    const L2SqrKernel l2_sqr_kernel = l2_sqr_kernel_;
+    const size_t heap_k = static_cast<size_t>(k);
+    if (out.capacity() < heap_k) out.reserve(heap_k);
+    
+    BPlusNode scratch;
+    BufferPool::PinnedNode pinned;
+    NodeView node;
+    uint64_t nodes_traversed = 0;
+    uint64_t leaf_reads = 1;
+    uint64_t leaves_pruned = 0;
+    MetricVectorSampler sampler;
+    
+    // Navigate to leaf containing min_key
+    MetricTimer traversal_timer(MetricStage::Traversal);
+    while (true) {
+        node = fetchNodeConcurrent(pid, scratch, page_buffer, pinned, use_memory_index);
+        nodes_traversed++;
+        if (node.isLeaf) break;
+        int i = node.lowerBound(min_key);
+        pid = node.children[i];
+    }
+    traversal_timer.stop();
     
-    int hw_threads = static_cast<int>(std::thread::hardware_concurrency());
-    if (hw_threads <= 0) hw_threads = 4;  // Fallback
+    while (true) {
+        if (leaf_cannot_improve(leaf_summaries_, node, query_vector, kth_distance(out, heap_k), l2_sqr_kernel)) {
+            leaves_pruned++;
+        } else {
+            MetricTimer scan_timer(MetricStage::LeafScan);
+            sampler.new_leaf();
+            for_each_leaf_vector(vector_store, node, min_key, max_key,
+                [&](int key, const VectorStore::VectorView& view) {
+                    sampler.begin();
+                    double distance = calculate_squared_distance(l2_sqr_kernel, query_vector, view.data, view.size);
+                    sampler.distance_done();
+                    if (out.size() >= heap_k && distance >= out.front().distance) return;
+                    sampler.offer_begin();
+                    offer_knn_candidate(out, heap_k, {distance, view.id, key, view.original_id});
+                    sampler.offered();
+                }
+            );
+        }
+        if (node.keyCount > 0 && node.keys[node.keyCount - 1] > max_key) break;
+        
+        uint32_t nextPid = node.next;
+        if (nextPid == INVALID_PAGE || nextPid == pid) break;
+        pid = nextPid;
+        MetricTimer read_timer(MetricStage::LeafRead);
+        node = fetchNodeConcurrent(pid, scratch, page_buffer, pinned, use_memory_index);
+        leaf_reads++;
+    }
     
-    int max_useful_threads = std::max(1, range_size / MIN_RANGE_PER_THREAD);
-    int actual_threads = (num_threads > 0) ? num_threads : std::min(hw_threads, max_useful_threads);
+    Metrics::add(MetricCounter::NodesTraversed, nodes_traversed);
+    Metrics::add(MetricCounter::LeafReads, leaf_reads);
+    Metrics::add(MetricCounter::LeavesScanned, leaf_reads - leaves_pruned);
+    Metrics::add(MetricCounter::LeavesPruned, leaves_pruned);
+    std::sort_heap(out.begin(), out.end());
+}
+
+// Merge sorted hits into sorted out, keeping the k nearest
+static void merge_knn_hits(std::vector<KNNResult>& out, const std::vector<KNNResult>& hits, size_t k,
+                           std::vector<KNNResult>& merged) {
+    merged.clear();
+    std::merge(out.begin(), out.end(), hits.begin(), hits.end(), std::back_inserter(merged));
+    if (merged.size() > k) merged.resize(k);
+    out.swap(merged);
+}
+
+void DiskBPlusTree::search_knn_ranges_into(const std::vector<float>& query_vector,
+                                           const std::vector<std::pair<int, int>>& intervals, int k,
+                                           std::vector<KNNResult>& out, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    out.clear();
+    if (k <= 0) return;
+    std::vector<KNNResult> hits, merged;
+    for (const auto& interval : intervals) {
+        if (interval.first > interval.second) continue;
+        search_knn_into(query_vector, interval.first, interval.second, k, hits, use_memory_index);
+        merge_knn_hits(out, hits, static_cast<size_t>(k), merged);
+    }
+}
+
+void DiskBPlusTree::search_knn_batch(const std::vector<std::vector<float>>& queries,
+                                     const std::vector<std::pair<int, int>>& ranges, int k,
+                                     const KNNBatchHooks& hooks, int num_threads, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    const size_t count = std::min(queries.size(), ranges.size());
+    if (count == 0) return;
     
-    Logger::debug("Thread configuration: requested=" + std::to_string(num_threads) + 
-                  ", hw_threads=" + std::to_string(hw_threads) + 
-                  ", max_useful=" + std::to_string(max_useful_threads) + 
-                  ", actual_threads=" + std::to_string(actual_threads));
+    int actual_threads = num_threads;
+    if (actual_threads <= 0) {
+        actual_threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (actual_threads <= 0) actual_threads = 4;  // Fallback
+    }
+    actual_threads = static_cast<int>(std::min<size_t>(static_cast<size_t>(actual_threads), count));
     
-    // For small ranges, use single-threaded version (parallel overhead not worth it)
-    if (actual_threads <= 1 || range_size < MIN_TOTAL_RANGE_FOR_PARALLEL) {
-        Logger::debug("Falling back to single-threaded search (range too small or threads=1)");
-        Logger::log_query("KNN_PARALLEL", "Fallback to single-threaded (range=" + std::to_string(range_size) + ", K=" + std::to_string(k) + ")", 0.0, 0);
-        return search_knn_optimized(query_vector, min_key, max_key, k, use_memory_index);
+    // Workers read nodes and vectors through positional reads; without them run on this thread only
+    if (actual_threads > 1 && !pm->prepareConcurrentReads()) {
+        Logger::warning("Concurrent read handles unavailable, running batch on one thread");
+        actual_threads = 1;
     }
     
-    // Divide range into sub-ranges
-    std::vector<std::pair<int, int>> sub_ranges;
-    int range_per_thread = range_size / actual_threads;
-    int remainder = range_size % actual_threads;
+    Logger::log_query("KNN_BATCH", "Queries: " + std::to_string(count) + " | Threads: " + std::to_string(actual_threads) + " | K: " + std::to_string(k), 0.0, 0);
     
-    int current_start = min_key;
-    for (int t = 0; t < actual_threads; t++) {
-        int sub_range_size = range_per_thread + (t < remainder ? 1 : 0);
-        int sub_end = current_start + sub_range_size - 1;
-        sub_ranges.push_back({current_start, sub_end});
-        current_start = sub_end + 1;
+    struct SlotState {
+        std::vector<KNNResult> hits;
+        std::vector<char> page_buffer;
+        std::vector<std::pair<int, int>> intervals;
+        std::vector<KNNResult> part, merged;
+    };
+    
+    auto search_interval = [&](size_t q, int min_key, int max_key, std::vector<KNNResult>& out, SlotState& slot) {
+        if (actual_threads > 1) {
+            search_knn_concurrent(queries[q], min_key, max_key, k, out, slot.page_buffer, use_memory_index);
+        } else {
+            search_knn_into(queries[q], min_key, max_key, k, out, use_memory_index);
+        }
+    };
+    
+    auto run_query = [&](size_t q, SlotState& slot) {
+        if (hooks.lookup && hooks.lookup(q)) {
+            slot.hits.clear();
+            if (hooks.on_result) hooks.on_result(q, slot.hits, false, 0);
+            return;
+        }
+        slot.intervals.clear();
+        const bool narrowed = hooks.narrow && hooks.narrow(q, slot.intervals);
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!narrowed) {
+            search_interval(q, ranges[q].first, ranges[q].second, slot.hits, slot);
+        } else {
+            slot.hits.clear();
+            for (const auto& interval : slot.intervals) {
+                if (interval.first > interval.second || k <= 0) continue;
+                search_interval(q, interval.first, interval.second, slot.part, slot);
+                merge_knn_hits(slot.hits, slot.part, static_cast<size_t>(k), slot.merged);
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        long long search_us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        if (hooks.on_result) hooks.on_result(q, slot.hits, true, search_us);
+    };
+    
+    if (actual_threads <= 1) {
+        SlotState slot;
+        for (size_t q = 0; q < count; q++) run_query(q, slot);
+        return;
     }
     
-    // Thread-local results: each thread returns sorted K candidates with distances
-    std::vector<std::vector<std::pair<double, DataObject*>>> thread_results(actual_threads);
-    std::vector<std::thread> threads;
-    std::mutex pm_mutex;  // Protect PageManager access (file I/O)
+    // Queries are claimed one at a time, so a slow query only delays its own result
+    std::shared_ptr<ThreadPool> pool = getSearchPool(static_cast<size_t>(actual_threads - 1));
+    std::vector<SlotState> slots(pool->slot_count());
+    const PageManager::Snapshot* batch_snapshot = pm->pinnedSnapshot();  // held until the pool is done
+    pool->parallel_for(count, [&](size_t q, size_t slot) {
+        PageManager::SnapshotScope scope(*pm, batch_snapshot);
+        run_query(q, slots[slot]);
+    });
+}
+
+void DiskBPlusTree::search_knn_shared_scan(const std::vector<std::vector<float>>& queries,
+                                           const std::vector<std::pair<int, int>>& ranges, int k,
+                                           const KNNBatchHooks& hooks, bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    const size_t count = std::min(queries.size(), ranges.size());
+    if (count == 0) return;
     
-    // Log actual threads being used for this query
-    Logger::log_query("KNN_PARALLEL", "Threads: " + std::to_string(actual_threads) + " | Range: [" + std::to_string(min_key) + "," + std::to_string(max_key) + "] | K: " + std::to_string(k), 0.0, 0);
+    static const std::vector<KNNResult> no_hits;
+    auto report = [&](size_t q, const std::vector<KNNResult>& hits, bool searched, long long search_us) {
+        if (hooks.on_result) hooks.on_result(q, hits, searched, search_us);
+    };
     
-    // worker function for each thread (retrieve all vectors from each key's list)
-    auto worker = [&](int thread_id, int sub_min, int sub_max) {
-        std::priority_queue<std::pair<double, DataObject*>> local_heap;
-        
-        uint32_t pid;
-        {
-            std::lock_guard<std::mutex> lock(pm_mutex);
-            pid = pm->getRoot();
+    // Lookups first; only the misses take part in the scan
+    const bool tree_empty = pm->getRoot() == INVALID_PAGE;
+    std::vector<size_t> pending;
+    pending.reserve(count);
+    for (size_t q = 0; q < count; q++) {
+        if (hooks.lookup && hooks.lookup(q)) {
+            report(q, no_hits, false, 0);
+        } else if (tree_empty || k <= 0 || ranges[q].first > ranges[q].second) {
+            report(q, no_hits, true, 0);
+        } else {
+            pending.push_back(q);
         }
-        
-        if (pid == INVALID_PAGE) return;
-        
-        BPlusNode diskNode;
-        const BPlusNode* nodePtr = nullptr;
-        
-        // Navigate to leaf containing sub_min
-        while (true) {
-            if (use_memory_index && memory_index_loaded_) {
-                nodePtr = getNodeFromMemory(pid);
+    }
+    if (pending.empty()) return;
+    
+    // Sweep in key order: queries join the active set at q_min and leave after q_max
+    std::sort(pending.begin(), pending.end(), [&](size_t a, size_t b) {
+        return ranges[a] < ranges[b];
+    });
+    
+    Logger::log_query("KNN_SHARED_SCAN", "Queries: " + std::to_string(pending.size()) + " | K: " + std::to_string(k), 0.0, 0);
+    
+    const size_t heap_k = static_cast<size_t>(k);
+    const size_t query_dim = queries[pending[0]].size();
+    bool uniform_dim = true;
+    for (size_t q : pending) uniform_dim = uniform_dim && queries[q].size() == query_dim;
+    
+    std::vector<std::vector<KNNResult>> heaps(count);
+    std::vector<size_t> active;                 // query indices whose range covers the current key
+    std::vector<const float*> active_vectors;   // parallel to active, for the one-to-many kernel
+    std::vector<float> distances;
+    int active_expiry = std::numeric_limits<int>::max();  // smallest q_max in the active set
+    
+    VectorStore* vector_store = pm->getVectorStore();
+    const L2SqrKernel l2_sqr_kernel = l2_sqr_kernel_;
+    auto scan_start = std::chrono::high_resolution_clock::now();
+    
+    // A query is final once the sweep passes its q_max; report it right away
+    auto finish = [&](size_t q) {
+        std::sort_heap(heaps[q].begin(), heaps[q].end());
+        auto now = std::chrono::high_resolution_clock::now();
+        report(q, heaps[q], true, std::chrono::duration_cast<std::chrono::microseconds>(now - scan_start).count());
+        std::vector<KNNResult>().swap(heaps[q]);
+    };
+    
+    auto expire = [&](int key) {
+        size_t kept = 0;
+        active_expiry = std::numeric_limits<int>::max();
+        for (size_t a = 0; a < active.size(); a++) {
+            size_t q = active[a];
+            if (ranges[q].second < key) {
+                finish(q);
             } else {
-                std::lock_guard<std::mutex> lock(pm_mutex);
-                read(pid, diskNode);
-                nodePtr = &diskNode;
+                active[kept++] = q;
+                active_expiry = std::min(active_expiry, ranges[q].second);
             }
-            
-            int i = 0;
-            while (i < nodePtr->keyCount && sub_min > nodePtr->keys[i]) i++;
-            
-            if (nodePtr->isLeaf) break;
-            pid = nodePtr->children[i];
+        }
+        active.resize(kept);
+        active_vectors.resize(kept);
+        for (size_t a = 0; a < kept; a++) active_vectors[a] = queries[active[a]].data();
+    };
+    
+    size_t next = 0;  // next pending query to activate
+    BPlusNode scratch;
+    
+    while (next < pending.size()) {
+        // Nothing active: jump straight to the leaf of the next range instead of scanning the gap
+        const int descended_for = ranges[pending[next]].first;
+        uint32_t pid = pm->getRoot();
+        NodeView leaf;
+        while (true) {
+            leaf = fetchNode(pid, scratch, use_memory_index);
+            if (leaf.isLeaf) break;
+            int i = leaf.lowerBound(descended_for);
+            pid = leaf.children[i];
         }
         
-        // Traverse leaves in this sub-range
-        uint32_t currentPid = pid;
-        
-        while (currentPid != INVALID_PAGE) {
-            const BPlusNode* leafPtr = nullptr;
-            BPlusNode diskLeaf;
-            if (use_memory_index && memory_index_loaded_) {
-                leafPtr = getNodeFromMemory(currentPid);
-            } else {
-                std::lock_guard<std::mutex> lock(pm_mutex);
-                read(currentPid, diskLeaf);
-                leafPtr = &diskLeaf;
-            }
-            if (!leafPtr) break;
-            
-            for (int i = 0; i < leafPtr->keyCount; i++) {
-                if (leafPtr->keys[i] >= sub_min && leafPtr->keys[i] <= sub_max) {
-                    // retrieve all vectors for this key
-                    std::vector<std::vector<float>> vectors;
-                    std::vector<uint32_t> sizes;
-                    std::vector<int32_t> original_ids;
-                    {
-                        std::lock_guard<std::mutex> lock(pm_mutex);
-                        pm->getVectorStore()->retrieveVectorList(
-                            leafPtr->vector_list_ids[i], 
-                            leafPtr->vector_counts[i],
-                            vectors, sizes, original_ids
-                        );
-                    }
-                    
-                    for (size_t v = 0; v < vectors.size(); v++) {
-                        double distance = calculate_euclidean_distance(query_vector, vectors[v]);
-                        
-                        if (local_heap.size() >= static_cast<size_t>(k) && distance >= local_heap.top().first) {
-                            continue;
-                        }
-                        
-                        DataObject* candidate = new DataObject(vectors[v], leafPtr->keys[i]);
-                        if (v < original_ids.size()) candidate->set_id(original_ids[v]);
-                        
-                        if (local_heap.size() < static_cast<size_t>(k)) {
-                            local_heap.push({distance, candidate});
+        bool chain_end = false;
+        while (true) {
+            for (int i = 0; i < leaf.keyCount; i++) {
+                const int key = leaf.keys[i];
+                
+                bool joined = false;
+                while (next < pending.size() && ranges[pending[next]].first <= key) {
+                    size_t q = pending[next++];
+                    heaps[q].reserve(heap_k);
+                    active.push_back(q);
+                    joined = true;
+                }
+                if (joined || key > active_expiry) expire(key);
+                if (active.empty()) continue;
+                
+                // Each vector is read once and scored against every active query
+                distances.resize(active.size());
+                vector_store->forEachVectorInList(
+                    leaf.vector_list_ids[i], 
+                    leaf.vector_counts[i],
+                    [&](const VectorStore::VectorView& view) {
+                        if (uniform_dim) {
+                            l2_sqr_one_to_many(l2_sqr_kernel, view.data, active_vectors.data(), active.size(),
+                                               std::min<size_t>(query_dim, view.size), distances.data());
                         } else {
-                            delete local_heap.top().second;
-                            local_heap.pop();
-                            local_heap.push({distance, candidate});
+                            for (size_t a = 0; a < active.size(); a++) {
+                                distances[a] = static_cast<float>(calculate_squared_distance(
+                                    l2_sqr_kernel, queries[active[a]], view.data, view.size));
+                            }
+                        }
+                        for (size_t a = 0; a < active.size(); a++) {
+                            offer_knn_candidate(heaps[active[a]], heap_k, {distances[a], view.id, key, view.original_id});
                         }
                     }
-                }
-                else if (leafPtr->keys[i] > sub_max) {
-                    break;
-                }
+                );
             }
             
-            if (leafPtr->keyCount > 0 && leafPtr->keys[leafPtr->keyCount - 1] > sub_max) {
+            // Re-descend for the next range unless that descent already led here
+            if (active.empty() && (next >= pending.size() || ranges[pending[next]].first != descended_for)) {
                 break;
             }
             
-            uint32_t nextPid = leafPtr->next;
-            if (nextPid == currentPid || nextPid == INVALID_PAGE) break;
-            currentPid = nextPid;
+            uint32_t nextPid = leaf.next;
+            if (nextPid == INVALID_PAGE || nextPid == pid) {
+                chain_end = true;
+                break;
+            }
+            pid = nextPid;
+            leaf = fetchNode(pid, scratch, use_memory_index);
         }
         
-        // Extract sorted results
-        std::vector<std::pair<double, DataObject*>> sorted_results;
-        sorted_results.reserve(local_heap.size());
-        while (!local_heap.empty()) {
-            sorted_results.push_back(local_heap.top());
-            local_heap.pop();
+        if (chain_end) break;
+    }
+    
+    // Past the last leaf: everything still active or pending is final
+    for (size_t q : active) finish(q);
+    while (next < pending.size()) finish(pending[next++]);
+}
+
+void DiskBPlusTree::search_knn_parallel_into(
+    const std::vector<float>& query_vector, 
+    int min_key, 
+    int max_key, 
+    int k, 
+    std::vector<KNNResult>& out,
+    int num_threads,
+    bool use_memory_index) {
+    PageManager::ReadSnapshot snapshot(*pm);
+    
+    out.clear();
+    
+    uint32_t rootPid = pm->getRoot();
+    if (rootPid == INVALID_PAGE || k <= 0) {
+        return;
+    }
+    
+    // Covered segments go through their graphs; only ranges covering none are split into morsels
+    if (graph_ef_ > 0 && hasSegmentGraphs() &&
+        search_knn_graph_into(query_vector, min_key, max_key, k, out, use_memory_index)) {
+        return;
+    }
+    
+    const bool debug_log = Logger::is_enabled(LogLevel::DEBUG);
+    if (debug_log) {
+        Logger::debug("Parallel KNN search started: range=[" + std::to_string(min_key) + "," + 
+                      std::to_string(max_key) + "], K=" + std::to_string(k));
+    }
+    
+    // Split the range into leaf-aligned morsels instead of equal-width key ranges, so a few
+    // dense keys cannot leave one thread with most of the work
+    std::vector<uint32_t> leaves;
+    std::vector<uint64_t> leaf_counts;
+    collect_leaf_pids(min_key, max_key, leaves, use_memory_index, &leaf_counts);
+    
+    int hw_threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (hw_threads <= 0) hw_threads = 4;  // Fallback
+    int actual_threads = (num_threads > 0) ? num_threads : hw_threads;
+    
+    // Several morsels per thread so idle workers have something to steal
+    // With subtree counts a morsel closes once it holds its share of the vectors (leaves differ
+    // in fill); otherwise every morsel gets the same number of leaves
+    const size_t MORSELS_PER_THREAD = 8;
+    const size_t MAX_MORSEL_LEAVES = 16;
+    const size_t target_morsels = static_cast<size_t>(actual_threads) * MORSELS_PER_THREAD;
+    
+    std::vector<size_t> morsel_begin;  // first leaf of each morsel, plus leaves.size()
+    if (!leaf_counts.empty()) {
+        uint64_t range_vectors = 0;
+        for (uint64_t c : leaf_counts) range_vectors += c;
+        const uint64_t morsel_vectors = std::max<uint64_t>(1, range_vectors / target_morsels);
+        uint64_t filled = 0;
+        for (size_t l = 0; l < leaves.size(); l++) {
+            if (l == 0 || filled >= morsel_vectors || l - morsel_begin.back() >= MAX_MORSEL_LEAVES) {
+                morsel_begin.push_back(l);
+                filled = 0;
+            }
+            filled += leaf_counts[l];
         }
-        std::reverse(sorted_results.begin(), sorted_results.end());
-        
-        thread_results[thread_id] = std::move(sorted_results);
-    };
+    } else {
+        size_t morsel_leaves = leaves.size() / target_morsels;
+        morsel_leaves = std::max<size_t>(1, std::min(morsel_leaves, MAX_MORSEL_LEAVES));
+        for (size_t l = 0; l < leaves.size(); l += morsel_leaves) morsel_begin.push_back(l);
+    }
+    size_t morsel_count = morsel_begin.size();
+    morsel_begin.push_back(leaves.size());
+    actual_threads = static_cast<int>(std::min<size_t>(static_cast<size_t>(actual_threads), morsel_count));
     
-    // Launch threads
-    for (int t = 0; t < actual_threads; t++) {
-        threads.emplace_back(worker, t, sub_ranges[t].first, sub_ranges[t].second);
+    if (debug_log) {
+        Logger::debug("Thread configuration: requested=" + std::to_string(num_threads) + 
+                      ", hw_threads=" + std::to_string(hw_threads) + 
+                      ", leaves=" + std::to_string(leaves.size()) + 
+                      ", morsels=" + std::to_string(morsel_count) + 
+                      ", actual_threads=" + std::to_string(actual_threads));
     }
     
-    // Wait for all threads
-    for (auto& thread : threads) {
-        thread.join();
+    // A single morsel gains nothing from the pool
+    if (actual_threads <= 1) {
+        if (debug_log) {
+            Logger::debug("Falling back to single-threaded search (too few leaves or threads=1)");
+            Logger::log_query("KNN_PARALLEL", "Fallback to single-threaded (leaves=" + std::to_string(leaves.size()) + ", K=" + std::to_string(k) + ")", 0.0, 0);
+        }
+        search_knn_into(query_vector, min_key, max_key, k, out, use_memory_index);
+        return;
+    }
+    
+    // Workers read nodes and vectors through positional reads (no shared seek state, no lock)
+    if (!pm->prepareConcurrentReads()) {
+        Logger::warning("Concurrent read handles unavailable, falling back to single-threaded search");
+        search_knn_into(query_vector, min_key, max_key, k, out, use_memory_index);
+        return;
+    }
+    
+    // The calling thread works too, so the pool needs one thread less
+    std::shared_ptr<ThreadPool> pool = getSearchPool(static_cast<size_t>(actual_threads - 1));
+    
+    // Per-slot state: each executing thread owns one heap and its scratch buffers
+    struct WorkerState {
+        std::vector<KNNResult> heap;
+        std::vector<char> page_buffer;
+        BPlusNode scratch;
+    };
+    std::vector<WorkerState> states(pool->slot_count());
+    
+    VectorStore* vector_store = pm->getVectorStore();
+    const L2SqrKernel l2_sqr_kernel = l2_sqr_kernel_;
+    const size_t heap_k = static_cast<size_t>(k);
+    
+    // K-th best distance found by any worker so far; nothing at or beyond it can make the top K
+    std::atomic<double> kth_bound(std::numeric_limits<double>::infinity());
+    
+    if (debug_log) {
+        Logger::log_query("KNN_PARALLEL", "Threads: " + std::to_string(actual_threads) + " | Range: [" + std::to_string(min_key) + "," + std::to_string(max_key) + "] | Morsels: " + std::to_string(morsel_count) + " | K: " + std::to_string(k), 0.0, 0);
+    }
+    MetricTimer search_timer(MetricStage::Search);
+    Metrics::add(MetricCounter::Searches);
+    Metrics::add(MetricCounter::LeafReads, leaves.size());
+    
+    const PageManager::Snapshot* search_snapshot = pm->pinnedSnapshot();  // held until the pool is done
+    pool->parallel_for(morsel_count, [&](size_t morsel, size_t slot) {
+        PageManager::SnapshotScope scope(*pm, search_snapshot);
+        WorkerState& state = states[slot];
+        std::vector<KNNResult>& heap = state.heap;
+        if (heap.capacity() < heap_k) heap.reserve(heap_k);
+        MetricVectorSampler sampler;  // counts go to the executing thread
+        uint64_t pruned = 0;
+        
+        size_t first = morsel_begin[morsel];
+        size_t last = morsel_begin[morsel + 1];
+        
+        for (size_t l = first; l < last; l++) {
+            BufferPool::PinnedNode pinned;  // Keeps a cached leaf resident while it is scanned
+            MetricTimer read_timer(MetricStage::LeafRead);
+            NodeView leaf = fetchNodeConcurrent(leaves[l], state.scratch, state.page_buffer,
+                                                           pinned, use_memory_index);
+            read_timer.stop();
+            if (leaf_cannot_improve(leaf_summaries_, leaf, query_vector,
+                                    kth_bound.load(std::memory_order_relaxed), l2_sqr_kernel)) {
+                pruned++;
+                continue;
+            }
+            
+            MetricTimer scan_timer(MetricStage::LeafScan);
+            sampler.new_leaf();
+            for_each_leaf_vector(vector_store, leaf, min_key, max_key,
+                [&](int key, const VectorStore::VectorView& view) {
+                    sampler.begin();
+                    double distance = calculate_squared_distance(l2_sqr_kernel, query_vector, view.data, view.size);
+                    sampler.distance_done();
+                    if (distance >= kth_bound.load(std::memory_order_relaxed)) return;
+                    sampler.offer_begin();
+                    offer_knn_candidate(heap, heap_k, {distance, view.id, key, view.original_id});
+                    sampler.offered();
+                    
+                    // A full local heap bounds the global K-th best: publish it if tighter
+                    if (heap.size() == heap_k) {
+                        double worst = heap.front().distance;
+                        double bound = kth_bound.load(std::memory_order_relaxed);
+                        while (worst < bound &&
+                               !kth_bound.compare_exchange_weak(bound, worst, std::memory_order_relaxed)) {
+                        }
+                    }
+                }
+            );
+        }
+        if (pruned) Metrics::add(MetricCounter::LeavesPruned, pruned);
+        if (last > first + pruned) Metrics::add(MetricCounter::LeavesScanned, last - first - pruned);
+    });
+    
+    // Sort each slot's heap in place (ascending by distance)
+    for (auto& state : states) {
+        std::sort_heap(state.heap.begin(), state.heap.end());
     }
     
     // K-way merge using min-heap - O(K log T) instead of O(TK log TK)
     // This is the key optimization: we don't sort all results, just merge sorted lists
     std::priority_queue<KNNCandidate, std::vector<KNNCandidate>, std::greater<KNNCandidate>> merge_heap;
     
-    // Initialize merge heap with first element from each non-empty thread result
-    for (int t = 0; t < actual_threads; t++) {
-        if (!thread_results[t].empty()) {
-            merge_heap.push({
-                thread_results[t][0].first,
-                thread_results[t][0].second,
-                t,
-                1  // Next index to fetch
-            });
+    // Initialize merge heap with first element from each non-empty slot result
+    for (size_t t = 0; t < states.size(); t++) {
+        if (!states[t].heap.empty()) {
+            merge_heap.push({states[t].heap[0], static_cast<int>(t), 1});
         }
     }
     
     // Extract K smallest elements
-    results.reserve(k);
-    while (results.size() < static_cast<size_t>(k) && !merge_heap.empty()) {
+    out.reserve(k);
+    while (out.size() < static_cast<size_t>(k) && !merge_heap.empty()) {
         KNNCandidate best = merge_heap.top();
         merge_heap.pop();
         
-        results.push_back(best.obj);
-        
-        // Push next element from same thread's results
-        if (best.next_index < thread_results[best.source_thread].size()) {
-            auto& next = thread_results[best.source_thread][best.next_index];
-            merge_heap.push({
-                next.first,
-                next.second,
-                best.source_thread,
-                best.next_index + 1
-            });
-        }
-    }
-    
-    // Clean up remaining objects that weren't selected
-    for (int t = 0; t < actual_threads; t++) {
-        for (size_t i = 0; i < thread_results[t].size(); i++) {
-            DataObject* obj = thread_results[t][i].second;
-            // Check if this object was already added to results
-            bool in_results = false;
-            for (DataObject* r : results) {
-                if (r == obj) {
-                    in_results = true;
-                    break;
-                }
-            }
-            if (!in_results) {
-                delete obj;
-            }
+        out.push_back(best.hit);
+        
+        // Push next element from same slot's results
+        const std::vector<KNNResult>& source = states[best.source_thread].heap;
+        if (best.next_index < source.size()) {
+            merge_heap.push({source[best.next_index], best.source_thread, best.next_index + 1});
         }
     }
-    
-    return results;
 }
 
 int DiskBPlusTree::get_min_keys() {
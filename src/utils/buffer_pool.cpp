@@ -0,0 +1,202 @@
+#include "buffer_pool.h"
+#include <algorithm>
+
+BufferPool::PinnedNode& BufferPool::PinnedNode::operator=(PinnedNode&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        shard_ = other.shard_;
+        frame_ = other.frame_;
+        node_ = other.node_;
+        owned_ = std::move(other.owned_);
+        other.pool_ = nullptr;
+        other.shard_ = nullptr;
+        other.node_ = nullptr;
+    }
+    return *this;
+}
+
+void BufferPool::PinnedNode::release() {
+    if (pool_ && shard_) {
+        pool_->unpin(*shard_, frame_);
+    }
+    pool_ = nullptr;
+    shard_ = nullptr;
+    node_ = nullptr;
+    owned_.reset();
+}
+
+BufferPool::BufferPool(size_t budget_bytes, size_t node_bytes, size_t num_shards) {
+    if (node_bytes == 0) node_bytes = 1;
+    size_t frames = std::max<size_t>(1, budget_bytes / node_bytes);
+
+    // Default: ~64 frames per shard, at most 64 shards
+    if (num_shards == 0) {
+        num_shards = std::min<size_t>(64, std::max<size_t>(1, frames / 64));
+    }
+    size_t shard_count = 1;
+    while (shard_count * 2 <= num_shards) shard_count *= 2;  // power of two for masking
+
+    size_t per_shard = std::max<size_t>(1, frames / shard_count);
+    shards_.reserve(shard_count);
+    for (size_t s = 0; s < shard_count; s++) {
+        auto shard = std::make_unique<Shard>();
+        shard->frames.resize(per_shard);
+        shard->index.reserve(per_shard);
+        shards_.push_back(std::move(shard));
+    }
+    shard_mask_ = shard_count - 1;
+    capacity_ = per_shard * shard_count;
+}
+
+bool BufferPool::tryPin(uint32_t pid, PinnedNode& out) {
+    Shard& shard = shardFor(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(pid);
+    if (it == shard.index.end()) {
+        shard.misses++;
+        return false;
+    }
+    Frame& frame = shard.frames[it->second];
+    frame.pin_count++;
+    frame.referenced = true;
+    shard.hits++;
+
+    out.pool_ = this;
+    out.shard_ = &shard;
+    out.frame_ = it->second;
+    out.node_ = &frame.node;
+    return true;
+}
+
+bool BufferPool::findVictim(Shard& shard, uint32_t& frame_idx) {
+    const size_t n = shard.frames.size();
+    // Two sweeps: the first may only clear reference bits
+    for (size_t step = 0; step < 2 * n; step++) {
+        size_t idx = shard.hand;
+        shard.hand = (shard.hand + 1) % n;
+        Frame& frame = shard.frames[idx];
+
+        if (frame.pin_count > 0) continue;
+        if (frame.pid == INVALID_PAGE) {
+            frame_idx = static_cast<uint32_t>(idx);
+            return true;
+        }
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        shard.index.erase(frame.pid);
+        frame.pid = INVALID_PAGE;
+        shard.evictions++;
+        frame_idx = static_cast<uint32_t>(idx);
+        return true;
+    }
+    return false;
+}
+
+BufferPool::PinnedNode BufferPool::insertAndPin(uint32_t pid, BPlusNode&& node) {
+    PinnedNode handle;
+    Shard& shard = shardFor(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Another reader may have loaded the same page while we were reading it
+    auto it = shard.index.find(pid);
+    uint32_t frame_idx;
+    if (it != shard.index.end()) {
+        frame_idx = it->second;
+    } else if (findVictim(shard, frame_idx)) {
+        Frame& frame = shard.frames[frame_idx];
+        frame.pid = pid;
+        frame.node = std::move(node);
+        shard.index[pid] = frame_idx;
+    } else {
+        // Every frame is pinned: hand out a private copy instead of caching
+        shard.bypasses++;
+        handle.owned_ = std::make_unique<BPlusNode>(std::move(node));
+        handle.node_ = handle.owned_.get();
+        return handle;
+    }
+
+    Frame& frame = shard.frames[frame_idx];
+    frame.pin_count++;
+    frame.referenced = true;
+    handle.pool_ = this;
+    handle.shard_ = &shard;
+    handle.frame_ = frame_idx;
+    handle.node_ = &frame.node;
+    return handle;
+}
+
+void BufferPool::unpin(Shard& shard, uint32_t frame_idx) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Frame& frame = shard.frames[frame_idx];
+    if (frame.pin_count > 0) frame.pin_count--;
+}
+
+void BufferPool::put(uint32_t pid, const BPlusNode& node) {
+    Shard& shard = shardFor(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(pid);
+    if (it != shard.index.end()) {
+        shard.frames[it->second].node = node;
+    }
+}
+
+void BufferPool::invalidate(uint32_t pid) {
+    Shard& shard = shardFor(pid);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(pid);
+    if (it != shard.index.end()) {
+        Frame& frame = shard.frames[it->second];
+        if (frame.pin_count == 0) {
+            frame.pid = INVALID_PAGE;
+            frame.referenced = false;
+            shard.index.erase(it);
+        }
+    }
+}
+
+void BufferPool::clear() {
+    for (auto& shard_ptr : shards_) {
+        Shard& shard = *shard_ptr;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.index.begin(); it != shard.index.end();) {
+            Frame& frame = shard.frames[it->second];
+            if (frame.pin_count == 0) {
+                frame.pid = INVALID_PAGE;
+                frame.referenced = false;
+                it = shard.index.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+BufferPool::Stats BufferPool::getStats() const {
+    Stats stats;
+    stats.capacity = capacity_;
+    for (const auto& shard_ptr : shards_) {
+        const Shard& shard = *shard_ptr;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.hits += shard.hits;
+        stats.misses += shard.misses;
+        stats.evictions += shard.evictions;
+        stats.bypasses += shard.bypasses;
+        stats.resident += shard.index.size();
+    }
+    return stats;
+}
+
+void BufferPool::resetStats() {
+    for (auto& shard_ptr : shards_) {
+        Shard& shard = *shard_ptr;
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.hits = 0;
+        shard.misses = 0;
+        shard.evictions = 0;
+        shard.bypasses = 0;
+    }
+}
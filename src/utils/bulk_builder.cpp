@@ -0,0 +1,337 @@
+#include "bulk_builder.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <queue>
+#include <thread>
+#include <utility>
+
+namespace {
+
+constexpr size_t KEY_MORSEL = 65536;                    // records keyed per parallel task
+constexpr size_t SPILL_BUFFER_BYTES = 8 * 1024 * 1024;  // staging for one sequential run write
+
+// Sort entries order by key, then by position in the run (so equal keys keep file order)
+inline uint64_t order_entry(int key, size_t index) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(key) ^ 0x80000000u) << 32) | static_cast<uint32_t>(index);
+}
+inline int entry_key(uint64_t entry) {
+    return static_cast<int>(static_cast<uint32_t>(entry >> 32) ^ 0x80000000u);
+}
+inline size_t entry_index(uint64_t entry) {
+    return static_cast<size_t>(entry & 0xFFFFFFFFu);
+}
+
+// Sequential reader over one spilled run
+struct RunReader {
+    std::ifstream in;
+    std::vector<char> buffer;
+    size_t record_bytes = 0;
+    size_t pos = 0;
+    size_t size = 0;
+    bool failed = false;
+
+    const char* current() const { return buffer.data() + pos; }
+    int key() const {
+        int key;
+        std::memcpy(&key, current(), sizeof(int));
+        return key;
+    }
+    // Move to the next record, refilling the buffer; false at the end of the run
+    bool advance() {
+        pos += record_bytes;
+        if (pos < size) return true;
+        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        size = static_cast<size_t>(in.gcount());
+        pos = 0;
+        if (size % record_bytes != 0) failed = true;
+        return size >= record_bytes;
+    }
+};
+
+}  // namespace
+
+BulkBuilder::BulkBuilder(DiskBPlusTree& tree, const BulkBuildOptions& options)
+    : tree_(tree), options_(options) {
+    int threads = options_.threads;
+    if (threads <= 0) {
+        threads = static_cast<int>(std::thread::hardware_concurrency());
+        if (threads <= 0) threads = 4;  // Fallback
+    }
+    // The calling thread takes part in parallel_for, so it counts as one of them
+    if (threads > 1) pool_ = std::make_unique<ThreadPool>(static_cast<size_t>(threads - 1));
+}
+
+void BulkBuilder::parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+    if (!pool_) {
+        for (size_t i = 0; i < count; i++) fn(i);
+        return;
+    }
+    pool_->parallel_for(count, [&](size_t index, size_t) { fn(index); });
+}
+
+bool BulkBuilder::build(const std::string& fvecs_path, const std::vector<int>* labels) {
+    std::ifstream in(fvecs_path, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Error: Cannot open input file: " << fvecs_path << std::endl;
+        return false;
+    }
+    int32_t dimension = 0;
+    if (!in.read(reinterpret_cast<char*>(&dimension), sizeof(int32_t)) || dimension <= 0) {
+        std::cerr << "Error: Cannot read dimension from input file" << std::endl;
+        return false;
+    }
+    dimension_ = static_cast<uint32_t>(dimension);
+
+    in.seekg(0, std::ios::end);
+    const uint64_t file_bytes = static_cast<uint64_t>(in.tellg());
+    const size_t record_bytes = fvecsRecordBytes();
+    if (file_bytes % record_bytes != 0) {
+        std::cerr << "Error: " << fvecs_path << " is not a sequence of " << dimension_
+                  << "-dimensional records (bulk builds need one dimension for all vectors)" << std::endl;
+        return false;
+    }
+    uint64_t total = file_bytes / record_bytes;
+    if (labels) {
+        if (labels->size() > total) {
+            std::cerr << "Error: " << labels->size() << " labels but only " << total << " vectors in " << fvecs_path << std::endl;
+            return false;
+        }
+        total = labels->size();
+    }
+    if (total == 0) return true;
+    if (total > static_cast<uint64_t>(std::numeric_limits<int32_t>::max())) {
+        std::cerr << "Error: " << total << " vectors exceed the 32-bit original ids" << std::endl;
+        return false;
+    }
+
+    // Two chunks in flight (the one being sorted and the one being read) plus the sort entries
+    const uint64_t budget = std::max<uint64_t>(1, options_.memory_mb) * 1024 * 1024;
+    const uint64_t run_capacity = std::min<uint64_t>(total, std::max<uint64_t>(1, budget / (2 * record_bytes + sizeof(uint64_t))));
+    run_count_ = static_cast<size_t>((total + run_capacity - 1) / run_capacity);
+    std::cout << "Bulk build: " << total << " vectors in " << run_count_ << " run(s) of up to "
+              << run_capacity << " vectors, " << (pool_ ? pool_->slot_count() : 1) << " thread(s)" << std::endl;
+
+    auto read_run = [&in, record_bytes, total, run_capacity](Run& run, size_t index) {
+        run.first = index * run_capacity;
+        run.count = static_cast<size_t>(std::min<uint64_t>(run_capacity, total - run.first));
+        run.records.resize(run.count * record_bytes);
+        in.seekg(static_cast<std::streamoff>(run.first * record_bytes));
+        in.read(run.records.data(), static_cast<std::streamsize>(run.records.size()));
+        return static_cast<size_t>(in.gcount()) == run.records.size();
+    };
+
+    Run current;
+    Run next;
+    in.clear();
+    if (!read_run(current, 0)) {
+        std::cerr << "Error: Failed to read " << fvecs_path << std::endl;
+        return false;
+    }
+    for (size_t r = 0; r < run_count_; r++) {
+        auto run_start = std::chrono::high_resolution_clock::now();
+        // The next chunk is read while this one is keyed, sorted and written
+        std::future<bool> pending;
+        if (r + 1 < run_count_) {
+            pending = std::async(std::launch::async, read_run, std::ref(next), r + 1);
+        }
+
+        bool ok = keyRun(current, labels);
+        if (ok) {
+            sortRun(current);
+            if (run_count_ == 1) {
+                DiskBPlusTree::BulkLoader loader(tree_, options_.fill_factor);
+                loader.reserve(current.count);
+                loadRun(current, loader);
+                loader.finish();
+            } else {
+                ok = spillRun(current);
+            }
+        }
+        if (pending.valid() && !pending.get() && ok) {
+            std::cerr << "Error: Failed to read " << fvecs_path << std::endl;
+            ok = false;
+        }
+        if (!ok) {
+            removeSpilled();
+            return false;
+        }
+
+        auto run_end = std::chrono::high_resolution_clock::now();
+        std::cout << "Run " << (r + 1) << "/" << run_count_ << ": " << current.count << " vectors "
+                  << (run_count_ == 1 ? "sorted and loaded" : "sorted and spilled") << " ("
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(run_end - run_start).count() << " ms)" << std::endl;
+        std::swap(current, next);
+    }
+    vector_count_ = total;
+    if (run_count_ == 1) return true;
+
+    // Release the chunk buffers before the merge takes the budget for its read buffers
+    current = Run();
+    next = Run();
+    bool ok = true;
+    {
+        DiskBPlusTree::BulkLoader loader(tree_, options_.fill_factor);
+        loader.reserve(static_cast<size_t>(total));
+        ok = mergeRuns(loader);
+        if (ok) loader.finish();
+    }
+    removeSpilled();
+    return ok;
+}
+
+bool BulkBuilder::keyRun(Run& run, const std::vector<int>* labels) {
+    const size_t record_bytes = fvecsRecordBytes();
+    run.order.resize(run.count);
+    std::atomic<uint64_t> first_bad{std::numeric_limits<uint64_t>::max()};
+    const size_t morsels = (run.count + KEY_MORSEL - 1) / KEY_MORSEL;
+    parallelFor(morsels, [&](size_t m) {
+        const size_t end = std::min(run.count, (m + 1) * KEY_MORSEL);
+        for (size_t i = m * KEY_MORSEL; i < end; i++) {
+            int32_t dim;
+            std::memcpy(&dim, run.records.data() + i * record_bytes, sizeof(int32_t));
+            const uint64_t position = run.first + i;
+            if (dim != static_cast<int32_t>(dimension_)) {
+                uint64_t seen = first_bad.load();
+                while (position < seen && !first_bad.compare_exchange_weak(seen, position)) {}
+            }
+            const int key = labels ? (*labels)[position] : static_cast<int>(position);
+            run.order[i] = order_entry(key, i);
+        }
+    });
+    if (first_bad.load() != std::numeric_limits<uint64_t>::max()) {
+        std::cerr << "Error: Inconsistent dimension at vector " << first_bad.load()
+                  << " (expected " << dimension_ << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void BulkBuilder::sortRun(Run& run) {
+    const size_t slices = pool_ ? pool_->slot_count() : 1;
+    if (slices <= 1 || run.count < slices * KEY_MORSEL) {
+        std::sort(run.order.begin(), run.order.end());
+        return;
+    }
+    // Sort equal slices in parallel, then merge neighbours pairwise, halving the slices per round
+    std::vector<size_t> bounds(slices + 1);
+    for (size_t s = 0; s <= slices; s++) bounds[s] = run.count * s / slices;
+    auto begin = run.order.begin();
+    parallelFor(slices, [&](size_t s) {
+        std::sort(begin + bounds[s], begin + bounds[s + 1]);
+    });
+    for (size_t width = 1; width < slices; width *= 2) {
+        const size_t pairs = (slices + 2 * width - 1) / (2 * width);
+        parallelFor(pairs, [&](size_t p) {
+            const size_t lo = p * 2 * width;
+            const size_t mid = std::min(slices, lo + width);
+            const size_t hi = std::min(slices, lo + 2 * width);
+            if (mid < hi) std::inplace_merge(begin + bounds[lo], begin + bounds[mid], begin + bounds[hi]);
+        });
+    }
+}
+
+void BulkBuilder::loadRun(const Run& run, DiskBPlusTree::BulkLoader& loader) const {
+    const size_t record_bytes = fvecsRecordBytes();
+    for (uint64_t entry : run.order) {
+        const size_t i = entry_index(entry);
+        const float* vector = reinterpret_cast<const float*>(run.records.data() + i * record_bytes + sizeof(int32_t));
+        loader.add(entry_key(entry), vector, dimension_, static_cast<int32_t>(run.first + i));
+    }
+}
+
+bool BulkBuilder::spillRun(const Run& run) {
+    const std::string path = options_.temp_dir + "/bulk_run_" + std::to_string(spilled_.size()) + ".tmp";
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: Cannot create run file: " << path << std::endl;
+        return false;
+    }
+    spilled_.push_back(path);
+
+    // Run records: key, original id, vector, in sorted order
+    const size_t fvecs_bytes = fvecsRecordBytes();
+    const size_t vector_bytes = dimension_ * sizeof(float);
+    const size_t record_bytes = runRecordBytes();
+    std::vector<char> buffer;
+    buffer.reserve(std::max(SPILL_BUFFER_BYTES, record_bytes));
+    for (uint64_t entry : run.order) {
+        if (buffer.size() + record_bytes > buffer.capacity()) {
+            out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+        }
+        const size_t i = entry_index(entry);
+        const int32_t key = entry_key(entry);
+        const int32_t original_id = static_cast<int32_t>(run.first + i);
+        const size_t at = buffer.size();
+        buffer.resize(at + record_bytes);
+        std::memcpy(buffer.data() + at, &key, sizeof(int32_t));
+        std::memcpy(buffer.data() + at + sizeof(int32_t), &original_id, sizeof(int32_t));
+        std::memcpy(buffer.data() + at + 2 * sizeof(int32_t), run.records.data() + i * fvecs_bytes + sizeof(int32_t), vector_bytes);
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    out.close();
+    if (!out) {
+        std::cerr << "Error: Failed to write run file: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool BulkBuilder::mergeRuns(DiskBPlusTree::BulkLoader& loader) {
+    const size_t record_bytes = runRecordBytes();
+    const uint64_t budget = std::max<uint64_t>(1, options_.memory_mb) * 1024 * 1024;
+    const size_t buffer_records = static_cast<size_t>(std::max<uint64_t>(1, budget / spilled_.size() / record_bytes));
+    std::cout << "Merging " << spilled_.size() << " runs" << std::endl;
+
+    std::vector<RunReader> readers(spilled_.size());
+    // (key, run): equal keys come from earlier runs first, which keeps them in file order
+    using Head = std::pair<int, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (size_t r = 0; r < readers.size(); r++) {
+        RunReader& reader = readers[r];
+        reader.in.open(spilled_[r], std::ios::binary);
+        if (!reader.in.is_open()) {
+            std::cerr << "Error: Cannot open run file: " << spilled_[r] << std::endl;
+            return false;
+        }
+        reader.record_bytes = record_bytes;
+        reader.buffer.resize(buffer_records * record_bytes);
+        // pos == size == 0, so the first advance() fills the buffer
+        if (reader.advance()) heads.push({reader.key(), r});
+    }
+
+    while (!heads.empty()) {
+        const size_t r = heads.top().second;
+        heads.pop();
+        RunReader& reader = readers[r];
+        const char* record = reader.current();
+        int32_t key;
+        int32_t original_id;
+        std::memcpy(&key, record, sizeof(int32_t));
+        std::memcpy(&original_id, record + sizeof(int32_t), sizeof(int32_t));
+        loader.add(key, reinterpret_cast<const float*>(record + 2 * sizeof(int32_t)), dimension_, original_id);
+        if (reader.advance()) heads.push({reader.key(), r});
+    }
+
+    for (size_t r = 0; r < readers.size(); r++) {
+        if (readers[r].failed) {
+            std::cerr << "Error: Truncated run file: " << spilled_[r] << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void BulkBuilder::removeSpilled() {
+    for (const std::string& path : spilled_) std::remove(path.c_str());
+    spilled_.clear();
+}
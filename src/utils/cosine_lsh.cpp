@@ -0,0 +1,110 @@
+#include "cosine_lsh.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+static constexpr double PI = 3.14159265358979323846;
+
+void CosineLSH::clear() {
+    dim_ = 0;
+    planes_.clear();
+    tables_.clear();
+    ids_.clear();
+    signatures_.clear();
+    free_slots_.clear();
+    slot_of_.clear();
+}
+
+void CosineLSH::signature(const std::vector<float>& vector, uint32_t* out) const {
+    const float* plane = planes_.data();
+    for (uint32_t t = 0; t < TABLES; t++) {
+        uint32_t bits = 0;
+        for (uint32_t b = 0; b < BITS; b++, plane += dim_) {
+            float dot = 0.0f;
+            for (uint32_t d = 0; d < dim_; d++) dot += plane[d] * vector[d];
+            if (dot >= 0.0f) bits |= 1u << b;
+        }
+        out[t] = bits;
+    }
+}
+
+void CosineLSH::insert(const std::string& id, const std::vector<float>& vector) {
+    if (vector.empty()) return;
+    if (dim_ == 0) {
+        // Fixed seed: the same cache contents always hash the same way
+        dim_ = static_cast<uint32_t>(vector.size());
+        std::mt19937 rng(0x5EED1234u);
+        std::normal_distribution<float> normal(0.0f, 1.0f);
+        planes_.resize(static_cast<size_t>(TABLES) * BITS * dim_);
+        for (float& value : planes_) value = normal(rng);
+        tables_.assign(TABLES, {});
+    }
+    if (vector.size() != dim_) return;
+    remove(id);
+
+    uint32_t slot;
+    if (!free_slots_.empty()) {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        ids_[slot] = id;
+    } else {
+        slot = static_cast<uint32_t>(ids_.size());
+        ids_.push_back(id);
+        signatures_.resize(signatures_.size() + TABLES);
+    }
+    slot_of_[id] = slot;
+    uint32_t* sig = signatures_.data() + static_cast<size_t>(slot) * TABLES;
+    signature(vector, sig);
+    for (uint32_t t = 0; t < TABLES; t++) tables_[t][sig[t]].push_back(slot);
+}
+
+void CosineLSH::remove(const std::string& id) {
+    auto it = slot_of_.find(id);
+    if (it == slot_of_.end()) return;
+    const uint32_t slot = it->second;
+    const uint32_t* sig = signatures_.data() + static_cast<size_t>(slot) * TABLES;
+    for (uint32_t t = 0; t < TABLES; t++) {
+        auto bucket = tables_[t].find(sig[t]);
+        if (bucket == tables_[t].end()) continue;
+        std::vector<uint32_t>& slots = bucket->second;
+        auto pos = std::find(slots.begin(), slots.end(), slot);
+        if (pos != slots.end()) {
+            *pos = slots.back();
+            slots.pop_back();
+        }
+        if (slots.empty()) tables_[t].erase(bucket);
+    }
+    ids_[slot].clear();
+    free_slots_.push_back(slot);
+    slot_of_.erase(it);
+}
+
+void CosineLSH::candidates(const std::vector<float>& vector, std::vector<const std::string*>& out) const {
+    out.clear();
+    if (dim_ == 0 || vector.size() != dim_ || slot_of_.empty()) return;
+    uint32_t sig[TABLES];
+    signature(vector, sig);
+
+    std::vector<uint32_t> slots;
+    for (uint32_t t = 0; t < TABLES; t++) {
+        const auto& table = tables_[t];
+        for (uint32_t flip = 0; flip <= BITS; flip++) {
+            // flip == BITS probes the query's own bucket
+            const uint32_t key = flip < BITS ? sig[t] ^ (1u << flip) : sig[t];
+            auto bucket = table.find(key);
+            if (bucket != table.end()) slots.insert(slots.end(), bucket->second.begin(), bucket->second.end());
+        }
+    }
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+    out.reserve(slots.size());
+    for (uint32_t slot : slots) out.push_back(&ids_[slot]);
+}
+
+double CosineLSH::recall(double similarity) {
+    const double cosine = std::max(-1.0, std::min(1.0, 2.0 * similarity - 1.0));
+    const double p = 1.0 - std::acos(cosine) / PI;  // one bit agrees
+    // Within one bit in a table: all BITS agree, or exactly one differs
+    const double table_hit = std::pow(p, BITS) + BITS * std::pow(p, BITS - 1) * (1.0 - p);
+    return 1.0 - std::pow(1.0 - table_hit, TABLES);
+}
@@ -0,0 +1,76 @@
+#include "dataset_io.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <nlohmann/json.hpp>
+
+std::vector<std::vector<float>> load_fvecs_queries(const std::string& path) {
+    std::vector<std::vector<float>> queries;
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open query file: " << path << "\n";
+        return queries;
+    }
+
+    int32_t dimension;
+    while (file.read(reinterpret_cast<char*>(&dimension), sizeof(int32_t))) {
+        std::vector<float> vec(dimension);
+        file.read(reinterpret_cast<char*>(vec.data()), dimension * sizeof(float));
+        if (file) {
+            queries.push_back(vec);
+        }
+    }
+    return queries;
+}
+
+std::vector<std::vector<int32_t>> load_ivecs_groundtruth(const std::string& path) {
+    std::vector<std::vector<int32_t>> groundtruth;
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error: Cannot open groundtruth file: " << path << "\n";
+        return groundtruth;
+    }
+
+    int32_t count;
+    while (file.read(reinterpret_cast<char*>(&count), sizeof(int32_t))) {
+        std::vector<int32_t> neighbors(count);
+        file.read(reinterpret_cast<char*>(neighbors.data()), count * sizeof(int32_t));
+        if (file) {
+            groundtruth.push_back(neighbors);
+        }
+    }
+    return groundtruth;
+}
+
+std::vector<std::pair<int, int>> read_qrange_json(const std::string& path, int num_queries) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        std::cerr << "Error: Cannot open qrange file: " << path << "\n";
+        return {};
+    }
+    nlohmann::json j;
+    in >> j;
+    in.close();
+    std::vector<int> raw = j.get<std::vector<int>>();
+    int limit = num_queries * 2;
+    if (static_cast<int>(raw.size()) > limit) raw.resize(limit);
+    std::vector<std::pair<int, int>> ranges;
+    for (size_t i = 0; i + 1 < raw.size(); i += 2) {
+        ranges.push_back({raw[i], raw[i + 1]});
+    }
+    return ranges;
+}
+
+double calculate_recall(const std::vector<int>& retrieved, const std::vector<int32_t>& groundtruth, int k) {
+    if (groundtruth.empty() || k <= 0) return 0.0;
+    
+    std::set<int> gt_set(groundtruth.begin(), groundtruth.begin() + std::min(k, static_cast<int>(groundtruth.size())));
+    int hits = 0;
+    for (int i = 0; i < std::min(k, static_cast<int>(retrieved.size())); i++) {
+        if (gt_set.count(retrieved[i]) > 0) {
+            hits++;
+        }
+    }
+    return static_cast<double>(hits) / std::min(k, static_cast<int>(gt_set.size()));
+}
@@ -0,0 +1,251 @@
+#include "distance.h"
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BPTREE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BPTREE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC/Clang compile each x86 kernel for its own target so the rest of the build
+// needs no -mavx flags; MSVC accepts the intrinsics without target attributes
+#if defined(BPTREE_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// Each kernel is a template over Dim: Dim = 0 is the generic kernel for any n, any other Dim
+// fixes the trip count at compile time (unrolled loops, no tail code) and hands other lengths
+// to the generic kernel.
+
+template <size_t Dim>
+static float l2_sqr_scalar(const float* a, const float* b, size_t count) {
+    if (Dim != 0 && count != Dim) return l2_sqr_scalar<0>(a, b, count);
+    const size_t n = Dim != 0 ? Dim : count;
+    float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+    const size_t blocks = n - n % 4;
+    size_t i = 0;
+    for (; i < blocks; i += 4) {
+        float d0 = a[i] - b[i];
+        float d1 = a[i + 1] - b[i + 1];
+        float d2 = a[i + 2] - b[i + 2];
+        float d3 = a[i + 3] - b[i + 3];
+        sum0 += d0 * d0;
+        sum1 += d1 * d1;
+        sum2 += d2 * d2;
+        sum3 += d3 * d3;
+    }
+    for (; i < n; i++) {
+        float d = a[i] - b[i];
+        sum0 += d * d;
+    }
+    return (sum0 + sum1) + (sum2 + sum3);
+}
+
+#ifdef BPTREE_X86
+
+template <size_t Dim>
+TARGET_AVX2 static float l2_sqr_avx2(const float* a, const float* b, size_t count) {
+    if (Dim != 0 && count != Dim) return l2_sqr_avx2<0>(a, b, count);
+    const size_t n = Dim != 0 ? Dim : count;
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+        acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+    }
+    if (i + 8 <= n) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+        acc0 = _mm256_fmadd_ps(d, d, acc0);
+        i += 8;
+    }
+    acc0 = _mm256_add_ps(acc0, acc1);
+
+    // Horizontal sum of 8 lanes
+    __m128 lo = _mm256_castps256_ps128(acc0);
+    __m128 hi = _mm256_extractf128_ps(acc0, 1);
+    __m128 s = _mm_add_ps(lo, hi);
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 0x55));
+    float sum = _mm_cvtss_f32(s);
+
+    for (; i < n; i++) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+template <size_t Dim>
+TARGET_AVX512 static float l2_sqr_avx512(const float* a, const float* b, size_t count) {
+    if (Dim != 0 && count != Dim) return l2_sqr_avx512<0>(a, b, count);
+    const size_t n = Dim != 0 ? Dim : count;
+    __m512 acc0 = _mm512_setzero_ps();
+    __m512 acc1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+        acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+        acc0 = _mm512_fmadd_ps(d, d, acc0);
+    }
+    if (i < n) {
+        // Masked tail: lanes past n load as zero on both sides
+        __mmask16 mask = static_cast<__mmask16>((1u << (n - i)) - 1u);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+        acc1 = _mm512_fmadd_ps(d, d, acc1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+static bool cpu_has_avx2_fma() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return false;
+#endif
+}
+
+static bool cpu_has_avx512f() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx512f");
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    // OS must save opmask + upper ZMM state (XCR0 bits 5-7) as well as SSE/AVX state
+    if (!osxsave || (_xgetbv(0) & 0xE6) != 0xE6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif  // BPTREE_X86
+
+#ifdef BPTREE_NEON
+
+template <size_t Dim>
+static float l2_sqr_neon(const float* a, const float* b, size_t count) {
+    if (Dim != 0 && count != Dim) return l2_sqr_neon<0>(a, b, count);
+    const size_t n = Dim != 0 ? Dim : count;
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t d0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        float32x4_t d1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc0 = vfmaq_f32(acc0, d0, d0);
+        acc1 = vfmaq_f32(acc1, d1, d1);
+    }
+    if (i + 4 <= n) {
+        float32x4_t d = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+        acc0 = vfmaq_f32(acc0, d, d);
+        i += 4;
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; i++) {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+#endif  // BPTREE_NEON
+
+namespace {
+
+// Instantiates a kernel for dim when it is one of the fixed dimensions (common embedding sizes),
+// the generic kernel otherwise
+template <class Instantiate>
+L2SqrKernel kernel_for_dim(size_t dim, Instantiate instantiate) {
+    switch (dim) {
+        case 96: return instantiate(std::integral_constant<size_t, 96>());
+        case 128: return instantiate(std::integral_constant<size_t, 128>());
+        case 256: return instantiate(std::integral_constant<size_t, 256>());
+        case 384: return instantiate(std::integral_constant<size_t, 384>());
+        case 768: return instantiate(std::integral_constant<size_t, 768>());
+        case 960: return instantiate(std::integral_constant<size_t, 960>());
+        default: return instantiate(std::integral_constant<size_t, 0>());
+    }
+}
+
+struct KernelChoice {
+    L2SqrKernel fn;
+    const char* name;
+    L2SqrKernel (*for_dim)(size_t dim);
+};
+
+KernelChoice select_kernel() {
+#ifdef BPTREE_X86
+    if (cpu_has_avx512f()) {
+        return {l2_sqr_avx512<0>, "avx512", [](size_t dim) {
+                    return kernel_for_dim(dim, [](auto d) -> L2SqrKernel { return l2_sqr_avx512<decltype(d)::value>; });
+                }};
+    }
+    if (cpu_has_avx2_fma()) {
+        return {l2_sqr_avx2<0>, "avx2", [](size_t dim) {
+                    return kernel_for_dim(dim, [](auto d) -> L2SqrKernel { return l2_sqr_avx2<decltype(d)::value>; });
+                }};
+    }
+#endif
+#ifdef BPTREE_NEON
+    return {l2_sqr_neon<0>, "neon", [](size_t dim) {
+                return kernel_for_dim(dim, [](auto d) -> L2SqrKernel { return l2_sqr_neon<decltype(d)::value>; });
+            }};
+#endif
+    return {l2_sqr_scalar<0>, "scalar", [](size_t dim) {
+                return kernel_for_dim(dim, [](auto d) -> L2SqrKernel { return l2_sqr_scalar<decltype(d)::value>; });
+            }};
+}
+
+const KernelChoice& active_kernel() {
+    static const KernelChoice choice = select_kernel();
+    return choice;
+}
+
+}  // namespace
+
+L2SqrKernel get_l2_sqr_kernel() {
+    return active_kernel().fn;
+}
+
+L2SqrKernel get_l2_sqr_kernel(size_t dim) {
+    return active_kernel().for_dim(dim);
+}
+
+bool has_fixed_l2_sqr_kernel(size_t dim) {
+    return get_l2_sqr_kernel(dim) != get_l2_sqr_kernel();
+}
+
+const char* get_l2_sqr_kernel_name() {
+    return active_kernel().name;
+}
@@ -0,0 +1,66 @@
+#include "epoch_manager.h"
+#include <functional>
+#include <thread>
+
+EpochManager::~EpochManager() {
+    for (auto& entry : retired_) {
+        entry.second();
+    }
+}
+
+size_t EpochManager::enter() {
+    // Start at a per-thread slot so concurrent readers rarely probe the same cache lines
+    size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % MAX_READERS;
+    while (true) {
+        for (size_t probe = 0; probe < MAX_READERS; probe++, slot = (slot + 1) % MAX_READERS) {
+            uint64_t idle = IDLE;
+            if (slots_[slot].epoch.load(std::memory_order_relaxed) == IDLE &&
+                slots_[slot].epoch.compare_exchange_strong(idle, current(), std::memory_order_relaxed)) {
+                // Pairs with the fence in isSafe(): either the writer sees this slot, or every
+                // load after this fence sees what the writer published before its scan
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                return slot;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void EpochManager::exit(size_t slot) {
+    slots_[slot].epoch.store(IDLE, std::memory_order_release);
+}
+
+void EpochManager::retire(std::function<void()> free) {
+    retired_.emplace_back(current(), std::move(free));
+}
+
+bool EpochManager::isSafe(uint64_t epoch) const {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (const Slot& slot : slots_) {
+        if (slot.epoch.load(std::memory_order_acquire) <= epoch) {
+            return false;  // IDLE is larger than every epoch
+        }
+    }
+    return true;
+}
+
+void EpochManager::reclaim() {
+    while (!retired_.empty() && isSafe(retired_.front().first)) {
+        // Epochs are in retire order, so one scan covers the whole run of this epoch
+        const uint64_t epoch = retired_.front().first;
+        while (!retired_.empty() && retired_.front().first == epoch) {
+            std::function<void()> free = std::move(retired_.front().second);
+            retired_.pop_front();
+            free();
+        }
+    }
+}
+
+void EpochManager::synchronize() {
+    const uint64_t epoch = current();
+    advance();
+    while (!isSafe(epoch)) {
+        std::this_thread::yield();
+    }
+    reclaim();
+}
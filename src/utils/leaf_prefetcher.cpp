@@ -0,0 +1,98 @@
+#include "leaf_prefetcher.h"
+#include <utility>
+
+LeafPrefetcher::LeafPrefetcher(ReadFn read, HintFn hint)
+    : read_(std::move(read)), hint_(std::move(hint)) {
+    worker_ = std::thread([this] { worker_loop(); });
+}
+
+LeafPrefetcher::~LeafPrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+void LeafPrefetcher::start(uint32_t first_pid, int min_key, int max_key, size_t window) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_pid_ = first_pid;
+    min_key_ = min_key;
+    max_key_ = max_key;
+    window_ = window > 0 ? window : 1;
+    active_ = true;
+    done_ = first_pid == INVALID_PAGE;
+    cv_.notify_all();
+}
+
+bool LeafPrefetcher::next(BPlusNode& leaf) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (ready_.empty() && !done_ && active_) {
+        consumer_waiting_ = true;
+        cv_.wait(lock, [&] { return !ready_.empty() || done_ || !active_; });
+        consumer_waiting_ = false;
+    }
+    if (ready_.empty()) return false;
+    std::swap(leaf, ready_.front());
+    spare_.push_back(std::move(ready_.front()));
+    ready_.pop_front();
+    // Wake the worker once half the window is used up, not per leaf: every wake-up is a
+    // context switch, which costs more than reading a cached page
+    if (worker_waiting_ && ready_.size() <= window_ / 2) cv_.notify_all();
+    return true;
+}
+
+void LeafPrefetcher::stop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    active_ = false;
+    generation_++;
+    while (!ready_.empty()) {
+        spare_.push_back(std::move(ready_.front()));
+        ready_.pop_front();
+    }
+    cv_.notify_all();
+    // The caller may write to the files next, so no read may still be in flight
+    cv_.wait(lock, [&] { return !reading_; });
+}
+
+void LeafPrefetcher::worker_loop() {
+    std::vector<char> buffer;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        if (!shutdown_ && !(active_ && !done_ && ready_.size() < window_)) {
+            worker_waiting_ = true;
+            cv_.wait(lock, [&] { return shutdown_ || (active_ && !done_ && ready_.size() <= window_ / 2); });
+            worker_waiting_ = false;
+        }
+        if (shutdown_) return;
+
+        const uint32_t pid = next_pid_;
+        const int min_key = min_key_;
+        const int max_key = max_key_;
+        const uint64_t generation = generation_;
+        BPlusNode node;
+        if (!spare_.empty()) {
+            node = std::move(spare_.back());
+            spare_.pop_back();
+        }
+        reading_ = true;
+        lock.unlock();
+
+        read_(pid, node, buffer);
+        hint_(node, min_key, max_key);
+
+        lock.lock();
+        reading_ = false;
+        if (generation != generation_) {
+            spare_.push_back(std::move(node));
+            cv_.notify_all();  // stop() may be waiting for this read
+            continue;
+        }
+        next_pid_ = node.next;
+        done_ = node.next == INVALID_PAGE || node.next == pid ||
+                (node.keyCount > 0 && node.keys[node.keyCount - 1] > max_key);
+        ready_.push_back(std::move(node));
+        if (consumer_waiting_) cv_.notify_all();
+    }
+}
@@ -0,0 +1,121 @@
+#include "leaf_summary.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+// file format (<vectors file>.leafsum):
+// Header (32 bytes):
+//   - magic (4 bytes): 0x314D534C ("LSM1")
+//   - version (4 bytes): 1
+//   - dimension (4 bytes)
+//   - reserved (4 bytes)
+//   - store_next_id (8 bytes): VectorStore next id at build time
+//   - entry_count (8 bytes)
+// Entries: entry_count * {first_key (4), radius (4), fingerprint (8)}, ascending by first_key
+// Centroids: entry_count * dimension floats
+
+static constexpr uint32_t LEAFSUM_MAGIC = 0x314D534C;  // "LSM1"
+static constexpr uint32_t LEAFSUM_VERSION = 1;
+
+struct LeafSummaryFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t reserved;
+    uint64_t store_next_id;
+    uint64_t entry_count;
+};
+static_assert(sizeof(LeafSummaryFileHeader) == 32, "LeafSummaryFileHeader must match the on-disk layout");
+
+uint64_t LeafSummaries::fingerprint(const NodeView& leaf) {
+    // FNV-1a style mix of whole words (key count, keys, list heads, list lengths);
+    // computed on every scanned leaf, so it stays a few multiplies per key
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](uint64_t value) {
+        hash = (hash ^ value) * 1099511628211ULL;
+        hash ^= hash >> 29;
+    };
+    mix(static_cast<uint64_t>(leaf.keyCount));
+    for (int i = 0; i < leaf.keyCount; i++) {
+        mix(static_cast<uint32_t>(leaf.keys[i]));
+        mix(leaf.vector_list_ids[i]);
+        mix(leaf.vector_counts[i]);
+    }
+    return hash;
+}
+
+void LeafSummaries::clear() {
+    dim_ = 0;
+    entries_.clear();
+    centroids_.clear();
+}
+
+void LeafSummaries::reset(uint32_t dim) {
+    clear();
+    dim_ = dim;
+}
+
+void LeafSummaries::add(const NodeView& leaf, const float* centroid, float radius) {
+    if (leaf.keyCount == 0) return;
+    entries_.push_back({leaf.keys[0], radius, fingerprint(leaf)});
+    centroids_.insert(centroids_.end(), centroid, centroid + dim_);
+}
+
+bool LeafSummaries::save(const std::string& path, uint64_t store_next_id) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to create leaf summaries: " << path << std::endl;
+        return false;
+    }
+    LeafSummaryFileHeader header{LEAFSUM_MAGIC, LEAFSUM_VERSION, dim_, 0, store_next_id, entries_.size()};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries_.data()), entries_.size() * sizeof(Entry));
+    out.write(reinterpret_cast<const char*>(centroids_.data()), centroids_.size() * sizeof(float));
+    return out.good();
+}
+
+bool LeafSummaries::load(const std::string& path, uint64_t store_next_id) {
+    clear();
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+
+    LeafSummaryFileHeader header{};
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || header.magic != LEAFSUM_MAGIC || header.version != LEAFSUM_VERSION || header.dimension == 0) {
+        std::cerr << "Invalid leaf summaries: " << path << std::endl;
+        return false;
+    }
+    if (header.store_next_id != store_next_id) {
+        std::cerr << "Leaf summaries are out of date (index modified since they were built): " << path << std::endl;
+        return false;
+    }
+
+    std::vector<Entry> entries(header.entry_count);
+    std::vector<float> centroids(header.entry_count * header.dimension);
+    in.read(reinterpret_cast<char*>(entries.data()), entries.size() * sizeof(Entry));
+    in.read(reinterpret_cast<char*>(centroids.data()), centroids.size() * sizeof(float));
+    if (!in) {
+        std::cerr << "Truncated leaf summaries: " << path << std::endl;
+        return false;
+    }
+
+    dim_ = header.dimension;
+    entries_ = std::move(entries);
+    centroids_ = std::move(centroids);
+    return true;
+}
+
+const float* LeafSummaries::find(const NodeView& leaf, float& radius) const {
+    if (leaf.keyCount == 0 || entries_.empty()) return nullptr;
+
+    const int32_t first_key = leaf.keys[0];
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), first_key,
+                               [](const Entry& e, int32_t key) { return e.first_key < key; });
+    if (it == entries_.end() || it->first_key != first_key || it->fingerprint != fingerprint(leaf)) {
+        return nullptr;
+    }
+    radius = it->radius;
+    return centroids_.data() + static_cast<size_t>(it - entries_.begin()) * dim_;
+}
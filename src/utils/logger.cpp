@@ -180,10 +180,11 @@ std::string Logger::level_to_string(LogLevel level) {
 }
 
 void Logger::write_log(LogLevel level, const std::string& message, const std::string& log_type) {
-    std::lock_guard<std::mutex> lock(log_mutex_);
-    
+    // Format before taking the lock, so concurrent callers only serialize on the write
     std::string formatted_msg = "[" + get_timestamp() + "] [" + level_to_string(level) + "] [" + session_id_ + "] " + message;
     
+    std::lock_guard<std::mutex> lock(log_mutex_);
+    
     // Write to appropriate log file based on type
     if (log_type == "search" && search_log_file_.is_open()) {
         search_log_file_ << formatted_msg << "\n";
@@ -0,0 +1,250 @@
+#include "metrics.h"
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline uint32_t highest_bit(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return static_cast<uint32_t>(index);
+#else
+    return 63u - static_cast<uint32_t>(__builtin_clzll(v));
+#endif
+}
+
+size_t HistogramSnapshot::bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) return static_cast<size_t>(ns);
+    const uint32_t e = highest_bit(ns);  // >= 4
+    const size_t sub = static_cast<size_t>((ns >> (e - 4)) & (SUB_BUCKETS - 1));
+    return SUB_BUCKETS + (e - 4) * SUB_BUCKETS + sub;
+}
+
+uint64_t HistogramSnapshot::bucket_upper(size_t bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    const uint32_t e = static_cast<uint32_t>((bucket - SUB_BUCKETS) / SUB_BUCKETS + 4);
+    const uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+    const uint64_t width = 1ULL << (e - 4);
+    return ((SUB_BUCKETS + sub) << (e - 4)) + (width - 1);
+}
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p * count + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= rank) return std::min(bucket_upper(b), max_ns);
+    }
+    return max_ns;
+}
+
+#if BPTREE_METRICS
+
+std::atomic<bool> Metrics::enabled_{false};
+
+namespace {
+
+// Written only by the thread that owns the block (relaxed load + store, no locked RMW)
+inline void bump(std::atomic<uint64_t>& slot, uint64_t n) {
+    slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct ThreadHistogram {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKETS> buckets{};
+};
+
+struct ThreadMetrics {
+    std::array<std::atomic<uint64_t>, METRIC_COUNTER_COUNT> counters{};
+    std::array<ThreadHistogram, METRIC_STAGE_COUNT> stages;
+};
+
+// Blocks outlive their threads: an exited thread's block keeps its counts and is handed to the
+// next thread that needs one
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadMetrics>> blocks;
+    std::vector<ThreadMetrics*> free_blocks;
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry();  // never destroyed: threads may exit after main
+    return *instance;
+}
+
+struct ThreadSlot {
+    ThreadMetrics* block = nullptr;
+    ~ThreadSlot() {
+        if (!block) return;
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.free_blocks.push_back(block);
+    }
+};
+
+thread_local ThreadSlot thread_slot;
+
+ThreadMetrics& local_metrics() {
+    if (!thread_slot.block) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        if (!r.free_blocks.empty()) {
+            thread_slot.block = r.free_blocks.back();
+            r.free_blocks.pop_back();
+        } else {
+            r.blocks.push_back(std::make_unique<ThreadMetrics>());
+            thread_slot.block = r.blocks.back().get();
+        }
+    }
+    return *thread_slot.block;
+}
+
+}  // namespace
+
+void Metrics::set_enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void Metrics::add(MetricCounter counter, uint64_t n) {
+    if (!enabled()) return;
+    bump(local_metrics().counters[static_cast<size_t>(counter)], n);
+}
+
+void Metrics::record(MetricStage stage, uint64_t ns) {
+    if (!enabled()) return;
+    ThreadHistogram& h = local_metrics().stages[static_cast<size_t>(stage)];
+    bump(h.count, 1);
+    bump(h.sum_ns, ns);
+    if (ns > h.max_ns.load(std::memory_order_relaxed)) h.max_ns.store(ns, std::memory_order_relaxed);
+    bump(h.buckets[HistogramSnapshot::bucket_of(ns)], 1);
+}
+
+MetricsSnapshot Metrics::snapshot() {
+    MetricsSnapshot snap;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto& block : r.blocks) {
+        for (size_t c = 0; c < METRIC_COUNTER_COUNT; c++) {
+            snap.counters[c] += block->counters[c].load(std::memory_order_relaxed);
+        }
+        for (size_t s = 0; s < METRIC_STAGE_COUNT; s++) {
+            const ThreadHistogram& from = block->stages[s];
+            HistogramSnapshot& to = snap.stages[s];
+            to.count += from.count.load(std::memory_order_relaxed);
+            to.sum_ns += from.sum_ns.load(std::memory_order_relaxed);
+            to.max_ns = std::max(to.max_ns, from.max_ns.load(std::memory_order_relaxed));
+            for (size_t b = 0; b < HistogramSnapshot::BUCKETS; b++) {
+                to.buckets[b] += from.buckets[b].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return snap;
+}
+
+// Counts of searches running during a reset may survive it (owners write without locking)
+void Metrics::reset() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const auto& block : r.blocks) {
+        for (auto& counter : block->counters) counter.store(0, std::memory_order_relaxed);
+        for (ThreadHistogram& h : block->stages) {
+            h.count.store(0, std::memory_order_relaxed);
+            h.sum_ns.store(0, std::memory_order_relaxed);
+            h.max_ns.store(0, std::memory_order_relaxed);
+            for (auto& bucket : h.buckets) bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+#else
+
+void Metrics::set_enabled(bool) {}
+void Metrics::add(MetricCounter, uint64_t) {}
+void Metrics::record(MetricStage, uint64_t) {}
+MetricsSnapshot Metrics::snapshot() { return MetricsSnapshot(); }
+void Metrics::reset() {}
+
+#endif
+
+const char* Metrics::stage_name(MetricStage stage) {
+    switch (stage) {
+        case MetricStage::Search:      return "search";
+        case MetricStage::Traversal:   return "traversal";
+        case MetricStage::LeafRead:    return "leaf_read";
+        case MetricStage::LeafScan:    return "leaf_scan";
+        case MetricStage::VectorFetch: return "vector_fetch";
+        case MetricStage::Distance:    return "distance";
+        case MetricStage::Heap:        return "heap";
+        default:                       return "unknown";
+    }
+}
+
+const char* Metrics::counter_name(MetricCounter counter) {
+    switch (counter) {
+        case MetricCounter::Searches:       return "searches";
+        case MetricCounter::NodesTraversed: return "nodes_traversed";
+        case MetricCounter::LeafReads:      return "leaf_reads";
+        case MetricCounter::LeavesScanned:  return "leaves_scanned";
+        case MetricCounter::LeavesPruned:   return "leaves_pruned";
+        case MetricCounter::VectorsScored:  return "vectors_scored";
+        case MetricCounter::HeapInserts:    return "heap_inserts";
+        default:                            return "unknown";
+    }
+}
+
+std::string Metrics::to_prometheus(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    for (size_t c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        const std::string name = std::string("bptree_") + counter_name(static_cast<MetricCounter>(c)) + "_total";
+        out << "# TYPE " << name << " counter\n" << name << " " << snapshot.counters[c] << "\n";
+    }
+    // Power-of-two bounds from 128 ns to ~17 s line up with the fine bucket edges
+    for (size_t s = 0; s < METRIC_STAGE_COUNT; s++) {
+        const HistogramSnapshot& h = snapshot.stages[s];
+        const std::string name = std::string("bptree_") + stage_name(static_cast<MetricStage>(s)) + "_seconds";
+        out << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        size_t b = 0;
+        for (uint32_t e = 7; e <= 34; e++) {
+            const uint64_t bound = 1ULL << e;
+            while (b < HistogramSnapshot::BUCKETS && HistogramSnapshot::bucket_upper(b) < bound) cumulative += h.buckets[b++];
+            out << name << "_bucket{le=\"" << std::setprecision(9) << bound / 1e9 << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{le=\"+Inf\"} " << h.count << "\n";
+        out << name << "_sum " << std::setprecision(9) << h.sum_ns / 1e9 << "\n";
+        out << name << "_count " << h.count << "\n";
+    }
+    return out.str();
+}
+
+std::string Metrics::format_summary(const MetricsSnapshot& snapshot) {
+    std::ostringstream out;
+    for (size_t c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        out << "  " << std::left << std::setw(16) << counter_name(static_cast<MetricCounter>(c))
+            << std::right << snapshot.counters[c] << "\n";
+    }
+    out << "  " << std::left << std::setw(14) << "stage (us)" << std::right << std::setw(10) << "count"
+        << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p95"
+        << std::setw(10) << "p99" << std::setw(10) << "max" << "\n";
+    out << std::fixed << std::setprecision(2);
+    for (size_t s = 0; s < METRIC_STAGE_COUNT; s++) {
+        const HistogramSnapshot& h = snapshot.stages[s];
+        if (h.count == 0) continue;
+        out << "  " << std::left << std::setw(14) << stage_name(static_cast<MetricStage>(s)) << std::right
+            << std::setw(10) << h.count << std::setw(10) << h.mean_ns() / 1000.0
+            << std::setw(10) << h.percentile(0.50) / 1000.0 << std::setw(10) << h.percentile(0.95) / 1000.0
+            << std::setw(10) << h.percentile(0.99) / 1000.0 << std::setw(10) << h.max_ns / 1000.0 << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,74 @@
+#include "node_arena.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+NodeArena::Layout NodeArena::layoutFor(uint32_t order) {
+    Layout layout;
+    const size_t key_slots = round_up(order, 4);
+    layout.fields = round_up(KEYS_OFFSET + key_slots * sizeof(int), sizeof(uint64_t));
+    // internal: child_counts[order+1] then children[order+1]
+    layout.children = (order + 1) * sizeof(uint64_t);
+    const size_t internal_bytes = layout.children + (order + 1) * sizeof(uint32_t);
+    // leaf: vector_list_ids[order] then vector_counts[order]
+    layout.leaf_counts = order * sizeof(uint64_t);
+    const size_t leaf_bytes = layout.leaf_counts + order * sizeof(uint32_t);
+    layout.stride = round_up(layout.fields + std::max(internal_bytes, leaf_bytes), CACHE_LINE);
+    return layout;
+}
+
+size_t NodeArena::recordBytes(uint32_t order) {
+    return layoutFor(order).stride;
+}
+
+void NodeArena::reset(uint32_t order, uint32_t page_count) {
+    clear();
+    Layout layout = layoutFor(order);
+    stride_ = layout.stride;
+    fields_offset_ = layout.fields;
+    children_offset_ = layout.children;
+    leaf_counts_offset_ = layout.leaf_counts;
+    order_ = order;
+    lower_bound_ = padded_lower_bound_for(round_up(order, 4));
+    page_count_ = page_count;
+    // zeroed records read as absent until stored
+    storage_.assign(static_cast<size_t>(page_count) * (stride_ / CACHE_LINE), CacheLine{});
+}
+
+void NodeArena::clear() {
+    storage_.clear();
+    storage_.shrink_to_fit();
+    stride_ = 0;
+    page_count_ = 0;
+    stored_ = 0;
+}
+
+void NodeArena::store(uint32_t pid, const BPlusNode& node) {
+    if (pid >= page_count_) return;
+    char* record = base() + static_cast<size_t>(pid) * stride_;
+    RecordHeader* header = reinterpret_cast<RecordHeader*>(record);
+    if (!header->present) stored_++;
+    header->next = node.next;
+    header->key_count = node.keyCount;
+    header->is_leaf = node.isLeaf ? 1 : 0;
+    header->present = 1;
+
+    int* keys = reinterpret_cast<int*>(record + KEYS_OFFSET);
+    const size_t key_slots = round_up(order_, 4);
+    std::copy(node.keys.begin(), node.keys.begin() + node.keyCount, keys);
+    std::fill(keys + node.keyCount, keys + key_slots, std::numeric_limits<int>::max());
+
+    char* fields = record + fields_offset_;
+    if (node.isLeaf) {
+        std::memcpy(fields, node.vector_list_ids.data(), node.keyCount * sizeof(uint64_t));
+        std::memcpy(fields + leaf_counts_offset_, node.vector_counts.data(), node.keyCount * sizeof(uint32_t));
+    } else {
+        const size_t children = static_cast<size_t>(node.keyCount) + 1;
+        std::memcpy(fields, node.child_counts.data(), children * sizeof(uint64_t));
+        std::memcpy(fields + children_offset_, node.children.data(), children * sizeof(uint32_t));
+    }
+}
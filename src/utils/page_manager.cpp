@@ -1,12 +1,27 @@
 #include "page_manager.h"
 #include "node.h"
+#include "node_arena.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <string>
 #include <vector>
 #include <stdexcept>
 #include <iostream>
 
+namespace {
+
+// Snapshot pinned on this thread (see PageManager::ReadSnapshot) and the PageManager it belongs to
+struct PinnedSnapshot {
+    const PageManager* owner = nullptr;
+    const PageManager::Snapshot* snapshot = nullptr;
+};
+thread_local PinnedSnapshot tls_pinned;
+thread_local std::vector<char> tls_page_buffer;  // readNode scratch for snapshot readers
+
+}  // namespace
+
 // Constructor for creating new index with specified config
 PageManager::PageManager(const std::string& filename, const BPTreeConfig& config)
     : filename_(filename) {
@@ -67,6 +82,9 @@ PageManager::PageManager(const std::string& filename)
 }
 
 PageManager::~PageManager() {
+    if (batch_write_) {
+        endBatchWrite();
+    }
     if (vector_store_) {
         vector_store_->flush();
     }
@@ -75,6 +93,7 @@ PageManager::~PageManager() {
         file_.flush();
         file_.close();
     }
+    delete snapshot_.load();
 }
 
 void PageManager::initNewFile(const BPTreeConfig& config) {
@@ -94,6 +113,7 @@ void PageManager::initNewFile(const BPTreeConfig& config) {
     header_.root_page = INVALID_PAGE;
     header_.next_free_page = 1;  // Page 0 is header
     header_.total_entries = 0;
+    header_.flags = IndexFileHeader::HEADER_FLAG_SUBTREE_COUNTS;
     
     // Write header (pad to page size)
     std::vector<char> header_page(config.page_size, 0);
@@ -130,6 +150,7 @@ void PageManager::loadExistingFile() {
         header_.root_page = old_root;
         header_.next_free_page = old_next;
         header_.total_entries = 0;
+        header_.flags = 0;
     }
     
     // always initialize vector store
@@ -143,6 +164,15 @@ void PageManager::saveHeader() {
     std::vector<char> header_page(header_.config.page_size, 0);
     std::memcpy(header_page.data(), &header_, sizeof(IndexFileHeader));
     
+    if (!snapshots_) {
+        concurrent_reader_.close();
+        mapped_.close();
+    }
+    if (batch_write_) {
+        dirty_pages_[0] = std::move(header_page);
+        return;
+    }
+    flushStagedPages();
     file_.seekp(0);
     file_.write(header_page.data(), header_.config.page_size);
     maybeFlush();
@@ -158,6 +188,19 @@ void PageManager::maybeFlush() {
 
 void PageManager::readNode(uint32_t pid, BPlusNode& node) {
     if (pid == INVALID_PAGE) return;
+    // Snapshot readers never see pages the writer has not published, so they read positionally
+    if (snapshots_ && pinnedSnapshot()) {
+        readNodeAt(pid, node, tls_page_buffer);
+        return;
+    }
+    if (batch_write_) {
+        auto dirty = dirty_pages_.find(pid);
+        if (dirty != dirty_pages_.end()) {
+            node.deserialize(dirty->second.data(), header_.config);
+            return;
+        }
+    }
+    flushStagedPages();
     
     // Seek to page
     file_.seekg(static_cast<std::streamoff>(pid) * header_.config.page_size);
@@ -170,7 +213,172 @@ void PageManager::readNode(uint32_t pid, BPlusNode& node) {
     node.deserialize(page_buffer_.data(), header_.config);
 }
 
+bool PageManager::prepareConcurrentReads() {
+    if (!concurrent_reader_.is_open()) {
+        flushStagedPages();
+        flushDirtyPages();
+        file_.flush();  // Positional reads bypass the stream buffer
+        if (!concurrent_reader_.open(filename_)) {
+            return false;
+        }
+    }
+    return vector_store_ && vector_store_->prepareConcurrentReads();
+}
+
+void PageManager::readNodeAt(uint32_t pid, BPlusNode& node, std::vector<char>& buffer) const {
+    if (pid == INVALID_PAGE) return;
+    
+    const uint32_t page_size = header_.config.page_size;
+    buffer.assign(page_size, 0);
+    concurrent_reader_.read_at(static_cast<uint64_t>(pid) * page_size, buffer.data(), page_size);
+    
+    node.deserialize(buffer.data(), header_.config);
+}
+
+bool PageManager::mapPages() {
+    if (mapped_.is_open()) return true;
+    if (!file_.is_open()) return false;
+    
+    // Views read the fields in place, so every array has to be naturally aligned in the page
+    const uint32_t order = header_.config.order;
+    const uint32_t page_size = header_.config.page_size;
+    if (page_size % sizeof(uint64_t) != 0 || (hasSubtreeCounts() && order % 2 != 0)) {
+        std::cerr << "Index layout (order " << order << ", page size " << page_size
+                  << ") cannot be memory-mapped" << std::endl;
+        return false;
+    }
+    
+    flushStagedPages();
+    flushDirtyPages();
+    file_.flush();  // Mapped reads bypass the stream buffer
+    if (!mapped_.open(filename_)) {
+        std::cerr << "Failed to memory-map index file: " << filename_ << std::endl;
+        return false;
+    }
+    return true;
+}
+
+NodeView PageManager::mappedNode(uint32_t pid) const {
+    const size_t page_size = header_.config.page_size;
+    const size_t offset = static_cast<size_t>(pid) * page_size;
+    if (pid == INVALID_PAGE || !mapped_.is_open() || offset + page_size > mapped_.size()) return NodeView();
+    
+    // Same layout as BPlusNode::serialize
+    const char* page = mapped_.data() + offset;
+    const size_t order = header_.config.order;
+    uint32_t leaf_flag, key_count;
+    std::memcpy(&leaf_flag, page, sizeof(uint32_t));
+    std::memcpy(&key_count, page + sizeof(uint32_t), sizeof(uint32_t));
+    
+    NodeView view;
+    view.isLeaf = leaf_flag != 0;
+    view.keyCount = static_cast<uint16_t>(key_count);
+    const char* ptr = page + 2 * sizeof(uint32_t);
+    view.keys = reinterpret_cast<const int*>(ptr);
+    ptr += order * sizeof(int);
+    view.children = reinterpret_cast<const uint32_t*>(ptr);
+    ptr += (order + 1) * sizeof(uint32_t);
+    std::memcpy(&view.next, ptr, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+    view.vector_list_ids = reinterpret_cast<const uint64_t*>(ptr);
+    ptr += order * sizeof(uint64_t);
+    view.vector_counts = reinterpret_cast<const uint32_t*>(ptr);
+    ptr += order * sizeof(uint32_t);
+    // Older files leave child_counts unset
+    if (hasSubtreeCounts()) view.child_counts = reinterpret_cast<const uint64_t*>(ptr);
+    return view;
+}
+
+void PageManager::beginBulkWrite(size_t buffer_bytes) {
+    bulk_write_ = true;
+    staged_pages_.reserve(std::max<size_t>(buffer_bytes, header_.config.page_size));
+}
+
+void PageManager::endBulkWrite() {
+    flushStagedPages();
+    bulk_write_ = false;
+    staged_pages_.clear();
+    staged_pages_.shrink_to_fit();
+}
+
+void PageManager::flushStagedPages() {
+    if (staged_pages_.empty()) return;
+    file_.seekp(static_cast<std::streamoff>(staged_first_pid_) * header_.config.page_size);
+    file_.write(staged_pages_.data(), staged_pages_.size());
+    staged_pages_.clear();
+}
+
+void PageManager::beginBatchWrite() {
+    batch_write_ = true;
+}
+
+void PageManager::endBatchWrite() {
+    batch_write_ = false;
+    flushDirtyPages();
+}
+
+void PageManager::flushDirtyPages() {
+    if (dirty_pages_.empty()) return;
+    const size_t page_size = header_.config.page_size;
+    std::vector<char> run;
+    uint32_t run_first = 0;
+    auto write_run = [&]() {
+        if (run.empty()) return;
+        file_.seekp(static_cast<std::streamoff>(run_first) * page_size);
+        file_.write(run.data(), run.size());
+        run.clear();
+    };
+    for (const auto& page : dirty_pages_) {
+        if (run.empty() || page.first != run_first + run.size() / page_size) {
+            write_run();
+            run_first = page.first;
+        }
+        run.insert(run.end(), page.second.begin(), page.second.end());
+    }
+    write_run();
+    dirty_pages_.clear();
+    file_.flush();
+}
+
+bool PageManager::sync() {
+    if (!file_.is_open()) return false;
+    if (vector_store_ && !vector_store_->sync()) return false;
+    const bool batch = batch_write_;
+    batch_write_ = false;  // the header goes to the file now
+    saveHeader();
+    flushDirtyPages();
+    batch_write_ = batch;
+    file_.flush();
+    return file_.good() && PositionalFile::sync(filename_);
+}
+
 void PageManager::writeNode(uint32_t pid, const BPlusNode& node) {
+    if (!snapshots_) {
+        concurrent_reader_.close();
+        mapped_.close();
+    }
+    
+    if (batch_write_) {
+        std::vector<char>& page = dirty_pages_[pid];
+        page.assign(header_.config.page_size, 0);
+        node.serialize(page.data(), header_.config);
+        return;
+    }
+    
+    if (bulk_write_) {
+        const size_t page_size = header_.config.page_size;
+        const size_t staged = staged_pages_.size() / page_size;
+        if (staged_pages_.empty() || pid != staged_first_pid_ + staged ||
+            staged_pages_.size() + page_size > staged_pages_.capacity()) {
+            flushStagedPages();
+            staged_first_pid_ = pid;
+        }
+        size_t at = staged_pages_.size();
+        staged_pages_.resize(at + page_size, 0);
+        node.serialize(staged_pages_.data() + at, header_.config);
+        return;
+    }
+    
     // Serialize node to buffer
     std::fill(page_buffer_.begin(), page_buffer_.end(), 0);
     node.serialize(page_buffer_.data(), header_.config);
@@ -182,28 +390,42 @@ void PageManager::writeNode(uint32_t pid, const BPlusNode& node) {
 }
 
 void PageManager::readRawPage(uint32_t pid, char* buffer, size_t size) {
+    if (batch_write_) {
+        auto dirty = dirty_pages_.find(pid);
+        if (dirty != dirty_pages_.end()) {
+            std::memcpy(buffer, dirty->second.data(), std::min<size_t>(size, dirty->second.size()));
+            return;
+        }
+    }
+    flushStagedPages();
     file_.seekg(static_cast<std::streamoff>(pid) * header_.config.page_size);
     file_.read(buffer, size);
 }
 
+size_t PageManager::estimateNodeBytes() const {
+    return header_.config.order * sizeof(int) +                 // keys
+           (header_.config.order + 1) * sizeof(uint32_t) +      // children
+           header_.config.order * sizeof(uint64_t) +            // vector_list_ids
+           header_.config.order * sizeof(uint32_t) +            // vector_counts
+           (header_.config.order + 1) * sizeof(uint64_t) +      // child_counts
+           100;  // overhead for std::vector headers, map entry, etc.
+}
+
 size_t PageManager::estimateNodeMemoryMB() const {
     uint32_t total_pages = header_.next_free_page;
     if (total_pages <= 1) return 0;
     
-    // estimate per-node memory
-    size_t per_node_bytes = 
-        header_.config.order * sizeof(int) +                    // keys
-        (header_.config.order + 1) * sizeof(uint32_t) +         // children
-        header_.config.order * sizeof(uint64_t) +               // vector_list_ids
-        header_.config.order * sizeof(uint32_t) +               // vector_counts
-        100;  // overhead for std::vector headers, map entry, etc.
+    size_t per_node_bytes = NodeArena::recordBytes(header_.config.order);
     
-    return ((total_pages - 1) * per_node_bytes) / (1024 * 1024);
+    return (static_cast<size_t>(total_pages - 1) * per_node_bytes) / (1024 * 1024);
 }
 
-void PageManager::loadAllNodes(std::unordered_map<uint32_t, BPlusNode>& nodes, size_t max_memory_mb) {
+void PageManager::loadAllNodes(NodeArena& arena, size_t max_memory_mb) {
     uint32_t total_pages = header_.next_free_page;
-    if (total_pages <= 1) return;  // Only header page
+    if (total_pages <= 1) {
+        arena.clear();
+        return;  // Only header page
+    }
     
     size_t estimated_mb = estimateNodeMemoryMB();
     std::cout << "Estimated memory for " << (total_pages - 1) << " nodes: " << estimated_mb << " MB" << std::endl;
@@ -215,15 +437,15 @@ void PageManager::loadAllNodes(std::unordered_map<uint32_t, BPlusNode>& nodes, s
     }
     
     std::cout << "Bulk loading pages sequentially..." << std::endl;
+    flushStagedPages();
+    flushDirtyPages();
     
-    // Calculate how many nodes we can load
-    size_t per_node_bytes = (estimated_mb * 1024 * 1024) / (total_pages - 1);
-    size_t max_nodes = (max_memory_mb > 0 && per_node_bytes > 0) 
+    // Calculate how many nodes we can load (a prefix of the page ids)
+    const size_t per_node_bytes = NodeArena::recordBytes(header_.config.order);
+    size_t max_nodes = (max_memory_mb > 0)
         ? std::min(static_cast<size_t>(total_pages - 1), (max_memory_mb * 1024 * 1024) / per_node_bytes)
         : (total_pages - 1);
-    
-    // Pre-reserve map capacity
-    nodes.reserve(max_nodes);
+    arena.reset(header_.config.order, static_cast<uint32_t>(max_nodes + 1));
     
     // Seek to first data page (page 1, after header)
     file_.seekg(static_cast<std::streamoff>(header_.config.page_size));
@@ -231,16 +453,10 @@ void PageManager::loadAllNodes(std::unordered_map<uint32_t, BPlusNode>& nodes, s
     size_t loaded = 0;
     size_t last_progress = 0;
     size_t memory_used = 0;
-    const size_t memory_limit_bytes = max_memory_mb * 1024 * 1024;
+    BPlusNode node;
     
     // Read all pages sequentially - much faster than random seeks
-    for (uint32_t pid = 1; pid < total_pages; pid++) {
-        // Check memory limit
-        if (max_memory_mb > 0 && memory_used >= memory_limit_bytes) {
-            std::cout << "Memory limit reached at " << loaded << " nodes (" << (memory_used / (1024*1024)) << " MB)" << std::endl;
-            break;
-        }
-        
+    for (uint32_t pid = 1; pid <= max_nodes; pid++) {
         std::fill(page_buffer_.begin(), page_buffer_.end(), 0);
         file_.read(page_buffer_.data(), header_.config.page_size);
         
@@ -249,10 +465,9 @@ void PageManager::loadAllNodes(std::unordered_map<uint32_t, BPlusNode>& nodes, s
             break;
         }
         
-        BPlusNode node;
         node.deserialize(page_buffer_.data(), header_.config);
+        arena.store(pid, node);
         memory_used += per_node_bytes;
-        nodes[pid] = std::move(node);
         loaded++;
         
         // Progress logging every 10%
@@ -262,27 +477,43 @@ void PageManager::loadAllNodes(std::unordered_map<uint32_t, BPlusNode>& nodes, s
             last_progress = progress;
         }
     }
+    if (max_nodes < total_pages - 1) {
+        std::cout << "Memory limit reached at " << loaded << " nodes (" << (memory_used / (1024*1024)) << " MB)" << std::endl;
+    }
     
     std::cout << "Loaded " << loaded << "/" << (total_pages - 1) << " nodes (" << (memory_used / (1024*1024)) << " MB)" << std::endl;
 }
 
 void PageManager::writeRawPage(uint32_t pid, const char* buffer, size_t size) {
+    if (!snapshots_) {
+        concurrent_reader_.close();
+        mapped_.close();
+    }
+    flushDirtyPages();  // a partial page goes over the current image
     file_.seekp(static_cast<std::streamoff>(pid) * header_.config.page_size);
     file_.write(buffer, size);
     maybeFlush();
 }
 
 uint32_t PageManager::allocatePage() {
-    uint32_t pid = header_.next_free_page++;
+    uint32_t pid = allocatePageDeferred();
     saveHeader();
     return pid;
 }
 
 uint32_t PageManager::allocatePageDeferred() {
-    return header_.next_free_page++;
+    if (!snapshots_) {
+        return header_.next_free_page++;
+    }
+    uint32_t pid = takePage();
+    private_pages_.insert(pid);
+    return pid;
 }
 
 uint32_t PageManager::getRoot() {
+    if (snapshots_) {
+        if (const Snapshot* snapshot = pinnedSnapshot()) return snapshot->root;
+    }
     return header_.root_page;
 }
 
@@ -294,3 +525,138 @@ void PageManager::setRoot(uint32_t pid) {
 void PageManager::setRootDeferred(uint32_t pid) {
     header_.root_page = pid;
 }
+
+bool PageManager::enableSnapshots() {
+    if (snapshots_) return true;
+    if (!prepareConcurrentReads() || !vector_store_->enableConcurrentAppends(&epochs_)) {
+        return false;
+    }
+    Snapshot* snapshot = new Snapshot();
+    snapshot->root = header_.root_page;
+    snapshot->flags = header_.flags;
+    snapshot_.store(snapshot);
+    snapshots_ = true;
+    return true;
+}
+
+const PageManager::Snapshot* PageManager::pinnedSnapshot() const {
+    return tls_pinned.owner == this ? tls_pinned.snapshot : nullptr;
+}
+
+uint32_t PageManager::headerFlags() const {
+    const Snapshot* snapshot = snapshots_ ? pinnedSnapshot() : nullptr;
+    return snapshot ? snapshot->flags : header_.flags;
+}
+
+uint32_t PageManager::resolvePinned(uint32_t pid) const {
+    const Snapshot* snapshot = pinnedSnapshot();
+    const std::unordered_map<uint32_t, uint32_t>& remaps = snapshot ? snapshot->remaps : remaps_;
+    if (remaps.empty()) return pid;
+    auto it = remaps.find(pid);
+    return it != remaps.end() ? it->second : pid;
+}
+
+uint32_t PageManager::takePage() {
+    if (!free_pages_.empty()) {
+        uint32_t pid = free_pages_.back();
+        free_pages_.pop_back();
+        return pid;
+    }
+    return header_.next_free_page++;
+}
+
+uint32_t PageManager::pageForWrite(uint32_t pid) {
+    if (!snapshots_ || pid == INVALID_PAGE) return pid;
+    auto remap = remaps_.find(pid);
+    const uint32_t current = remap != remaps_.end() ? remap->second : pid;
+    if (private_pages_.count(current)) return current;
+    
+    // Readers may be looking at current: write a shadow and remap pid to it
+    const uint32_t shadow = takePage();
+    private_pages_.insert(shadow);
+    if (remap != remaps_.end()) {
+        superseded_.push_back(current);
+        remap->second = shadow;
+    } else {
+        remaps_[pid] = shadow;
+        hidden_homes_[pid] = HIDDEN_PENDING;
+    }
+    return shadow;
+}
+
+void PageManager::publish() {
+    if (!snapshots_) return;
+    
+    // Everything the new snapshot refers to has to be readable through the positional handles
+    saveHeader();
+    flushStagedPages();
+    flushDirtyPages();
+    file_.flush();
+    vector_store_->publishAppends();
+    
+    Snapshot* next = new Snapshot();
+    next->root = header_.root_page;
+    next->flags = header_.flags;
+    next->remaps = remaps_;
+    const Snapshot* previous = snapshot_.exchange(next);
+    
+    // Readers of previous (and so of the pages it alone refers to) all entered by this epoch
+    const uint64_t epoch = epochs_.current();
+    epochs_.retire([previous] { delete previous; });
+    for (uint32_t page : superseded_) {
+        epochs_.retire([this, page] { free_pages_.push_back(page); });
+    }
+    for (auto& home : hidden_homes_) {
+        if (home.second == HIDDEN_PENDING) home.second = epoch;
+    }
+    superseded_.clear();
+    private_pages_.clear();
+    epochs_.advance();
+    epochs_.reclaim();
+}
+
+void PageManager::foldablePages(std::vector<std::pair<uint32_t, uint32_t>>& pages) const {
+    pages.clear();
+    for (const auto& home : hidden_homes_) {
+        if (home.second != HIDDEN_PENDING && epochs_.isSafe(home.second)) {
+            pages.emplace_back(home.first, remaps_.at(home.first));
+        }
+    }
+}
+
+void PageManager::finishFold(uint32_t home) {
+    auto remap = remaps_.find(home);
+    if (remap == remaps_.end()) return;
+    // The home is private again until publish(); the shadow stays readable for older snapshots
+    private_pages_.insert(home);
+    superseded_.push_back(remap->second);
+    remaps_.erase(remap);
+    hidden_homes_.erase(home);
+}
+
+PageManager::ReadSnapshot::ReadSnapshot(PageManager& pm) {
+    if (!pm.snapshots_ || tls_pinned.owner == &pm) return;
+    pm_ = &pm;
+    prev_owner_ = tls_pinned.owner;
+    prev_snapshot_ = tls_pinned.snapshot;
+    slot_ = pm.epochs_.enter();
+    tls_pinned = {&pm, pm.snapshot_.load(std::memory_order_acquire)};
+}
+
+PageManager::ReadSnapshot::~ReadSnapshot() {
+    if (!pm_) return;
+    tls_pinned = {prev_owner_, prev_snapshot_};
+    pm_->epochs_.exit(slot_);
+}
+
+PageManager::SnapshotScope::SnapshotScope(const PageManager& pm, const Snapshot* snapshot) {
+    if (!snapshot) return;
+    active_ = true;
+    prev_owner_ = tls_pinned.owner;
+    prev_snapshot_ = tls_pinned.snapshot;
+    tls_pinned = {&pm, snapshot};
+}
+
+PageManager::SnapshotScope::~SnapshotScope() {
+    if (active_) tls_pinned = {prev_owner_, prev_snapshot_};
+}
@@ -0,0 +1,119 @@
+#include "positional_file.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+PositionalFile::~PositionalFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool PositionalFile::open(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    handle_ = file;
+    return true;
+}
+
+void PositionalFile::close() {
+    if (handle_) CloseHandle(handle_);
+    handle_ = nullptr;
+}
+
+bool PositionalFile::is_open() const {
+    return handle_ != nullptr;
+}
+
+bool PositionalFile::read_at(uint64_t offset, void* buffer, size_t size) const {
+    char* out = static_cast<char*>(buffer);
+    while (size > 0) {
+        OVERLAPPED ov = {};
+        ov.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFull);
+        ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunk = size > 0x40000000u ? 0x40000000u : static_cast<DWORD>(size);
+        DWORD got = 0;
+        if (!ReadFile(handle_, out, chunk, &got, &ov) || got == 0) return false;
+        out += got;
+        offset += got;
+        size -= got;
+    }
+    return true;
+}
+
+void PositionalFile::prefetch(uint64_t, size_t) const {
+    // No cheap asynchronous hint for plain handles; reads stay on demand
+}
+
+bool PositionalFile::sync(const std::string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    bool ok = FlushFileBuffers(file) != 0;
+    CloseHandle(file);
+    return ok;
+}
+
+#else
+
+bool PositionalFile::open(const std::string& path) {
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    return fd_ >= 0;
+}
+
+void PositionalFile::close() {
+    if (fd_ >= 0) ::close(fd_);
+    fd_ = -1;
+}
+
+bool PositionalFile::is_open() const {
+    return fd_ >= 0;
+}
+
+bool PositionalFile::read_at(uint64_t offset, void* buffer, size_t size) const {
+    char* out = static_cast<char*>(buffer);
+    while (size > 0) {
+        ssize_t got = ::pread(fd_, out, size, static_cast<off_t>(offset));
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (got == 0) return false;  // EOF
+        out += got;
+        offset += static_cast<uint64_t>(got);
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+void PositionalFile::prefetch(uint64_t offset, size_t size) const {
+#ifdef POSIX_FADV_WILLNEED
+    if (fd_ >= 0 && size > 0) {
+        ::posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+    }
+#else
+    (void)offset;
+    (void)size;
+#endif
+}
+
+bool PositionalFile::sync(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include "quantized_store.h"
+#include "vector_store.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+// file format (<vectors file>.sq8):
+// Header (32 bytes):
+//   - magic (4 bytes): 0x31385153 ("SQ81")
+//   - version (4 bytes): 1
+//   - dimension (4 bytes)
+//   - reserved (4 bytes)
+//   - slot_count (8 bytes): code slots (max vector id + 1)
+//   - encoded_count (8 bytes): slots holding a stored vector
+// min (dimension floats), scale (dimension floats)
+// Codes: slot_count * dimension bytes, slot i = vector id i (absent ids are all zero)
+
+static constexpr uint32_t SQ8_MAGIC = 0x31385153;  // "SQ81"
+static constexpr uint32_t SQ8_VERSION = 1;
+
+struct QuantizedFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t reserved;
+    uint64_t slot_count;
+    uint64_t encoded_count;
+};
+static_assert(sizeof(QuantizedFileHeader) == 32, "QuantizedFileHeader must match the on-disk layout");
+
+bool QuantizedStore::build(VectorStore& store, const std::string& path) {
+    const uint32_t dim = store.getMaxVectorSize();
+    const uint64_t next_id = store.getNextVectorId();
+    if (dim == 0 || next_id <= 1) {
+        return false;
+    }
+    const uint64_t ids = next_id - 1;  // ids start at 1
+    
+    // Pass 1: per-dimension range (missing trailing dimensions count as 0)
+    std::vector<float> lo(dim, std::numeric_limits<float>::max());
+    std::vector<float> hi(dim, std::numeric_limits<float>::lowest());
+    uint64_t encoded = 0;
+    store.forEachVectorInIdRange(1, ids, [&](const VectorStore::VectorView& view) {
+        for (uint32_t d = 0; d < dim; d++) {
+            float x = d < view.size ? view.data[d] : 0.0f;
+            lo[d] = std::min(lo[d], x);
+            hi[d] = std::max(hi[d], x);
+        }
+        encoded++;
+    });
+    if (encoded == 0) {
+        return false;
+    }
+    
+    std::vector<float> scale(dim);
+    for (uint32_t d = 0; d < dim; d++) {
+        scale[d] = (hi[d] - lo[d]) / 255.0f;
+    }
+    
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to create quantized store: " << path << std::endl;
+        return false;
+    }
+    QuantizedFileHeader header{SQ8_MAGIC, SQ8_VERSION, dim, 0, next_id, encoded};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(lo.data()), dim * sizeof(float));
+    out.write(reinterpret_cast<const char*>(scale.data()), dim * sizeof(float));
+    
+    // Pass 2: codes in id order; slots without a record stay zero
+    std::vector<uint8_t> code(dim);
+    const std::vector<uint8_t> empty(dim, 0);
+    uint64_t written = 0;  // slots written so far (slot 0 is never a vector)
+    store.forEachVectorInIdRange(1, ids, [&](const VectorStore::VectorView& view) {
+        for (; written < view.id; written++) {
+            out.write(reinterpret_cast<const char*>(empty.data()), dim);
+        }
+        for (uint32_t d = 0; d < dim; d++) {
+            float x = d < view.size ? view.data[d] : 0.0f;
+            float q = scale[d] > 0.0f ? std::round((x - lo[d]) / scale[d]) : 0.0f;
+            code[d] = static_cast<uint8_t>(std::min(255.0f, std::max(0.0f, q)));
+        }
+        out.write(reinterpret_cast<const char*>(code.data()), dim);
+        written++;
+    });
+    for (; written < next_id; written++) {
+        out.write(reinterpret_cast<const char*>(empty.data()), dim);
+    }
+    
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write quantized store: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool QuantizedStore::open(const std::string& path) {
+    close();
+    if (!file_.open(path)) {
+        return false;
+    }
+    
+    if (file_.size() < sizeof(QuantizedFileHeader)) {
+        close();
+        return false;
+    }
+    QuantizedFileHeader header;
+    std::copy(file_.data(), file_.data() + sizeof(header), reinterpret_cast<char*>(&header));
+    if (header.magic != SQ8_MAGIC || header.version != SQ8_VERSION || header.dimension == 0) {
+        std::cerr << "Invalid quantized store: " << path << std::endl;
+        close();
+        return false;
+    }
+    
+    const size_t params_bytes = 2 * static_cast<size_t>(header.dimension) * sizeof(float);
+    const size_t expected = sizeof(header) + params_bytes + header.slot_count * header.dimension;
+    if (file_.size() < expected) {
+        std::cerr << "Truncated quantized store: " << path << std::endl;
+        close();
+        return false;
+    }
+    
+    dim_ = header.dimension;
+    slot_count_ = header.slot_count;
+    encoded_count_ = header.encoded_count;
+    min_ = reinterpret_cast<const float*>(file_.data() + sizeof(header));
+    scale_ = min_ + dim_;
+    codes_ = reinterpret_cast<const uint8_t*>(file_.data() + sizeof(header) + params_bytes);
+    return true;
+}
+
+void QuantizedStore::close() {
+    file_.close();
+    dim_ = 0;
+    slot_count_ = 0;
+    encoded_count_ = 0;
+    min_ = nullptr;
+    scale_ = nullptr;
+    codes_ = nullptr;
+}
+
+void QuantizedStore::buildDistanceTable(const float* query, size_t n, std::vector<float>& table) const {
+    n = std::min(n, static_cast<size_t>(dim_));
+    table.resize(n * 256);
+    for (size_t d = 0; d < n; d++) {
+        float* row = table.data() + d * 256;
+        for (int c = 0; c < 256; c++) {
+            float diff = query[d] - (min_[d] + c * scale_[d]);
+            row[c] = diff * diff;
+        }
+    }
+}
@@ -1,14 +1,166 @@
 #include "query_cache.h"
+#include "distance.h"
 #include <filesystem>
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <iterator>
 #include <fstream>
 #include <cmath>
 #include <cstring>
 
 namespace fs = std::filesystem;
 
+// log format (.cache/segment_<n>.log, replayed in n order):
+// Record: type (1 byte) + payload size (4 bytes) + payload
+//   PUT:   query id + created (8) + last used (8) + min_key + max_key + max_k
+//          + input vector (size + floats) + neighbors (count + per neighbor: size + floats,
+//          key, original_id, distance)
+//   ERASE: query id
+//   TOUCH: query id + last used (8)
+// Strings are a 4-byte length plus bytes. A record cut short by a crash ends its segment's replay.
+
+namespace {
+
+constexpr uint8_t RECORD_PUT = 1;
+constexpr uint8_t RECORD_ERASE = 2;
+constexpr uint8_t RECORD_TOUCH = 3;
+constexpr size_t RECORD_HEADER_SIZE = sizeof(uint8_t) + sizeof(uint32_t);
+
+template <typename T>
+void put(std::vector<char>& out, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void put_floats(std::vector<char>& out, const std::vector<float>& values) {
+    put(out, static_cast<uint32_t>(values.size()));
+    const char* bytes = reinterpret_cast<const char*>(values.data());
+    out.insert(out.end(), bytes, bytes + values.size() * sizeof(float));
+}
+
+void put_string(std::vector<char>& out, const std::string& value) {
+    put(out, static_cast<uint32_t>(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+// Bounds-checked cursor over one record payload; ok turns false on a short read
+struct RecordReader {
+    const char* pos;
+    const char* end;
+    bool ok = true;
+
+    bool take(void* out, size_t size) {
+        if (!ok || static_cast<size_t>(end - pos) < size) return ok = false;
+        std::memcpy(out, pos, size);
+        pos += size;
+        return true;
+    }
+    template <typename T>
+    T get() {
+        T value{};
+        take(&value, sizeof(T));
+        return value;
+    }
+    void get_floats(std::vector<float>& values) {
+        uint32_t size = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - pos) / sizeof(float) < size) {
+            ok = false;
+            return;
+        }
+        values.resize(size);
+        take(values.data(), size * sizeof(float));
+    }
+    std::string get_string() {
+        uint32_t size = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - pos) < size) {
+            ok = false;
+            return std::string();
+        }
+        std::string value(pos, size);
+        pos += size;
+        return value;
+    }
+};
+
+void encode_result(std::vector<char>& out, const CachedQueryResult& result) {
+    put_string(out, result.query_id);
+    put(out, static_cast<int64_t>(result.created_date));
+    put(out, static_cast<int64_t>(result.last_used_date));
+    put(out, static_cast<int32_t>(result.min_key));
+    put(out, static_cast<int32_t>(result.max_key));
+    put(out, static_cast<int32_t>(result.max_k));
+    put_floats(out, result.input_vector);
+    put(out, static_cast<uint32_t>(result.neighbors.size()));
+    for (const auto& neighbor : result.neighbors) {
+        put_floats(out, neighbor.vector);
+        put(out, static_cast<int32_t>(neighbor.key));
+        put(out, neighbor.original_id);
+        put(out, neighbor.distance);
+    }
+}
+
+bool decode_result(RecordReader& in, CachedQueryResult& result) {
+    result.query_id = in.get_string();
+    result.created_date = static_cast<std::time_t>(in.get<int64_t>());
+    result.last_used_date = static_cast<std::time_t>(in.get<int64_t>());
+    result.min_key = in.get<int32_t>();
+    result.max_key = in.get<int32_t>();
+    result.max_k = in.get<int32_t>();
+    in.get_floats(result.input_vector);
+    uint32_t num_neighbors = in.get<uint32_t>();
+    result.neighbors.clear();
+    for (uint32_t i = 0; i < num_neighbors && in.ok; i++) {
+        CachedNeighbor neighbor;
+        in.get_floats(neighbor.vector);
+        neighbor.key = in.get<int32_t>();
+        neighbor.original_id = in.get<int32_t>();
+        neighbor.distance = in.get<double>();
+        result.neighbors.push_back(std::move(neighbor));
+    }
+    return in.ok;
+}
+
+// One file per query (<query_id>.qcache), the layout before the log; only read to migrate
+bool read_legacy_file(const std::string& path, const std::string& query_id, CachedQueryResult& result) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    
+    result.query_id = query_id;
+    
+    file.read(reinterpret_cast<char*>(&result.created_date), sizeof(result.created_date));
+    file.read(reinterpret_cast<char*>(&result.last_used_date), sizeof(result.last_used_date));
+    file.read(reinterpret_cast<char*>(&result.min_key), sizeof(result.min_key));
+    file.read(reinterpret_cast<char*>(&result.max_key), sizeof(result.max_key));
+    file.read(reinterpret_cast<char*>(&result.max_k), sizeof(result.max_k));
+    
+    uint32_t vec_size = 0;
+    file.read(reinterpret_cast<char*>(&vec_size), sizeof(vec_size));
+    if (!file) return false;
+    result.input_vector.resize(vec_size);
+    file.read(reinterpret_cast<char*>(result.input_vector.data()), vec_size * sizeof(float));
+    
+    uint32_t num_neighbors = 0;
+    file.read(reinterpret_cast<char*>(&num_neighbors), sizeof(num_neighbors));
+    if (!file) return false;
+    result.neighbors.resize(num_neighbors);
+    
+    for (uint32_t i = 0; i < num_neighbors && file; i++) {
+        uint32_t neighbor_vec_size = 0;
+        file.read(reinterpret_cast<char*>(&neighbor_vec_size), sizeof(neighbor_vec_size));
+        if (!file) break;
+        result.neighbors[i].vector.resize(neighbor_vec_size);
+        file.read(reinterpret_cast<char*>(result.neighbors[i].vector.data()), neighbor_vec_size * sizeof(float));
+        file.read(reinterpret_cast<char*>(&result.neighbors[i].key), sizeof(int));
+        file.read(reinterpret_cast<char*>(&result.neighbors[i].original_id), sizeof(int32_t));
+        file.read(reinterpret_cast<char*>(&result.neighbors[i].distance), sizeof(double));
+    }
+    
+    return file.good();
+}
+
+}  // namespace
+
 static std::string uint64_to_hex(uint64_t value) {
     std::ostringstream oss;
     oss << std::hex << std::setfill('0') << std::setw(16) << value;
@@ -18,24 +170,24 @@ static std::string uint64_to_hex(uint64_t value) {
 QueryCache::QueryCache(const std::string& index_dir, bool enabled)
     : index_dir_(index_dir), enabled_(enabled) {
     cache_dir_ = index_dir_ + "/.cache";
-    interval_tree_path_ = cache_dir_ + "/interval_tree.bin";
     
     if (enabled_) {
-        ensure_directories();
-        load_interval_tree();
+        load_log();
     }
 }
 
 QueryCache::~QueryCache() {
-    if (enabled_) {
-        save_interval_tree();
-    }
+    segment_.close();
 }
 
 void QueryCache::set_enabled(bool enabled) {
-    if (enabled && !enabled_) {
-        ensure_directories();
-        load_interval_tree();
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    set_enabled_locked(enabled);
+}
+
+void QueryCache::set_enabled_locked(bool enabled) {
+    if (enabled && !loaded_) {
+        load_log();
     }
     enabled_ = enabled;
 }
@@ -71,28 +223,25 @@ std::string QueryCache::compute_query_hash(const std::vector<float>& query_vecto
 
 bool QueryCache::has_cached_result(const std::string& query_id, int k) const {
     if (!enabled_) return false;
-    if (query_ranges_.find(query_id) == query_ranges_.end()) return false;
-    
-    // load and check if we have at least k neighbors cached
-    CachedQueryResult result;
-    if (!load_query_result(query_id, result)) return false;
-    
-    return static_cast<int>(result.neighbors.size()) >= k;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = entries_.find(query_id);
+    return it != entries_.end() && static_cast<int>(it->second.result.neighbors.size()) >= k;
 }
 
 CachedQueryResult QueryCache::get_cached_result(const std::string& query_id, int k) {
     CachedQueryResult result;
     if (!enabled_) return result;
     
-    if (load_query_result(query_id, result)) {
-        result.last_used_date = std::time(nullptr);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = entries_.find(query_id);
+    if (it != entries_.end()) {
+        touch_entry(it->second);
+        result = copy_result(it->second);
         
         // return only first k neighbors
         if (static_cast<int>(result.neighbors.size()) > k) {
             result.neighbors.resize(k);
         }
-        
-        save_query_result(result);
     }
     return result;
 }
@@ -107,26 +256,27 @@ void QueryCache::store_result(const std::string& query_id,
     // if we used a similar query's results, don't cache this query
     // instead, update the similar query's last_used_date
     if (!used_similar_query_id.empty()) {
-        CachedQueryResult similar_result;
-        if (load_query_result(used_similar_query_id, similar_result)) {
-            similar_result.last_used_date = std::time(nullptr);
-            save_query_result(similar_result);
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto similar = entries_.find(used_similar_query_id);
+        if (similar != entries_.end()) {
+            touch_entry(similar->second);
         }
         return;
     }
     
+    std::unique_lock<std::shared_mutex> lock(mutex_);
     // check if we already have a cached result
-    CachedQueryResult existing;
-    bool has_existing = load_query_result(query_id, existing);
+    auto existing = entries_.find(query_id);
+    bool has_existing = existing != entries_.end();
     
-    if (has_existing && existing.max_k >= k) {
+    if (has_existing && existing->second.result.max_k >= k) {
         // existing cache has same or more neighbors, don't update
         return;
     }
     
     CachedQueryResult cached;
     cached.query_id = query_id;
-    cached.created_date = has_existing ? existing.created_date : std::time(nullptr);
+    cached.created_date = has_existing ? existing->second.result.created_date : std::time(nullptr);
     cached.last_used_date = std::time(nullptr);
     cached.input_vector = input_vector;
     cached.min_key = min_key;
@@ -134,37 +284,29 @@ void QueryCache::store_result(const std::string& query_id,
     cached.max_k = k;
     cached.neighbors = results;
     
-    save_query_result(cached);
-    
-    if (!has_existing) {
-        add_to_interval_tree(query_id, min_key, max_key);
-        save_interval_tree();
-    }
-    
-    enforce_cache_limit();
+    put_entry(cached);
+    evict_to_limit();
 }
 
 void QueryCache::invalidate_for_key(int key) {
     if (!enabled_) return;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
     
     // use interval tree for efficient o(log n) lookup instead of o(n) linear search
     std::vector<std::string> queries_to_remove;
     find_overlapping_intervals(interval_root_.get(), key, queries_to_remove);
     
     for (const auto& query_id : queries_to_remove) {
-        remove_from_interval_tree(query_id);
-        delete_query_result(query_id);
-    }
-    
-    if (!queries_to_remove.empty()) {
-        save_interval_tree();
+        erase_entry(query_id);
     }
+    maybe_compact();
 }
 
 int QueryCache::update_for_inserted_object(int key, const std::vector<float>& vector,
                                             std::function<double(const std::vector<float>&, const std::vector<float>&)> distance_fn,
                                             int32_t original_id) {
     if (!enabled_) return 0;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
     
     // find all queries whose range contains this key
     std::vector<std::string> affected_queries;
@@ -175,18 +317,21 @@ int QueryCache::update_for_inserted_object(int key, const std::vector<float>& ve
     int updated_count = 0;
     
     for (const auto& query_id : affected_queries) {
-        CachedQueryResult result;
-        if (!load_query_result(query_id, result)) continue;
-        if (result.neighbors.empty()) continue;
+        auto it = entries_.find(query_id);
+        if (it == entries_.end()) continue;
+        const CachedQueryResult& cached = it->second.result;
+        if (cached.neighbors.empty()) continue;
         
         // calculate distance from query vector to new object
-        double new_dist = distance_fn(result.input_vector, vector);
+        double new_dist = distance_fn(cached.input_vector, vector);
         
         // get the furthest cached neighbor's distance
-        double furthest_dist = result.neighbors.back().distance;
+        double furthest_dist = cached.neighbors.back().distance;
         
         // if new object is closer than furthest cached neighbor, insert it
-        if (new_dist < furthest_dist || static_cast<int>(result.neighbors.size()) < result.max_k) {
+        if (new_dist < furthest_dist || static_cast<int>(cached.neighbors.size()) < cached.max_k) {
+            CachedQueryResult result = cached;
+            
             // create new neighbor entry
             CachedNeighbor new_neighbor;
             new_neighbor.vector = vector;
@@ -205,67 +350,137 @@ int QueryCache::update_for_inserted_object(int key, const std::vector<float>& ve
             // keep the furthest neighbor - allows cache to grow and serve higher k queries
             
             result.last_used_date = std::time(nullptr);
-            save_query_result(result);
+            put_entry(result);
             updated_count++;
         }
     }
     
+    if (updated_count > 0) {
+        evict_to_limit();
+    }
     return updated_count;
 }
 
 int QueryCache::update_for_deleted_object(int key, const std::vector<float>& vector) {
-    if (!enabled_) return 0;
+    return update_for_deleted_objects({DataObject(vector, key)});
+}
+
+static int object_key(const DataObject& obj) {
+    return obj.is_int_value() ? obj.get_int_value() : static_cast<int>(obj.get_float_value());
+}
+
+std::unordered_map<std::string, std::vector<size_t>> QueryCache::group_by_entry(
+    const std::vector<DataObject>& objects) const {
+    std::unordered_map<std::string, std::vector<size_t>> groups;
+    std::vector<std::string> containing;
+    for (size_t i = 0; i < objects.size(); i++) {
+        containing.clear();
+        find_overlapping_intervals(interval_root_.get(), object_key(objects[i]), containing);
+        for (const std::string& query_id : containing) groups[query_id].push_back(i);
+    }
+    return groups;
+}
+
+int QueryCache::update_for_inserted_objects(const std::vector<DataObject>& objects) {
+    if (!enabled_ || objects.empty()) return 0;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
     
-    // find all queries whose range contains this key
-    std::vector<std::string> affected_queries;
-    find_overlapping_intervals(interval_root_.get(), key, affected_queries);
+    const L2SqrKernel l2_sqr_kernel = get_l2_sqr_kernel();
+    const std::time_t now = std::time(nullptr);
+    int updated_count = 0;
+    CachedQueryResult result;
     
-    if (affected_queries.empty()) return 0;
+    for (const auto& group : group_by_entry(objects)) {
+        auto it = entries_.find(group.first);
+        if (it == entries_.end()) continue;
+        const CachedQueryResult& cached = it->second.result;
+        if (cached.neighbors.empty()) continue;
+        
+        // same rule as update_for_inserted_object, applied object by object to one copy
+        bool changed = false;
+        for (size_t i : group.second) {
+            const std::vector<float>& vector = objects[i].get_vector();
+            const std::vector<CachedNeighbor>& current = changed ? result.neighbors : cached.neighbors;
+            const size_t n = std::min(cached.input_vector.size(), vector.size());
+            double new_dist = std::sqrt(static_cast<double>(l2_sqr_kernel(cached.input_vector.data(), vector.data(), n)));
+            if (new_dist >= current.back().distance && static_cast<int>(current.size()) >= cached.max_k) continue;
+            
+            if (!changed) {
+                result = cached;
+                changed = true;
+            }
+            CachedNeighbor new_neighbor;
+            new_neighbor.vector = vector;
+            new_neighbor.key = object_key(objects[i]);
+            new_neighbor.original_id = objects[i].get_id();
+            new_neighbor.distance = new_dist;
+            auto insert_pos = std::lower_bound(result.neighbors.begin(), result.neighbors.end(), new_neighbor,
+                [](const CachedNeighbor& a, const CachedNeighbor& b) {
+                    return a.distance < b.distance;
+                });
+            result.neighbors.insert(insert_pos, std::move(new_neighbor));
+        }
+        
+        if (changed) {
+            result.last_used_date = now;
+            put_entry(result);
+            updated_count++;
+        }
+    }
+    
+    if (updated_count > 0) {
+        evict_to_limit();
+    }
+    return updated_count;
+}
+
+int QueryCache::update_for_deleted_objects(const std::vector<DataObject>& objects) {
+    if (!enabled_ || objects.empty()) return 0;
+    std::unique_lock<std::shared_mutex> lock(mutex_);
     
-    int updated_count = 0;
     const float epsilon = 1e-3f;
+    const std::time_t now = std::time(nullptr);
+    int updated_count = 0;
+    CachedQueryResult result;
     
-    for (const auto& query_id : affected_queries) {
-        CachedQueryResult result;
-        if (!load_query_result(query_id, result)) continue;
+    for (const auto& group : group_by_entry(objects)) {
+        auto entry = entries_.find(group.first);
+        if (entry == entries_.end()) continue;
+        const CachedQueryResult& cached = entry->second.result;
         
-        // find and remove the deleted object from neighbors
-        bool found = false;
-        auto it = result.neighbors.begin();
-        while (it != result.neighbors.end()) {
-            if (it->key == key) {
-                // compare vectors
-                bool vectors_match = true;
-                if (it->vector.size() == vector.size()) {
-                    for (size_t i = 0; i < vector.size(); i++) {
-                        if (std::abs(it->vector[i] - vector[i]) > epsilon) {
-                            vectors_match = false;
-                            break;
-                        }
-                    }
-                } else {
-                    vectors_match = false;
-                }
-                
-                if (vectors_match) {
-                    it = result.neighbors.erase(it);
-                    found = true;
-                    break;  // only remove first match
-                } else {
-                    ++it;
+        // each deleted object removes the first neighbor with its key and (nearly) its vector
+        bool changed = false;
+        for (size_t i : group.second) {
+            const int key = object_key(objects[i]);
+            const std::vector<float>& vector = objects[i].get_vector();
+            const std::vector<CachedNeighbor>& current = changed ? result.neighbors : cached.neighbors;
+            auto match = std::find_if(current.begin(), current.end(), [&](const CachedNeighbor& neighbor) {
+                if (neighbor.key != key || neighbor.vector.size() != vector.size()) return false;
+                for (size_t d = 0; d < vector.size(); d++) {
+                    if (std::abs(neighbor.vector[d] - vector[d]) > epsilon) return false;
                 }
-            } else {
-                ++it;
+                return true;
+            });
+            if (match == current.end()) continue;
+            
+            const size_t pos = static_cast<size_t>(match - current.begin());
+            if (!changed) {
+                result = cached;
+                changed = true;
             }
+            result.neighbors.erase(result.neighbors.begin() + pos);
         }
         
-        if (found) {
-            result.last_used_date = std::time(nullptr);
-            save_query_result(result);
+        if (changed) {
+            result.last_used_date = now;
+            put_entry(result);
             updated_count++;
         }
     }
     
+    if (updated_count > 0) {
+        maybe_compact();
+    }
     return updated_count;
 }
 
@@ -273,6 +488,7 @@ void QueryCache::load_config(const std::string& config_path) {
     std::ifstream file(config_path);
     if (!file.is_open()) return;
     
+    std::unique_lock<std::shared_mutex> lock(mutex_);
     std::string line;
     while (std::getline(file, line)) {
         if (line.empty() || line[0] == '#' || line[0] == '[') continue;
@@ -292,189 +508,293 @@ void QueryCache::load_config(const std::string& config_path) {
             config_.max_cache_size_bytes = std::stoull(value) * 1024 * 1024;
         } else if (key == "cache_enabled") {
             config_.cache_enabled = (value == "true" || value == "1");
-            enabled_ = config_.cache_enabled;
+            set_enabled_locked(config_.cache_enabled);
         }
     }
 }
 
 void QueryCache::enforce_cache_limit() {
     if (!enabled_) return;
-    
-    size_t current_size = get_cache_size();
-    if (current_size <= config_.max_cache_size_bytes) return;
-    
-    auto queries_by_time = get_queries_by_last_used();
-    
-    std::sort(queries_by_time.begin(), queries_by_time.end(),
-              [](const auto& a, const auto& b) { return a.second < b.second; });
-    
-    for (const auto& [query_id, _] : queries_by_time) {
-        if (current_size <= config_.max_cache_size_bytes) break;
-        
-        std::string file_path = get_query_file_path(query_id);
-        if (fs::exists(file_path)) {
-            size_t file_size = fs::file_size(file_path);
-            remove_from_interval_tree(query_id);
-            delete_query_result(query_id);
-            current_size -= file_size;
-        }
-    }
-    save_interval_tree();
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    evict_to_limit();
 }
 
-std::string QueryCache::get_query_file_path(const std::string& query_id) const {
-    return cache_dir_ + "/" + query_id + ".qcache";
+void QueryCache::evict_to_limit() {
+    // least recently used entries go first
+    while (live_bytes_ > config_.max_cache_size_bytes && !lru_.empty()) {
+        erase_entry(lru_.back());
+    }
+    maybe_compact();
 }
 
 bool QueryCache::load_query_result(const std::string& query_id, CachedQueryResult& result) const {
-    std::string path = get_query_file_path(query_id);
-    std::ifstream file(path, std::ios::binary);
-    if (!file.is_open()) return false;
-    
-    result.query_id = query_id;
-    
-    file.read(reinterpret_cast<char*>(&result.created_date), sizeof(result.created_date));
-    file.read(reinterpret_cast<char*>(&result.last_used_date), sizeof(result.last_used_date));
-    file.read(reinterpret_cast<char*>(&result.min_key), sizeof(result.min_key));
-    file.read(reinterpret_cast<char*>(&result.max_key), sizeof(result.max_key));
-    file.read(reinterpret_cast<char*>(&result.max_k), sizeof(result.max_k));
-    
-    uint32_t vec_size;
-    file.read(reinterpret_cast<char*>(&vec_size), sizeof(vec_size));
-    result.input_vector.resize(vec_size);
-    file.read(reinterpret_cast<char*>(result.input_vector.data()), vec_size * sizeof(float));
-    
-    uint32_t num_neighbors;
-    file.read(reinterpret_cast<char*>(&num_neighbors), sizeof(num_neighbors));
-    result.neighbors.resize(num_neighbors);
-    
-    for (uint32_t i = 0; i < num_neighbors; i++) {
-        uint32_t neighbor_vec_size;
-        file.read(reinterpret_cast<char*>(&neighbor_vec_size), sizeof(neighbor_vec_size));
-        result.neighbors[i].vector.resize(neighbor_vec_size);
-        file.read(reinterpret_cast<char*>(result.neighbors[i].vector.data()), neighbor_vec_size * sizeof(float));
-        file.read(reinterpret_cast<char*>(&result.neighbors[i].key), sizeof(int));
-        file.read(reinterpret_cast<char*>(&result.neighbors[i].original_id), sizeof(int32_t));
-        file.read(reinterpret_cast<char*>(&result.neighbors[i].distance), sizeof(double));
-    }
-    
-    return file.good();
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = entries_.find(query_id);
+    if (it == entries_.end()) return false;
+    result = copy_result(it->second);
+    return true;
 }
 
-void QueryCache::save_query_result(const CachedQueryResult& result) {
-    std::string path = get_query_file_path(result.query_id);
-    std::ofstream file(path, std::ios::binary);
-    if (!file.is_open()) return;
-    
-    file.write(reinterpret_cast<const char*>(&result.created_date), sizeof(result.created_date));
-    file.write(reinterpret_cast<const char*>(&result.last_used_date), sizeof(result.last_used_date));
-    file.write(reinterpret_cast<const char*>(&result.min_key), sizeof(result.min_key));
-    file.write(reinterpret_cast<const char*>(&result.max_key), sizeof(result.max_key));
-    file.write(reinterpret_cast<const char*>(&result.max_k), sizeof(result.max_k));
-    
-    uint32_t vec_size = static_cast<uint32_t>(result.input_vector.size());
-    file.write(reinterpret_cast<const char*>(&vec_size), sizeof(vec_size));
-    file.write(reinterpret_cast<const char*>(result.input_vector.data()), vec_size * sizeof(float));
-    
-    uint32_t num_neighbors = static_cast<uint32_t>(result.neighbors.size());
-    file.write(reinterpret_cast<const char*>(&num_neighbors), sizeof(num_neighbors));
-    
-    for (const auto& neighbor : result.neighbors) {
-        uint32_t neighbor_vec_size = static_cast<uint32_t>(neighbor.vector.size());
-        file.write(reinterpret_cast<const char*>(&neighbor_vec_size), sizeof(neighbor_vec_size));
-        file.write(reinterpret_cast<const char*>(neighbor.vector.data()), neighbor_vec_size * sizeof(float));
-        file.write(reinterpret_cast<const char*>(&neighbor.key), sizeof(int));
-        file.write(reinterpret_cast<const char*>(&neighbor.original_id), sizeof(int32_t));
-        file.write(reinterpret_cast<const char*>(&neighbor.distance), sizeof(double));
+std::vector<std::string> QueryCache::list_query_ids() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::lock_guard<std::mutex> lru_lock(lru_mutex_);
+    return std::vector<std::string>(lru_.begin(), lru_.end());
+}
+
+size_t QueryCache::get_cache_size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return live_bytes_;
+}
+
+CachedQueryResult QueryCache::copy_result(const Entry& entry) const {
+    CachedQueryResult result = entry.result;
+    result.last_used_date = static_cast<std::time_t>(entry.last_used.load(std::memory_order_relaxed));
+    return result;
+}
+
+// ============================================================================
+// ENTRIES AND LOG
+// ============================================================================
+
+void QueryCache::put_entry(const CachedQueryResult& result) {
+    std::vector<char> payload;
+    encode_result(payload, result);
+    size_t bytes = append_record(RECORD_PUT, payload);
+    apply_put(CachedQueryResult(result), bytes);
+}
+
+void QueryCache::erase_entry(const std::string& query_id) {
+    std::vector<char> payload;
+    put_string(payload, query_id);
+    std::string id = query_id;  // query_id may be the lru_ node apply_erase removes
+    size_t bytes = append_record(RECORD_ERASE, payload);
+    apply_erase(id, bytes);
+}
+
+void QueryCache::touch_entry(Entry& entry) {
+    std::lock_guard<std::mutex> lru_lock(lru_mutex_);
+    std::time_t now = std::time(nullptr);
+    std::vector<char> payload;
+    put_string(payload, entry.result.query_id);
+    put(payload, static_cast<int64_t>(now));
+    size_t bytes = append_record(RECORD_TOUCH, payload);
+    apply_touch(entry.result.query_id, now, bytes);
+}
+
+void QueryCache::apply_put(CachedQueryResult&& result, size_t bytes) {
+    auto it = entries_.find(result.query_id);
+    if (it == entries_.end()) {
+        it = entries_.try_emplace(result.query_id).first;
+        lru_.push_front(result.query_id);
+    } else {
+        // the previous version stays in the log until compaction
+        live_bytes_ -= it->second.bytes;
+        dead_bytes_ += it->second.bytes;
+        remove_from_interval_tree(result.query_id);
+        vector_index_.remove(result.query_id);
+        lru_.erase(it->second.lru);
+        lru_.push_front(result.query_id);
     }
+    Entry& entry = it->second;
+    entry.lru = lru_.begin();
+    entry.bytes = bytes;
+    live_bytes_ += bytes;
+    entry.last_used.store(static_cast<int64_t>(result.last_used_date), std::memory_order_relaxed);
+    add_to_interval_tree(result.query_id, result.min_key, result.max_key);
+    vector_index_.insert(result.query_id, result.input_vector);
+    entry.result = std::move(result);
 }
 
-void QueryCache::delete_query_result(const std::string& query_id) {
-    std::string path = get_query_file_path(query_id);
-    fs::remove(path);
+void QueryCache::apply_erase(const std::string& query_id, size_t bytes) {
+    dead_bytes_ += bytes;
+    auto it = entries_.find(query_id);
+    if (it == entries_.end()) return;
+    live_bytes_ -= it->second.bytes;
+    dead_bytes_ += it->second.bytes;
+    remove_from_interval_tree(query_id);
+    vector_index_.remove(query_id);
+    lru_.erase(it->second.lru);
+    entries_.erase(it);
 }
 
-void QueryCache::add_to_interval_tree(const std::string& query_id, int min_key, int max_key) {
-    // store only range bounds - o(1) instead of o(n) where n = range size
-    query_ranges_[query_id] = {min_key, max_key};
-    
-    // add to interval tree for efficient lookups
-    insert_interval(interval_root_, min_key, max_key, query_id);
+void QueryCache::apply_touch(const std::string& query_id, std::time_t last_used, size_t bytes) {
+    dead_bytes_ += bytes;
+    auto it = entries_.find(query_id);
+    if (it == entries_.end()) return;
+    it->second.last_used.store(static_cast<int64_t>(last_used), std::memory_order_relaxed);
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
 }
 
-void QueryCache::remove_from_interval_tree(const std::string& query_id) {
-    // remove from interval tree
-    remove_interval(interval_root_, query_id);
-    
-    query_ranges_.erase(query_id);
+std::string QueryCache::segment_path(uint32_t id) const {
+    std::ostringstream name;
+    name << cache_dir_ << "/segment_" << std::setfill('0') << std::setw(6) << id << ".log";
+    return name.str();
 }
 
-void QueryCache::load_interval_tree() {
-    std::ifstream file(interval_tree_path_, std::ios::binary);
-    if (!file.is_open()) return;
-    
-    query_ranges_.clear();
-    interval_root_.reset();  // clear interval tree
-    
-    uint32_t num_queries;
-    file.read(reinterpret_cast<char*>(&num_queries), sizeof(num_queries));
-    
-    for (uint32_t i = 0; i < num_queries; i++) {
-        uint32_t id_len;
-        file.read(reinterpret_cast<char*>(&id_len), sizeof(id_len));
-        std::string query_id(id_len, '\0');
-        file.read(&query_id[0], id_len);
-        
-        int min_key, max_key;
-        file.read(reinterpret_cast<char*>(&min_key), sizeof(min_key));
-        file.read(reinterpret_cast<char*>(&max_key), sizeof(max_key));
-        
-        query_ranges_[query_id] = {min_key, max_key};
-        // rebuild interval tree
-        insert_interval(interval_root_, min_key, max_key, query_id);
+bool QueryCache::open_segment(uint32_t id) {
+    segment_.close();
+    segment_.clear();
+    segment_id_ = id;
+    std::string path = segment_path(id);
+    segment_.open(path, std::ios::binary | std::ios::app);
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    segment_bytes_ = ec ? 0 : static_cast<size_t>(size);
+    return segment_.is_open();
+}
+
+size_t QueryCache::append_record(uint8_t type, const std::vector<char>& payload) {
+    const size_t bytes = RECORD_HEADER_SIZE + payload.size();
+    if (segment_bytes_ > 0 && segment_bytes_ + bytes > SEGMENT_BYTES) {
+        open_segment(segment_id_ + 1);
     }
+    if (!segment_.is_open()) return bytes;
+    
+    // one write per record, so interrupted appends only ever tear the last record
+    std::vector<char> record;
+    record.reserve(bytes);
+    put(record, type);
+    put(record, static_cast<uint32_t>(payload.size()));
+    record.insert(record.end(), payload.begin(), payload.end());
+    segment_.write(record.data(), static_cast<std::streamsize>(record.size()));
+    segment_.flush();
+    segment_bytes_ += bytes;
+    return bytes;
 }
 
-void QueryCache::save_interval_tree() {
-    std::ofstream file(interval_tree_path_, std::ios::binary);
-    if (!file.is_open()) return;
-    
-    uint32_t num_queries = static_cast<uint32_t>(query_ranges_.size());
-    file.write(reinterpret_cast<const char*>(&num_queries), sizeof(num_queries));
-    
-    for (const auto& [query_id, range] : query_ranges_) {
-        uint32_t id_len = static_cast<uint32_t>(query_id.size());
-        file.write(reinterpret_cast<const char*>(&id_len), sizeof(id_len));
-        file.write(query_id.data(), id_len);
-        
-        file.write(reinterpret_cast<const char*>(&range.min_key), sizeof(range.min_key));
-        file.write(reinterpret_cast<const char*>(&range.max_key), sizeof(range.max_key));
+void QueryCache::load_log() {
+    loaded_ = true;
+    ensure_directories();
+    entries_.clear();
+    lru_.clear();
+    interval_root_.reset();
+    vector_index_.clear();
+    live_bytes_ = 0;
+    dead_bytes_ = 0;
+    
+    std::vector<uint32_t> segments;
+    for (const auto& entry : fs::directory_iterator(cache_dir_)) {
+        const std::string name = entry.path().filename().string();
+        if (!entry.is_regular_file() || name.rfind("segment_", 0) != 0 || entry.path().extension() != ".log") continue;
+        try {
+            segments.push_back(static_cast<uint32_t>(std::stoul(name.substr(8))));
+        } catch (const std::exception&) {
+            // not one of ours
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    
+    bool torn = false;
+    for (uint32_t id : segments) {
+        std::ifstream file(segment_path(id), std::ios::binary);
+        std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        size_t pos = 0;
+        torn = false;
+        while (pos < data.size()) {
+            uint8_t type;
+            uint32_t payload_size;
+            if (data.size() - pos < RECORD_HEADER_SIZE) break;
+            std::memcpy(&type, data.data() + pos, sizeof(uint8_t));
+            std::memcpy(&payload_size, data.data() + pos + sizeof(uint8_t), sizeof(uint32_t));
+            if (data.size() - pos - RECORD_HEADER_SIZE < payload_size) break;
+            
+            const size_t bytes = RECORD_HEADER_SIZE + payload_size;
+            RecordReader in{data.data() + pos + RECORD_HEADER_SIZE, data.data() + pos + bytes};
+            if (type == RECORD_PUT) {
+                CachedQueryResult result;
+                if (!decode_result(in, result)) break;
+                apply_put(std::move(result), bytes);
+            } else if (type == RECORD_ERASE) {
+                std::string query_id = in.get_string();
+                if (!in.ok) break;
+                apply_erase(query_id, bytes);
+            } else if (type == RECORD_TOUCH) {
+                std::string query_id = in.get_string();
+                std::time_t last_used = static_cast<std::time_t>(in.get<int64_t>());
+                if (!in.ok) break;
+                apply_touch(query_id, last_used, bytes);
+            } else {
+                break;
+            }
+            pos += bytes;
+        }
+        if (pos < data.size()) {
+            torn = true;
+            dead_bytes_ += data.size() - pos;
+        }
     }
     
-    // note: interval tree is rebuilt from query_ranges_ on load, so no need to persist it separately
+    // append after the last record, or in a fresh segment if the last one ends in a torn record
+    uint32_t active = segments.empty() ? 1 : segments.back() + (torn ? 1 : 0);
+    open_segment(active);
+    
+    import_legacy_files();
+    maybe_compact();
 }
 
-size_t QueryCache::get_cache_size() const {
-    size_t total = 0;
+void QueryCache::import_legacy_files() {
+    std::vector<CachedQueryResult> imported;
+    std::vector<fs::path> legacy_files;
     for (const auto& entry : fs::directory_iterator(cache_dir_)) {
-        if (entry.is_regular_file() && entry.path().extension() == ".qcache") {
-            total += entry.file_size();
+        if (!entry.is_regular_file() || entry.path().extension() != ".qcache") continue;
+        legacy_files.push_back(entry.path());
+        CachedQueryResult result;
+        if (read_legacy_file(entry.path().string(), entry.path().stem().string(), result)) {
+            imported.push_back(std::move(result));
         }
     }
-    return total;
+    if (legacy_files.empty()) return;
+    
+    // oldest first, so the most recently used ends up at the front of the LRU list
+    std::sort(imported.begin(), imported.end(), [](const CachedQueryResult& a, const CachedQueryResult& b) {
+        return a.last_used_date < b.last_used_date;
+    });
+    for (const CachedQueryResult& result : imported) {
+        if (entries_.find(result.query_id) == entries_.end()) put_entry(result);
+    }
+    std::error_code ec;
+    for (const fs::path& path : legacy_files) fs::remove(path, ec);
+    fs::remove(cache_dir_ + "/interval_tree.bin", ec);
 }
 
-std::vector<std::pair<std::string, std::time_t>> QueryCache::get_queries_by_last_used() const {
-    std::vector<std::pair<std::string, std::time_t>> result;
-    
-    for (const auto& [query_id, _] : query_ranges_) {
-        CachedQueryResult cached;
-        if (load_query_result(query_id, cached)) {
-            result.push_back({query_id, cached.last_used_date});
+void QueryCache::maybe_compact() {
+    if (dead_bytes_ > COMPACT_MIN_BYTES && dead_bytes_ > live_bytes_) {
+        compact();
+    }
+}
+
+void QueryCache::compact() {
+    // Live entries, least recently used first, go to segments after the current ones; the old
+    // segments are removed afterwards, so a crash in between only leaves duplicates behind
+    const uint32_t first = segment_id_ + 1;
+    open_segment(first);
+    live_bytes_ = 0;
+    for (auto it = lru_.rbegin(); it != lru_.rend(); ++it) {
+        Entry& entry = entries_.at(*it);
+        entry.result.last_used_date = static_cast<std::time_t>(entry.last_used.load(std::memory_order_relaxed));
+        std::vector<char> payload;
+        encode_result(payload, entry.result);
+        entry.bytes = append_record(RECORD_PUT, payload);
+        live_bytes_ += entry.bytes;
+    }
+    std::error_code ec;
+    for (const auto& file : fs::directory_iterator(cache_dir_)) {
+        const std::string name = file.path().filename().string();
+        if (name.rfind("segment_", 0) != 0 || file.path().extension() != ".log") continue;
+        try {
+            if (std::stoul(name.substr(8)) < first) fs::remove(file.path(), ec);
+        } catch (const std::exception&) {
         }
     }
-    
-    return result;
+    dead_bytes_ = 0;
+}
+
+void QueryCache::add_to_interval_tree(const std::string& query_id, int min_key, int max_key) {
+    insert_interval(interval_root_, min_key, max_key, query_id);
+}
+
+void QueryCache::remove_from_interval_tree(const std::string& query_id) {
+    remove_interval(interval_root_, query_id);
 }
 
 // Public API for B+ tree operations: efficiently find all queries containing a key
@@ -482,6 +802,7 @@ std::vector<std::string> QueryCache::get_queries_containing_key(int key) const {
     std::vector<std::string> result;
     if (!enabled_) return result;
     
+    std::shared_lock<std::shared_mutex> lock(mutex_);
     find_overlapping_intervals(interval_root_.get(), key, result);
     return result;
 }
@@ -535,8 +856,9 @@ void QueryCache::remove_interval(std::unique_ptr<IntervalNode>& node, const std:
             node->end = successor->end;
             node->query_id = successor->query_id;
             
-            // Remove successor
-            remove_interval(node->right, successor->query_id);
+            // Remove successor (by a copy of its id: the recursion frees the node holding it)
+            const std::string successor_id = successor->query_id;
+            remove_interval(node->right, successor_id);
         }
     } else {
         // Recursively search in subtrees
@@ -677,23 +999,20 @@ SimilarCacheMatch QueryCache::find_similar_cached_result(
     
     SimilarCacheMatch best_match;
     if (!enabled_) return best_match;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
     
-    // First check for exact match (fast path)
+    // First check for exact match (fast path): one hash probe
     std::string exact_hash = compute_query_hash(query_vector, min_key, max_key);
-    if (has_cached_result(exact_hash, k)) {
-        CachedQueryResult cached;
-        if (load_query_result(exact_hash, cached)) {
-            best_match.found = true;
-            best_match.query_id = exact_hash;
-            best_match.vector_similarity = 1.0;
-            best_match.range_similarity = 1.0;
-            best_match.result = cached;
-            // Trim to k neighbors
-            if (static_cast<int>(best_match.result.neighbors.size()) > k) {
-                best_match.result.neighbors.resize(k);
-            }
-            return best_match;
-        }
+    auto exact = entries_.find(exact_hash);
+    if (exact != entries_.end() && static_cast<int>(exact->second.result.neighbors.size()) >= k) {
+        best_match.found = true;
+        best_match.query_id = exact_hash;
+        best_match.vector_similarity = 1.0;
+        best_match.range_similarity = 1.0;
+        best_match.result = copy_result(exact->second);
+        // Trim to k neighbors
+        best_match.result.neighbors.resize(k);
+        return best_match;
     }
     
     // If thresholds require exact match, return not found
@@ -702,34 +1021,25 @@ SimilarCacheMatch QueryCache::find_similar_cached_result(
         return best_match;
     }
     
-    // Use interval tree to efficiently find cached queries that overlap with the requested range
-    // This is O(log N + M) where M is the number of overlapping intervals, instead of O(N) linear scan
-    std::vector<std::string> candidate_queries;
-    find_overlapping_range(interval_root_.get(), min_key, max_key, candidate_queries);
-    
-    // Search only through overlapping cached queries
     double best_combined_score = 0.0;
-    
-    for (const std::string& query_id : candidate_queries) {
-        auto range_it = query_ranges_.find(query_id);
-        if (range_it == query_ranges_.end()) continue;
-        const QueryRange& range = range_it->second;
+    const Entry* best = nullptr;
+    auto consider = [&](const std::string& query_id) {
+        auto it = entries_.find(query_id);
+        if (it == entries_.end()) return;
+        const CachedQueryResult& cached = it->second.result;
+        if (cached.min_key > max_key || min_key > cached.max_key) return;  // no overlap
         
         // Compute range similarity (we know they overlap, but need IoU score)
-        double range_sim = compute_range_iou(min_key, max_key, range.min_key, range.max_key);
+        double range_sim = compute_range_iou(min_key, max_key, cached.min_key, cached.max_key);
         if (range_sim < thresholds.range_similarity_threshold) {
-            continue;  // Range IoU doesn't meet threshold
+            return;  // Range IoU doesn't meet threshold
         }
-        
-        // Load the cached result to compare vectors
-        CachedQueryResult cached;
-        if (!load_query_result(query_id, cached)) continue;
-        if (static_cast<int>(cached.neighbors.size()) < k) continue;
+        if (static_cast<int>(cached.neighbors.size()) < k) return;
         
         // Compute vector similarity
         double vec_sim = compute_vector_cosine_similarity(query_vector, cached.input_vector);
         if (vec_sim < thresholds.vector_similarity_threshold) {
-            continue;  // Vector doesn't meet threshold
+            return;  // Vector doesn't meet threshold
         }
         
         // Both thresholds met - check if this is the best match
@@ -738,18 +1048,108 @@ SimilarCacheMatch QueryCache::find_similar_cached_result(
         
         if (combined_score > best_combined_score) {
             best_combined_score = combined_score;
+            best = &it->second;
             best_match.found = true;
             best_match.query_id = query_id;
             best_match.vector_similarity = vec_sim;
             best_match.range_similarity = range_sim;
-            best_match.result = cached;
         }
+    };
+    
+    if (entries_.size() > LSH_MIN_ENTRIES &&
+        CosineLSH::recall(thresholds.vector_similarity_threshold) >= LSH_MIN_RECALL) {
+        // Large cache and a selective vector threshold: only cached vectors hashing near the query
+        std::vector<const std::string*> candidates;
+        vector_index_.candidates(query_vector, candidates);
+        for (const std::string* query_id : candidates) consider(*query_id);
+    } else {
+        // Use interval tree to find cached queries that overlap with the requested range
+        // This is O(log N + M) where M is the number of overlapping intervals, instead of O(N) linear scan
+        std::vector<std::string> candidate_queries;
+        find_overlapping_range(interval_root_.get(), min_key, max_key, candidate_queries);
+        for (const std::string& query_id : candidate_queries) consider(query_id);
     }
     
-    // Trim result to k neighbors if found
-    if (best_match.found && static_cast<int>(best_match.result.neighbors.size()) > k) {
-        best_match.result.neighbors.resize(k);
+    // Copy out only the winner, trimmed to k neighbors
+    if (best) {
+        best_match.result = copy_result(*best);
+        if (static_cast<int>(best_match.result.neighbors.size()) > k) {
+            best_match.result.neighbors.resize(k);
+        }
     }
     
     return best_match;
 }
+
+RangeCoverMatch QueryCache::find_range_cover(const std::vector<float>& query_vector,
+                                             int min_key, int max_key, int k) const {
+    RangeCoverMatch cover;
+    if (!enabled_ || k <= 0 || min_key > max_key) return cover;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    
+    // Usable pieces: inside the range, same vector (cached distances are to it), at least k neighbors
+    std::vector<std::string> overlapping;
+    find_overlapping_range(interval_root_.get(), min_key, max_key, overlapping);
+    std::vector<const CachedQueryResult*> pieces;
+    for (const std::string& query_id : overlapping) {
+        auto it = entries_.find(query_id);
+        if (it == entries_.end()) continue;
+        const CachedQueryResult& cached = it->second.result;
+        if (cached.min_key < min_key || cached.max_key > max_key) continue;
+        if (static_cast<int>(cached.neighbors.size()) < k) continue;
+        if (cached.input_vector != query_vector) continue;
+        pieces.push_back(&cached);
+    }
+    if (pieces.empty()) return cover;
+    
+    // Weighted interval scheduling: disjoint pieces with the largest total key width
+    std::sort(pieces.begin(), pieces.end(), [](const CachedQueryResult* a, const CachedQueryResult* b) {
+        return a->max_key < b->max_key;
+    });
+    const size_t n = pieces.size();
+    auto width = [](const CachedQueryResult* piece) {
+        return static_cast<long long>(piece->max_key) - piece->min_key + 1;
+    };
+    std::vector<long long> best(n + 1, 0);   // best[i]: over the first i pieces
+    std::vector<size_t> previous(n);          // pieces ending before piece i starts
+    for (size_t i = 0; i < n; i++) {
+        const int start = pieces[i]->min_key;
+        previous[i] = static_cast<size_t>(std::lower_bound(pieces.begin(), pieces.begin() + i, start,
+            [](const CachedQueryResult* piece, int key) { return piece->max_key < key; }) - pieces.begin());
+        best[i + 1] = std::max(best[i], width(pieces[i]) + best[previous[i]]);
+    }
+    std::vector<const CachedQueryResult*> chosen;
+    for (size_t i = n; i > 0;) {
+        if (best[i] == best[i - 1]) {
+            i--;
+        } else {
+            chosen.push_back(pieces[i - 1]);
+            i = previous[i - 1];
+        }
+    }
+    std::reverse(chosen.begin(), chosen.end());
+    
+    cover.found = true;
+    cover.covered_keys = best[n];
+    long long next_key = min_key;  // first key not yet covered (long long: max_key may be INT_MAX)
+    for (const CachedQueryResult* piece : chosen) {
+        cover.query_ids.push_back(piece->query_id);
+        if (piece->min_key > next_key) {
+            cover.residual.emplace_back(static_cast<int>(next_key), piece->min_key - 1);
+        }
+        std::vector<CachedNeighbor> nearest(piece->neighbors.begin(), piece->neighbors.begin() + k);
+        merge_neighbors(cover.neighbors, nearest, k);
+        next_key = static_cast<long long>(piece->max_key) + 1;
+    }
+    if (next_key <= max_key) cover.residual.emplace_back(static_cast<int>(next_key), max_key);
+    return cover;
+}
+
+void QueryCache::merge_neighbors(std::vector<CachedNeighbor>& into, const std::vector<CachedNeighbor>& more, int k) {
+    std::vector<CachedNeighbor> merged;
+    merged.reserve(into.size() + more.size());
+    std::merge(into.begin(), into.end(), more.begin(), more.end(), std::back_inserter(merged),
+        [](const CachedNeighbor& a, const CachedNeighbor& b) { return a.distance < b.distance; });
+    if (k >= 0 && merged.size() > static_cast<size_t>(k)) merged.resize(static_cast<size_t>(k));
+    into.swap(merged);
+}
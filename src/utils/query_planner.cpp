@@ -0,0 +1,66 @@
+#include "query_planner.h"
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+const char* KNNPlan::strategyName() const {
+    switch (strategy) {
+        case Strategy::CacheReuse: return "cache";
+        case Strategy::Serial: return "serial";
+        case Strategy::Parallel: return "parallel";
+    }
+    return "unknown";
+}
+
+std::string KNNPlan::describe() const {
+    std::ostringstream out;
+    out << "Plan: " << strategyName();
+    if (strategy == Strategy::CacheReuse) return out.str();
+    if (strategy == Strategy::Parallel) out << " (" << threads << " threads)";
+    out << " | Leaves: " << range.leaves
+        << " | Vectors: " << (range.exact ? "" : "~") << range.vectors
+        << " | Memory resident: " << (memory_resident ? "yes" : "no");
+    return out.str();
+}
+
+QueryPlanner::QueryPlanner(DiskBPlusTree& tree, int max_threads)
+    : tree_(tree), max_threads_(max_threads) {
+    if (max_threads_ <= 0) {
+        max_threads_ = static_cast<int>(std::thread::hardware_concurrency());
+        if (max_threads_ <= 0) max_threads_ = 4;  // Fallback
+    }
+}
+
+KNNPlan QueryPlanner::plan(int min_key, int max_key, bool cache_candidate, bool use_memory_index) {
+    KNNPlan plan;
+    plan.memory_resident = use_memory_index && tree_.isMemoryIndexLoaded();
+
+    // A cached answer costs one small file read, cheaper than any scan
+    if (cache_candidate) {
+        plan.strategy = KNNPlan::Strategy::CacheReuse;
+        return plan;
+    }
+
+    plan.range = tree_.estimate_range(min_key, max_key, use_memory_index);
+
+    const uint64_t per_thread = plan.memory_resident ? MIN_VECTORS_PER_THREAD_MEMORY : MIN_VECTORS_PER_THREAD_DISK;
+    uint64_t useful = plan.range.vectors / per_thread;
+    // Morsels are whole leaves, so a range needs at least one leaf per thread
+    useful = std::min<uint64_t>(useful, plan.range.leaves);
+    int threads = static_cast<int>(std::min<uint64_t>(useful, static_cast<uint64_t>(max_threads_)));
+
+    if (threads >= 2) {
+        plan.strategy = KNNPlan::Strategy::Parallel;
+        plan.threads = threads;
+    }
+    return plan;
+}
+
+void QueryPlanner::execute(const KNNPlan& plan, const std::vector<float>& query_vector, int min_key, int max_key,
+                           int k, std::vector<KNNResult>& out, bool use_memory_index) {
+    if (plan.strategy == KNNPlan::Strategy::Parallel) {
+        tree_.search_knn_parallel_into(query_vector, min_key, max_key, k, out, plan.threads, use_memory_index);
+    } else {
+        tree_.search_knn_into(query_vector, min_key, max_key, k, out, use_memory_index);
+    }
+}
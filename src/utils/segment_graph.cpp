@@ -0,0 +1,310 @@
+#include "segment_graph.h"
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+#include <queue>
+#include <random>
+
+// file format (<vectors file>.graph):
+// Header (48 bytes):
+//   - magic (4 bytes): 0x31524753 ("SGR1")
+//   - version (4 bytes): 1
+//   - dimension (4 bytes)
+//   - degree (4 bytes): neighbor slots per node
+//   - segment_count (4 bytes)
+//   - modification_count (4 bytes): index header counter at build time
+//   - store_next_id (8 bytes): VectorStore next id at build time
+//   - table_offset (8 bytes): file offset of the segment table
+//   - reserved (8 bytes)
+// Segment blocks (64-byte aligned), each:
+//   - nodes: node_count * {vector_id (8), key (4), original_id (4)}
+//   - vectors: node_count * dimension floats
+//   - adjacency: node_count * degree uint32 (0xFFFFFFFF = empty slot, filled slots come first)
+// Segment table at table_offset: segment_count * {first_key, last_key, node_count, entry, offset}
+
+static constexpr uint32_t GRAPH_MAGIC = 0x31524753;  // "SGR1"
+static constexpr uint32_t GRAPH_VERSION = 1;
+static constexpr uint32_t NO_NEIGHBOR = 0xFFFFFFFF;
+static constexpr size_t BLOCK_ALIGNMENT = 64;
+
+struct GraphFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t degree;
+    uint32_t segment_count;
+    uint32_t modification_count;
+    uint64_t store_next_id;
+    uint64_t table_offset;
+    uint64_t reserved;
+};
+static_assert(sizeof(GraphFileHeader) == 48, "GraphFileHeader must match the on-disk layout");
+static_assert(sizeof(SegmentGraphs::Node) == 16, "Node must match the on-disk layout");
+static_assert(sizeof(SegmentGraphs::Segment) == 24, "Segment must match the on-disk layout");
+
+using Candidate = std::pair<float, uint32_t>;  // (squared distance, node)
+
+// Best-first beam search from entry over the graph (adj: degree slots per node)
+// Returns the ef closest nodes found, ascending by distance
+static void beam_search(const float* query, uint32_t entry, size_t ef, const float* vectors, uint32_t dim,
+                        const uint32_t* adj, uint32_t degree, L2SqrKernel l2_sqr_kernel,
+                        SegmentGraphs::Scratch& scratch, std::vector<Candidate>& out) {
+    if (++scratch.epoch == 0) {
+        std::fill(scratch.visited.begin(), scratch.visited.end(), 0);
+        scratch.epoch = 1;
+    }
+    const uint32_t epoch = scratch.epoch;
+    std::vector<uint32_t>& visited = scratch.visited;
+
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> frontier;
+    out.clear();  // max-heap of the best ef while searching
+
+    float d0 = l2_sqr_kernel(query, vectors + static_cast<size_t>(entry) * dim, dim);
+    visited[entry] = epoch;
+    frontier.push({d0, entry});
+    out.push_back({d0, entry});
+
+    while (!frontier.empty()) {
+        Candidate current = frontier.top();
+        if (out.size() >= ef && current.first > out.front().first) break;
+        frontier.pop();
+
+        const uint32_t* neighbors = adj + static_cast<size_t>(current.second) * degree;
+        for (uint32_t j = 0; j < degree && neighbors[j] != NO_NEIGHBOR; j++) {
+            uint32_t nb = neighbors[j];
+            if (visited[nb] == epoch) continue;
+            visited[nb] = epoch;
+
+            float d = l2_sqr_kernel(query, vectors + static_cast<size_t>(nb) * dim, dim);
+            if (out.size() < ef || d < out.front().first) {
+                frontier.push({d, nb});
+                out.push_back({d, nb});
+                std::push_heap(out.begin(), out.end());
+                if (out.size() > ef) {
+                    std::pop_heap(out.begin(), out.end());
+                    out.pop_back();
+                }
+            }
+        }
+    }
+    std::sort_heap(out.begin(), out.end());
+}
+
+// Neighbor-diversity heuristic (HNSW): take candidates in ascending order, keeping one only if
+// it is closer to the base than to every neighbor kept so far
+static void select_neighbors(const std::vector<Candidate>& candidates, uint32_t max_count,
+                             const float* vectors, uint32_t dim, L2SqrKernel l2_sqr_kernel,
+                             std::vector<uint32_t>& selected) {
+    selected.clear();
+    for (const Candidate& c : candidates) {
+        if (selected.size() >= max_count) break;
+        const float* cv = vectors + static_cast<size_t>(c.second) * dim;
+        bool keep = true;
+        for (uint32_t s : selected) {
+            if (l2_sqr_kernel(cv, vectors + static_cast<size_t>(s) * dim, dim) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) selected.push_back(c.second);
+    }
+}
+
+// Build the graph of n vectors; adj gets n * degree slots
+static uint32_t build_graph(const float* vectors, uint32_t n, uint32_t dim, uint32_t degree,
+                            uint32_t ef_construction, std::vector<uint32_t>& adj) {
+    const L2SqrKernel l2_sqr_kernel = get_l2_sqr_kernel();
+    adj.assign(static_cast<size_t>(n) * degree, NO_NEIGHBOR);
+    if (n == 0) return 0;
+
+    // Insert in a fixed pseudo-random order: key order would build the graph one label run at a time
+    std::vector<uint32_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 rng(n);
+    std::shuffle(order.begin(), order.end(), rng);
+
+    const uint32_t links = std::max<uint32_t>(1, degree / 2);
+    SegmentGraphs::Scratch scratch;
+    scratch.visited.assign(n, 0);
+    std::vector<Candidate> candidates;
+    std::vector<uint32_t> selected;
+    const uint32_t entry = order[0];
+
+    for (uint32_t i = 1; i < n; i++) {
+        const uint32_t q = order[i];
+        const float* qv = vectors + static_cast<size_t>(q) * dim;
+        beam_search(qv, entry, ef_construction, vectors, dim, adj.data(), degree, l2_sqr_kernel, scratch, candidates);
+        select_neighbors(candidates, links, vectors, dim, l2_sqr_kernel, selected);
+
+        std::copy(selected.begin(), selected.end(), adj.begin() + static_cast<size_t>(q) * degree);
+
+        // Reverse links; a full neighbor list is re-pruned with the same heuristic
+        for (uint32_t s : selected) {
+            uint32_t* slots = adj.data() + static_cast<size_t>(s) * degree;
+            uint32_t* free_slot = std::find(slots, slots + degree, NO_NEIGHBOR);
+            if (free_slot != slots + degree) {
+                *free_slot = q;
+                continue;
+            }
+            const float* sv = vectors + static_cast<size_t>(s) * dim;
+            std::vector<Candidate> pool;
+            pool.reserve(degree + 1);
+            pool.push_back({l2_sqr_kernel(sv, qv, dim), q});
+            for (uint32_t j = 0; j < degree; j++) {
+                pool.push_back({l2_sqr_kernel(sv, vectors + static_cast<size_t>(slots[j]) * dim, dim), slots[j]});
+            }
+            std::sort(pool.begin(), pool.end());
+            std::vector<uint32_t> kept;
+            select_neighbors(pool, degree, vectors, dim, l2_sqr_kernel, kept);
+            std::fill(slots, slots + degree, NO_NEIGHBOR);
+            std::copy(kept.begin(), kept.end(), slots);
+        }
+    }
+
+    // Search entry: the node nearest to the centroid
+    std::vector<double> sum(dim, 0.0);
+    for (size_t v = 0; v < n; v++) {
+        for (uint32_t d = 0; d < dim; d++) sum[d] += vectors[v * dim + d];
+    }
+    std::vector<float> centroid(dim);
+    for (uint32_t d = 0; d < dim; d++) centroid[d] = static_cast<float>(sum[d] / n);
+
+    uint32_t best = 0;
+    float best_distance = l2_sqr_kernel(centroid.data(), vectors, dim);
+    for (uint32_t v = 1; v < n; v++) {
+        float d = l2_sqr_kernel(centroid.data(), vectors + static_cast<size_t>(v) * dim, dim);
+        if (d < best_distance) {
+            best_distance = d;
+            best = v;
+        }
+    }
+    return best;
+}
+
+SegmentGraphs::Builder::Builder(const std::string& path, uint32_t dim, uint32_t degree, uint32_t ef_construction)
+    : out_(path, std::ios::binary | std::ios::trunc),
+      dim_(dim), degree_(std::max<uint32_t>(2, degree)), ef_construction_(std::max(ef_construction, degree)) {
+    if (!out_.is_open()) {
+        std::cerr << "Failed to create segment graphs: " << path << std::endl;
+        return;
+    }
+    GraphFileHeader placeholder{};
+    out_.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+}
+
+void SegmentGraphs::Builder::addSegment(int32_t first_key, int32_t last_key,
+                                        const std::vector<Node>& nodes, const std::vector<float>& vectors) {
+    if (!out_ || nodes.empty()) return;
+    const uint32_t n = static_cast<uint32_t>(nodes.size());
+
+    std::vector<uint32_t> adj;
+    uint32_t entry = build_graph(vectors.data(), n, dim_, degree_, ef_construction_, adj);
+
+    uint64_t offset = static_cast<uint64_t>(out_.tellp());
+    uint64_t aligned = (offset + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+    static const char zeros[BLOCK_ALIGNMENT] = {};
+    out_.write(zeros, static_cast<std::streamsize>(aligned - offset));
+
+    out_.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(Node));
+    out_.write(reinterpret_cast<const char*>(vectors.data()), static_cast<size_t>(n) * dim_ * sizeof(float));
+    out_.write(reinterpret_cast<const char*>(adj.data()), adj.size() * sizeof(uint32_t));
+    segments_.push_back({first_key, last_key, n, entry, aligned});
+}
+
+bool SegmentGraphs::Builder::finish(uint64_t store_next_id, uint32_t modification_count) {
+    if (!out_) return false;
+    GraphFileHeader header{GRAPH_MAGIC, GRAPH_VERSION, dim_, degree_,
+                           static_cast<uint32_t>(segments_.size()), modification_count,
+                           store_next_id, static_cast<uint64_t>(out_.tellp()), 0};
+    out_.write(reinterpret_cast<const char*>(segments_.data()), segments_.size() * sizeof(Segment));
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out_.close();
+    return static_cast<bool>(out_);
+}
+
+bool SegmentGraphs::open(const std::string& path, uint64_t store_next_id, uint32_t modification_count) {
+    close();
+    if (!file_.open(path)) {
+        return false;
+    }
+
+    GraphFileHeader header{};
+    if (file_.size() < sizeof(header)) {
+        close();
+        return false;
+    }
+    std::copy(file_.data(), file_.data() + sizeof(header), reinterpret_cast<char*>(&header));
+    if (header.magic != GRAPH_MAGIC || header.version != GRAPH_VERSION || header.dimension == 0 || header.degree == 0) {
+        std::cerr << "Invalid segment graphs: " << path << std::endl;
+        close();
+        return false;
+    }
+    if (header.store_next_id != store_next_id || header.modification_count != modification_count) {
+        std::cerr << "Segment graphs are out of date (index modified since they were built): " << path << std::endl;
+        close();
+        return false;
+    }
+    if (header.table_offset + static_cast<uint64_t>(header.segment_count) * sizeof(Segment) > file_.size()) {
+        std::cerr << "Truncated segment graphs: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    segments_.resize(header.segment_count);
+    const char* table = file_.data() + header.table_offset;
+    std::copy(table, table + segments_.size() * sizeof(Segment), reinterpret_cast<char*>(segments_.data()));
+    dim_ = header.dimension;
+    degree_ = header.degree;
+
+    for (const Segment& seg : segments_) {
+        uint64_t bytes = static_cast<uint64_t>(seg.node_count) * (sizeof(Node) + dim_ * sizeof(float) + degree_ * sizeof(uint32_t));
+        if (seg.offset + bytes > header.table_offset) {
+            std::cerr << "Truncated segment graphs: " << path << std::endl;
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void SegmentGraphs::close() {
+    file_.close();
+    dim_ = 0;
+    degree_ = 0;
+    segments_.clear();
+}
+
+const SegmentGraphs::Node* SegmentGraphs::nodes(size_t s) const {
+    return reinterpret_cast<const Node*>(file_.data() + segments_[s].offset);
+}
+
+const float* SegmentGraphs::vectors(size_t s) const {
+    return reinterpret_cast<const float*>(nodes(s) + segments_[s].node_count);
+}
+
+const uint32_t* SegmentGraphs::adjacency(size_t s) const {
+    return reinterpret_cast<const uint32_t*>(vectors(s) + static_cast<size_t>(segments_[s].node_count) * dim_);
+}
+
+std::pair<size_t, size_t> SegmentGraphs::coveredSegments(int min_key, int max_key) const {
+    // Segments are disjoint and in key order, so both key columns are sorted
+    auto first = std::lower_bound(segments_.begin(), segments_.end(), min_key,
+                                  [](const Segment& seg, int key) { return seg.first_key < key; });
+    auto last = std::upper_bound(segments_.begin(), segments_.end(), max_key,
+                                 [](int key, const Segment& seg) { return key < seg.last_key; });
+    size_t begin = static_cast<size_t>(first - segments_.begin());
+    size_t end = static_cast<size_t>(last - segments_.begin());
+    return {begin, std::max(begin, end)};
+}
+
+void SegmentGraphs::search(size_t s, const float* query, size_t k, size_t ef, L2SqrKernel l2_sqr_kernel,
+                           Scratch& scratch, std::vector<Candidate>& out) const {
+    const Segment& seg = segments_[s];
+    if (scratch.visited.size() < seg.node_count) {
+        scratch.visited.resize(seg.node_count, 0);
+    }
+    beam_search(query, seg.entry, std::max(ef, k), vectors(s), dim_, adjacency(s), degree_,
+                l2_sqr_kernel, scratch, out);
+    if (out.size() > k) out.resize(k);
+}
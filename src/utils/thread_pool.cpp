@@ -0,0 +1,157 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <exception>
+
+namespace {
+
+// Pool and worker index of the current thread (set in worker_loop)
+thread_local const ThreadPool* tls_pool = nullptr;
+thread_local int tls_worker = -1;
+
+// Shared state of one parallel_for call; outlives the call if a late ticket still holds it
+struct ForGroup {
+    const std::function<void(size_t, size_t)>* fn = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+
+    void run(size_t slot) {
+        size_t index;
+        while ((index = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+            try {
+                (*fn)(index, slot);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+            }
+            if (done.fetch_add(1, std::memory_order_acq_rel) + 1 == count) {
+                std::lock_guard<std::mutex> lock(mutex);
+                cv.notify_all();
+            }
+        }
+    }
+};
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t num_threads) {
+    if (num_threads == 0) {
+        num_threads = std::thread::hardware_concurrency();
+        if (num_threads == 0) num_threads = 4;  // Fallback
+    }
+    queues_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        stopping_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+int ThreadPool::current_worker() const {
+    return tls_pool == this ? tls_worker : -1;
+}
+
+void ThreadPool::push(size_t queue, std::function<void()> task) {
+    // Count first so try_pop() never sees a task it has not been told about
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        pending_.fetch_add(1, std::memory_order_release);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[queue]->mutex);
+        queues_[queue]->tasks.push_back(std::move(task));
+    }
+    sleep_cv_.notify_one();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    size_t queue = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    push(queue, std::move(task));
+}
+
+bool ThreadPool::try_pop(size_t index, std::function<void()>& task) {
+    // Own queue first (front), then steal from the back of the others
+    for (size_t n = 0; n < queues_.size(); n++) {
+        size_t victim = (index + n) % queues_.size();
+        WorkerQueue& queue = *queues_[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        if (n == 0) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        } else {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        pending_.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    tls_pool = this;
+    tls_worker = static_cast<int>(index);
+
+    while (true) {
+        std::function<void()> task;
+        if (try_pop(index, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleep_cv_.wait(lock, [this] { return stopping_ || pending_.load(std::memory_order_acquire) > 0; });
+        if (stopping_ && pending_.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) return;
+
+    // The caller gets the slot after the workers (or its own worker slot when nested)
+    int worker = current_worker();
+    size_t caller_slot = worker >= 0 ? static_cast<size_t>(worker) : workers_.size();
+
+    auto group = std::make_shared<ForGroup>();
+    group->fn = &fn;
+    group->count = count;
+
+    // One ticket per other worker; each ticket keeps claiming morsels until none are left
+    size_t tickets = std::min(count, workers_.size());
+    for (size_t t = 0; t < tickets; t++) {
+        size_t queue = (next_queue_.fetch_add(1, std::memory_order_relaxed)) % queues_.size();
+        if (worker >= 0 && queue == static_cast<size_t>(worker)) {
+            queue = (queue + 1) % queues_.size();
+        }
+        push(queue, [group, this] {
+            int self = current_worker();
+            group->run(static_cast<size_t>(self));
+        });
+    }
+
+    group->run(caller_slot);
+
+    std::unique_lock<std::mutex> lock(group->mutex);
+    group->cv.wait(lock, [&] { return group->done.load(std::memory_order_acquire) >= count; });
+    if (group->error) {
+        std::rethrow_exception(group->error);
+    }
+}
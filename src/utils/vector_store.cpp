@@ -1,8 +1,10 @@
 #include "vector_store.h"
+#include "epoch_manager.h"
 #include <iostream>
 #include <cstring>
 #include <algorithm>
 #include <cmath>
+#include <filesystem>
 
 // file format (Seperate Vector Storage - linked list support):
 // Header (24 bytes):
@@ -13,12 +15,39 @@
 //   - max_vector_size (4 bytes): max dimension
 // 
 // Vector data (starting at data_start_offset):
-//   For each vector: size (4 bytes) + next_id (8 bytes) + floats (size * 4 bytes)
+//   For each vector: size (4 bytes) + next_id (8 bytes) + original_id (4 bytes) + floats (size * 4 bytes)
 //
-// Metadata is stored in a separate .meta file
+// In mapped mode (mapReadOnly) the whole file is mapped and vector data is read in place
+// at offset + RECORD_HEADER_SIZE.
+//
+// Metadata is stored in a separate .meta file as a flat table indexed by vector id:
+// Header (32 bytes):
+//   - magic (4 bytes): 0x324D5356 (VSM2)
+//   - version (4 bytes): 2
+//   - entry_count (8 bytes): number of table slots (max vector id + 1)
+//   - stored_count (8 bytes): number of slots holding a record
+//   - max_original_id (4 bytes)
+//   - reserved (4 bytes)
+// Entries (24 bytes each, slot i = vector id i):
+//   offset (8 bytes, 0 = no record) + next_id (8 bytes) + size (4 bytes) + original_id (4 bytes)
+//
+// The table is memory-mapped on open, so startup does not depend on the number of vectors.
+// Older .meta files (count + per-entry id/offset/size/next_id/original_id) are converted on load.
 
 static constexpr uint32_t HEADER_SIZE = 24;
 static constexpr uint32_t MAGIC_VS2 = 0x56535432;  // "VS2"
+static constexpr uint32_t META_MAGIC = 0x324D5356;  // "VSM2"
+static constexpr uint32_t META_VERSION = 2;
+
+struct MetaFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t entry_count;
+    uint64_t stored_count;
+    int32_t max_original_id;
+    uint32_t reserved;
+};
+static_assert(sizeof(MetaFileHeader) == 32, "MetaFileHeader must match the on-disk layout");
 
 VectorStore::VectorStore(const std::string& filename, uint32_t max_vector_size)
     : filename_(filename), max_vector_size_(max_vector_size), next_vector_id_(1), write_pos_(HEADER_SIZE) {
@@ -57,14 +86,17 @@ void VectorStore::initNewFile() {
     
     file_.flush();
     
-    // Clear metadata file
-    std::ofstream meta_file(filename_ + ".meta", std::ios::binary | std::ios::trunc);
-    uint32_t count = 0;
-    meta_file.write(reinterpret_cast<const char*>(&count), sizeof(uint32_t));
-    meta_file.close();
-    
     next_vector_id_ = 1;
     write_pos_ = HEADER_SIZE;
+    
+    // Clear metadata file
+    metadata_.clear();
+    meta_table_ = nullptr;
+    meta_table_size_ = 0;
+    stored_count_ = 0;
+    max_original_id_ = -1;
+    metadata_dirty_ = true;
+    writeMetadata();
 }
 
 void VectorStore::loadExistingFile() {
@@ -97,61 +129,165 @@ void VectorStore::loadExistingFile() {
     if (write_pos_ < HEADER_SIZE) write_pos_ = HEADER_SIZE;
 }
 
-void VectorStore::storeVectorInternal(uint64_t vector_id, const std::vector<float>& vector, 
+void VectorStore::storeVectorInternal(uint64_t vector_id, const float* data, size_t available,
                                       uint32_t actual_size, uint64_t next_id, int32_t original_id) {
     if (actual_size > max_vector_size_) {
         actual_size = max_vector_size_;
     }
+    const size_t copied = std::min<size_t>(available, actual_size);
+    
+    // Appended records are not visible through an existing mapping or positional reader
+    // (concurrent appends keep them: readers fall back to the file past the mapping)
+    if (!epochs_) {
+        if (mapped_.is_open()) {
+            mapped_.close();
+        }
+        concurrent_reader_.close();
+    }
     
     // Use tracked write position instead of seeking to end each time
     uint64_t offset = write_pos_;
-    file_.seekp(offset);
     
-    // Write: size (4 bytes) + next_id (8 bytes) + original_id (4 bytes) + vector data (bulk write)
-    file_.write(reinterpret_cast<const char*>(&actual_size), sizeof(uint32_t));
-    file_.write(reinterpret_cast<const char*>(&next_id), sizeof(uint64_t));
-    file_.write(reinterpret_cast<const char*>(&original_id), sizeof(int32_t));
-    
-    if (vector.size() >= actual_size) {
-        // Common path: vector has enough data, single bulk write
-        file_.write(reinterpret_cast<const char*>(vector.data()), actual_size * sizeof(float));
+    if (bulk_append_) {
+        stageRecord(offset, data, copied, actual_size, next_id, original_id);
     } else {
-        // Rare path: vector shorter than actual_size, zero-pad
-        std::vector<float> padded(actual_size, 0.0f);
-        std::copy(vector.begin(), vector.end(), padded.begin());
-        file_.write(reinterpret_cast<const char*>(padded.data()), actual_size * sizeof(float));
+        file_.seekp(offset);
+        
+        // Write: size (4 bytes) + next_id (8 bytes) + original_id (4 bytes) + vector data (bulk write)
+        file_.write(reinterpret_cast<const char*>(&actual_size), sizeof(uint32_t));
+        file_.write(reinterpret_cast<const char*>(&next_id), sizeof(uint64_t));
+        file_.write(reinterpret_cast<const char*>(&original_id), sizeof(int32_t));
+        file_.write(reinterpret_cast<const char*>(data), copied * sizeof(float));
+        if (copied < actual_size) {
+            // Rare path: vector shorter than actual_size, zero-pad
+            std::vector<float> padding(actual_size - copied, 0.0f);
+            file_.write(reinterpret_cast<const char*>(padding.data()), padding.size() * sizeof(float));
+        }
+        
+        // Batched flush: only flush every FLUSH_INTERVAL writes
+        writes_since_flush_++;
+        if (writes_since_flush_ >= FLUSH_INTERVAL) {
+            file_.flush();
+            writes_since_flush_ = 0;
+        }
     }
     
     // Advance tracked write position: header (4+8+4) + vector data
-    write_pos_ = offset + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(int32_t) + actual_size * sizeof(float);
+    write_pos_ = offset + RECORD_HEADER_SIZE + actual_size * sizeof(float);
     
-    // Batched flush: only flush every FLUSH_INTERVAL writes
-    writes_since_flush_++;
-    if (writes_since_flush_ >= FLUSH_INTERVAL) {
-        file_.flush();
-        writes_since_flush_ = 0;
+    makeMetadataWritable();
+    if (vector_id >= metadata_.size()) {
+        if (epochs_ && vector_id >= metadata_.capacity()) {
+            reserveMetadataSlots(std::max<size_t>(vector_id + 1, metadata_.capacity() * 2));
+        }
+        metadata_.resize(vector_id + 1);  // zeroed slots = no record
     }
-    
-    metadata_[vector_id] = {offset, actual_size, next_id, original_id};
+    VectorMetadata& entry = metadata_[vector_id];
+    if (entry.offset == 0) {
+        stored_count_++;
+    }
+    entry = {offset, next_id, actual_size, original_id};
+    publishMetadataTable();
+    if (original_id > max_original_id_) {
+        max_original_id_ = original_id;
+    }
+    metadata_dirty_ = true;
     
     if (vector_id >= next_vector_id_) {
         next_vector_id_ = vector_id + 1;
     }
 }
 
+void VectorStore::stageRecord(uint64_t offset, const float* data, size_t copied, uint32_t actual_size,
+                              uint64_t next_id, int32_t original_id) {
+    const size_t record_bytes = RECORD_HEADER_SIZE + actual_size * sizeof(float);
+    const uint64_t staged_end = append_start_ + append_buffer_.size();
+    // Only a forward run of records (with alignment gaps) fits in one write
+    if (append_buffer_.empty() || offset < staged_end ||
+        offset - append_start_ + record_bytes > append_buffer_.capacity()) {
+        flushAppendBuffer();
+        append_start_ = offset;
+    }
+    size_t at = static_cast<size_t>(offset - append_start_);
+    append_buffer_.resize(at + record_bytes, 0);  // zero-fills the gap and any missing floats
+    char* record = append_buffer_.data() + at;
+    std::memcpy(record, &actual_size, sizeof(uint32_t));
+    std::memcpy(record + sizeof(uint32_t), &next_id, sizeof(uint64_t));
+    std::memcpy(record + sizeof(uint32_t) + sizeof(uint64_t), &original_id, sizeof(int32_t));
+    std::memcpy(record + RECORD_HEADER_SIZE, data, copied * sizeof(float));
+}
+
+void VectorStore::flushAppendBuffer() {
+    if (append_buffer_.empty()) {
+        return;
+    }
+    file_.seekp(append_start_);
+    file_.write(append_buffer_.data(), append_buffer_.size());
+    append_buffer_.clear();
+}
+
+void VectorStore::beginBulkAppend(size_t buffer_bytes) {
+    bulk_append_ = true;
+    append_buffer_.reserve(std::max(buffer_bytes, RECORD_HEADER_SIZE + max_vector_size_ * sizeof(float)));
+}
+
+void VectorStore::endBulkAppend() {
+    flushAppendBuffer();
+    bulk_append_ = false;
+    append_buffer_.clear();
+    append_buffer_.shrink_to_fit();
+}
+
 uint64_t VectorStore::storeVector(const std::vector<float>& vector, uint32_t actual_size, int32_t original_id) {
     uint64_t vector_id = next_vector_id_++;
-    storeVectorInternal(vector_id, vector, actual_size, 0, original_id);  // 0 = no next
+    storeVectorInternal(vector_id, vector.data(), vector.size(), actual_size, 0, original_id);  // 0 = no next
     return vector_id;
 }
 
 uint64_t VectorStore::appendVectorToList(uint64_t first_vector_id, const std::vector<float>& vector, uint32_t actual_size, int32_t original_id) {
     // Store new vector, pointing to the old first
     uint64_t new_id = next_vector_id_++;
-    storeVectorInternal(new_id, vector, actual_size, first_vector_id, original_id);
+    storeVectorInternal(new_id, vector.data(), vector.size(), actual_size, first_vector_id, original_id);
     return new_id;  // New vector becomes the head of the list
 }
 
+uint64_t VectorStore::storeVectorSequence(const std::vector<const std::vector<float>*>& vectors,
+                                         const std::vector<int32_t>& original_ids) {
+    if (vectors.empty()) {
+        return 0;
+    }
+    uint64_t first_id = next_vector_id_;
+    next_vector_id_ += vectors.size();
+    for (size_t i = 0; i < vectors.size(); i++) {
+        uint64_t id = first_id + i;
+        uint64_t next_id = (i + 1 < vectors.size()) ? id + 1 : 0;
+        int32_t original_id = i < original_ids.size() ? original_ids[i] : -1;
+        storeVectorInternal(id, vectors[i]->data(), vectors[i]->size(), static_cast<uint32_t>(vectors[i]->size()),
+                            next_id, original_id);
+    }
+    return first_id;
+}
+
+uint64_t VectorStore::storeVectorSequence(const float* data, const uint32_t* sizes, const int32_t* original_ids,
+                                         size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t first_id = next_vector_id_;
+    next_vector_id_ += count;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t id = first_id + i;
+        uint64_t next_id = (i + 1 < count) ? id + 1 : 0;
+        storeVectorInternal(id, data, sizes[i], sizes[i], next_id, original_ids[i]);
+        data += sizes[i];
+    }
+    return first_id;
+}
+
+void VectorStore::alignNextRecord() {
+    write_pos_ = (write_pos_ + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+}
+
 void VectorStore::retrieveVector(uint64_t vector_id, std::vector<float>& vector, uint32_t& actual_size) {
     int32_t dummy_id;
     retrieveVector(vector_id, vector, actual_size, dummy_id);
@@ -162,40 +298,16 @@ void VectorStore::retrieveVector(uint64_t vector_id, std::vector<float>& vector,
         throw std::runtime_error("Invalid vector ID: 0");
     }
     
-    // Check in-memory cache first
-    if (memory_cache_loaded_) {
-        auto cache_it = memory_cache_.find(vector_id);
-        if (cache_it != memory_cache_.end()) {
-            const CachedVector& cached = cache_it->second;
-            actual_size = cached.size;
-            original_id = cached.original_id;
-            vector = cached.data;
-            return;
-        }
-    }
-    
-    // Fall back to disk read
-    auto it = metadata_.find(vector_id);
-    if (it == metadata_.end()) {
+    // Same sources as the list scans: mapping, in-memory cache, then a disk read
+    std::vector<float> scratch;
+    VectorView view;
+    uint64_t next_id;
+    if (!viewVector(vector_id, view, next_id, scratch)) {
         throw std::runtime_error("Vector ID not found in store: " + std::to_string(vector_id));
     }
-    
-    const VectorMetadata& meta = it->second;
-    actual_size = meta.size;
-    original_id = meta.original_id;
-    
-    vector.resize(actual_size);
-    
-    file_.seekg(meta.offset);
-    
-    uint32_t stored_size;
-    file_.read(reinterpret_cast<char*>(&stored_size), sizeof(uint32_t));
-    
-    // Skip next_id (8 bytes) + original_id (4 bytes)
-    file_.seekg(sizeof(uint64_t) + sizeof(int32_t), std::ios::cur);
-    
-    // Bulk read entire vector at once
-    file_.read(reinterpret_cast<char*>(vector.data()), actual_size * sizeof(float));
+    actual_size = view.size;
+    original_id = view.original_id;
+    vector.assign(view.data, view.data + view.size);
 }
 
 void VectorStore::retrieveVectorList(uint64_t first_vector_id, uint32_t count,
@@ -216,55 +328,153 @@ void VectorStore::retrieveVectorList(uint64_t first_vector_id, uint32_t count,
     sizes.reserve(count);
     original_ids.reserve(count);
     
-    uint64_t current_id = first_vector_id;
-    uint32_t retrieved = 0;
-    
-    while (current_id != 0 && retrieved < count) {
-        // Check cache first
-        if (memory_cache_loaded_) {
-            auto cache_it = memory_cache_.find(current_id);
-            if (cache_it != memory_cache_.end()) {
-                const CachedVector& cached = cache_it->second;
-                vectors.push_back(cached.data);
-                sizes.push_back(cached.size);
-                original_ids.push_back(cached.original_id);
-                current_id = cached.next_id;
-                retrieved++;
-                continue;
-            }
+    forEachVectorInList(first_vector_id, count, [&](const VectorView& view) {
+        vectors.emplace_back(view.data, view.data + view.size);
+        sizes.push_back(view.size);
+        original_ids.push_back(view.original_id);
+    });
+}
+
+bool VectorStore::viewVector(uint64_t vector_id, VectorView& view, uint64_t& next_id, std::vector<float>& scratch) {
+    const VectorMetadata* entry = findMetadata(vector_id);
+    
+    // Mapped file: point straight into the mapping (records appended since are read below)
+    if (mapped_.is_open()) {
+        if (!entry) {
+            return false;
         }
-        
-        // Disk read
-        auto it = metadata_.find(current_id);
-        if (it == metadata_.end()) {
-            break;  // End of valid chain
+        const VectorMetadata& meta = *entry;
+        if (meta.offset + RECORD_HEADER_SIZE + meta.size * sizeof(float) <= mapped_.size()) {
+            view.id = vector_id;
+            view.data = reinterpret_cast<const float*>(mapped_.data() + meta.offset + RECORD_HEADER_SIZE);
+            view.size = meta.size;
+            view.original_id = meta.original_id;
+            next_id = meta.next_id;
+            return true;
         }
-        
-        const VectorMetadata& meta = it->second;
-        
-        std::vector<float> vec(meta.size);
-        file_.seekg(meta.offset);
-        
-        uint32_t stored_size;
-        file_.read(reinterpret_cast<char*>(&stored_size), sizeof(uint32_t));
-        
-        uint64_t next_id;
-        file_.read(reinterpret_cast<char*>(&next_id), sizeof(uint64_t));
-        
+    }
+    
+    // Check cache next
+    if (memory_cache_loaded_) {
+        auto cache_it = memory_cache_.find(vector_id);
+        if (cache_it != memory_cache_.end()) {
+            const CachedVector& cached = cache_it->second;
+            view.id = vector_id;
+            view.data = cached.data.data();
+            view.size = cached.size;
+            view.original_id = cached.original_id;
+            next_id = cached.next_id;
+            return true;
+        }
+    }
+    
+    // Disk read into scratch buffer
+    if (!entry) {
+        return false;
+    }
+    const VectorMetadata& meta = *entry;
+    
+    // Positional read: record header (16 bytes = 4 floats) and data in a single call
+    if (concurrent_reader_.is_open()) {
+        constexpr size_t HEADER_FLOATS = RECORD_HEADER_SIZE / sizeof(float);
+        ensureReadable(meta.offset + RECORD_HEADER_SIZE + meta.size * sizeof(float));
+        scratch.resize(HEADER_FLOATS + meta.size);
+        if (!concurrent_reader_.read_at(meta.offset, scratch.data(), RECORD_HEADER_SIZE + meta.size * sizeof(float))) {
+            return false;
+        }
+        const char* record = reinterpret_cast<const char*>(scratch.data());
         int32_t orig_id;
-        file_.read(reinterpret_cast<char*>(&orig_id), sizeof(int32_t));
-        
-        file_.read(reinterpret_cast<char*>(vec.data()), meta.size * sizeof(float));
-        
-        vectors.push_back(std::move(vec));
-        sizes.push_back(meta.size);
-        original_ids.push_back(orig_id);
+        std::memcpy(&next_id, record + sizeof(uint32_t), sizeof(uint64_t));
+        std::memcpy(&orig_id, record + sizeof(uint32_t) + sizeof(uint64_t), sizeof(int32_t));
         
-        current_id = next_id;
-        retrieved++;
+        view.id = vector_id;
+        view.data = scratch.data() + HEADER_FLOATS;
+        view.size = meta.size;
+        view.original_id = orig_id;
+        return true;
+    }
+    
+    flushAppendBuffer();
+    file_.seekg(meta.offset);
+    
+    uint32_t stored_size;
+    file_.read(reinterpret_cast<char*>(&stored_size), sizeof(uint32_t));
+    file_.read(reinterpret_cast<char*>(&next_id), sizeof(uint64_t));
+    
+    int32_t orig_id;
+    file_.read(reinterpret_cast<char*>(&orig_id), sizeof(int32_t));
+    
+    scratch.resize(meta.size);
+    file_.read(reinterpret_cast<char*>(scratch.data()), meta.size * sizeof(float));
+    
+    view.id = vector_id;
+    view.data = scratch.data();
+    view.size = meta.size;
+    view.original_id = orig_id;
+    return true;
+}
+
+bool VectorStore::isSequentialList(uint64_t first_id, uint32_t count) const {
+    if (first_id == 0 || count == 0) {
+        return false;
+    }
+    const VectorMetadata* prev = nullptr;
+    for (uint32_t i = 0; i < count; i++) {
+        const VectorMetadata* meta = findMetadata(first_id + i);
+        if (!meta) {
+            return false;
+        }
+        uint64_t expected_next = (i + 1 < count) ? first_id + i + 1 : 0;
+        if (meta->next_id != expected_next) {
+            return false;
+        }
+        if (prev && meta->offset != prev->offset + RECORD_HEADER_SIZE + prev->size * sizeof(float)) {
+            return false;
+        }
+        prev = meta;
+    }
+    return true;
+}
+
+void VectorStore::prefetchLists(const uint64_t* first_ids, const uint32_t* counts, size_t lists) const {
+    if (!readsFromDisk() || !concurrent_reader_.is_open()) {
+        return;
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> records;  // [offset, end)
+    for (size_t l = 0; l < lists; l++) {
+        forEachIdInList(first_ids[l], counts[l], [&](uint64_t vector_id, int32_t) {
+            const VectorMetadata* meta = findMetadata(vector_id);
+            records.emplace_back(meta->offset, meta->offset + RECORD_HEADER_SIZE + meta->size * sizeof(float));
+        });
+    }
+    // One hint per run of records close to each other (bulk-loaded leaves are a single block)
+    std::sort(records.begin(), records.end());
+    size_t r = 0;
+    while (r < records.size()) {
+        uint64_t begin = records[r].first;
+        uint64_t end = records[r].second;
+        for (r++; r < records.size() && records[r].first <= end + PREFETCH_GAP_BYTES; r++) {
+            end = std::max(end, records[r].second);
+        }
+        concurrent_reader_.prefetch(begin, static_cast<size_t>(end - begin));
     }
 }
 
+bool VectorStore::readBytes(uint64_t offset, char* buffer, size_t size) {
+    if (concurrent_reader_.is_open()) {
+        ensureReadable(offset + size);
+        return concurrent_reader_.read_at(offset, buffer, size);
+    }
+    flushAppendBuffer();
+    file_.seekg(offset);
+    file_.read(buffer, size);
+    if (static_cast<size_t>(file_.gcount()) != size) {
+        file_.clear();  // Keep the stream usable after a short read
+        return false;
+    }
+    return true;
+}
+
 uint64_t VectorStore::removeVectorFromList(uint64_t first_vector_id, uint32_t count,
                                            const std::vector<float>& vector_to_remove,
                                            uint32_t& new_count) {
@@ -319,42 +529,132 @@ uint64_t VectorStore::removeVectorFromList(uint64_t first_vector_id, uint32_t co
     return new_first_id;
 }
 
+void VectorStore::reserveMetadata(size_t count) {
+    makeMetadataWritable();
+    reserveMetadataSlots(next_vector_id_ + count);
+    publishMetadataTable();
+}
+
+void VectorStore::reserveMetadataSlots(size_t capacity) {
+    if (capacity <= metadata_.capacity()) {
+        return;
+    }
+    if (!epochs_) {
+        metadata_.reserve(capacity);
+        return;
+    }
+    // Readers may still index the current buffer: copy to a new one and retire the old one
+    std::vector<VectorMetadata> grown;
+    grown.reserve(capacity);
+    grown.assign(metadata_.begin(), metadata_.end());
+    auto* retired = new std::vector<VectorMetadata>(std::move(metadata_));
+    metadata_ = std::move(grown);
+    publishMetadataTable();
+    epochs_->retire([retired] { delete retired; });
+}
+
+void VectorStore::publishMetadataTable() {
+    meta_table_.store(metadata_.data(), std::memory_order_release);
+    meta_table_size_.store(metadata_.size(), std::memory_order_release);
+}
+
+void VectorStore::makeMetadataWritable() {
+    if (meta_mapped_.is_open()) {
+        const VectorMetadata* table = meta_table_.load(std::memory_order_relaxed);
+        metadata_.assign(table, table + meta_table_size_.load(std::memory_order_relaxed));
+        meta_mapped_.close();
+    }
+    publishMetadataTable();
+}
+
 void VectorStore::writeMetadata() {
+    if (!metadata_dirty_) {
+        return;  // Nothing changed since the table was loaded or last written
+    }
+    
     // Write next_vector_id to main file header
     file_.seekp(8);
     file_.write(reinterpret_cast<const char*>(&next_vector_id_), sizeof(uint64_t));
     file_.flush();
     
-    // Write metadata to separate file (now includes next_id)
+    // The table file is rewritten in place, so it must not be mapped
+    makeMetadataWritable();
+    
     std::ofstream meta_file(filename_ + ".meta", std::ios::binary | std::ios::trunc);
     if (!meta_file.is_open()) {
         return;
     }
     
-    uint32_t count = static_cast<uint32_t>(metadata_.size());
-    meta_file.write(reinterpret_cast<const char*>(&count), sizeof(uint32_t));
-    
-    for (const auto& pair : metadata_) {
-        uint64_t id = pair.first;
-        const VectorMetadata& meta = pair.second;
-        
-        meta_file.write(reinterpret_cast<const char*>(&id), sizeof(uint64_t));
-        meta_file.write(reinterpret_cast<const char*>(&meta.offset), sizeof(uint64_t));
-        meta_file.write(reinterpret_cast<const char*>(&meta.size), sizeof(uint32_t));
-        meta_file.write(reinterpret_cast<const char*>(&meta.next_id), sizeof(uint64_t));
-        meta_file.write(reinterpret_cast<const char*>(&meta.original_id), sizeof(int32_t));
+    MetaFileHeader header{META_MAGIC, META_VERSION, metadata_.size(), stored_count_, max_original_id_, 0};
+    meta_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!metadata_.empty()) {
+        meta_file.write(reinterpret_cast<const char*>(metadata_.data()), metadata_.size() * sizeof(VectorMetadata));
     }
     meta_file.close();
+    metadata_dirty_ = false;
 }
 
 void VectorStore::readMetadata() {
-    std::ifstream meta_file(filename_ + ".meta", std::ios::binary);
+    const std::string meta_path = filename_ + ".meta";
+    std::ifstream meta_file(meta_path, std::ios::binary | std::ios::ate);
     if (!meta_file.is_open()) {
         return;  // No metadata file yet
     }
     
-    uint32_t count;
-    meta_file.read(reinterpret_cast<char*>(&count), sizeof(uint32_t));
+    uint64_t file_size = static_cast<uint64_t>(meta_file.tellg());
+    meta_file.seekg(0);
+    if (file_size < sizeof(uint32_t)) {
+        return;
+    }
+    
+    uint32_t first_word;
+    meta_file.read(reinterpret_cast<char*>(&first_word), sizeof(uint32_t));
+    
+    bool is_table = first_word == META_MAGIC && file_size >= sizeof(MetaFileHeader) &&
+                    file_size != sizeof(uint32_t) + static_cast<uint64_t>(first_word) * 32;
+    if (!is_table) {
+        readLegacyMetadata(meta_file, first_word);
+        return;
+    }
+    
+    MetaFileHeader header;
+    meta_file.seekg(0);
+    meta_file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (header.version != META_VERSION) {
+        throw std::runtime_error("Unsupported vector metadata version: " + std::to_string(header.version));
+    }
+    if (file_size < sizeof(MetaFileHeader) + header.entry_count * sizeof(VectorMetadata)) {
+        throw std::runtime_error("Truncated vector metadata file: " + meta_path);
+    }
+    
+    stored_count_ = header.stored_count;
+    max_original_id_ = header.max_original_id;
+    if (header.entry_count == 0) {
+        return;
+    }
+    
+    // Serve the table straight from the mapped file
+    meta_file.close();
+    if (meta_mapped_.open(meta_path)) {
+        meta_table_ = reinterpret_cast<const VectorMetadata*>(meta_mapped_.data() + sizeof(MetaFileHeader));
+        meta_table_size_ = header.entry_count;
+        return;
+    }
+    
+    // Mapping failed: fall back to a single bulk read
+    std::ifstream table_file(meta_path, std::ios::binary);
+    metadata_.resize(header.entry_count);
+    table_file.seekg(sizeof(MetaFileHeader));
+    table_file.read(reinterpret_cast<char*>(metadata_.data()), header.entry_count * sizeof(VectorMetadata));
+    if (!table_file.good()) {
+        throw std::runtime_error("Failed to read vector metadata file: " + meta_path);
+    }
+    meta_table_ = metadata_.data();
+    meta_table_size_ = metadata_.size();
+}
+
+void VectorStore::readLegacyMetadata(std::ifstream& meta_file, uint32_t count) {
+    std::cout << "Converting vector metadata (" << count << " entries) to offset table format..." << std::endl;
     
     for (uint32_t i = 0; i < count; i++) {
         uint64_t id;
@@ -365,42 +665,142 @@ void VectorStore::readMetadata() {
         meta_file.read(reinterpret_cast<char*>(&meta.size), sizeof(uint32_t));
         meta_file.read(reinterpret_cast<char*>(&meta.next_id), sizeof(uint64_t));
         meta_file.read(reinterpret_cast<char*>(&meta.original_id), sizeof(int32_t));
+        if (!meta_file.good()) {
+            throw std::runtime_error("Truncated vector metadata file: " + filename_ + ".meta");
+        }
         
+        if (id >= metadata_.size()) {
+            metadata_.resize(id + 1);
+        }
+        if (metadata_[id].offset == 0) {
+            stored_count_++;
+        }
         metadata_[id] = meta;
+        if (meta.original_id > max_original_id_) {
+            max_original_id_ = meta.original_id;
+        }
     }
     meta_file.close();
+    
+    meta_table_ = metadata_.data();
+    meta_table_size_ = metadata_.size();
+    metadata_dirty_ = true;  // Rewritten in the new format on flush/close
 }
 
 void VectorStore::flush() {
     if (file_.is_open()) {
+        flushAppendBuffer();
         file_.flush();
     }
     writeMetadata();
 }
 
+bool VectorStore::sync() {
+    if (!file_.is_open()) return false;
+    flush();
+    if (!file_.good()) return false;
+    const std::string meta_path = filename_ + ".meta";
+    return PositionalFile::sync(filename_) &&
+           (!std::filesystem::exists(meta_path) || PositionalFile::sync(meta_path));
+}
+
 void VectorStore::close() {
+    unmap();
+    concurrent_reader_.close();
     if (file_.is_open()) {
+        flushAppendBuffer();
         file_.flush();
         writeMetadata();
         file_.close();
     }
+    meta_mapped_.close();
     clearMemoryCache();
 }
 
 size_t VectorStore::estimateMemoryUsageMB() const {
     size_t total_bytes = 0;
-    for (const auto& pair : metadata_) {
+    const uint64_t table_size = meta_table_size_.load(std::memory_order_acquire);
+    const VectorMetadata* table = meta_table_.load(std::memory_order_acquire);
+    for (uint64_t id = 0; id < table_size; id++) {
+        if (table[id].offset == 0) continue;
         // Each vector: size floats * 4 bytes + overhead (~40 bytes per entry)
-        total_bytes += pair.second.size * sizeof(float) + 40;
+        total_bytes += table[id].size * sizeof(float) + 40;
     }
     return total_bytes / (1024 * 1024);
 }
 
+bool VectorStore::mapReadOnly() {
+    if (mapped_.is_open()) {
+        return true;
+    }
+    if (!file_.is_open()) {
+        return false;
+    }
+    
+    // Make sure every buffered record is on disk before mapping
+    flushAppendBuffer();
+    file_.flush();
+    
+    if (!mapped_.open(filename_)) {
+        std::cerr << "Failed to memory-map vector store: " << filename_ << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void VectorStore::unmap() {
+    mapped_.close();
+}
+
+bool VectorStore::prepareConcurrentReads() {
+    if (mapped_.is_open() || concurrent_reader_.is_open()) {
+        return true;
+    }
+    if (!file_.is_open()) {
+        return false;
+    }
+    flushAppendBuffer();
+    file_.flush();  // Positional reads bypass the stream buffer
+    return concurrent_reader_.open(filename_);
+}
+
+bool VectorStore::enableConcurrentAppends(EpochManager* epochs) {
+    if (epochs_) {
+        return true;
+    }
+    if (!file_.is_open()) {
+        return false;
+    }
+    makeMetadataWritable();
+    flushAppendBuffer();
+    file_.flush();
+    // Opened even when mapped: appended records lie past the end of the mapping
+    if (!concurrent_reader_.is_open() && !concurrent_reader_.open(filename_)) {
+        return false;
+    }
+    epochs_ = epochs;
+    flushed_end_.store(write_pos_, std::memory_order_release);
+    return true;
+}
+
+void VectorStore::publishAppends() {
+    flushAppendBuffer();
+    file_.flush();
+    flushed_end_.store(write_pos_, std::memory_order_release);
+}
+
+void VectorStore::ensureReadable(uint64_t end) {
+    // Readers only see published records, so this only fires for the writer's own reads
+    if (epochs_ && end > flushed_end_.load(std::memory_order_acquire)) {
+        publishAppends();
+    }
+}
+
 bool VectorStore::loadAllVectorsIntoMemory(size_t max_memory_mb) {
     memory_cache_.clear();
     memory_cache_loaded_ = false;
     
-    size_t total_vectors = metadata_.size();
+    size_t total_vectors = static_cast<size_t>(stored_count_);
     if (total_vectors == 0) {
         memory_cache_loaded_ = true;
         return true;
@@ -418,7 +818,15 @@ bool VectorStore::loadAllVectorsIntoMemory(size_t max_memory_mb) {
     std::cout << "Loading vectors into memory..." << std::endl;
     
     // Sort metadata by offset for sequential disk reads
-    std::vector<std::pair<uint64_t, VectorMetadata>> sorted_meta(metadata_.begin(), metadata_.end());
+    std::vector<std::pair<uint64_t, VectorMetadata>> sorted_meta;
+    sorted_meta.reserve(total_vectors);
+    const uint64_t table_size = meta_table_size_.load(std::memory_order_acquire);
+    const VectorMetadata* table = meta_table_.load(std::memory_order_acquire);
+    for (uint64_t id = 0; id < table_size; id++) {
+        if (table[id].offset != 0) {
+            sorted_meta.push_back({id, table[id]});
+        }
+    }
     std::sort(sorted_meta.begin(), sorted_meta.end(), 
               [](const auto& a, const auto& b) { return a.second.offset < b.second.offset; });
     
@@ -439,7 +847,6 @@ bool VectorStore::loadAllVectorsIntoMemory(size_t max_memory_mb) {
     size_t memory_used = 0;
     const size_t memory_limit_bytes = max_memory_mb * 1024 * 1024;
     const size_t BATCH_SIZE = 100000;  // Read ~100k vectors per I/O batch
-    const size_t RECORD_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(int32_t);  // 16 bytes
     
     size_t idx = 0;
     while (idx < sorted_meta.size()) {
@@ -472,6 +879,7 @@ bool VectorStore::loadAllVectorsIntoMemory(size_t max_memory_mb) {
         
         // Single I/O read for the entire batch
         std::vector<char> read_buffer(region_size);
+        flushAppendBuffer();
         file_.seekg(region_start_offset);
         if (!file_.good()) {
             std::cerr << "Error seeking to batch at offset " << region_start_offset << std::endl;
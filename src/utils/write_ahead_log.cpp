@@ -0,0 +1,267 @@
+#include "write_ahead_log.h"
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// file format:
+// Header (16 bytes): magic (4 bytes) + version (4 bytes) + reserved (8 bytes)
+// Record: payload size (4 bytes) + CRC32 of payload (4 bytes) + payload
+//   payload: lsn (8 bytes) + key (4 bytes) + original_id (4 bytes) + size (4 bytes) + size floats
+
+namespace {
+
+constexpr uint32_t WAL_MAGIC = 0x4C415742;  // "BWAL"
+constexpr uint32_t WAL_VERSION = 1;
+constexpr size_t WAL_HEADER_SIZE = 16;
+constexpr size_t RECORD_PREFIX_SIZE = 2 * sizeof(uint32_t);
+constexpr size_t PAYLOAD_FIXED_SIZE = sizeof(uint64_t) + 2 * sizeof(int32_t) + sizeof(uint32_t);
+
+uint32_t crc32(const char* data, size_t size) {
+    static const auto table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+#ifdef _WIN32
+int open_log(const std::string& path) {
+    return _open(path.c_str(), _O_RDWR | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+void close_log(int fd) { _close(fd); }
+long long read_log(int fd, char* buffer, size_t size) {
+    return _read(fd, buffer, static_cast<unsigned>(size));
+}
+long long write_log(int fd, const char* data, size_t size) {
+    return _write(fd, data, static_cast<unsigned>(size));
+}
+bool sync_log(int fd) { return _commit(fd) == 0; }
+bool truncate_log(int fd, uint64_t size) { return _chsize_s(fd, static_cast<long long>(size)) == 0; }
+bool rewind_log(int fd) { return _lseeki64(fd, 0, SEEK_SET) == 0; }
+#else
+int open_log(const std::string& path) {
+    return ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+}
+void close_log(int fd) { ::close(fd); }
+long long read_log(int fd, char* buffer, size_t size) {
+    ssize_t got;
+    do { got = ::read(fd, buffer, size); } while (got < 0 && errno == EINTR);
+    return got;
+}
+long long write_log(int fd, const char* data, size_t size) {
+    ssize_t put;
+    do { put = ::write(fd, data, size); } while (put < 0 && errno == EINTR);
+    return put;
+}
+bool sync_log(int fd) {
+#if defined(__APPLE__)
+    return ::fsync(fd) == 0;
+#else
+    return ::fdatasync(fd) == 0;
+#endif
+}
+bool truncate_log(int fd, uint64_t size) { return ::ftruncate(fd, static_cast<off_t>(size)) == 0; }
+bool rewind_log(int fd) { return ::lseek(fd, 0, SEEK_SET) == 0; }
+#endif
+
+}  // namespace
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open(const std::string& path, std::vector<Record>* recovered) {
+    close();
+    fd_ = open_log(path);
+    if (fd_ < 0) {
+        std::cerr << "Error: Cannot open write-ahead log: " << path << std::endl;
+        return false;
+    }
+    path_ = path;
+    if (!recover(recovered)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void WriteAheadLog::close() {
+    if (fd_ >= 0) {
+        commitAll();
+        close_log(fd_);
+    }
+    fd_ = -1;
+    pending_.clear();
+    next_lsn_ = 1;
+    durable_lsn_ = 0;
+    syncs_ = 0;
+    failed_ = false;
+}
+
+bool WriteAheadLog::recover(std::vector<Record>* recovered) {
+    std::vector<char> data;
+    char chunk[1 << 16];
+    long long got;
+    if (!rewind_log(fd_)) return false;
+    while ((got = read_log(fd_, chunk, sizeof(chunk))) > 0) {
+        data.insert(data.end(), chunk, chunk + got);
+    }
+    if (got < 0) {
+        std::cerr << "Error: Cannot read write-ahead log: " << path_ << std::endl;
+        return false;
+    }
+
+    if (data.size() < WAL_HEADER_SIZE) {
+        // New (or torn before its header was complete): start over with an empty log
+        char header[WAL_HEADER_SIZE] = {};
+        std::memcpy(header, &WAL_MAGIC, sizeof(uint32_t));
+        std::memcpy(header + sizeof(uint32_t), &WAL_VERSION, sizeof(uint32_t));
+        return truncate_log(fd_, 0) && writeAll(header, sizeof(header)) && sync_log(fd_);
+    }
+    uint32_t magic, version;
+    std::memcpy(&magic, data.data(), sizeof(uint32_t));
+    std::memcpy(&version, data.data() + sizeof(uint32_t), sizeof(uint32_t));
+    if (magic != WAL_MAGIC || version != WAL_VERSION) {
+        std::cerr << "Error: Not a write-ahead log: " << path_ << std::endl;
+        return false;
+    }
+
+    // Keep the longest prefix of complete records with matching checksums
+    size_t pos = WAL_HEADER_SIZE;
+    uint64_t last_lsn = 0;
+    while (pos + RECORD_PREFIX_SIZE <= data.size()) {
+        uint32_t payload_size, crc;
+        std::memcpy(&payload_size, data.data() + pos, sizeof(uint32_t));
+        std::memcpy(&crc, data.data() + pos + sizeof(uint32_t), sizeof(uint32_t));
+        const char* payload = data.data() + pos + RECORD_PREFIX_SIZE;
+        if (payload_size < PAYLOAD_FIXED_SIZE || payload_size > data.size() - pos - RECORD_PREFIX_SIZE ||
+            crc32(payload, payload_size) != crc) {
+            break;
+        }
+        Record record;
+        uint32_t size;
+        std::memcpy(&record.lsn, payload, sizeof(uint64_t));
+        std::memcpy(&record.key, payload + 8, sizeof(int32_t));
+        std::memcpy(&record.original_id, payload + 12, sizeof(int32_t));
+        std::memcpy(&size, payload + 16, sizeof(uint32_t));
+        if (PAYLOAD_FIXED_SIZE + static_cast<size_t>(size) * sizeof(float) != payload_size) break;
+        record.vector.resize(size);
+        std::memcpy(record.vector.data(), payload + PAYLOAD_FIXED_SIZE, size * sizeof(float));
+        last_lsn = record.lsn;
+        if (recovered) recovered->push_back(std::move(record));
+        pos += RECORD_PREFIX_SIZE + payload_size;
+    }
+    if (pos < data.size()) {
+        std::cerr << "Warning: Dropping " << (data.size() - pos) << " bytes of torn records from "
+                  << path_ << std::endl;
+        if (!truncate_log(fd_, pos) || !sync_log(fd_)) return false;
+    }
+    next_lsn_ = last_lsn + 1;
+    durable_lsn_ = last_lsn;
+    return true;
+}
+
+bool WriteAheadLog::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        long long put = write_log(fd_, data, size);
+        if (put <= 0) return false;
+        data += put;
+        size -= static_cast<size_t>(put);
+    }
+    return true;
+}
+
+uint64_t WriteAheadLog::append(int key, int32_t original_id, const float* vector, uint32_t size) {
+    const uint32_t payload_size = static_cast<uint32_t>(PAYLOAD_FIXED_SIZE + size * sizeof(float));
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t lsn = next_lsn_++;
+    const size_t at = pending_.size();
+    pending_.resize(at + RECORD_PREFIX_SIZE + payload_size);
+    char* payload = pending_.data() + at + RECORD_PREFIX_SIZE;
+    std::memcpy(payload, &lsn, sizeof(uint64_t));
+    std::memcpy(payload + 8, &key, sizeof(int32_t));
+    std::memcpy(payload + 12, &original_id, sizeof(int32_t));
+    std::memcpy(payload + 16, &size, sizeof(uint32_t));
+    std::memcpy(payload + PAYLOAD_FIXED_SIZE, vector, size * sizeof(float));
+    const uint32_t crc = crc32(payload, payload_size);
+    std::memcpy(pending_.data() + at, &payload_size, sizeof(uint32_t));
+    std::memcpy(pending_.data() + at + sizeof(uint32_t), &crc, sizeof(uint32_t));
+    return lsn;
+}
+
+bool WriteAheadLog::commit(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (durable_lsn_ < lsn && !failed_) {
+        if (syncing_) {
+            cv_.wait(lock);
+            continue;
+        }
+        // Lead this group: write out everything queued so far with one sync
+        syncing_ = true;
+        std::vector<char> group;
+        group.swap(pending_);
+        const uint64_t group_lsn = next_lsn_ - 1;
+        lock.unlock();
+        const bool ok = writeAll(group.data(), group.size()) && sync_log(fd_);
+        lock.lock();
+        syncing_ = false;
+        syncs_++;
+        if (ok) {
+            durable_lsn_ = group_lsn;
+        } else {
+            std::cerr << "Error: Failed to write write-ahead log: " << path_ << std::endl;
+            failed_ = true;
+        }
+        cv_.notify_all();
+    }
+    return !failed_;
+}
+
+bool WriteAheadLog::commitAll() {
+    return commit(lastLsn());
+}
+
+bool WriteAheadLog::checkpoint() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return !syncing_; });
+    pending_.clear();
+    if (failed_ || !truncate_log(fd_, WAL_HEADER_SIZE) || !sync_log(fd_)) {
+        failed_ = true;
+        return false;
+    }
+    durable_lsn_ = next_lsn_ - 1;
+    return true;
+}
+
+uint64_t WriteAheadLog::lastLsn() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return next_lsn_ - 1;
+}
+
+uint64_t WriteAheadLog::durableLsn() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return durable_lsn_;
+}
+
+uint64_t WriteAheadLog::syncCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_;
+}